@@ -0,0 +1,145 @@
+/* Bit-parallel edit distances, against plain dynamic programming.
+ *
+ * usage: approx_bench [m] [ntexts] [len] [nthreads]
+ *
+ * A random pattern of `m` bytes is matched against `ntexts` texts of `len`
+ * bytes, derived from the pattern with random edits over a 4 letter
+ * alphabet. Edit distances to whole texts and least distances to substrings
+ * are computed with Myers' algorithm, in batch, and with the quadratic
+ * dynamic programming; results are checked to agree, and throughputs in
+ * matrix cells per second are reported. Occurrences within a few errors are
+ * then looked for with Shift-Or.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bitset/approx.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next_random(uint64_t* x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+/* Edit distance of `p` to `t`, or to a substring of `t` if `search`. */
+static size_t dp(const char* p, size_t m, const char* t, size_t n, int search,
+                 size_t* col)
+{
+    for (size_t i = 0; i <= m; i++) {
+        col[i] = i;
+    }
+    size_t best = m;
+    for (size_t j = 1; j <= n; j++) {
+        size_t diag = col[0];
+        col[0] = search ? 0 : j;
+        for (size_t i = 1; i <= m; i++) {
+            size_t up = col[i];
+            size_t d = diag + (p[i - 1] != t[j - 1]);
+            if (up + 1 < d) {
+                d = up + 1;
+            }
+            if (col[i - 1] + 1 < d) {
+                d = col[i - 1] + 1;
+            }
+            col[i] = d;
+            diag = up;
+        }
+        if (col[m] < best) {
+            best = col[m];
+        }
+    }
+    return search ? best : col[m];
+}
+
+int main(int argc, char** argv) {
+    size_t m = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000;
+    size_t ntexts = argc > 2 ? strtoull(argv[2], NULL, 0) : 2000;
+    size_t len = argc > 3 ? strtoull(argv[3], NULL, 0) : 1000;
+    unsigned nthreads = argc > 4 ? strtoul(argv[4], NULL, 0) : 1;
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+    char* pattern = malloc(m);
+    for (size_t i = 0; i < m; i++) {
+        pattern[i] = "ACGT"[next_random(&x) % 4];
+    }
+    char* data = malloc(ntexts * len);
+    const char** texts = malloc(ntexts * sizeof(*texts));
+    size_t* lens = malloc(ntexts * sizeof(*lens));
+    for (size_t t = 0; t < ntexts; t++) {
+        char* text = data + t * len;
+        size_t start = next_random(&x) % (len / 2 + 1);
+        for (size_t i = 0; i < len; i++) {
+            size_t k = i - start;
+            text[i] = i >= start && k < m && next_random(&x) % 16 != 0
+                    ? pattern[k] : "ACGT"[next_random(&x) % 4];
+        }
+        texts[t] = text;
+        lens[t] = len;
+    }
+
+    bitset_approx_t ap;
+    if (bitset_approx_compile(&ap, pattern, m) != 0) {
+        perror("bitset_approx_compile");
+        return 1;
+    }
+    size_t* dist = malloc(ntexts * sizeof(size_t));
+    size_t* col = malloc((m + 1) * sizeof(size_t));
+    double cells = (double)m * len * ntexts;
+
+    for (int search = 0; search <= 1; search++) {
+        double start = now();
+        if (bitset_approx_batch(&ap, texts, lens, ntexts,
+                                search ? BITSET_APPROX_SEARCH
+                                       : BITSET_APPROX_GLOBAL,
+                                nthreads, dist) != 0) {
+            perror("bitset_approx_batch");
+            return 1;
+        }
+        double t_myers = now() - start;
+
+        start = now();
+        size_t mismatches = 0;
+        for (size_t t = 0; t < ntexts; t++) {
+            mismatches += dp(pattern, m, texts[t], lens[t], search, col)
+                       != dist[t];
+        }
+        double t_dp = now() - start;
+
+        printf("%s: %zu mismatches\n", search ? "search" : "global",
+               mismatches);
+        printf("  myers: %.3fs, %.2f Gcells/s\n", t_myers,
+               cells / t_myers * 1e-9);
+        printf("  dp:    %.3fs, %.2f Gcells/s\n", t_dp, cells / t_dp * 1e-9);
+    }
+
+    unsigned k = m / 16;
+    double start = now();
+    size_t nfound = 0;
+    for (size_t t = 0; t < ntexts; t++) {
+        size_t end;
+        nfound += bitset_approx_find(&ap, texts[t], lens[t], k, &end) == 1;
+    }
+    double t_shift_or = now() - start;
+    printf("shift-or, k = %u: %zu texts, %.3fs, %.2f Gcells/s\n", k, nfound,
+           t_shift_or, cells / t_shift_or * 1e-9);
+
+    bitset_approx_wipe(&ap);
+    free(pattern);
+    free(data);
+    free(texts);
+    free(lens);
+    free(dist);
+    free(col);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* Streaming set algebra over out-of-core bitsets, against plain mmap.
+ *
+ * usage: file_bench [dir] [nbits] [cache_size]
+ *
+ * Two random image files are created, then the size of their intersection
+ * and their union are computed through `bitset_file_t` with a cache of
+ * `cache_size` bytes, and through mmap(2) of the same images.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "bitset/file.h"
+#include "bitset/image.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int fill_random(const char* path, size_t nbits, unsigned int seed) {
+    bitset_file_t bf;
+    if (bitset_file_create(&bf, path, nbits, 1 << 20) != 0) {
+        return -1;
+    }
+    uint64_t x = seed * 0x9e3779b97f4a7c15ULL + 1;
+    for (size_t block = 0; block < bf.nblocks; block++) {
+        bitset_atom_t* atoms = bitset_file_block(&bf, block, 1);
+        size_t n = bitset_file_block_natoms(&bf, block);
+        for (size_t i = 0; i < n; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            atoms[i] = x;
+        }
+    }
+    return bitset_file_close(&bf);
+}
+
+static const bitset_atom_t* map_image(const char* path, size_t* natoms,
+                                      size_t* size)
+{
+    int fd = open(path, O_RDONLY);
+    bitset_image_header_t header;
+    if (fd < 0 || bitset_image_read_header(fd, &header) != 0) {
+        return NULL;
+    }
+    *natoms = BITS_TO_NATOMS(header.nbits);
+    *size = BITSET_IMAGE_SIZE(header.nbits);
+    char* map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    posix_madvise(map, *size, POSIX_MADV_SEQUENTIAL);
+    return (const bitset_atom_t*)(map + BITSET_IMAGE_HEADER_SIZE);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = argc > 1 ? argv[1] : ".";
+    size_t nbits = argc > 2 ? strtoull(argv[2], NULL, 0) : (size_t)1 << 33;
+    size_t cache = argc > 3 ? strtoull(argv[3], NULL, 0) : 16 << 20;
+    char pa[4096], pb[4096], pd[4096];
+    snprintf(pa, sizeof(pa), "%s/file_bench_a.img", dir);
+    snprintf(pb, sizeof(pb), "%s/file_bench_b.img", dir);
+    snprintf(pd, sizeof(pd), "%s/file_bench_d.img", dir);
+
+    if (fill_random(pa, nbits, 1) != 0 || fill_random(pb, nbits, 2) != 0) {
+        perror("fill_random");
+        return 1;
+    }
+    double bytes = 2.0 * BITS_TO_NATOMS(nbits) * sizeof(bitset_atom_t);
+
+    bitset_file_t a, b, d;
+    if (bitset_file_open(&a, pa, 1, cache) != 0
+    ||  bitset_file_open(&b, pb, 1, cache) != 0
+    ||  bitset_file_create(&d, pd, nbits, cache) != 0) {
+        perror("bitset_file_open");
+        return 1;
+    }
+    double start = now();
+    long long count = bitset_file_and_popcnt(&a, &b);
+    double t_and = now() - start;
+    start = now();
+    bitset_file_or_to(&d, &a, &b);
+    bitset_file_flush(&d);
+    double t_or = now() - start;
+    printf("block cache (%zu MiB): and+popcnt %lld in %.3fs (%.0f MiB/s), "
+           "or_to %.3fs, %zu misses\n",
+           cache >> 20, count, t_and, bytes / t_and / (1 << 20), t_or,
+           a.misses);
+    bitset_file_close(&a);
+    bitset_file_close(&b);
+    bitset_file_close(&d);
+
+    size_t natoms, size;
+    const bitset_atom_t* x = map_image(pa, &natoms, &size);
+    const bitset_atom_t* y = map_image(pb, &natoms, &size);
+    if (!x || !y) {
+        perror("mmap");
+        return 1;
+    }
+    start = now();
+    count = 0;
+    for (size_t i = 0; i < natoms; i++) {
+        count += __builtin_popcountl(x[i] & y[i]);
+    }
+    t_and = now() - start;
+    printf("mmap:                 and+popcnt %lld in %.3fs (%.0f MiB/s)\n",
+           count, t_and, bytes / t_and / (1 << 20));
+
+    unlink(pa);
+    unlink(pb);
+    unlink(pd);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* Hamming radius search with multi-index hashing, against a full scan.
+ *
+ * usage: mih_bench [ncodes] [nbits] [nqueries] [radius]
+ *
+ * A database of random codes is indexed, and queried with codes of the
+ * database in which a few bits are flipped, so that every query has close
+ * neighbors. For each query, codes within `radius` are looked for through
+ * the index and through a full scan. Recall of the index against the scan
+ * and mean latencies of both are reported.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bitset/mih.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next_random(uint64_t* x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+static int compare_matches(const void* a, const void* b) {
+    const bitset_hamming_match_t* ma = a;
+    const bitset_hamming_match_t* mb = b;
+    return (ma->index > mb->index) - (ma->index < mb->index);
+}
+
+int main(int argc, char** argv) {
+    size_t ncodes = argc > 1 ? strtoull(argv[1], NULL, 0) : 1 << 22;
+    size_t nbits = argc > 2 ? strtoull(argv[2], NULL, 0) : 128;
+    size_t nqueries = argc > 3 ? strtoull(argv[3], NULL, 0) : 100;
+    unsigned radius = argc > 4 ? strtoul(argv[4], NULL, 0) : 8;
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+    bitset_codes_t db, queries;
+    if (bitset_codes_init(&db, ncodes, nbits) != 0
+    ||  bitset_codes_init(&queries, nqueries, nbits) != 0) {
+        perror("bitset_codes_init");
+        return 1;
+    }
+    bitset_atom_t last = nbits % BITS_PER_ATOM
+                       ? ((bitset_atom_t)1 << (nbits % BITS_PER_ATOM)) - 1
+                       : BITSET_ATOM_MAX;
+    for (size_t i = 0; i < ncodes; i++) {
+        bitset_atom_t* code = bitset_codes_row(&db, i);
+        for (size_t j = 0; j < db.stride; j++) {
+            code[j] = next_random(&x);
+        }
+        code[db.stride - 1] &= last;
+    }
+    for (size_t q = 0; q < nqueries; q++) {
+        bitset_atom_t* code = bitset_codes_row(&queries, q);
+        memcpy(code, bitset_codes_row(&db, next_random(&x) % ncodes),
+               db.stride * sizeof(bitset_atom_t));
+        size_t nflips = next_random(&x) % (radius + 3);
+        for (size_t f = 0; f < nflips; f++) {
+            size_t bit = next_random(&x) % nbits;
+            code[bit / BITS_PER_ATOM] ^= (bitset_atom_t)1 << (bit % BITS_PER_ATOM);
+        }
+    }
+
+    double start = now();
+    bitset_mih_t mih;
+    if (bitset_mih_init(&mih, &db, 0) != 0) {
+        perror("bitset_mih_init");
+        return 1;
+    }
+    printf("index: %u substrings, built in %.3fs\n", mih.m, now() - start);
+
+    bitset_hamming_match_t* found = malloc(ncodes * sizeof(*found));
+    bitset_hamming_match_t* expected = malloc(ncodes * sizeof(*expected));
+    uint32_t* dist = malloc(ncodes * sizeof(uint32_t));
+    double t_mih = 0, t_scan = 0;
+    size_t nfound = 0, nexpected = 0, nmatched = 0;
+    for (size_t q = 0; q < nqueries; q++) {
+        const bitset_atom_t* query = bitset_codes_row(&queries, q);
+
+        start = now();
+        size_t n = bitset_mih_search(&mih, query, radius, found, ncodes);
+        t_mih += now() - start;
+
+        start = now();
+        bitset_hamming_distances(&db, query, dist);
+        size_t e = 0;
+        for (size_t i = 0; i < ncodes; i++) {
+            if (dist[i] <= radius) {
+                expected[e].index = i;
+                expected[e++].distance = dist[i];
+            }
+        }
+        t_scan += now() - start;
+
+        qsort(found, n, sizeof(*found), compare_matches);
+        for (size_t i = 0, j = 0; i < n && j < e; ) {
+            if (found[i].index == expected[j].index) {
+                nmatched++;
+                i++;
+                j++;
+            } else if (found[i].index < expected[j].index) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+        nfound += n;
+        nexpected += e;
+    }
+
+    printf("radius %u: %zu neighbors found, %zu expected, recall %.4f\n",
+           radius, nfound, nexpected,
+           nexpected ? (double)nmatched / nexpected : 1.0);
+    printf("multi-index hashing: %.3f ms per query\n",
+           t_mih * 1e3 / nqueries);
+    printf("full scan:           %.3f ms per query\n",
+           t_scan * 1e3 / nqueries);
+
+    bitset_mih_wipe(&mih);
+    bitset_codes_wipe(&db);
+    bitset_codes_wipe(&queries);
+    free(found);
+    free(expected);
+    free(dist);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* Throughput of batched durable updates.
+ *
+ * usage: wal_bench [path] [nbits] [nupdates]
+ *
+ * Random bits are set or unset through a durable bitset, committing every
+ * `batch` updates, for several batch sizes. A single commit per update is
+ * the worst case, as each update pays its own fdatasync.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bitset/wal.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void cleanup(const char* path) {
+    char wal[4096];
+    snprintf(wal, sizeof(wal), "%s.wal", path);
+    unlink(path);
+    unlink(wal);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "wal_bench.img";
+    size_t nbits = argc > 2 ? strtoull(argv[2], NULL, 0) : 1 << 24;
+    size_t nupdates = argc > 3 ? strtoull(argv[3], NULL, 0) : 1 << 16;
+    static const size_t batches[] = { 1, 16, 256, 4096, 65536 };
+
+    printf("%10s %12s %14s %10s\n", "batch", "updates", "updates/s", "fsyncs");
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        size_t batch = batches[b];
+        size_t n = nupdates;
+        if (batch == 1 && n > 4096) {
+            n = 4096;   // One fsync per update, keep it reasonable
+        }
+
+        cleanup(path);
+        bitset_durable_t d;
+        if (bitset_durable_open(&d, path, nbits) != 0) {
+            perror("bitset_durable_open");
+            return 1;
+        }
+        d.batch_max = SIZE_MAX;
+
+        unsigned int seed = 42;
+        double start = now();
+        for (size_t i = 0; i < n; i++) {
+            size_t bit = (((size_t)rand_r(&seed) << 16) ^ rand_r(&seed)) % nbits;
+            int res = (i & 1) ? bitset_durable_unset(&d, bit)
+                              : bitset_durable_set(&d, bit);
+            if (res == 0 && (i + 1) % batch == 0) {
+                res = bitset_durable_commit(&d);
+            }
+            if (res != 0) {
+                perror("update");
+                return 1;
+            }
+        }
+        bitset_durable_commit(&d);
+        double elapsed = now() - start;
+
+        printf("%10zu %12zu %14.0f %10zu\n", batch, n, n / elapsed,
+               (n + batch - 1) / batch);
+        bitset_durable_close(&d);
+    }
+    cleanup(path);
+    return 0;
+}
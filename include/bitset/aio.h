@@ -0,0 +1,132 @@
+/* Module      : bitset/aio
+ * Description : Asynchronous loading and saving of bitset images
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : Linux (io_uring), POSIX (thread pool)
+ *
+ * Images (see `bitset/image.h`) are read or written in chunks of
+ * BITSET_AIO_CHUNK_SIZE bytes, with up to `depth` chunks in flight over all
+ * requests of a context. I/O is driven by io_uring when the kernel allows
+ * it, and by a pool of threads doing pread/pwrite otherwise.
+ *
+ * Files are opened with O_DIRECT when the filesystem supports it, so atoms
+ * go straight from the device into the bitset: loaded bitsets are allocated
+ * page-aligned (they are still released with `bitset_wipe`).
+ *
+ * Requests progress while the caller is in `bitset_aio_wait` or
+ * `bitset_aio_poll`. Each time a chunk is complete, the request callback is
+ * called on these atoms, in the caller's thread, while following chunks are
+ * still being transferred: decoding or verifying the atoms overlaps with the
+ * I/O. Chunks may complete out of order.
+ *
+ * CRC32C checksums of images are handled the same way: a load verifies each
+ * block as soon as its chunk is read, and a save computes them as chunks are
+ * written (see `bitset/crc32c.h`).
+ *
+ * A context is not thread-safe: it must be used from one thread at a time.
+ */
+
+#ifndef _bitset_aio_h_
+#define _bitset_aio_h_
+
+#include <sys/uio.h>
+#include "bitset/bitset.h"
+
+/* Size of the chunks transferred by a single I/O, a multiple of
+ * BITSET_CRC32C_BLOCK_SIZE */
+#define BITSET_AIO_CHUNK_SIZE       (4 << 20)
+
+/* Don't use io_uring even if it is available */
+#define BITSET_AIO_NO_URING         0x1
+
+/* Don't open files with O_DIRECT */
+#define BITSET_AIO_NO_DIRECT        0x2
+
+/* Don't verify CRCs of loaded images */
+#define BITSET_AIO_NO_VERIFY        0x4
+
+typedef struct bitset_aio bitset_aio_t;
+
+/* Called when atoms [atom, atom + natoms[ of `bs` have been transferred.
+ * Returning not 0 fails the request.
+ */
+typedef int (*bitset_aio_cb_t)(const bitset_t* bs, size_t atom, size_t natoms,
+                               void* arg);
+
+/* An in-flight chunk */
+typedef struct bitset_aio_chunk {
+    struct bitset_aio_req   *req;
+    size_t                   index;
+    struct iovec             iov;
+    int                      res;
+    struct bitset_aio_chunk *next;
+} bitset_aio_chunk_t;
+
+/* A load or save request. Fields are private. */
+typedef struct bitset_aio_req {
+    bitset_t                *bs;
+    bitset_aio_cb_t          cb;
+    void                    *arg;
+    int                      write;
+    int                      fd;
+    int                      direct;    /* fd was opened with O_DIRECT */
+    char                    *path;      /* Final path of a save */
+    char                    *tmp_path;  /* Temporary path of a save */
+    size_t                   payload;   /* Payload size in bytes */
+    size_t                   nchunks;
+    size_t                   next;      /* Next chunk to submit */
+    size_t                   inflight;
+    size_t                   done;
+    int                      error;
+    void                    *bounce;    /* Aligned copy of a last chunk */
+    uint32_t                *crcs;      /* CRC32C of each block, or NULL */
+    bitset_aio_chunk_t      *slots;     /* `depth` chunk descriptors */
+    bitset_aio_chunk_t      *free_slots;
+    struct bitset_aio_req   *next_active;
+} bitset_aio_req_t;
+
+/* Create an asynchronous I/O context with at most `depth` chunks in flight.
+ * `flags` is a combination of BITSET_AIO_* flags.
+ * @return not 0 if the creation failed.
+ */
+int bitset_aio_init(bitset_aio_t** aio, unsigned depth, int flags);
+
+/* Release `aio`.
+ * @pre no request is pending on `aio`.
+ */
+void bitset_aio_wipe(bitset_aio_t* aio);
+
+/* Return not 0 if `aio` is driven by io_uring. */
+int bitset_aio_uses_uring(const bitset_aio_t* aio);
+
+/* Start loading the image `path` into `bs`, which will be initialized by
+ * `bitset_aio_wait`. `cb` (may be NULL) is called with `arg` on each chunk,
+ * after its CRCs have been verified.
+ * @return not 0 if the request couldn't be started.
+ */
+int bitset_aio_load(bitset_aio_t* aio, bitset_aio_req_t* req, bitset_t* bs,
+                    const char* path, bitset_aio_cb_t cb, void* arg);
+
+/* Start saving `bs` into the image `path`. The file is replaced atomically
+ * once every chunk is written and synced. `bs` must not be modified until
+ * the request is complete. `cb` (may be NULL) is called with `arg` on each
+ * chunk written.
+ * @return not 0 if the request couldn't be started.
+ */
+int bitset_aio_save(bitset_aio_t* aio, bitset_aio_req_t* req,
+                    const bitset_t* bs, const char* path,
+                    bitset_aio_cb_t cb, void* arg);
+
+/* Process completed chunks without blocking.
+ */
+void bitset_aio_poll(bitset_aio_t* aio);
+
+/* Wait for the end of `req`, and release its resources. On failure of a
+ * load, the bitset is not initialized.
+ * @return not 0 if the request failed.
+ */
+int bitset_aio_wait(bitset_aio_t* aio, bitset_aio_req_t* req);
+
+#endif
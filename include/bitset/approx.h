@@ -0,0 +1,86 @@
+/* Module      : bitset/approx
+ * Description : Bit-parallel approximate string matching
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A pattern of m bytes is compiled to one m-bit mask per byte value, Peq[c]
+ * having bit i set if the i-th byte of the pattern is c.
+ *
+ * Edit distances are computed with Myers' bit-vector algorithm: a column of
+ * the dynamic programming matrix is encoded as its vertical deltas, in two
+ * m-bit vectors, and the next column is derived from them with a handful of
+ * logical operations, an m-bit addition and an m-bit shift. Patterns of up
+ * to 64 bytes take a single atom; longer ones are processed atom by atom,
+ * carries of the addition (see bitset/arith) and of the shifts being
+ * propagated from one atom to the next, so that a column costs O(m / 64).
+ *
+ * Occurrences with at most k errors are found with Shift-Or extended to
+ * errors (Wu and Manber): k + 1 state vectors, the d-th one tracking prefixes
+ * of the pattern matched with d errors. It only takes shifts and ands, and
+ * is the fastest choice for small k. Vectors of long patterns are banded:
+ * only the low atoms holding active prefixes are updated, so a text byte
+ * costs O(k) atoms rather than O(k m / 64) while few prefixes survive.
+ */
+
+#ifndef _bitset_approx_h_
+#define _bitset_approx_h_
+
+#include "bitset/bitset.h"
+
+typedef struct bitset_approx {
+    size_t         m;       /* Length of the pattern */
+    size_t         natoms;  /* Number of atoms of a mask */
+    bitset_atom_t *peq;     /* Mask of each byte value */
+} bitset_approx_t;
+
+/* Distances computed by `bitset_approx_batch` */
+typedef enum bitset_approx_mode {
+    BITSET_APPROX_GLOBAL,   /* Edit distance to the whole text */
+    BITSET_APPROX_SEARCH,   /* Least edit distance to a substring */
+} bitset_approx_mode_t;
+
+/* Compile the `m` bytes of `pattern`.
+ * @pre m > 0
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_approx_compile(bitset_approx_t* ap, const char* pattern, size_t m);
+
+/* Wipe a compiled pattern.
+ * @pre `ap` must have been compiled.
+ */
+void bitset_approx_wipe(bitset_approx_t* ap);
+
+/* Return the edit distance between the pattern and the `n` bytes of
+ * `text`, or SIZE_MAX if memory allocation failed.
+ */
+size_t bitset_approx_distance(const bitset_approx_t* ap, const char* text,
+                              size_t n);
+
+/* Return the least edit distance between the pattern and a substring of the
+ * `n` bytes of `text`, or SIZE_MAX if memory allocation failed. If `end` is
+ * not NULL, store the end offset of the first such substring into it.
+ */
+size_t bitset_approx_search(const bitset_approx_t* ap, const char* text,
+                            size_t n, size_t* end);
+
+/* Find the first substring of the `n` bytes of `text` within `k` errors of
+ * the pattern, and store its end offset into `end` if not NULL.
+ * @return 1 if there is one, 0 otherwise, or -1 if memory allocation failed.
+ */
+int bitset_approx_find(const bitset_approx_t* ap, const char* text, size_t n,
+                       unsigned k, size_t* end);
+
+/* Compute the distances of `mode` between the pattern and each of the `n`
+ * texts, of `lens[i]` bytes each, with `nthreads` threads, and store them
+ * into `out`.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_approx_batch(const bitset_approx_t* ap, const char* const* texts,
+                        const size_t* lens, size_t n,
+                        bitset_approx_mode_t mode, unsigned nthreads,
+                        size_t* out);
+
+#endif
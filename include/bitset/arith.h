@@ -0,0 +1,97 @@
+/* Module      : bitset/arith
+ * Description : Multi-atom integer arithmetic
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 ADC when available
+ *
+ * A bitset of n bits is read as an unsigned integer modulo 2^n, bit i having
+ * weight 2^i. Additions and subtractions propagate carries from atom to
+ * atom, with the add-with-carry and subtract-with-borrow instructions on
+ * x86. Bits above n in the last atom are kept clear, and the carry out of
+ * bit n - 1 is returned.
+ *
+ * A carry chain is sequential by nature. For very long sets, the parallel
+ * variants split atoms in chunks of BITSET_ARITH_CHUNK atoms, and add every
+ * chunk on its own with a carry in of 0, noting whether it generates a
+ * carry out, and whether it would propagate a carry in, that is whether its
+ * sum is all ones. Carries into chunks are then resolved by a lookahead
+ * over chunks, and the few chunks receiving a carry are incremented, which
+ * stops at their first atom that is not all ones.
+ */
+
+#ifndef _bitset_arith_h_
+#define _bitset_arith_h_
+
+#include "bitset/bitset.h"
+
+/* Number of atoms per chunk of the parallel variants */
+#define BITSET_ARITH_CHUNK  (1 << 16)
+
+/* Return a + b + `*carry`, and store the carry out into `carry`.
+ */
+inline bitset_atom_t bitset_atom_addc(bitset_atom_t a, bitset_atom_t b,
+                                      bit_t* carry)
+{
+    bitset_atom_t s;
+    bit_t c = __builtin_add_overflow(a, b, &s);
+    c |= __builtin_add_overflow(s, (bitset_atom_t)*carry, &s);
+    *carry = c;
+    return s;
+}
+
+/* Return a - b - `*borrow`, and store the borrow out into `borrow`.
+ */
+inline bitset_atom_t bitset_atom_subb(bitset_atom_t a, bitset_atom_t b,
+                                      bit_t* borrow)
+{
+    bitset_atom_t s;
+    bit_t c = __builtin_sub_overflow(a, b, &s);
+    c |= __builtin_sub_overflow(s, (bitset_atom_t)*borrow, &s);
+    *borrow = c;
+    return s;
+}
+
+/* Store a + b + `carry` into `dest`.
+ * @pre dest, a and b have the same number of bits
+ * @return the carry out.
+ */
+bit_t bitset_add_to(bitset_t* dest, const bitset_t* a, const bitset_t* b,
+                    bit_t carry);
+
+/* Store a - b - `borrow` into `dest`.
+ * @pre dest, a and b have the same number of bits
+ * @return the borrow out, that is 1 if a < b + borrow.
+ */
+bit_t bitset_sub_to(bitset_t* dest, const bitset_t* a, const bitset_t* b,
+                    bit_t borrow);
+
+/* Replace `bs` by its two's complement.
+ * @return 1 if `bs` was not 0.
+ */
+bit_t bitset_neg(bitset_t* bs);
+
+/* Add 1 to `bs`.
+ * @return the carry out, that is 1 if `bs` was all ones.
+ */
+bit_t bitset_inc(bitset_t* bs);
+
+/* Subtract 1 from `bs`.
+ * @return the borrow out, that is 1 if `bs` was 0.
+ */
+bit_t bitset_dec(bitset_t* bs);
+
+/* Same as `bitset_add_to`, with `nthreads` threads.
+ * @return the carry out, or -1 if memory allocation failed.
+ */
+int bitset_add_to_parallel(bitset_t* dest, const bitset_t* a,
+                           const bitset_t* b, bit_t carry, unsigned nthreads);
+
+/* Same as `bitset_sub_to`, with `nthreads` threads.
+ * @return the borrow out, or -1 if memory allocation failed.
+ */
+int bitset_sub_to_parallel(bitset_t* dest, const bitset_t* a,
+                           const bitset_t* b, bit_t borrow, unsigned nthreads);
+
+#endif
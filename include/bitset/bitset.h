@@ -27,6 +27,7 @@
 #define _bitset_h_
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* A bitset_atom is an integer storing part of bitset */
@@ -51,6 +52,12 @@ typedef struct bitset {
     bitset_atom_t *bits;
 } bitset_t;
 
+/* A run of consecutive bits set, [start, end) */
+typedef struct bitset_run {
+    size_t start;
+    size_t end;
+} bitset_run_t;
+
 /* Initialize a bitset with `nbits` bits.
  * @return not 0 if initialization failed.
  */
@@ -76,7 +83,7 @@ int bitset_resize(bitset_t* bitset, size_t nbits);
  */
 inline bit_t bitset_get(const bitset_t* bs, size_t bit) {
     assert (bit < bs->nbits);
-    return bs->bits[bit / BITS_PER_ATOM] |= (1 << (bit & BITS_PER_ATOM));
+    return (bs->bits[bit / BITS_PER_ATOM] >> (bit % BITS_PER_ATOM)) & 1;
 }
 
 /* Set the bit `idx` of `bs`.
@@ -84,7 +91,7 @@ inline bit_t bitset_get(const bitset_t* bs, size_t bit) {
  */
 inline void bitset_set(bitset_t* bs, size_t bit) {
     assert (bit < bs->nbits);
-    bs->bits[bit / BITS_PER_ATOM] |= (1 << (bit & BITS_PER_ATOM));
+    bs->bits[bit / BITS_PER_ATOM] |= ((bitset_atom_t)1 << (bit % BITS_PER_ATOM));
 }
 
 /* Unset the bit `idx` of `bs`.
@@ -92,17 +99,17 @@ inline void bitset_set(bitset_t* bs, size_t bit) {
  */
 inline void bitset_unset(bitset_t* bs, size_t bit) {
     assert (bit < bs->nbits);
-    bs->bits[bit / BITS_PER_ATOM] &= ~(1 << (bit & BITS_PER_ATOM));
+    bs->bits[bit / BITS_PER_ATOM] &= ~((bitset_atom_t)1 << (bit % BITS_PER_ATOM));
 }
 
 /* Set the bit `idx` of `bs` to value `bit`.
  * @pre bit < bs->nbits
  */
 inline void bitset_set_bit(bitset_t* bs, size_t idx, bit_t bit) {
-    if (bitset_get(bs, idx)) {
-        bitset_unset(bs, idx);
-    } else {
+    if (bit) {
         bitset_set(bs, idx);
+    } else {
+        bitset_unset(bs, idx);
     }
 }
 
@@ -120,6 +127,41 @@ int bitset_first_set(const bitset_t* bs);
  */
 int bitset_next_set(const bitset_t* bs, size_t idx);
 
+/* Write the indexes of bits set in `bs` into `out`, in increasing order.
+ * @pre `out` has room for bitset_popcnt(bs) values
+ * @return the number of indexes written.
+ */
+size_t bitset_to_array(const bitset_t* bs, size_t* out);
+
+/* Set the bits of `bs` whose indexes are the `n` values of `in`.
+ * @pre in[i] < bs->nbits
+ */
+void bitset_from_array(bitset_t* bs, const size_t* in, size_t n);
+
+/* Return the number of runs of consecutive bits set in `bs`.
+ */
+size_t bitset_count_runs(const bitset_t* bs);
+
+/* Write the runs of consecutive bits set in `bs` into `out`, in increasing
+ * order. Runs start and end at the transitions of x ^ (x << 1), found a
+ * whole atom at a time, and blocks of atoms all 0 outside a run, or all 1
+ * inside one, are skipped at once.
+ * @pre `out` has room for bitset_count_runs(bs) runs
+ * @return the number of runs written.
+ */
+size_t bitset_to_runs(const bitset_t* bs, bitset_run_t* out);
+
+/* Set the bits of the `n` runs of `in`, filling whole atoms at once.
+ * @pre in[i].start <= in[i].end <= bs->nbits
+ */
+void bitset_from_runs(bitset_t* bs, const bitset_run_t* in, size_t n);
+
+/* Return the number of bits set in both `a` and `b`, without storing their
+ * intersection.
+ * @pre a->natoms == b->natoms
+ */
+size_t bitset_and_popcnt(const bitset_t* a, const bitset_t* b);
+
 /* Do the and (intersection) of `a` and `b`, and store the result into `dest`.
  */
 void bitset_and_to(bitset_t* dest, const bitset_t* a, const bitset_t* b);
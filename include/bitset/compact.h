@@ -0,0 +1,50 @@
+/* Module      : bitset/compact
+ * Description : Compaction of columns by a selection bitset
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX2 or AVX-512 when available
+ *
+ * Compaction gathers, in order, the values of the rows of a column whose
+ * bit is set in a selection bitset, such as one produced by bitset/scan.
+ *
+ * Selections are read an atom, 64 rows, at a time: empty atoms are skipped
+ * and full atoms copied at once. Other atoms are split in vectors of rows,
+ * the bits of which drive a compress instruction with AVX-512 (VPCOMPRESSD,
+ * VPCOMPRESSQ), or a permutation looked up in a table with AVX2, before the
+ * selected values are stored with a masked store. Without them, set bits
+ * are visited one at a time.
+ *
+ * Several columns are compacted by blocks of BITSET_COMPACT_BLOCK rows, all
+ * columns of a block one after the other, so that the selection and the
+ * columns are read once from memory.
+ */
+
+#ifndef _bitset_compact_h_
+#define _bitset_compact_h_
+
+#include "bitset/bitset.h"
+
+/* Rows per block of columns */
+#define BITSET_COMPACT_BLOCK    4096
+
+/* Store into `out`, in order, the values of the rows of `col` set in `sel`.
+ * @pre `col` holds sel->nbits values, `out` room for as many as bits set
+ * @return the number of values stored.
+ */
+size_t bitset_compact_u32(const bitset_t* sel, const uint32_t* col,
+                          uint32_t* out);
+size_t bitset_compact_u64(const bitset_t* sel, const uint64_t* col,
+                          uint64_t* out);
+
+/* Compact each of the `ncols` columns cols[c], whose values are sizes[c]
+ * bytes, into outs[c], as bitset_compact_u32() or bitset_compact_u64().
+ * @pre sizes[c] is 4 or 8
+ * @return the number of values stored per column.
+ */
+size_t bitset_compact_columns(const bitset_t* sel, size_t ncols,
+                              const void* const* cols, const size_t* sizes,
+                              void* const* outs);
+
+#endif
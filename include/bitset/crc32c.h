@@ -0,0 +1,58 @@
+/* Module      : bitset/crc32c
+ * Description : CRC32C checksums of atoms
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 SSE4.2 when available
+ *
+ * CRC32C (Castagnoli polynomial) is computed with the SSE4.2 `crc32`
+ * instruction when the CPU has it, and with a slicing-by-8 table otherwise.
+ *
+ * The `crc32` instruction has a latency of 3 cycles but a throughput of 1 per
+ * cycle, so large buffers are cut in three lanes whose CRCs are computed in
+ * an interleaved way, and then combined. Combining CRCs is also what allows
+ * to checksum blocks independently (and in parallel) and still get the CRC
+ * of the whole data.
+ */
+
+#ifndef _bitset_crc32c_h_
+#define _bitset_crc32c_h_
+
+#include "bitset/bitset.h"
+
+/* Size of the blocks checksummed independently by `bitset_crc32c_blocks` */
+#define BITSET_CRC32C_BLOCK_SIZE    (1 << 20)
+
+/* Number of checksum blocks for `natoms` atoms */
+#define BITSET_CRC32C_NBLOCKS(_natoms)  \
+    (((_natoms) * sizeof(bitset_atom_t) + BITSET_CRC32C_BLOCK_SIZE - 1) \
+     / BITSET_CRC32C_BLOCK_SIZE)
+
+/* Update the CRC32C `crc` (0 to start) with `len` bytes of `data`.
+ */
+uint32_t bitset_crc32c(uint32_t crc, const void* data, size_t len);
+
+/* Return the CRC32C of the concatenation of two buffers, given the CRC32C
+ * `crc1` of the first one, and `crc2` of the second one, of `len2` bytes.
+ */
+uint32_t bitset_crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/* Return not 0 if the CRC32C is computed by the hardware. */
+int bitset_crc32c_hw(void);
+
+/* Compute the CRC32C of each block of BITSET_CRC32C_BLOCK_SIZE bytes of
+ * `natoms` atoms into `crcs`, using up to `nthreads` threads.
+ * @pre `crcs` has room for BITSET_CRC32C_NBLOCKS(natoms) values
+ */
+void bitset_crc32c_blocks(const bitset_atom_t* atoms, size_t natoms,
+                          uint32_t* crcs, unsigned nthreads);
+
+/* Check the CRC32C of each block of `natoms` atoms against `crcs`, using up
+ * to `nthreads` threads.
+ * @return not 0 if any block doesn't match.
+ */
+int bitset_crc32c_verify(const bitset_atom_t* atoms, size_t natoms,
+                         const uint32_t* crcs, unsigned nthreads);
+
+#endif
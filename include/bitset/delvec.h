@@ -0,0 +1,142 @@
+/* Module      : bitset/delvec
+ * Description : Deletion vectors of columnar segments
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A deletion vector marks the deleted rows of a segment, which stay in its
+ * columns until it is rewritten: rows are filtered out when the segment is
+ * read (merge on read).
+ *
+ * On disk, a deletion vector is a small header holding the CRC32C of its
+ * payload, followed by the set of deleted rows in the smallest encoding of
+ * bitset/encode. Deletions usually come in several files, one per delete
+ * operation: they are merged by decoding each of them straight into the
+ * atoms of the same vector.
+ *
+ * Live rows are read as runs of consecutive rows, found a whole atom at a
+ * time. Filters evaluate a predicate on blocks of BITSET_DELVEC_BLOCK rows
+ * and clear deleted rows in the block while it is in cache; blocks of
+ * deleted rows only are not evaluated.
+ */
+
+#ifndef _bitset_delvec_h_
+#define _bitset_delvec_h_
+
+#include "bitset/bitset.h"
+
+#define BITSET_DELVEC_MAGIC     0x314c454454455342ULL   /* "BSETDEL1" */
+#define BITSET_DELVEC_VERSION   1
+
+/* Rows per block of filters */
+#define BITSET_DELVEC_BLOCK     4096
+
+typedef struct bitset_delvec {
+    bitset_t deleted;   /* Bit i set if row i is deleted */
+} bitset_delvec_t;
+
+typedef struct bitset_delvec_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t crc;       /* CRC32C of the payload */
+    uint64_t size;      /* Size in bytes of the payload */
+} bitset_delvec_header_t;
+
+/* Iterator over the runs of live rows */
+typedef struct bitset_delvec_iter {
+    const bitset_delvec_t *dv;
+    size_t                 row;     /* First row not looked at */
+} bitset_delvec_iter_t;
+
+/* Fill `block`, which has the bits of rows `first` to
+ * first + block->nbits - 1, with a predicate on those rows.
+ */
+typedef void (*bitset_delvec_pred_fn)(bitset_t* block, size_t first,
+                                      void* arg);
+
+/* Initialize a deletion vector of a segment of `nrows` rows, all live.
+ * @return not 0 if initialization failed.
+ */
+int bitset_delvec_init(bitset_delvec_t* dv, size_t nrows);
+
+/* Wipe a deletion vector.
+ * @pre `dv` must have been initialized.
+ */
+void bitset_delvec_wipe(bitset_delvec_t* dv);
+
+/* Mark row `row` deleted.
+ * @pre row < dv->deleted.nbits
+ */
+inline void bitset_delvec_delete(bitset_delvec_t* dv, size_t row) {
+    bitset_set(&dv->deleted, row);
+}
+
+/* Return 1 if row `row` is live, 0 if it is deleted.
+ * @pre row < dv->deleted.nbits
+ */
+inline int bitset_delvec_is_live(const bitset_delvec_t* dv, size_t row) {
+    return !bitset_get(&dv->deleted, row);
+}
+
+/* Return the number of live rows. */
+size_t bitset_delvec_live_count(const bitset_delvec_t* dv);
+
+/* Return the size in bytes of the on-disk form of `dv`. */
+size_t bitset_delvec_encoded_size(const bitset_delvec_t* dv);
+
+/* Write the on-disk form of `dv` into `buf`, which has room for `len`
+ * bytes.
+ * @return the number of bytes written, or 0 if `buf` is too small.
+ */
+size_t bitset_delvec_encode(const bitset_delvec_t* dv, void* buf, size_t len);
+
+/* Initialize `dv` from its on-disk form, the `len` bytes of `buf`.
+ * @return not 0 if `buf` is corrupted or memory allocation failed.
+ */
+int bitset_delvec_decode(bitset_delvec_t* dv, const void* buf, size_t len);
+
+/* Mark deleted in `dv` the rows deleted in the on-disk form of `len` bytes
+ * of `buf`, of a segment of as many rows.
+ * @return not 0 if `buf` is corrupted or of another number of rows.
+ */
+int bitset_delvec_merge(bitset_delvec_t* dv, const void* buf, size_t len);
+
+/* Save `dv` into the file `path`, replacing it atomically.
+ * @return not 0 if saving failed.
+ */
+int bitset_delvec_save(const bitset_delvec_t* dv, const char* path);
+
+/* Initialize `dv` with the union of the `npaths` delete files `paths` of a
+ * segment of `nrows` rows.
+ * @return not 0 if a file cannot be read, is corrupted, or is of another
+ * number of rows.
+ */
+int bitset_delvec_load(bitset_delvec_t* dv, size_t nrows,
+                       const char* const* paths, size_t npaths);
+
+/* Start iterating over the runs of live rows of `dv`. */
+void bitset_delvec_iter_init(bitset_delvec_iter_t* it,
+                             const bitset_delvec_t* dv);
+
+/* Store the next run of live rows into [*start, *start + *len).
+ * @return 1 if there was one, 0 at the end of the segment.
+ */
+int bitset_delvec_iter_next(bitset_delvec_iter_t* it, size_t* start,
+                            size_t* len);
+
+/* Store into `dest` the rows of `pred` that are live.
+ * @pre dest, pred and dv->deleted have the same number of bits
+ */
+void bitset_delvec_live_and(bitset_t* dest, const bitset_delvec_t* dv,
+                            const bitset_t* pred);
+
+/* Store into `dest` the live rows for which `pred` holds, evaluating `pred`
+ * on blocks of rows with `arg`.
+ * @pre dest->nbits == dv->deleted.nbits
+ */
+void bitset_delvec_filter(bitset_t* dest, const bitset_delvec_t* dv,
+                          bitset_delvec_pred_fn pred, void* arg);
+
+#endif
@@ -0,0 +1,92 @@
+/* Module      : bitset/ef
+ * Description : Elias-Fano monotone sequences
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * An Elias-Fano sequence stores `n` non-decreasing integers below `universe`
+ * in about 2 + log(universe / n) bits each, while keeping random access and
+ * successor queries. It is a compact replacement for sorted arrays of
+ * integers.
+ *
+ * Every value is split in `l` low bits, packed in an array, and high bits.
+ * The i-th value sets bit `(value >> l) + i` of the `high` bitset: high bits
+ * are stored in unary, buckets of values being separated by zeros.
+ *
+ * Accessing the i-th value is finding the i-th one of `high` (select1), and
+ * looking for the first value not lower than `x` starts at the
+ * `(x >> l)`-th zero (select0). Both are sped up by sampling the positions
+ * of every BITSET_EF_SAMPLE-th one and zero.
+ */
+
+#ifndef _bitset_ef_h_
+#define _bitset_ef_h_
+
+#include "bitset/bitset.h"
+
+/* Distance between two samples of the select indexes */
+#define BITSET_EF_SAMPLE    256
+
+typedef struct bitset_ef {
+    size_t    count;        /* Number of values */
+    uint64_t  universe;     /* Values are below `universe` */
+    unsigned  low_bits;     /* Number of low bits per value */
+    uint64_t *low;          /* Low bits, packed */
+    bitset_t  high;         /* High bits, in unary */
+    size_t   *select1;      /* Position of every BITSET_EF_SAMPLE-th one */
+    size_t   *select0;      /* Position of every BITSET_EF_SAMPLE-th zero */
+} bitset_ef_t;
+
+/* Iterator over the values of a sequence */
+typedef struct bitset_ef_iter {
+    const bitset_ef_t *ef;
+    size_t             index;   /* Index of the next value */
+    size_t             pos;     /* Position in `high` to look from */
+} bitset_ef_iter_t;
+
+/* Initialize `ef` with the `n` values of `values`.
+ * @pre `values` is sorted, and values[n - 1] < universe
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_ef_init(bitset_ef_t* ef, const uint64_t* values, size_t n,
+                   uint64_t universe);
+
+/* Initialize `ef` with the indexes of bits set in `bs`.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_ef_from_bitset(bitset_ef_t* ef, const bitset_t* bs);
+
+/* Wipe a sequence.
+ * @pre `ef` must have been initialized.
+ */
+void bitset_ef_wipe(bitset_ef_t* ef);
+
+/* Return the size in bytes of the memory used by `ef`.
+ */
+size_t bitset_ef_size(const bitset_ef_t* ef);
+
+/* Return the i-th value of `ef`.
+ * @pre i < ef->count
+ */
+uint64_t bitset_ef_get(const bitset_ef_t* ef, size_t i);
+
+/* Look for the first value of `ef` greater than or equal to `x`, and store
+ * it into `value`.
+ * @return its index, or ef->count if there is no such value.
+ */
+size_t bitset_ef_next_geq(const bitset_ef_t* ef, uint64_t x, uint64_t* value);
+
+/* Initialize `it` to iterate over the values of `ef` from the i-th one.
+ * @pre i <= ef->count
+ */
+void bitset_ef_iter_init(bitset_ef_iter_t* it, const bitset_ef_t* ef,
+                         size_t i);
+
+/* Store the next value of `it` into `value`.
+ * @return 0 once all values have been read.
+ */
+int bitset_ef_iter_next(bitset_ef_iter_t* it, uint64_t* value);
+
+#endif
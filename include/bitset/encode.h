@@ -0,0 +1,74 @@
+/* Module      : bitset/encode
+ * Description : Compact encodings of bitsets for transfer
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 SSSE3 when available
+ *
+ * A sparse bitset is mostly made of zero atoms, and is better shipped as the
+ * list of its set positions. Three encodings are available:
+ *
+ * - raw: the atoms themselves, best for dense sets;
+ * - stream-vbyte: gaps between positions, each one stored on 1 to 4 bytes,
+ *   with the lengths of four gaps packed in a control byte. Control bytes and
+ *   data bytes are kept apart so four gaps are decoded at once with a byte
+ *   shuffle;
+ * - Elias-Fano: each position is split in `l` low bits, stored as is, and
+ *   high bits, stored in unary. It takes at most 2 + log(nbits / n) bits per
+ *   position, whatever their distribution.
+ *
+ * `BITSET_ENCODING_AUTO` picks the smallest one. Decoders write positions
+ * straight into the atoms of the decoded bitset.
+ *
+ * Encoded buffers start with a small header (encoding, number of bits,
+ * number of positions) and use the host endianness.
+ */
+
+#ifndef _bitset_encode_h_
+#define _bitset_encode_h_
+
+#include "bitset/bitset.h"
+
+typedef enum bitset_encoding {
+    BITSET_ENCODING_AUTO = 0,
+    BITSET_ENCODING_RAW,
+    BITSET_ENCODING_VBYTE,
+    BITSET_ENCODING_EF,
+} bitset_encoding_t;
+
+/* Return the size in bytes of `bs` encoded with `encoding`, or 0 if `bs`
+ * cannot be encoded this way (stream-vbyte needs gaps below 2^30).
+ * With BITSET_ENCODING_AUTO, return the size of the smallest encoding.
+ */
+size_t bitset_encoded_size(const bitset_t* bs, bitset_encoding_t encoding);
+
+/* Return the encoding BITSET_ENCODING_AUTO selects for `bs`.
+ */
+bitset_encoding_t bitset_best_encoding(const bitset_t* bs);
+
+/* Encode `bs` into `buf`, which has room for `len` bytes.
+ * @return the number of bytes written, or 0 if `buf` is too small or `bs`
+ * cannot be encoded this way.
+ */
+size_t bitset_encode(const bitset_t* bs, bitset_encoding_t encoding,
+                     void* buf, size_t len);
+
+/* Return the encoding of the `len` bytes of `buf`, or -1 if they aren't a
+ * valid encoded bitset.
+ */
+int bitset_encoding_of(const void* buf, size_t len);
+
+/* Initialize `bs` from the `len` bytes of `buf`.
+ * @return not 0 if `buf` is corrupted or memory allocation failed.
+ */
+int bitset_decode(bitset_t* bs, const void* buf, size_t len);
+
+/* Set in `bs` the bits set in the bitset encoded in the `len` bytes of
+ * `buf`, which has as many bits: `bs` becomes their union.
+ * @return not 0 if `buf` is corrupted or of another number of bits. Bits
+ * of `bs` may have been set when `buf` is found to be corrupted.
+ */
+int bitset_decode_or(bitset_t* bs, const void* buf, size_t len);
+
+#endif
@@ -0,0 +1,155 @@
+/* Module      : bitset/file
+ * Description : Out-of-core bitsets paged through a block cache
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A file bitset is stored in an image file (see `bitset/image.h`) and may be
+ * much larger than memory. Its atoms are split in blocks of
+ * BITSET_FILE_BLOCK_ATOMS atoms that are loaded on demand into a fixed-size
+ * cache, evicting blocks with the CLOCK algorithm. Modified blocks are
+ * written back when evicted or when the bitset is flushed.
+ *
+ * When a block is missed, the kernel is told that the next `readahead`
+ * blocks will be needed, so sequential scans don't wait on every block.
+ *
+ * Set functions below stream over their operands block by block: only one
+ * block of each operand needs to be in the cache at a time.
+ */
+
+#ifndef _bitset_file_h_
+#define _bitset_file_h_
+
+#include "bitset/bitset.h"
+
+/* Number of atoms per block (1 MiB blocks) */
+#define BITSET_FILE_BLOCK_ATOMS     (1 << 17)
+
+/* Default number of blocks read ahead on a miss */
+#define BITSET_FILE_READAHEAD       4
+
+/* A block cache entry */
+typedef struct bitset_file_slot {
+    size_t        block;    /* Cached block, or SIZE_MAX if free */
+    unsigned char ref;      /* CLOCK reference bit */
+    unsigned char dirty;
+} bitset_file_slot_t;
+
+typedef struct bitset_file {
+    size_t              nbits;       /* Number of bits */
+    size_t              natoms;      /* Number of atoms */
+    size_t              nblocks;     /* Number of blocks */
+    int                 fd;
+    int                 rdonly;
+    size_t              readahead;   /* Blocks read ahead on a miss */
+
+    size_t              nslots;      /* Number of cache entries */
+    size_t              hand;        /* CLOCK hand */
+    bitset_file_slot_t *slots;
+    bitset_atom_t      *frames;      /* nslots * BITSET_FILE_BLOCK_ATOMS */
+    uint32_t           *block_slot;  /* Slot of each block, or UINT32_MAX */
+
+    size_t              hits;        /* Cache statistics */
+    size_t              misses;
+    size_t              writebacks;
+} bitset_file_t;
+
+/* Create the file bitset `path` with `nbits` bits, all unset, using a cache
+ * of about `cache_size` bytes (at least one block per operand is needed by
+ * set functions).
+ * @return not 0 if creation failed.
+ */
+int bitset_file_create(bitset_file_t* bf, const char* path, size_t nbits,
+                       size_t cache_size);
+
+/* Open the existing file bitset `path`. If `rdonly` is not 0, the bitset
+ * cannot be modified.
+ * @return not 0 if opening failed.
+ */
+int bitset_file_open(bitset_file_t* bf, const char* path, int rdonly,
+                     size_t cache_size);
+
+/* Write back dirty blocks and close `bf`.
+ * @return not 0 if writing back failed.
+ */
+int bitset_file_close(bitset_file_t* bf);
+
+/* Write back every dirty block and sync the file.
+ * @return not 0 if writing back failed.
+ */
+int bitset_file_flush(bitset_file_t* bf);
+
+/* Return the atoms of block `block`, loading it if needed. Unless `write` is
+ * 0, the block is marked dirty. The pointer stays valid until the next call
+ * on `bf`.
+ * @pre block < bf->nblocks
+ * @return NULL if the block couldn't be loaded.
+ */
+bitset_atom_t* bitset_file_block(bitset_file_t* bf, size_t block, int write);
+
+/* Return the number of atoms of the block `block` (the last one may be
+ * shorter).
+ */
+inline size_t bitset_file_block_natoms(const bitset_file_t* bf, size_t block) {
+    size_t first = block * BITSET_FILE_BLOCK_ATOMS;
+    size_t left = bf->natoms - first;
+    return left < BITSET_FILE_BLOCK_ATOMS ? left : BITSET_FILE_BLOCK_ATOMS;
+}
+
+/* Return the state of the given bit, or -1 on I/O error.
+ * @pre bit < bf->nbits
+ */
+int bitset_file_get(bitset_file_t* bf, size_t bit);
+
+/* Set the bit `bit` of `bf`.
+ * @pre bit < bf->nbits
+ * @return not 0 on I/O error.
+ */
+int bitset_file_set(bitset_file_t* bf, size_t bit);
+
+/* Unset the bit `bit` of `bf`.
+ * @pre bit < bf->nbits
+ * @return not 0 on I/O error.
+ */
+int bitset_file_unset(bitset_file_t* bf, size_t bit);
+
+/* Count number of bits set in `bf`, or return -1 on I/O error.
+ */
+long long bitset_file_popcnt(bitset_file_t* bf);
+
+/* Do the and (intersection) of `a` and `b`, and store the result into
+ * `dest`. Blocks of `dest` are not read before being overwritten.
+ * @pre a->natoms == b->natoms == dest->natoms, operands are distinct
+ * @return not 0 on I/O error.
+ */
+int bitset_file_and_to(bitset_file_t* dest, bitset_file_t* a,
+                       bitset_file_t* b);
+
+/* Do the or (union) of `a` and `b`, and store the result into `dest`.
+ * @pre a->natoms == b->natoms == dest->natoms, operands are distinct
+ * @return not 0 on I/O error.
+ */
+int bitset_file_or_to(bitset_file_t* dest, bitset_file_t* a,
+                      bitset_file_t* b);
+
+/* Do the and (intersection) of `a` and `b`, and store the result into `a`.
+ * @pre a->natoms == b->natoms
+ * @return not 0 on I/O error.
+ */
+int bitset_file_and(bitset_file_t* a, bitset_file_t* b);
+
+/* Do the or (union) of `a` and `b`, and store the result into `a`.
+ * @pre a->natoms == b->natoms
+ * @return not 0 on I/O error.
+ */
+int bitset_file_or(bitset_file_t* a, bitset_file_t* b);
+
+/* Count number of bits set in the intersection of `a` and `b`, without
+ * storing it, or return -1 on I/O error.
+ * @pre a->natoms == b->natoms
+ */
+long long bitset_file_and_popcnt(bitset_file_t* a, bitset_file_t* b);
+
+#endif
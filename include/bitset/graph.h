@@ -0,0 +1,85 @@
+/* Module      : bitset/graph
+ * Description : Graph kernels over adjacency bitsets
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * An undirected graph of `n` vertices is stored as `n` adjacency rows of
+ * `n` bits. Kernels count triangles and k-cliques, and enumerate maximal
+ * cliques.
+ *
+ * All of them first rank vertices by increasing degree, and relabel the
+ * graph so that vertex ids are ranks. Every clique is then found once, from
+ * its lowest ranked vertex, through the neighbors of higher rank of this
+ * vertex. Those are few for high degree vertices, and since their ids are
+ * greater, intersections and decoding skip the atoms before them.
+ *
+ * Counting a triangle is an intersection count of two rows, without
+ * materializing the intersection; k-cliques are counted likewise at the
+ * last two levels. Candidate sets are decoded in bulk before being walked.
+ * Maximal cliques are enumerated with the Bron–Kerbosch algorithm, with
+ * pivoting.
+ *
+ * Vertices are handed out to threads dynamically, each thread having its
+ * own scratch sets.
+ */
+
+#ifndef _bitset_graph_h_
+#define _bitset_graph_h_
+
+#include "bitset/bitset.h"
+
+typedef struct bitset_graph {
+    size_t    n;        /* Number of vertices */
+    bitset_t *rows;     /* Adjacency rows */
+} bitset_graph_t;
+
+/* Called for every maximal clique of `n` vertices. Calls are serialized.
+ */
+typedef void (*bitset_graph_clique_cb)(const size_t* vertices, size_t n,
+                                       void* arg);
+
+/* Initialize a graph of `n` vertices without edges.
+ * @return not 0 if initialization failed.
+ */
+int bitset_graph_init(bitset_graph_t* g, size_t n);
+
+/* Wipe a graph.
+ * @pre `g` must have been initialized.
+ */
+void bitset_graph_wipe(bitset_graph_t* g);
+
+/* Add the edge between `u` and `v`.
+ * @pre u < g->n, v < g->n, u != v
+ */
+inline void bitset_graph_add_edge(bitset_graph_t* g, size_t u, size_t v) {
+    assert (u != v);
+    bitset_set(&g->rows[u], v);
+    bitset_set(&g->rows[v], u);
+}
+
+/* Count the triangles of `g` with `nthreads` threads, into `count`.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_graph_triangles(const bitset_graph_t* g, unsigned nthreads,
+                           uint64_t* count);
+
+/* Count the cliques of `k` vertices of `g` with `nthreads` threads, into
+ * `count`.
+ * @pre k > 0
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_graph_cliques(const bitset_graph_t* g, unsigned k,
+                         unsigned nthreads, uint64_t* count);
+
+/* Enumerate the maximal cliques of `g` with `nthreads` threads, calling
+ * `cb` for each of them if not NULL, and store their number into `count`.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_graph_maximal_cliques(const bitset_graph_t* g, unsigned nthreads,
+                                 bitset_graph_clique_cb cb, void* arg,
+                                 uint64_t* count);
+
+#endif
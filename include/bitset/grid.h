@@ -0,0 +1,135 @@
+/* Module      : bitset/grid
+ * Description : Two-dimensional bit grids
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A grid of width x height cells is a bitset of `height` rows, each row
+ * padded to a whole number of atoms, `stride`. Cell (x, y) is bit x of row
+ * y. Padding bits are kept clear, so that whole-set operations of
+ * bitset/bitset apply to grids of the same dimensions as they are.
+ *
+ * Rectangles are filled, cleared and counted with masked atoms at their
+ * left and right edges and whole atoms in between.
+ *
+ * Dilation and erosion by a (2 rx + 1) x (2 ry + 1) rectangle are separable:
+ * rows are first or-ed (and-ed) with shifted copies of themselves, then
+ * rows are or-ed (and-ed) together. Horizontal shifts double their span at
+ * each step, so that a row takes O(log rx) shifts. Cells outside the grid
+ * are empty.
+ *
+ * Connected regions are found on runs of set cells: runs of each row are
+ * decoded from the transitions of its atoms, and merged with a union-find
+ * with the runs of the previous row they touch.
+ */
+
+#ifndef _bitset_grid_h_
+#define _bitset_grid_h_
+
+#include "bitset/bitset.h"
+
+typedef struct bitset_grid {
+    size_t   width;     /* Number of columns */
+    size_t   height;    /* Number of rows */
+    size_t   stride;    /* Number of atoms per row */
+    bitset_t bits;      /* Rows, one after the other */
+} bitset_grid_t;
+
+/* Neighborhoods of connected regions */
+typedef enum bitset_grid_conn {
+    BITSET_GRID_CONN4,  /* Cells sharing an edge */
+    BITSET_GRID_CONN8,  /* Cells sharing an edge or a corner */
+} bitset_grid_conn_t;
+
+/* Initialize an empty grid of `width` x `height` cells.
+ * @return not 0 if initialization failed.
+ */
+int bitset_grid_init(bitset_grid_t* g, size_t width, size_t height);
+
+/* Wipe a grid.
+ * @pre `g` must have been initialized.
+ */
+void bitset_grid_wipe(bitset_grid_t* g);
+
+/* Return the atoms of row `y`.
+ * @pre y < g->height
+ */
+inline bitset_atom_t* bitset_grid_row(const bitset_grid_t* g, size_t y) {
+    assert (y < g->height);
+    return g->bits.bits + y * g->stride;
+}
+
+/* Return the state of cell (x, y).
+ * @pre x < g->width, y < g->height
+ */
+inline bit_t bitset_grid_get(const bitset_grid_t* g, size_t x, size_t y) {
+    assert (x < g->width);
+    const bitset_atom_t* row = bitset_grid_row(g, y);
+    return (row[x / BITS_PER_ATOM] >> (x % BITS_PER_ATOM)) & 1;
+}
+
+/* Set cell (x, y).
+ * @pre x < g->width, y < g->height
+ */
+inline void bitset_grid_set(bitset_grid_t* g, size_t x, size_t y) {
+    assert (x < g->width);
+    bitset_grid_row(g, y)[x / BITS_PER_ATOM] |=
+        (bitset_atom_t)1 << (x % BITS_PER_ATOM);
+}
+
+/* Unset cell (x, y).
+ * @pre x < g->width, y < g->height
+ */
+inline void bitset_grid_unset(bitset_grid_t* g, size_t x, size_t y) {
+    assert (x < g->width);
+    bitset_grid_row(g, y)[x / BITS_PER_ATOM] &=
+        ~((bitset_atom_t)1 << (x % BITS_PER_ATOM));
+}
+
+/* Set the cells of the `w` x `h` rectangle whose top left cell is (x, y).
+ * The rectangle is clipped to the grid.
+ */
+void bitset_grid_fill_rect(bitset_grid_t* g, size_t x, size_t y,
+                           size_t w, size_t h);
+
+/* Unset the cells of the `w` x `h` rectangle whose top left cell is (x, y).
+ * The rectangle is clipped to the grid.
+ */
+void bitset_grid_clear_rect(bitset_grid_t* g, size_t x, size_t y,
+                            size_t w, size_t h);
+
+/* Return the number of cells set in the `w` x `h` rectangle whose top left
+ * cell is (x, y). The rectangle is clipped to the grid.
+ */
+size_t bitset_grid_count_rect(const bitset_grid_t* g, size_t x, size_t y,
+                              size_t w, size_t h);
+
+/* Dilate `src` by a (2 rx + 1) x (2 ry + 1) rectangle into `dest`: a cell is
+ * set if any cell within rx columns and ry rows of it is set in `src`.
+ * @pre `dest` and `src` have the same dimensions, dest != src
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_grid_dilate_to(bitset_grid_t* dest, const bitset_grid_t* src,
+                          size_t rx, size_t ry);
+
+/* Erode `src` by a (2 rx + 1) x (2 ry + 1) rectangle into `dest`: a cell is
+ * set if all cells within rx columns and ry rows of it are in the grid and
+ * set in `src`.
+ * @pre `dest` and `src` have the same dimensions, dest != src
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_grid_erode_to(bitset_grid_t* dest, const bitset_grid_t* src,
+                         size_t rx, size_t ry);
+
+/* Label the connected regions of set cells of `g` under `conn`: store into
+ * labels[y * g->width + x] 0 for an empty cell, and a region number from 1
+ * otherwise, regions being numbered in the order of their first cell. Store
+ * the number of regions into `count`.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_grid_regions(const bitset_grid_t* g, bitset_grid_conn_t conn,
+                        uint32_t* labels, size_t* count);
+
+#endif
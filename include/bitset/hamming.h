@@ -0,0 +1,88 @@
+/* Module      : bitset/hamming
+ * Description : Nearest neighbors search over binary codes
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX-512 VPOPCNTDQ or POPCNT when available
+ *
+ * Binary codes (embeddings of 256 to 1024 bits, for instance) are compared
+ * with the Hamming distance, the popcount of their xor. Instead of one
+ * bitset_t per code, a code matrix stores all codes of a database back to
+ * back in a single 64-byte aligned array, so that a scan streams through
+ * memory.
+ *
+ * k nearest neighbors queries are batched: the database is cut in tiles of
+ * a few hundred kilobytes, and each tile is compared to every query while
+ * it is in cache. Every query keeps the k best matches in a bounded heap,
+ * that most distances don't enter. Tiles are shared between threads, whose
+ * heaps are merged at the end.
+ *
+ * The distance kernel uses AVX-512 VPOPCNTQ on 8 atoms at once if the CPU
+ * has it, and the POPCNT instruction otherwise.
+ */
+
+#ifndef _bitset_hamming_h_
+#define _bitset_hamming_h_
+
+#include "bitset/bitset.h"
+
+typedef struct bitset_codes {
+    size_t         ncodes;  /* Number of codes */
+    size_t         nbits;   /* Number of bits per code */
+    size_t         stride;  /* Number of atoms per code */
+    bitset_atom_t *atoms;   /* Code i starts at atoms + i * stride */
+} bitset_codes_t;
+
+/* A neighbor of a query */
+typedef struct bitset_hamming_match {
+    size_t   index;     /* Index of the code in the database */
+    uint32_t distance;
+} bitset_hamming_match_t;
+
+/* Initialize a matrix of `ncodes` codes of `nbits` bits, all 0.
+ * @return not 0 if initialization failed.
+ */
+int bitset_codes_init(bitset_codes_t* c, size_t ncodes, size_t nbits);
+
+/* Wipe a code matrix.
+ * @pre `c` must have been initialized.
+ */
+void bitset_codes_wipe(bitset_codes_t* c);
+
+/* Return the atoms of the i-th code of `c`.
+ * @pre i < c->ncodes
+ */
+inline bitset_atom_t* bitset_codes_row(const bitset_codes_t* c, size_t i) {
+    assert (i < c->ncodes);
+    return c->atoms + i * c->stride;
+}
+
+/* Copy `code` as the i-th code of `c`.
+ * @pre i < c->ncodes, and code->nbits == c->nbits
+ */
+void bitset_codes_set(bitset_codes_t* c, size_t i, const bitset_t* code);
+
+/* Return the Hamming distance between two codes of `nbits` bits.
+ */
+uint32_t bitset_hamming_distance(const bitset_atom_t* a,
+                                 const bitset_atom_t* b, size_t nbits);
+
+/* Compute the distances between `query` and every code of `db`, and store
+ * them into `out`.
+ * @pre `out` has room for db->ncodes distances
+ */
+void bitset_hamming_distances(const bitset_codes_t* db,
+                              const bitset_atom_t* query, uint32_t* out);
+
+/* Look for the `k` nearest neighbors in `db` of every code of `queries`,
+ * with `nthreads` threads. Neighbors of query q are stored into
+ * out[q * k ... q * k + k - 1], by increasing distance then index.
+ * @pre queries->nbits == db->nbits, and 0 < k <= db->ncodes
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_hamming_knn(const bitset_codes_t* db,
+                       const bitset_codes_t* queries, size_t k,
+                       unsigned nthreads, bitset_hamming_match_t* out);
+
+#endif
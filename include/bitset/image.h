@@ -0,0 +1,105 @@
+/* Module      : bitset/image
+ * Description : On-disk image of bitsets
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * An image is the serialized form of a bitset: a header of
+ * BITSET_IMAGE_HEADER_SIZE bytes followed by the atoms, exactly as they are
+ * laid out in memory (host endianness). Atoms start on a page boundary so the
+ * payload can be mapped or read with O_DIRECT.
+ *
+ * Images written by this module also hold the CRC32C of each block of
+ * BITSET_CRC32C_BLOCK_SIZE bytes of atoms (see `bitset/crc32c.h`), in a table
+ * following the atoms at the next page boundary. The header holds the
+ * CRC32C of that table. Images without the BITSET_IMAGE_CRC32C flag have no
+ * table and are not verified.
+ */
+
+#ifndef _bitset_image_h_
+#define _bitset_image_h_
+
+#include "bitset/bitset.h"
+
+#define BITSET_IMAGE_MAGIC          0x31474d4954455342ULL   /* "BSETIMG1" */
+#define BITSET_IMAGE_VERSION        1
+
+/* Size of the on-disk header, and so offset of the first atom */
+#define BITSET_IMAGE_HEADER_SIZE    4096
+
+/* Header flags */
+#define BITSET_IMAGE_CRC32C         0x1     /* The image has a CRC table */
+
+/* Flags of `bitset_image_read` */
+#define BITSET_IMAGE_NO_VERIFY      0x1     /* Don't check CRCs */
+
+typedef struct bitset_image_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flags;     /* BITSET_IMAGE_* header flags */
+    uint64_t nbits;     /* Number of bits of the stored bitset */
+    uint32_t table_crc; /* CRC32C of the CRC table */
+    uint32_t reserved;
+} bitset_image_header_t;
+
+/* Size in bytes of the image of a bitset of `nbits` bits, without the CRC
+ * table */
+#define BITSET_IMAGE_SIZE(_nbits)   \
+    (BITSET_IMAGE_HEADER_SIZE + BITS_TO_NATOMS(_nbits) * sizeof(bitset_atom_t))
+
+/* Offset of the CRC table of the image of a bitset of `nbits` bits */
+#define BITSET_IMAGE_CRC_OFFSET(_nbits) \
+    ((BITSET_IMAGE_SIZE(_nbits) + BITSET_IMAGE_HEADER_SIZE - 1) \
+     / BITSET_IMAGE_HEADER_SIZE * BITSET_IMAGE_HEADER_SIZE)
+
+/* Fill `header` to describe a bitset of `nbits` bits.
+ */
+void bitset_image_header_init(bitset_image_header_t* header, size_t nbits);
+
+/* Read and check the header of the image stored in `fd`.
+ * @return not 0 if it cannot be read or isn't a valid image header.
+ */
+int bitset_image_read_header(int fd, bitset_image_header_t* header);
+
+/* Read the CRC table of the image of `fd` described by `header`, and check
+ * its own CRC. `*crcs` is allocated page-aligned and must be freed.
+ * @pre header->flags & BITSET_IMAGE_CRC32C
+ * @return not 0 if it cannot be read or is corrupted.
+ */
+int bitset_image_read_crcs(int fd, const bitset_image_header_t* header,
+                           uint32_t** crcs);
+
+/* Write the CRC table `crcs` of a bitset of `nbits` bits in `fd`, then
+ * the header referring to it, and cut the file at the end of the table.
+ * Buffers are page-aligned, so `fd` may have been opened with O_DIRECT.
+ * @return not 0 if writing failed.
+ */
+int bitset_image_write_crcs(int fd, size_t nbits, const uint32_t* crcs);
+
+/* Write the image of `bs` at the beginning of `fd`, with its CRC table.
+ * Data is not synced.
+ * @return not 0 if writing failed.
+ */
+int bitset_image_write(int fd, const bitset_t* bs);
+
+/* Initialize `bs` from the image stored in `fd`. Unless `flags` has
+ * BITSET_IMAGE_NO_VERIFY, atoms are checked against the CRC table.
+ * @return not 0 if reading or verification failed, in which case `bs` is
+ * not initialized.
+ */
+int bitset_image_read(int fd, bitset_t* bs, int flags);
+
+/* Save `bs` into the file `path`, replacing it atomically (the image is
+ * written to a temporary file, synced, then renamed).
+ * @return not 0 if saving failed.
+ */
+int bitset_save(const bitset_t* bs, const char* path);
+
+/* Initialize `bs` from the image file `path`, checking its CRCs.
+ * @return not 0 if loading or verification failed.
+ */
+int bitset_load(bitset_t* bs, const char* path);
+
+#endif
@@ -0,0 +1,166 @@
+/* Module      : bitset/index
+ * Description : Inverted index of documents
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * An inverted index maps every term, a number, to its posting: the set of
+ * documents, numbered from 0, containing it. Each posting takes the
+ * smallest of three representations, which depends on its number of
+ * documents (document frequency, df):
+ *
+ * - array: the sorted documents, 4 bytes each, for rare terms;
+ * - roaring: documents grouped by their high 16 bits in containers, each
+ *   one the sorted low 16 bits of its documents or, above
+ *   BITSET_INDEX_CONTAINER_ARRAY_MAX documents, a bitmap of 2^16 bits. It
+ *   suits terms frequent in some ranges of documents only;
+ * - dense: a bitset of all documents, for common terms.
+ *
+ * Boolean queries intersect the postings of required terms, rarest first,
+ * with the union of optional ones, and remove those of excluded terms.
+ * When the rarest required term is an array, its documents are checked
+ * against the other terms one by one; otherwise postings are combined a
+ * whole atom at a time into the result.
+ *
+ * Ranked queries score documents containing query terms by the sum of the
+ * BM25 inverse document frequencies of the terms they contain (documents
+ * have no term frequencies), and return the best ones.
+ *
+ * Indexes are built from a stream of documents in bounded memory: postings
+ * are buffered as (term, document) pairs, and when the buffer is full,
+ * they are sorted by term (radix sort, documents staying in order) and
+ * spilled to a temporary file as a run. Documents of a run all come before
+ * those of the next one, so a term's documents are the concatenation of
+ * its documents in every run. At the end, groups of consecutive runs are
+ * merged term by term into new runs, as few at once as the budget has room
+ * for read buffers, until the last ones are merged into postings.
+ */
+
+#ifndef _bitset_index_h_
+#define _bitset_index_h_
+
+#include "bitset/bitset.h"
+
+/* Documents per container of roaring postings */
+#define BITSET_INDEX_CONTAINER_DOCS         65536
+
+/* Largest number of documents of an array container */
+#define BITSET_INDEX_CONTAINER_ARRAY_MAX    4096
+
+typedef enum bitset_posting_kind {
+    BITSET_POSTING_ARRAY,
+    BITSET_POSTING_ROARING,
+    BITSET_POSTING_DENSE,
+} bitset_posting_kind_t;
+
+/* Documents of a roaring posting sharing their high 16 bits */
+typedef struct bitset_index_container {
+    uint32_t  key;      /* High 16 bits of the documents */
+    uint32_t  card;     /* Number of documents */
+    void     *data;     /* Sorted uint16_t low bits, or a bitmap of atoms */
+} bitset_index_container_t;
+
+typedef struct bitset_posting {
+    bitset_posting_kind_t      kind;
+    uint32_t                   df;          /* Number of documents */
+    uint32_t                  *docs;        /* Array: sorted documents */
+    size_t                     ncontainers;
+    bitset_index_container_t  *containers;  /* Roaring: by increasing key */
+    bitset_t                   dense;       /* Dense: one bit per document */
+} bitset_posting_t;
+
+typedef struct bitset_index {
+    uint32_t          ndocs;
+    uint32_t          nterms;
+    bitset_posting_t *postings;     /* Indexed by term */
+} bitset_index_t;
+
+/* A document of the result of a ranked query */
+typedef struct bitset_index_hit {
+    uint32_t doc;
+    float    score;
+} bitset_index_hit_t;
+
+typedef struct bitset_index_builder {
+    uint32_t   ndocs;       /* Documents added */
+    uint32_t   nterms;      /* 1 + largest term seen */
+    uint64_t  *pairs;       /* term << 32 | document, in buffer */
+    uint64_t  *sorted;      /* Room for sorting pairs */
+    size_t     npairs;
+    size_t     cap;         /* Pairs the buffer holds */
+    char      *dir;         /* Directory of the temporary file */
+    int        fd;          /* Temporary file of runs, or -1 */
+    size_t     nruns;
+    uint64_t  *runs;        /* Offset of runs, then end of the last one */
+} bitset_index_builder_t;
+
+/* Initialize a builder keeping at most about `budget` bytes of postings in
+ * memory, and spilling the others into a temporary file in `dir`.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_index_builder_init(bitset_index_builder_t* b, size_t budget,
+                              const char* dir);
+
+/* Wipe a builder, discarding what it holds.
+ * @pre `b` must have been initialized.
+ */
+void bitset_index_builder_wipe(bitset_index_builder_t* b);
+
+/* Add the next document, numbered b->ndocs, made of the `n` terms of
+ * `terms`, in any order and possibly repeated.
+ * @pre terms[i] < UINT32_MAX
+ * @return not 0 if memory allocation or spilling failed.
+ */
+int bitset_index_builder_add(bitset_index_builder_t* b,
+                             const uint32_t* terms, size_t n);
+
+/* Initialize `idx` with the documents added to `b`, and wipe `b`.
+ * @return not 0 if memory allocation or reading spilled runs failed.
+ */
+int bitset_index_builder_finish(bitset_index_builder_t* b,
+                                bitset_index_t* idx);
+
+/* Wipe an index.
+ * @pre `idx` must have been initialized.
+ */
+void bitset_index_wipe(bitset_index_t* idx);
+
+/* Return the size in bytes of the memory used by `idx`. */
+size_t bitset_index_size(const bitset_index_t* idx);
+
+/* Return the number of documents containing `term`. */
+uint32_t bitset_index_df(const bitset_index_t* idx, uint32_t term);
+
+/* Return the representation of the posting of `term`. */
+bitset_posting_kind_t bitset_index_kind(const bitset_index_t* idx,
+                                        uint32_t term);
+
+/* Return 1 if document `doc` contains `term`, 0 otherwise. */
+int bitset_index_contains(const bitset_index_t* idx, uint32_t term,
+                          uint32_t doc);
+
+/* Store into `out` the documents containing all the `nmust` terms of
+ * `must`, at least one of the `nshould` terms of `should` if there are
+ * any, and none of the `nnot` terms of `must_not`.
+ * @pre out->nbits == idx->ndocs
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_index_query(const bitset_index_t* idx,
+                       const uint32_t* must, size_t nmust,
+                       const uint32_t* should, size_t nshould,
+                       const uint32_t* must_not, size_t nnot,
+                       bitset_t* out);
+
+/* Store into `hits` the `k` best documents containing at least one of the
+ * `n` terms of `terms`, and in `filter` unless it is NULL, by decreasing
+ * score then increasing number. Store their number into `nhits`.
+ * @pre filter is NULL or filter->nbits == idx->ndocs
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_index_ranked(const bitset_index_t* idx, const uint32_t* terms,
+                        size_t n, const bitset_t* filter, size_t k,
+                        bitset_index_hit_t* hits, size_t* nhits);
+
+#endif
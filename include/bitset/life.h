@@ -0,0 +1,69 @@
+/* Module      : bitset/life
+ * Description : Life-like cellular automata on bit grids
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX2 or AVX-512 when available
+ *
+ * A Life-like rule tells, for every number of live neighbors among the 8
+ * surrounding cells, whether a dead cell is born and whether a live cell
+ * survives. Conway's Game of Life is B3/S23.
+ *
+ * Generations are computed on bitset/grid grids a whole atom at a time: the
+ * 8 neighbors of the 64 cells of an atom are the atoms of the rows above and
+ * below and of its own row, shifted by one cell with the carry of adjacent
+ * atoms. They are summed with a network of bit-sliced full adders into a
+ * 4-bit count per cell, stored as 4 atoms, which the rule maps back to
+ * cells. The same network runs on 4 or 8 atoms at once with AVX2 or
+ * AVX-512.
+ *
+ * Grids are split in tiles of BITSET_LIFE_TILE_ROWS rows by
+ * BITSET_LIFE_TILE_ATOMS atoms, so that the rows a tile reads stay in
+ * cache, and tiles are handed out to threads dynamically. Cells outside the
+ * grid are dead.
+ */
+
+#ifndef _bitset_life_h_
+#define _bitset_life_h_
+
+#include "bitset/grid.h"
+
+/* Rows per tile */
+#define BITSET_LIFE_TILE_ROWS   64
+
+/* Atoms per tile row */
+#define BITSET_LIFE_TILE_ATOMS  512
+
+/* Bit n of `birth` (`survive`) is set if a dead (live) cell with n live
+ * neighbors is live at the next generation.
+ */
+typedef struct bitset_life_rule {
+    uint16_t birth;
+    uint16_t survive;
+} bitset_life_rule_t;
+
+/* Conway's Game of Life, B3/S23 */
+#define BITSET_LIFE_CONWAY  ((bitset_life_rule_t){ 1 << 3, 1 << 2 | 1 << 3 })
+
+/* Parse a rule in the B/S notation, such as "B36/S23".
+ * @return not 0 if `s` is not a valid rule.
+ */
+int bitset_life_rule_parse(bitset_life_rule_t* rule, const char* s);
+
+/* Compute into `dest` the generation after `src` under `rule`, with
+ * `nthreads` threads.
+ * @pre `dest` and `src` have the same dimensions, dest != src
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_life_step(bitset_grid_t* dest, const bitset_grid_t* src,
+                     bitset_life_rule_t rule, unsigned nthreads);
+
+/* Advance `g` by `generations` generations under `rule`, with `nthreads`
+ * threads.
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_life_run(bitset_grid_t* g, bitset_life_rule_t rule,
+                    size_t generations, unsigned nthreads);
+
+#endif
@@ -0,0 +1,72 @@
+/* Module      : bitset/mih
+ * Description : Multi-index hashing of binary codes
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * Multi-index hashing answers Hamming radius queries over a code matrix
+ * without scanning it. Codes are cut in `m` disjoint substrings, and each
+ * substring of every code is indexed in its own hash table.
+ *
+ * If two codes are within distance `r`, then by the pigeonhole principle
+ * one of their substrings are within distance `r / m`. A query thus looks
+ * up, in every table, all substrings within this small distance of its own
+ * substring, and candidates are verified with the full distance. Substrings
+ * of about log2(ncodes) bits keep both the number of lookups and the number
+ * of candidates per lookup small.
+ *
+ * A candidate found in several tables is verified once: it is skipped in a
+ * table if one of its previous substrings already matched.
+ *
+ * Search is exact, and read-only so that several threads can search the
+ * same index. Code indexes are stored on 32 bits.
+ */
+
+#ifndef _bitset_mih_h_
+#define _bitset_mih_h_
+
+#include "bitset/hamming.h"
+
+/* Largest length of a substring */
+#define BITSET_MIH_MAX_SUBSTRING    32
+
+/* Index of the codes sharing a substring value */
+typedef struct bitset_mih_table {
+    unsigned  first;        /* First bit of the substring */
+    unsigned  nbits;        /* Length of the substring */
+    unsigned  log_capacity; /* Number of slots is 1 << log_capacity */
+    uint32_t *keys;         /* Substring value of each slot */
+    uint32_t *groups;       /* Group of each slot, UINT32_MAX if empty */
+    uint32_t *starts;       /* Codes of group g are ids[starts[g]...] */
+    uint32_t *ids;          /* Indexes of codes, grouped by substring */
+} bitset_mih_table_t;
+
+typedef struct bitset_mih {
+    const bitset_codes_t *db;
+    unsigned              m;        /* Number of substrings */
+    bitset_mih_table_t   *tables;
+} bitset_mih_t;
+
+/* Index the codes of `db` with `m` substrings. With m == 0, substrings of
+ * about log2(db->ncodes) bits are used. `db` must outlive the index.
+ * @pre db->ncodes < 2^32, and m <= db->nbits
+ * @return not 0 if memory allocation failed.
+ */
+int bitset_mih_init(bitset_mih_t* mih, const bitset_codes_t* db, unsigned m);
+
+/* Wipe an index.
+ * @pre `mih` must have been initialized.
+ */
+void bitset_mih_wipe(bitset_mih_t* mih);
+
+/* Look for the codes of the database within distance `radius` of `query`.
+ * Up to `max` of them are stored into `out`, in no particular order.
+ * @return the number of codes found, which may be greater than `max`.
+ */
+size_t bitset_mih_search(const bitset_mih_t* mih, const bitset_atom_t* query,
+                         unsigned radius, bitset_hamming_match_t* out,
+                         size_t max);
+
+#endif
@@ -0,0 +1,90 @@
+/* Module      : bitset/packed
+ * Description : Packed arrays of k-bit integers
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX2 when available
+ *
+ * A packed vector stores `n` unsigned integers of `width` bits (1 to 32)
+ * back to back in an array of atoms: value i takes bits [i * width,
+ * (i + 1) * width), and may straddle two atoms. Small counters or codes of
+ * 3, 5 or 12 bits thus take 3, 5 or 12 bits each instead of 8, 8 or 16.
+ *
+ * 64 values of `width` bits fill exactly `width` atoms. Bulk unpacking and
+ * packing work on such groups with a function specialized for each width,
+ * so that all shifts and masks are constants. Unpacking uses AVX2 gathers
+ * instead for widths up to 25, where any value fits in a 32-bit load.
+ */
+
+#ifndef _bitset_packed_h_
+#define _bitset_packed_h_
+
+#include "bitset/bitset.h"
+
+/* Largest width of values */
+#define BITSET_PACKED_MAX_WIDTH     32
+
+typedef struct bitset_packed {
+    size_t         n;       /* Number of values */
+    unsigned       width;   /* Number of bits per value */
+    size_t         natoms;  /* Number of atoms, one of padding included */
+    bitset_atom_t *atoms;
+} bitset_packed_t;
+
+/* Initialize a vector of `n` values of `width` bits, all 0.
+ * @pre 0 < width <= BITSET_PACKED_MAX_WIDTH
+ * @return not 0 if initialization failed.
+ */
+int bitset_packed_init(bitset_packed_t* p, size_t n, unsigned width);
+
+/* Wipe a vector.
+ * @pre `p` must have been initialized.
+ */
+void bitset_packed_wipe(bitset_packed_t* p);
+
+/* Return the i-th value of `p`.
+ * @pre i < p->n
+ */
+inline uint32_t bitset_packed_get(const bitset_packed_t* p, size_t i) {
+    assert (i < p->n);
+    size_t bit = i * p->width;
+    unsigned shift = bit % BITS_PER_ATOM;
+    const bitset_atom_t* atom = p->atoms + bit / BITS_PER_ATOM;
+    bitset_atom_t v = atom[0] >> shift;
+    if (shift + p->width > BITS_PER_ATOM) {
+        v |= atom[1] << (BITS_PER_ATOM - shift);
+    }
+    return v & (((bitset_atom_t)1 << p->width) - 1);
+}
+
+/* Set the i-th value of `p` to `v`.
+ * @pre i < p->n, and `v` fits in p->width bits
+ */
+inline void bitset_packed_set(bitset_packed_t* p, size_t i, uint32_t v) {
+    assert (i < p->n);
+    bitset_atom_t mask = ((bitset_atom_t)1 << p->width) - 1;
+    assert (v <= mask);
+    size_t bit = i * p->width;
+    unsigned shift = bit % BITS_PER_ATOM;
+    bitset_atom_t* atom = p->atoms + bit / BITS_PER_ATOM;
+    atom[0] = (atom[0] & ~(mask << shift)) | ((bitset_atom_t)v << shift);
+    if (shift + p->width > BITS_PER_ATOM) {
+        unsigned rshift = BITS_PER_ATOM - shift;
+        atom[1] = (atom[1] & ~(mask >> rshift)) | ((bitset_atom_t)v >> rshift);
+    }
+}
+
+/* Write the `n` values of `p` starting at index `first` into `out`.
+ * @pre first + n <= p->n
+ */
+void bitset_packed_unpack(const bitset_packed_t* p, size_t first, size_t n,
+                          uint32_t* out);
+
+/* Set the `n` values of `p` starting at index `first` to those of `in`.
+ * @pre first + n <= p->n, and values of `in` fit in p->width bits
+ */
+void bitset_packed_pack(bitset_packed_t* p, size_t first, size_t n,
+                        const uint32_t* in);
+
+#endif
@@ -0,0 +1,52 @@
+/* Module      : bitset/pairs
+ * Description : All-pairs intersection counts
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX-512 VPOPCNTDQ or POPCNT when available
+ *
+ * Co-occurrence counts |Ai ∩ Aj| of n bitsets make a symmetric n x n
+ * matrix, whose diagonal holds the popcounts of the sets. Computing every
+ * count with `bitset_and_popcnt` streams both sets from memory each time,
+ * that is n² / 2 times each set overall.
+ *
+ * Instead, sets are grouped in tiles of BITSET_PAIRS_TILE sets, and atoms
+ * in blocks of BITSET_PAIRS_BLOCK atoms. For every pair of tiles, blocks of
+ * both tiles are loaded once and then combined in all pairs while they are
+ * in L1 cache: every set is read n / BITSET_PAIRS_TILE times instead of n.
+ * Pairs of tiles are handed out to threads dynamically, and each one writes
+ * its own part of the matrix.
+ */
+
+#ifndef _bitset_pairs_h_
+#define _bitset_pairs_h_
+
+#include "bitset/bitset.h"
+
+/* Number of sets per tile */
+#define BITSET_PAIRS_TILE   8
+
+/* Number of atoms per block: two tiles of blocks take 32KB */
+#define BITSET_PAIRS_BLOCK  256
+
+/* Scores derived from intersection counts */
+typedef enum bitset_pairs_score {
+    BITSET_PAIRS_JACCARD,   /* |A ∩ B| / |A ∪ B| */
+    BITSET_PAIRS_COSINE,    /* |A ∩ B| / sqrt(|A| |B|) */
+} bitset_pairs_score_t;
+
+/* Compute |sets[i] ∩ sets[j]| for all i and j with `nthreads` threads, and
+ * store it into counts[i * n + j].
+ * @pre all sets have the same number of atoms
+ */
+void bitset_pairs_count(const bitset_t* const* sets, size_t n,
+                        unsigned nthreads, uint64_t* counts);
+
+/* Compute scores[i * n + j] from the count matrix computed by
+ * `bitset_pairs_count`. Scores involving an empty set are 0.
+ */
+void bitset_pairs_scores(const uint64_t* counts, size_t n,
+                         bitset_pairs_score_t score, double* scores);
+
+#endif
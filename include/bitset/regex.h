@@ -0,0 +1,78 @@
+/* Module      : bitset/regex
+ * Description : Bit-parallel regular expression matching
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * Patterns are compiled to a Glushkov automaton: one state per character
+ * class of the pattern, plus an initial state 0. Such an automaton has no
+ * epsilon transitions, and every transition to a state is labeled with the
+ * class of this state, so that the set D of active states is updated for a
+ * byte c with
+ *
+ *      D = Follow(D) & B[c]
+ *
+ * where B[c] is the set of states whose class contains c. Follow(D) is
+ * mostly a shift: in a pattern without alternations nor repetitions, state
+ * i is followed by state i + 1 only. Only the other transitions, from
+ * "irregular" states, are looked up in tables.
+ *
+ * When all states fit in an atom, D is a single atom and the tables are
+ * indexed by bytes of D & irregular. Otherwise, D spans several atoms and
+ * is shifted with carries, and follow sets of irregular states are or-ed
+ * one at a time. In both cases, while no state but the initial one is
+ * active, bytes that can not start a match are skipped with a lookup.
+ *
+ * Supported syntax: literals, `.` (any byte but newline), classes `[a-z]`
+ * and `[^...]`, escapes `\d`, `\w`, `\s`, `\n`, `\t` and `\` followed by a
+ * punctuation character, groups `( )`, alternation `|`, repetitions `*`,
+ * `+` and `?`, and anchors `^` and `$` at the start and end of the pattern.
+ */
+
+#ifndef _bitset_regex_h_
+#define _bitset_regex_h_
+
+#include "bitset/bitset.h"
+
+typedef struct bitset_regex {
+    size_t         nstates;     /* Number of states, initial one included */
+    size_t         natoms;      /* Number of atoms of a set of states */
+    int            anchor_start;
+    int            anchor_end;
+    bitset_atom_t *classes;     /* B[c] for each byte c */
+    bitset_atom_t *shift;       /* States i + 1 following state i */
+    bitset_atom_t *irregular;   /* States with other transitions */
+    bitset_atom_t *follow;      /* Other transitions of each state */
+    bitset_atom_t *final;       /* Final states */
+    bitset_atom_t *first;       /* States following the initial state */
+    bitset_atom_t  starts[4];   /* Bytes entering a first state */
+    bitset_atom_t *table;       /* Single atom: follow sets of bytes of D */
+} bitset_regex_t;
+
+/* Compile `pattern`.
+ * @return not 0 if `pattern` is invalid or memory allocation failed.
+ */
+int bitset_regex_compile(bitset_regex_t* re, const char* pattern);
+
+/* Wipe a compiled pattern.
+ * @pre `re` must have been compiled.
+ */
+void bitset_regex_wipe(bitset_regex_t* re);
+
+/* Return 1 if `re` matches somewhere in the `len` bytes of `text`, 0
+ * otherwise.
+ */
+int bitset_regex_match(const bitset_regex_t* re, const char* text,
+                       size_t len);
+
+/* Match `re` against every line of the `len` bytes of `text`, and set bit
+ * i of `matches` if the i-th line matches. Lines are separated by '\n'.
+ * @pre `matches` has at least as many bits as `text` has lines
+ * @return the number of lines matching.
+ */
+size_t bitset_regex_match_lines(const bitset_regex_t* re, const char* text,
+                                size_t len, bitset_t* matches);
+
+#endif
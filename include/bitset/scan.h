@@ -0,0 +1,73 @@
+/* Module      : bitset/scan
+ * Description : Column predicates evaluated into bitsets
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX2 or AVX-512 when available
+ *
+ * A scan compares every value of a column against constants, and stores
+ * into a bitset one bit per row, set if the row matches. Bits are not set
+ * one by one: values are compared a vector at a time into a mask (an
+ * AVX-512 mask register, or the AVX2 sign bits), and masks are assembled
+ * into whole atoms before being stored, so that scans run at memory speed.
+ *
+ * Every comparison of integers is turned into a range [lo, hi], possibly
+ * negated, that a value v is in when the unsigned difference v - lo is at
+ * most hi - lo: a single compare per value. Ranges of floats take two
+ * compares; strict bounds become the next float inside. Comparisons of
+ * floats follow C: NaN matches nothing but BITSET_SCAN_NE.
+ *
+ * Sets of values are tested one member at a time, for a cost linear in
+ * their size: they should be small.
+ */
+
+#ifndef _bitset_scan_h_
+#define _bitset_scan_h_
+
+#include "bitset/bitset.h"
+
+/* Comparison of a value with a constant x */
+typedef enum bitset_scan_op {
+    BITSET_SCAN_LT,     /* value < x */
+    BITSET_SCAN_LE,     /* value <= x */
+    BITSET_SCAN_GT,     /* value > x */
+    BITSET_SCAN_GE,     /* value >= x */
+    BITSET_SCAN_EQ,     /* value == x */
+    BITSET_SCAN_NE,     /* value != x */
+} bitset_scan_op_t;
+
+/* Set bit i of `dest` if col[i] `op` x, and unset it otherwise, for i below
+ * dest->nbits.
+ * @pre `col` holds dest->nbits values
+ */
+void bitset_scan_i32(bitset_t* dest, const int32_t* col, bitset_scan_op_t op,
+                     int32_t x);
+void bitset_scan_i64(bitset_t* dest, const int64_t* col, bitset_scan_op_t op,
+                     int64_t x);
+void bitset_scan_f32(bitset_t* dest, const float* col, bitset_scan_op_t op,
+                     float x);
+
+/* Set bit i of `dest` if lo <= col[i] <= hi, and unset it otherwise, for i
+ * below dest->nbits.
+ * @pre `col` holds dest->nbits values
+ */
+void bitset_scan_between_i32(bitset_t* dest, const int32_t* col,
+                             int32_t lo, int32_t hi);
+void bitset_scan_between_i64(bitset_t* dest, const int64_t* col,
+                             int64_t lo, int64_t hi);
+void bitset_scan_between_f32(bitset_t* dest, const float* col,
+                             float lo, float hi);
+
+/* Set bit i of `dest` if col[i] is one of the `nset` values of `set`, and
+ * unset it otherwise, for i below dest->nbits.
+ * @pre `col` holds dest->nbits values
+ */
+void bitset_scan_in_i32(bitset_t* dest, const int32_t* col,
+                        const int32_t* set, size_t nset);
+void bitset_scan_in_i64(bitset_t* dest, const int64_t* col,
+                        const int64_t* set, size_t nset);
+void bitset_scan_in_f32(bitset_t* dest, const float* col,
+                        const float* set, size_t nset);
+
+#endif
@@ -0,0 +1,110 @@
+/* Module      : bitset/shm
+ * Description : POSIX shared-memory backed bitsets
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A shared bitset lives in a POSIX shared memory object (see shm_open(3)),
+ * so that several processes can map the same atoms instead of building one
+ * private copy each. The object starts with a small header holding the
+ * number of bits, followed by the atoms.
+ *
+ * Once created or attached, a shared bitset is a plain `bitset_t` and can be
+ * given to every read-only function of `bitset/bitset.h`. It must however be
+ * released with `bitset_shm_detach`, never with `bitset_wipe`, and it cannot
+ * be resized.
+ *
+ * When several processes write into the same bitset, they must use the
+ * `bitset_atomic_*` functions, which update atoms with atomic instructions.
+ */
+
+#ifndef _bitset_shm_h_
+#define _bitset_shm_h_
+
+#include "bitset/bitset.h"
+
+/* Map the bitset read-only. Any write into it will raise SIGSEGV. */
+#define BITSET_SHM_RDONLY       0x1
+
+/* Create a new shared bitset called `name` with `nbits` bits, all unset, and
+ * map it into `bs`. `name` follows shm_open(3) rules ("/something").
+ * @return not 0 if the creation failed (for instance if `name` exists).
+ */
+int bitset_shm_create(bitset_t* bs, const char* name, size_t nbits);
+
+/* Attach to the existing shared bitset `name`. `flags` is 0 or
+ * BITSET_SHM_RDONLY.
+ * @return not 0 if the object doesn't exist or isn't a shared bitset.
+ */
+int bitset_shm_attach(bitset_t* bs, const char* name, int flags);
+
+/* Unmap a bitset created or attached with functions above. The shared object
+ * itself stays alive until `bitset_shm_unlink` is called.
+ */
+void bitset_shm_detach(bitset_t* bs);
+
+/* Remove the shared bitset `name`. Processes still attached to it keep
+ * their mapping.
+ * @return not 0 if the removal failed.
+ */
+int bitset_shm_unlink(const char* name);
+
+/* {{{ Atomic operations */
+
+/* Atomically set the bit `bit` of `bs`.
+ * @pre bit < bs->nbits
+ */
+inline void bitset_atomic_set(bitset_t* bs, size_t bit) {
+    assert (bit < bs->nbits);
+    __atomic_fetch_or(&bs->bits[bit / BITS_PER_ATOM],
+                      (bitset_atom_t)1 << (bit % BITS_PER_ATOM),
+                      __ATOMIC_RELAXED);
+}
+
+/* Atomically unset the bit `bit` of `bs`.
+ * @pre bit < bs->nbits
+ */
+inline void bitset_atomic_unset(bitset_t* bs, size_t bit) {
+    assert (bit < bs->nbits);
+    __atomic_fetch_and(&bs->bits[bit / BITS_PER_ATOM],
+                       ~((bitset_atom_t)1 << (bit % BITS_PER_ATOM)),
+                       __ATOMIC_RELAXED);
+}
+
+/* Atomically read the bit `bit` of `bs`.
+ * @pre bit < bs->nbits
+ */
+inline bit_t bitset_atomic_get(const bitset_t* bs, size_t bit) {
+    assert (bit < bs->nbits);
+    bitset_atom_t atom = __atomic_load_n(&bs->bits[bit / BITS_PER_ATOM],
+                                         __ATOMIC_RELAXED);
+    return (atom >> (bit % BITS_PER_ATOM)) & 1;
+}
+
+/* Atomically set the bit `bit` of `bs` and return its previous state. Only
+ * one of concurrent callers on the same bit gets 0.
+ * @pre bit < bs->nbits
+ */
+inline bit_t bitset_atomic_test_and_set(bitset_t* bs, size_t bit) {
+    assert (bit < bs->nbits);
+    bitset_atom_t mask = (bitset_atom_t)1 << (bit % BITS_PER_ATOM);
+    bitset_atom_t old = __atomic_fetch_or(&bs->bits[bit / BITS_PER_ATOM],
+                                          mask, __ATOMIC_ACQ_REL);
+    return (old & mask) != 0;
+}
+
+/* Do the and (intersection) of `a` and `b` into `a`, each atom of `a` being
+ * updated atomically. The whole operation is not atomic.
+ */
+void bitset_atomic_and(bitset_t* a, const bitset_t* b);
+
+/* Do the or (union) of `a` and `b` into `a`, each atom of `a` being updated
+ * atomically. The whole operation is not atomic.
+ */
+void bitset_atomic_or(bitset_t* a, const bitset_t* b);
+
+/* }}} */
+
+#endif
@@ -0,0 +1,108 @@
+/* Module      : bitset/stream
+ * Description : Double-buffered streaming over bitset images
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A stream runs a kernel over the atoms of one or more images (see
+ * `bitset/image.h`) that are not resident in memory, one block at a time.
+ * A dedicated I/O thread reads following blocks into a ring of `depth`
+ * buffers while the calling thread runs the kernel on the current one, so
+ * neither the CPU waits on the disk nor the disk on the CPU, as long as the
+ * ring doesn't run empty or full.
+ *
+ * When an output image is given, the kernel writes its result in place of
+ * the first operand block, and the I/O thread writes it back before reusing
+ * the buffer. The output is written to a temporary file with its CRC table,
+ * synced and renamed, like `bitset_save` does. Blocks of inputs having a
+ * CRC table are verified by the I/O thread as they are read.
+ *
+ * After each run, the stream holds the time spent in I/O, in the kernel and
+ * in total. `bitset_stream_overlap` derives from them how much of the
+ * shortest of the two was hidden behind the other.
+ */
+
+#ifndef _bitset_stream_h_
+#define _bitset_stream_h_
+
+#include "bitset/bitset.h"
+
+/* Default size of a block in bytes */
+#define BITSET_STREAM_BLOCK_SIZE    (4 << 20)
+
+/* Default number of buffered blocks */
+#define BITSET_STREAM_DEPTH         4
+
+/* Maximum number of operands of a stream */
+#define BITSET_STREAM_MAX_INPUTS    8
+
+/* Process `natoms` atoms starting at atom `atom` of each input.
+ * `blocks[0]` may be overwritten with the result of the kernel.
+ * Returning not 0 stops the stream with an error.
+ */
+typedef int (*bitset_stream_kernel_t)(bitset_atom_t** blocks, size_t natoms,
+                                      size_t atom, void* arg);
+
+typedef struct bitset_stream {
+    size_t   block_size;    /* Bytes per block, a multiple of 4096 */
+    unsigned depth;         /* Number of blocks in the ring, at least 2 */
+
+    /* Statistics of the last run, in seconds */
+    double   io_time;       /* Spent reading and writing blocks */
+    double   cpu_time;      /* Spent in the kernel */
+    double   wall_time;     /* Elapsed */
+    size_t   nblocks;       /* Number of blocks processed */
+} bitset_stream_t;
+
+/* Initialize a stream. `block_size` is rounded up to a multiple of 4096,
+ * and `depth` to 2. 0 selects defaults.
+ */
+void bitset_stream_init(bitset_stream_t* s, size_t block_size, unsigned depth);
+
+/* Return the overlap efficiency of the last run: 1 if the I/O and the
+ * kernel ran fully in parallel, 0 if they ran one after the other.
+ */
+double bitset_stream_overlap(const bitset_stream_t* s);
+
+/* Run `kernel` over the `nin` images `inputs`, which must have the same
+ * number of bits. If `output` is not NULL, the first block of each step is
+ * written into a new image replacing `output` atomically.
+ * @pre 1 <= nin <= BITSET_STREAM_MAX_INPUTS
+ * @return not 0 on I/O error, if an input doesn't match its CRCs, or if
+ * the kernel failed.
+ */
+int bitset_stream_run(bitset_stream_t* s, const char* output,
+                      const char** inputs, size_t nin,
+                      bitset_stream_kernel_t kernel, void* arg);
+
+/* Count number of bits set in the image `path`, or return -1 on error.
+ */
+long long bitset_stream_popcnt(bitset_stream_t* s, const char* path);
+
+/* Count number of bits set in the intersection of images `a` and `b`, or
+ * return -1 on error.
+ */
+long long bitset_stream_and_popcnt(bitset_stream_t* s, const char* a,
+                                   const char* b);
+
+/* Count number of bits set in the union of images `a` and `b`, or return
+ * -1 on error.
+ */
+long long bitset_stream_or_popcnt(bitset_stream_t* s, const char* a,
+                                  const char* b);
+
+/* Write the and (intersection) of images `a` and `b` into image `dest`.
+ * @return not 0 on error.
+ */
+int bitset_stream_and_to(bitset_stream_t* s, const char* dest, const char* a,
+                         const char* b);
+
+/* Write the or (union) of images `a` and `b` into image `dest`.
+ * @return not 0 on error.
+ */
+int bitset_stream_or_to(bitset_stream_t* s, const char* dest, const char* a,
+                        const char* b);
+
+#endif
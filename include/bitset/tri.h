@@ -0,0 +1,125 @@
+/* Module      : bitset/tri
+ * Description : Vectors of three-valued (Kleene) states
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX, x86 AVX2 when available
+ *
+ * A tri-state vector stores for each element whether it is known true,
+ * known false, or unknown. Two bits per element are interleaved in the
+ * atoms: element i has its "true" bit at 2 * i and its "false" bit at
+ * 2 * i + 1, both unset meaning unknown. An atom holds 32 elements.
+ *
+ * With this layout Kleene logic is bit-parallel over whole atoms:
+ *
+ * - a AND b is true if both are true, false if any is false;
+ * - a OR b is true if any is true, false if both are false;
+ * - NOT a swaps the true and false bits.
+ *
+ * so that a single pass over one array replaces passes over two parallel
+ * bitsets.
+ */
+
+#ifndef _bitset_tri_h_
+#define _bitset_tri_h_
+
+#include "bitset/bitset.h"
+
+/* Number of elements per atom */
+#define BITSET_TRI_PER_ATOM     (BITS_PER_ATOM / 2)
+
+/* Mask of the "true" bits of an atom, the "false" ones being shifted by 1 */
+#define BITSET_TRI_TRUE_MASK    ((bitset_atom_t)0x5555555555555555ULL)
+
+typedef enum bitset_tri_state {
+    BITSET_TRI_UNKNOWN = 0,
+    BITSET_TRI_TRUE    = 1,
+    BITSET_TRI_FALSE   = 2,
+} bitset_tri_state_t;
+
+typedef struct bitset_tri {
+    size_t         n;       /* Number of elements */
+    size_t         natoms;  /* Number of atoms */
+    bitset_atom_t *atoms;
+} bitset_tri_t;
+
+/* Initialize a vector of `n` unknown elements.
+ * @return not 0 if initialization failed.
+ */
+int bitset_tri_init(bitset_tri_t* t, size_t n);
+
+/* Initialize a vector of `n` elements, true where `trues` has bits set,
+ * false where `falses` has bits set, and unknown elsewhere.
+ * @pre trues->nbits == falses->nbits, and they have no bit set in common
+ * @return not 0 if initialization failed.
+ */
+int bitset_tri_from_bitsets(bitset_tri_t* t, const bitset_t* trues,
+                            const bitset_t* falses);
+
+/* Wipe a vector.
+ * @pre `t` must have been initialized.
+ */
+void bitset_tri_wipe(bitset_tri_t* t);
+
+/* Return the state of the i-th element of `t`.
+ * @pre i < t->n
+ */
+inline bitset_tri_state_t bitset_tri_get(const bitset_tri_t* t, size_t i) {
+    assert (i < t->n);
+    unsigned shift = 2 * (i % BITSET_TRI_PER_ATOM);
+    return (t->atoms[i / BITSET_TRI_PER_ATOM] >> shift) & 3;
+}
+
+/* Set the state of the i-th element of `t`.
+ * @pre i < t->n
+ */
+inline void bitset_tri_set(bitset_tri_t* t, size_t i,
+                           bitset_tri_state_t state)
+{
+    assert (i < t->n);
+    unsigned shift = 2 * (i % BITSET_TRI_PER_ATOM);
+    bitset_atom_t* atom = &t->atoms[i / BITSET_TRI_PER_ATOM];
+    *atom = (*atom & ~((bitset_atom_t)3 << shift))
+          | ((bitset_atom_t)state << shift);
+}
+
+/* Return the number of elements of `t` in state `state`.
+ */
+size_t bitset_tri_count(const bitset_tri_t* t, bitset_tri_state_t state);
+
+/* Count elements of `t` per state, in a single pass. `counts` is indexed by
+ * states.
+ */
+void bitset_tri_counts(const bitset_tri_t* t, size_t counts[3]);
+
+/* Store the Kleene AND of `a` and `b` into `dest`.
+ * @pre dest->n == a->n == b->n
+ */
+void bitset_tri_and_to(bitset_tri_t* dest, const bitset_tri_t* a,
+                       const bitset_tri_t* b);
+
+/* Store the Kleene OR of `a` and `b` into `dest`.
+ * @pre dest->n == a->n == b->n
+ */
+void bitset_tri_or_to(bitset_tri_t* dest, const bitset_tri_t* a,
+                      const bitset_tri_t* b);
+
+/* Store the Kleene NOT of `a` into `dest`.
+ * @pre dest->n == a->n
+ */
+void bitset_tri_not_to(bitset_tri_t* dest, const bitset_tri_t* a);
+
+/* Do the Kleene AND of `a` and `b`, and store the result into `a`.
+ */
+void bitset_tri_and(bitset_tri_t* a, const bitset_tri_t* b);
+
+/* Do the Kleene OR of `a` and `b`, and store the result into `a`.
+ */
+void bitset_tri_or(bitset_tri_t* a, const bitset_tri_t* b);
+
+/* Do the Kleene NOT of `a`, in place.
+ */
+void bitset_tri_not(bitset_tri_t* a);
+
+#endif
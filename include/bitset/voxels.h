@@ -0,0 +1,122 @@
+/* Module      : bitset/voxels
+ * Description : Three-dimensional voxel occupancy
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * Voxels are grouped in bricks of 4 x 4 x 4 voxels, each brick being one
+ * atom whose bit x + 4 y + 16 z is voxel (x, y, z) of the brick. Bricks are
+ * stored in Morton (Z) order: the bits of their coordinates are interleaved
+ * to make their index, so that bricks close in space are mostly close in
+ * memory. Axes of different sizes are padded to powers of two each, and
+ * interleaved while they have bits left.
+ *
+ * A summary bitset has one bit per block of 4 x 4 x 4 bricks, set when a
+ * brick of the block is not empty. Box queries and ray traversal skip empty
+ * blocks with the summary, then empty bricks with their atom, before looking
+ * at voxels. Box queries fill, count and test whole bricks with a mask.
+ *
+ * Rays are traversed with a 3D DDA (Amanatides and Woo), which visits every
+ * voxel the ray goes through. Over an empty brick or block, it jumps to the
+ * first voxel after it at once.
+ */
+
+#ifndef _bitset_voxels_h_
+#define _bitset_voxels_h_
+
+#include "bitset/bitset.h"
+
+/* Voxels per brick side */
+#define BITSET_VOXELS_BRICK 4
+
+/* Voxels per block side */
+#define BITSET_VOXELS_BLOCK 16
+
+typedef struct bitset_voxels {
+    size_t    n[3];         /* Voxels per axis */
+    size_t    nbricks[3];   /* Bricks per axis */
+    size_t    nblocks[3];   /* Blocks per axis */
+    size_t   *morton[3];    /* Morton bits of brick coordinates, per axis */
+    bitset_t  bricks;       /* One atom per brick, in Morton order */
+    bitset_t  summary;      /* Non empty blocks, x first */
+} bitset_voxels_t;
+
+/* Initialize an empty volume of `nx` x `ny` x `nz` voxels.
+ * @return not 0 if initialization failed.
+ */
+int bitset_voxels_init(bitset_voxels_t* v, size_t nx, size_t ny, size_t nz);
+
+/* Wipe a volume.
+ * @pre `v` must have been initialized.
+ */
+void bitset_voxels_wipe(bitset_voxels_t* v);
+
+/* Return the atom of the brick of voxel (x, y, z).
+ * @pre x < v->n[0], y < v->n[1], z < v->n[2]
+ */
+inline bitset_atom_t* bitset_voxels_brick(const bitset_voxels_t* v,
+                                          size_t x, size_t y, size_t z)
+{
+    assert (x < v->n[0] && y < v->n[1] && z < v->n[2]);
+    size_t code = v->morton[0][x / BITSET_VOXELS_BRICK]
+                | v->morton[1][y / BITSET_VOXELS_BRICK]
+                | v->morton[2][z / BITSET_VOXELS_BRICK];
+    return &v->bricks.bits[code];
+}
+
+/* Return the bit of voxel (x, y, z) in its brick. */
+inline unsigned bitset_voxels_bit(size_t x, size_t y, size_t z) {
+    return x % 4 + 4 * (y % 4) + 16 * (z % 4);
+}
+
+/* Return the state of voxel (x, y, z).
+ * @pre x < v->n[0], y < v->n[1], z < v->n[2]
+ */
+inline bit_t bitset_voxels_get(const bitset_voxels_t* v,
+                               size_t x, size_t y, size_t z)
+{
+    bitset_atom_t brick = *bitset_voxels_brick(v, x, y, z);
+    return (brick >> bitset_voxels_bit(x, y, z)) & 1;
+}
+
+/* Set voxel (x, y, z).
+ * @pre x < v->n[0], y < v->n[1], z < v->n[2]
+ */
+void bitset_voxels_set(bitset_voxels_t* v, size_t x, size_t y, size_t z);
+
+/* Unset voxel (x, y, z).
+ * @pre x < v->n[0], y < v->n[1], z < v->n[2]
+ */
+void bitset_voxels_unset(bitset_voxels_t* v, size_t x, size_t y, size_t z);
+
+/* Set the voxels of the box [lo[0], hi[0]) x [lo[1], hi[1]) x [lo[2], hi[2]),
+ * clipped to the volume.
+ */
+void bitset_voxels_fill_box(bitset_voxels_t* v, const size_t lo[3],
+                            const size_t hi[3]);
+
+/* Return the number of voxels set in the box [lo, hi), clipped to the
+ * volume.
+ */
+size_t bitset_voxels_count_box(const bitset_voxels_t* v, const size_t lo[3],
+                               const size_t hi[3]);
+
+/* Return 1 if a voxel is set in the box [lo, hi), clipped to the volume, 0
+ * otherwise.
+ */
+int bitset_voxels_any_box(const bitset_voxels_t* v, const size_t lo[3],
+                          const size_t hi[3]);
+
+/* Cast the ray origin + t dir, for t in [0, tmax], voxel (x, y, z) spanning
+ * [x, x + 1) x [y, y + 1) x [z, z + 1). If it goes through a voxel set, store
+ * the first one into `hit` and the value of t where the ray enters it into
+ * `t`.
+ * @return 1 if the ray hits a voxel set, 0 otherwise.
+ */
+int bitset_voxels_raycast(const bitset_voxels_t* v, const double origin[3],
+                          const double dir[3], double tmax, size_t hit[3],
+                          double* t);
+
+#endif
@@ -0,0 +1,106 @@
+/* Module      : bitset/wal
+ * Description : Crash-consistent persistent bitsets
+ * Copyright   : (c) Timothée Napoli, 2016
+ * License     : WTFPL
+ * Maintainer  : timothee.napoli@laposte.net
+ * Stability   : experimental
+ * Portability : POSIX
+ *
+ * A durable bitset keeps its state in memory, an image file (see
+ * `bitset/image.h`) holding the last checkpoint, and an append-only
+ * write-ahead log (`<path>.wal`) holding every update done since.
+ *
+ * Updates are first buffered in memory, then written to the log and synced
+ * in one go by `bitset_durable_commit` (group commit): the cost of fdatasync
+ * is shared by every update of the batch. A batch is committed on its own
+ * when it grows over `batch_max` bytes.
+ *
+ * `bitset_durable_checkpoint` writes the current state into the image and
+ * truncates the log. It is done automatically by commits that make the log
+ * grow over `wal_max` bytes, so that it is replayed in bounded time.
+ * Opening a durable bitset loads the image and replays the log, dropping a
+ * torn record at its end. A new image is written aside and renamed into
+ * place, so that a crash never leaves one without a header.
+ *
+ * Every logged update maps each bit x to (x & m) | c for some m and c, and
+ * so does any sequence of them. Such functions are idempotent, so replaying
+ * the log over an image partially written by an interrupted checkpoint still
+ * gives the committed state: each bit is either old, and gets updated, or
+ * already new, and doesn't change.
+ */
+
+#ifndef _bitset_wal_h_
+#define _bitset_wal_h_
+
+#include "bitset/bitset.h"
+
+/* Default size of a batch before it is committed automatically */
+#define BITSET_WAL_BATCH_MAX        (1 << 20)
+
+/* Default size of the log before a checkpoint is done automatically */
+#define BITSET_WAL_CHECKPOINT_MAX   (64 << 20)
+
+typedef struct bitset_durable {
+    bitset_t       bs;          /* Current state, may be read directly */
+    int            image_fd;
+    int            wal_fd;
+    uint64_t       wal_size;    /* Bytes committed in the log */
+    unsigned char *batch;       /* Pending (not committed) records */
+    size_t         batch_len;
+    size_t         batch_cap;
+    size_t         batch_max;   /* Automatic commit threshold */
+    uint64_t       wal_max;     /* Automatic checkpoint threshold, 0: none */
+} bitset_durable_t;
+
+/* Open the durable bitset stored at `path`, creating it with `nbits` bits if
+ * it doesn't exist. An existing bitset is recovered from its image and its
+ * log, and `nbits` must then match its size.
+ * @return not 0 if opening or recovery failed.
+ */
+int bitset_durable_open(bitset_durable_t* d, const char* path, size_t nbits);
+
+/* Commit pending updates and close `d`.
+ * @return not 0 if the final commit failed.
+ */
+int bitset_durable_close(bitset_durable_t* d);
+
+/* Set the bit `bit` of `d`. The update is durable after the next commit.
+ * @pre bit < d->bs.nbits
+ * @return not 0 if an automatic commit failed.
+ */
+int bitset_durable_set(bitset_durable_t* d, size_t bit);
+
+/* Unset the bit `bit` of `d`. The update is durable after the next commit.
+ * @pre bit < d->bs.nbits
+ * @return not 0 if an automatic commit failed.
+ */
+int bitset_durable_unset(bitset_durable_t* d, size_t bit);
+
+/* Do the and (intersection) of `d` and `b`, and store the result into `d`.
+ * `b` is entirely logged.
+ * @pre d->bs.natoms == b->natoms
+ * @return not 0 if an automatic commit failed.
+ */
+int bitset_durable_and(bitset_durable_t* d, const bitset_t* b);
+
+/* Do the or (union) of `d` and `b`, and store the result into `d`.
+ * `b` is entirely logged.
+ * @pre d->bs.natoms == b->natoms
+ * @return not 0 if an automatic commit failed.
+ */
+int bitset_durable_or(bitset_durable_t* d, const bitset_t* b);
+
+/* Write pending updates to the log and sync it. Once it returns 0, every
+ * update done before is durable. A checkpoint follows if the log is then
+ * over d->wal_max bytes.
+ * @return not 0 if writing or syncing failed, or the checkpoint failed.
+ */
+int bitset_durable_commit(bitset_durable_t* d);
+
+/* Commit pending updates, write the current state into the image and empty
+ * the log.
+ * @return not 0 if the checkpoint failed. The log is kept in such case.
+ */
+int bitset_durable_checkpoint(bitset_durable_t* d);
+
+#endif
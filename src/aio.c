@@ -0,0 +1,768 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifdef BITSET_HAVE_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include "bitset/aio.h"
+#include "bitset/crc32c.h"
+#include "bitset/image.h"
+#include "io.h"
+
+/* Alignment of buffers, offsets and lengths for O_DIRECT */
+#define BITSET_AIO_ALIGN        4096
+
+#define BITSET_AIO_ROUND_UP(_n) \
+    (((_n) + BITSET_AIO_ALIGN - 1) / BITSET_AIO_ALIGN * BITSET_AIO_ALIGN)
+
+/* Maximum number of threads of the fallback pool */
+#define BITSET_AIO_MAX_THREADS  8
+
+struct bitset_aio {
+    unsigned          depth;
+    unsigned          inflight;
+    int               flags;
+    int               uring;
+    bitset_aio_req_t *active;   /* Requests with chunks left to submit */
+
+#ifdef BITSET_HAVE_IO_URING
+    struct {
+        int                  fd;
+        void                *sq_ptr;
+        size_t               sq_size;
+        void                *cq_ptr;
+        size_t               cq_size;
+        struct io_uring_sqe *sqes;
+        size_t               sqes_size;
+        unsigned            *sq_tail;
+        unsigned            *sq_mask;
+        unsigned            *sq_array;
+        unsigned            *cq_head;
+        unsigned            *cq_tail;
+        unsigned            *cq_mask;
+        struct io_uring_cqe *cqes;
+        unsigned             to_submit;
+    } ring;
+#endif
+
+    /* Fallback thread pool */
+    pthread_t          *threads;
+    unsigned            nthreads;
+    pthread_mutex_t     lock;
+    pthread_cond_t      job_cond;
+    pthread_cond_t      done_cond;
+    bitset_aio_chunk_t *jobs;
+    bitset_aio_chunk_t *jobs_tail;
+    bitset_aio_chunk_t *done;
+    int                 stop;
+};
+
+/* {{{ Chunk geometry */
+
+static off_t bitset_aio_chunk_offset(size_t index) {
+    return BITSET_IMAGE_HEADER_SIZE + (off_t)index * BITSET_AIO_CHUNK_SIZE;
+}
+
+/* Number of payload bytes of a chunk */
+static size_t bitset_aio_chunk_len(const bitset_aio_req_t* req, size_t index) {
+    size_t left = req->payload - index * BITSET_AIO_CHUNK_SIZE;
+    return left < BITSET_AIO_CHUNK_SIZE ? left : BITSET_AIO_CHUNK_SIZE;
+}
+
+/* Completions of cancels, which are not chunks */
+static bitset_aio_chunk_t bitset_aio_cancel;
+
+static void bitset_aio_complete(bitset_aio_t* aio, bitset_aio_chunk_t* chunk);
+
+/* }}} */
+/* {{{ io_uring backend */
+
+#ifdef BITSET_HAVE_IO_URING
+
+static int bitset_aio_uring_init(bitset_aio_t* aio) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, aio->depth, &p);
+    if (fd < 0) {
+        return -1;
+    }
+    aio->ring.fd = fd;
+    aio->ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    aio->ring.cq_size = p.cq_off.cqes
+                      + p.cq_entries * sizeof(struct io_uring_cqe);
+    aio->ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    aio->ring.sq_ptr = mmap(NULL, aio->ring.sq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (aio->ring.sq_ptr == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    aio->ring.cq_ptr = mmap(NULL, aio->ring.cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    aio->ring.sqes = mmap(NULL, aio->ring.sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (aio->ring.cq_ptr == MAP_FAILED || aio->ring.sqes == MAP_FAILED) {
+        if (aio->ring.cq_ptr != MAP_FAILED) {
+            munmap(aio->ring.cq_ptr, aio->ring.cq_size);
+        }
+        munmap(aio->ring.sq_ptr, aio->ring.sq_size);
+        close(fd);
+        return -1;
+    }
+
+    char* sq = aio->ring.sq_ptr;
+    char* cq = aio->ring.cq_ptr;
+    aio->ring.sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    aio->ring.sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    aio->ring.sq_array = (unsigned*)(sq + p.sq_off.array);
+    aio->ring.cq_head = (unsigned*)(cq + p.cq_off.head);
+    aio->ring.cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    aio->ring.cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    aio->ring.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    aio->ring.to_submit = 0;
+    return 0;
+}
+
+static void bitset_aio_uring_wipe(bitset_aio_t* aio) {
+    munmap(aio->ring.sqes, aio->ring.sqes_size);
+    munmap(aio->ring.cq_ptr, aio->ring.cq_size);
+    munmap(aio->ring.sq_ptr, aio->ring.sq_size);
+    close(aio->ring.fd);
+}
+
+/* Queue `sqe` at the tail of the submission ring. */
+static void bitset_aio_uring_queue(bitset_aio_t* aio,
+                                   const struct io_uring_sqe* sqe)
+{
+    unsigned tail = *aio->ring.sq_tail;
+    unsigned idx = tail & *aio->ring.sq_mask;
+    aio->ring.sqes[idx] = *sqe;
+    aio->ring.sq_array[idx] = idx;
+    __atomic_store_n(aio->ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    aio->ring.to_submit++;
+}
+
+static void bitset_aio_uring_push(bitset_aio_t* aio, bitset_aio_chunk_t* chunk)
+{
+    struct io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = chunk->req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe.fd = chunk->req->fd;
+    sqe.addr = (uint64_t)(uintptr_t)&chunk->iov;
+    sqe.len = 1;
+    sqe.off = bitset_aio_chunk_offset(chunk->index);
+    sqe.user_data = (uint64_t)(uintptr_t)chunk;
+    bitset_aio_uring_queue(aio, &sqe);
+}
+
+/* Submit queued entries, and wait for `min_complete` completions.
+ * @return 1 if the kernel is out of resources or has completions to be
+ * reaped first, in which case entries left to submit go with the next call,
+ * -1 on error, 0 otherwise.
+ */
+static int bitset_aio_uring_enter(bitset_aio_t* aio, unsigned min_complete) {
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        int res = syscall(__NR_io_uring_enter, aio->ring.fd,
+                          aio->ring.to_submit, min_complete, flags, NULL, 0);
+        if (res >= 0) {
+            aio->ring.to_submit -= res;
+            return 0;
+        }
+        if (errno == EAGAIN || errno == EBUSY) {
+            return 1;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static bitset_aio_chunk_t* bitset_aio_uring_reap(bitset_aio_t* aio, int wait)
+{
+    for (;;) {
+        unsigned head = *aio->ring.cq_head;
+        if (head != __atomic_load_n(aio->ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe =
+                &aio->ring.cqes[head & *aio->ring.cq_mask];
+            bitset_aio_chunk_t* chunk =
+                (bitset_aio_chunk_t*)(uintptr_t)cqe->user_data;
+            chunk->res = cqe->res;
+            __atomic_store_n(aio->ring.cq_head, head + 1, __ATOMIC_RELEASE);
+            return chunk;
+        }
+        if (!wait) {
+            return NULL;
+        }
+        int res = bitset_aio_uring_enter(aio, 1);
+        if (res < 0) {
+            return NULL;
+        }
+        // The kernel didn't wait: let it free resources, rather than
+        // spinning on the completion ring until it does.
+        if (res > 0) {
+            struct timespec pause = { 0, 100000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+/* Cancel the chunks of `req` in flight, and reap them, so that the kernel
+ * is done with their buffers and descriptors.
+ * @return not 0 if the ring failed before they were all reaped.
+ */
+static int bitset_aio_uring_cancel(bitset_aio_t* aio, bitset_aio_req_t* req)
+{
+    // Cancels take free entries of the submission ring.
+    if (aio->ring.to_submit
+    &&  (bitset_aio_uring_enter(aio, 0) < 0 || aio->ring.to_submit)) {
+        return -1;
+    }
+    for (unsigned i = 0; i < aio->depth; i++) {
+        bitset_aio_chunk_t* chunk = &req->slots[i];
+        bitset_aio_chunk_t* it = req->free_slots;
+        while (it && it != chunk) {
+            it = it->next;
+        }
+        if (it) {
+            continue;
+        }
+        struct io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = (uint64_t)(uintptr_t)chunk;
+        sqe.user_data = (uint64_t)(uintptr_t)&bitset_aio_cancel;
+        bitset_aio_uring_queue(aio, &sqe);
+        if (bitset_aio_uring_enter(aio, 0) < 0 || aio->ring.to_submit) {
+            return -1;
+        }
+    }
+    while (req->inflight) {
+        bitset_aio_chunk_t* chunk = bitset_aio_uring_reap(aio, 1);
+        if (!chunk) {
+            return -1;
+        }
+        bitset_aio_complete(aio, chunk);
+    }
+    return 0;
+}
+
+#endif
+
+/* }}} */
+/* {{{ Thread pool backend */
+
+static void* bitset_aio_worker(void* arg) {
+    bitset_aio_t* aio = arg;
+
+    pthread_mutex_lock(&aio->lock);
+    for (;;) {
+        while (!aio->stop && !aio->jobs) {
+            pthread_cond_wait(&aio->job_cond, &aio->lock);
+        }
+        if (aio->stop) {
+            break;
+        }
+        bitset_aio_chunk_t* chunk = aio->jobs;
+        aio->jobs = chunk->next;
+        pthread_mutex_unlock(&aio->lock);
+
+        int res;
+        off_t off = bitset_aio_chunk_offset(chunk->index);
+        if (chunk->req->write) {
+            res = bitset_pwrite_all(chunk->req->fd, chunk->iov.iov_base,
+                                    chunk->iov.iov_len, off);
+            res = res < 0 ? -errno : (int)chunk->iov.iov_len;
+        } else {
+            // A direct read of the last chunk may stop at the end of file.
+            size_t got = 0;
+            res = 0;
+            while (got < chunk->iov.iov_len) {
+                ssize_t n = pread(chunk->req->fd,
+                                  (char*)chunk->iov.iov_base + got,
+                                  chunk->iov.iov_len - got, off + got);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    res = n < 0 ? -errno : 0;
+                    break;
+                }
+                got += n;
+            }
+            res = res < 0 ? res : (int)got;
+        }
+        chunk->res = res;
+
+        pthread_mutex_lock(&aio->lock);
+        chunk->next = aio->done;
+        aio->done = chunk;
+        pthread_cond_signal(&aio->done_cond);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return NULL;
+}
+
+static int bitset_aio_pool_init(bitset_aio_t* aio) {
+    aio->jobs = aio->jobs_tail = aio->done = NULL;
+    aio->stop = 0;
+    pthread_mutex_init(&aio->lock, NULL);
+    pthread_cond_init(&aio->job_cond, NULL);
+    pthread_cond_init(&aio->done_cond, NULL);
+
+    aio->nthreads = aio->depth < BITSET_AIO_MAX_THREADS ? aio->depth
+                                                        : BITSET_AIO_MAX_THREADS;
+    aio->threads = malloc(aio->nthreads * sizeof(pthread_t));
+    if (!aio->threads) {
+        aio->nthreads = 0;
+        return -1;
+    }
+    for (unsigned i = 0; i < aio->nthreads; i++) {
+        if (pthread_create(&aio->threads[i], NULL, bitset_aio_worker, aio)) {
+            aio->nthreads = i;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void bitset_aio_pool_wipe(bitset_aio_t* aio) {
+    pthread_mutex_lock(&aio->lock);
+    aio->stop = 1;
+    pthread_cond_broadcast(&aio->job_cond);
+    pthread_mutex_unlock(&aio->lock);
+    for (unsigned i = 0; i < aio->nthreads; i++) {
+        pthread_join(aio->threads[i], NULL);
+    }
+    free(aio->threads);
+    pthread_cond_destroy(&aio->done_cond);
+    pthread_cond_destroy(&aio->job_cond);
+    pthread_mutex_destroy(&aio->lock);
+}
+
+static void bitset_aio_pool_push(bitset_aio_t* aio, bitset_aio_chunk_t* chunk) {
+    pthread_mutex_lock(&aio->lock);
+    chunk->next = NULL;
+    if (aio->jobs) {
+        aio->jobs_tail->next = chunk;
+    } else {
+        aio->jobs = chunk;
+    }
+    aio->jobs_tail = chunk;
+    pthread_cond_signal(&aio->job_cond);
+    pthread_mutex_unlock(&aio->lock);
+}
+
+static bitset_aio_chunk_t* bitset_aio_pool_reap(bitset_aio_t* aio, int wait) {
+    pthread_mutex_lock(&aio->lock);
+    while (wait && !aio->done) {
+        pthread_cond_wait(&aio->done_cond, &aio->lock);
+    }
+    bitset_aio_chunk_t* chunk = aio->done;
+    if (chunk) {
+        aio->done = chunk->next;
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return chunk;
+}
+
+/* }}} */
+/* {{{ Requests */
+
+static void bitset_aio_submit(bitset_aio_t* aio, bitset_aio_req_t* req) {
+    bitset_aio_chunk_t* chunk = req->free_slots;
+    req->free_slots = chunk->next;
+
+    size_t index = req->next++;
+    size_t len = bitset_aio_chunk_len(req, index);
+    char* data = (char*)req->bs->bits + index * BITSET_AIO_CHUNK_SIZE;
+
+    chunk->index = index;
+    chunk->iov.iov_base = data;
+    chunk->iov.iov_len = len;
+    if (req->direct) {
+        // Lengths must be aligned too: loaded bitsets are allocated large
+        // enough, and saved ones use an aligned copy of their last chunk.
+        chunk->iov.iov_len = BITSET_AIO_ROUND_UP(len);
+        if (req->write && req->bounce && index == req->nchunks - 1) {
+            memcpy(req->bounce, data, len);
+            memset((char*)req->bounce + len, 0, chunk->iov.iov_len - len);
+            chunk->iov.iov_base = req->bounce;
+        }
+    }
+
+    req->inflight++;
+    aio->inflight++;
+#ifdef BITSET_HAVE_IO_URING
+    if (aio->uring) {
+        bitset_aio_uring_push(aio, chunk);
+        return;
+    }
+#endif
+    bitset_aio_pool_push(aio, chunk);
+}
+
+/* Submit chunks of active requests in a round-robin way, until the context
+ * is full.
+ */
+static void bitset_aio_fill(bitset_aio_t* aio) {
+    while (aio->active && aio->inflight < aio->depth) {
+        bitset_aio_req_t** it = &aio->active;
+        while (*it && aio->inflight < aio->depth) {
+            bitset_aio_req_t* req = *it;
+            if (req->error || req->next == req->nchunks) {
+                *it = req->next_active;
+                continue;
+            }
+            bitset_aio_submit(aio, req);
+            it = &req->next_active;
+        }
+    }
+#ifdef BITSET_HAVE_IO_URING
+    if (aio->uring && aio->ring.to_submit) {
+        bitset_aio_uring_enter(aio, 0);
+    }
+#endif
+}
+
+static bitset_aio_chunk_t* bitset_aio_reap(bitset_aio_t* aio, int wait) {
+#ifdef BITSET_HAVE_IO_URING
+    if (aio->uring) {
+        return bitset_aio_uring_reap(aio, wait);
+    }
+#endif
+    return bitset_aio_pool_reap(aio, wait);
+}
+
+static void bitset_aio_complete(bitset_aio_t* aio, bitset_aio_chunk_t* chunk) {
+    if (chunk == &bitset_aio_cancel) {
+        return;
+    }
+    bitset_aio_req_t* req = chunk->req;
+    aio->inflight--;
+    req->inflight--;
+    req->done++;
+
+    size_t len = bitset_aio_chunk_len(req, chunk->index);
+    size_t atom = chunk->index * BITSET_AIO_CHUNK_SIZE / sizeof(bitset_atom_t);
+    size_t natoms = len / sizeof(bitset_atom_t);
+    size_t block = chunk->index
+                 * (BITSET_AIO_CHUNK_SIZE / BITSET_CRC32C_BLOCK_SIZE);
+    if (chunk->res < 0 || (size_t)chunk->res < len) {
+        req->error = -1;
+    }
+    if (!req->error && req->crcs) {
+        if (req->write) {
+            bitset_crc32c_blocks(req->bs->bits + atom, natoms,
+                                 req->crcs + block, 1);
+        } else if (bitset_crc32c_verify(req->bs->bits + atom, natoms,
+                                        req->crcs + block, 1) < 0) {
+            req->error = -1;
+        }
+    }
+    if (!req->error && req->cb
+    &&  req->cb(req->bs, atom, natoms, req->arg)) {
+        req->error = -1;
+    }
+    chunk->next = req->free_slots;
+    req->free_slots = chunk;
+}
+
+static int bitset_aio_finished(const bitset_aio_req_t* req) {
+    return req->inflight == 0 && (req->error || req->next == req->nchunks);
+}
+
+/* Common part of load and save: allocate chunk descriptors and queue `req`.
+ */
+static int bitset_aio_start(bitset_aio_t* aio, bitset_aio_req_t* req) {
+    req->nchunks = (req->payload + BITSET_AIO_CHUNK_SIZE - 1)
+                 / BITSET_AIO_CHUNK_SIZE;
+    req->next = req->inflight = req->done = 0;
+    req->error = 0;
+    req->slots = malloc(aio->depth * sizeof(bitset_aio_chunk_t));
+    if (!req->slots) {
+        return -1;
+    }
+    req->free_slots = NULL;
+    for (unsigned i = 0; i < aio->depth; i++) {
+        req->slots[i].req = req;
+        req->slots[i].next = req->free_slots;
+        req->free_slots = &req->slots[i];
+    }
+    req->next_active = aio->active;
+    aio->active = req;
+    bitset_aio_fill(aio);
+    return 0;
+}
+
+/* Open `path`, with O_DIRECT if possible. */
+static int bitset_aio_open(bitset_aio_t* aio, bitset_aio_req_t* req,
+                           const char* path, int flags)
+{
+    req->direct = 0;
+    if (!(aio->flags & BITSET_AIO_NO_DIRECT)) {
+        req->fd = open(path, flags | O_DIRECT, 0644);
+        if (req->fd >= 0) {
+            req->direct = 1;
+            return 0;
+        }
+    }
+    req->fd = open(path, flags, 0644);
+    return req->fd < 0 ? -1 : 0;
+}
+
+/* }}} */
+
+int bitset_aio_init(bitset_aio_t** aiop, unsigned depth, int flags) {
+    bitset_aio_t* aio = calloc(1, sizeof(bitset_aio_t));
+    if (!aio) {
+        return -1;
+    }
+    aio->depth = depth ? depth : 1;
+    aio->flags = flags;
+
+#ifdef BITSET_HAVE_IO_URING
+    if (!(flags & BITSET_AIO_NO_URING) && bitset_aio_uring_init(aio) == 0) {
+        aio->uring = 1;
+        *aiop = aio;
+        return 0;
+    }
+#endif
+    if (bitset_aio_pool_init(aio) < 0) {
+        bitset_aio_pool_wipe(aio);
+        free(aio);
+        return -1;
+    }
+    *aiop = aio;
+    return 0;
+}
+
+void bitset_aio_wipe(bitset_aio_t* aio) {
+#ifdef BITSET_HAVE_IO_URING
+    if (aio->uring) {
+        bitset_aio_uring_wipe(aio);
+        free(aio);
+        return;
+    }
+#endif
+    bitset_aio_pool_wipe(aio);
+    free(aio);
+}
+
+int bitset_aio_uses_uring(const bitset_aio_t* aio) {
+    return aio->uring;
+}
+
+int bitset_aio_load(bitset_aio_t* aio, bitset_aio_req_t* req, bitset_t* bs,
+                    const char* path, bitset_aio_cb_t cb, void* arg)
+{
+    memset(req, 0, sizeof(*req));
+    req->bs = bs;
+    req->cb = cb;
+    req->arg = arg;
+    if (bitset_aio_open(aio, req, path, O_RDONLY) < 0) {
+        return -1;
+    }
+
+    void* header;
+    if (posix_memalign(&header, BITSET_AIO_ALIGN, BITSET_IMAGE_HEADER_SIZE)) {
+        close(req->fd);
+        return -1;
+    }
+    // O_DIRECT needs the whole (aligned) header to be read.
+    const bitset_image_header_t* h = header;
+    if (bitset_pread_all(req->fd, header, BITSET_IMAGE_HEADER_SIZE, 0) < 0
+    ||  h->magic != BITSET_IMAGE_MAGIC || h->version != BITSET_IMAGE_VERSION) {
+        free(header);
+        close(req->fd);
+        return -1;
+    }
+    size_t nbits = h->nbits;
+    if ((h->flags & BITSET_IMAGE_CRC32C) && !(aio->flags & BITSET_AIO_NO_VERIFY)
+    &&  bitset_image_read_crcs(req->fd, h, &req->crcs) < 0) {
+        free(header);
+        close(req->fd);
+        return -1;
+    }
+    free(header);
+
+    bs->nbits = nbits;
+    bs->natoms = BITS_TO_NATOMS(nbits);
+    req->payload = bs->natoms * sizeof(bitset_atom_t);
+    size_t alloc = BITSET_AIO_ROUND_UP(req->payload);
+    if (posix_memalign((void**)&bs->bits, BITSET_AIO_ALIGN,
+                       alloc ? alloc : BITSET_AIO_ALIGN)) {
+        free(req->crcs);
+        close(req->fd);
+        return -1;
+    }
+    if (bitset_aio_start(aio, req) < 0) {
+        free(bs->bits);
+        free(req->crcs);
+        close(req->fd);
+        return -1;
+    }
+    return 0;
+}
+
+int bitset_aio_save(bitset_aio_t* aio, bitset_aio_req_t* req,
+                    const bitset_t* bs, const char* path,
+                    bitset_aio_cb_t cb, void* arg)
+{
+    memset(req, 0, sizeof(*req));
+    req->bs = (bitset_t*)bs;
+    req->cb = cb;
+    req->arg = arg;
+    req->write = 1;
+    req->payload = bs->natoms * sizeof(bitset_atom_t);
+
+    size_t len = strlen(path);
+    req->path = strdup(path);
+    req->tmp_path = malloc(len + sizeof(".tmp"));
+    if (!req->path || !req->tmp_path) {
+        goto error;
+    }
+    memcpy(req->tmp_path, path, len);
+    memcpy(req->tmp_path + len, ".tmp", sizeof(".tmp"));
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if ((uintptr_t)bs->bits % BITSET_AIO_ALIGN != 0) {
+        // Atoms can't be written directly from an unaligned bitset.
+        req->fd = open(req->tmp_path, flags, 0644);
+        if (req->fd < 0) {
+            goto error;
+        }
+    } else if (bitset_aio_open(aio, req, req->tmp_path, flags) < 0) {
+        goto error;
+    }
+
+    void* header;
+    if (posix_memalign(&header, BITSET_AIO_ALIGN, BITSET_IMAGE_HEADER_SIZE)) {
+        goto error_fd;
+    }
+    memset(header, 0, BITSET_IMAGE_HEADER_SIZE);
+    bitset_image_header_init(header, bs->nbits);
+    int res = bitset_pwrite_all(req->fd, header, BITSET_IMAGE_HEADER_SIZE, 0);
+    free(header);
+    if (res < 0) {
+        goto error_fd;
+    }
+
+    size_t nblocks = BITSET_CRC32C_NBLOCKS(bs->natoms);
+    req->crcs = malloc((nblocks ? nblocks : 1) * sizeof(uint32_t));
+    if (!req->crcs) {
+        goto error_fd;
+    }
+    if (req->direct && req->payload % BITSET_AIO_ALIGN != 0) {
+        size_t last = req->payload % BITSET_AIO_CHUNK_SIZE;
+        if (posix_memalign(&req->bounce, BITSET_AIO_ALIGN,
+                           BITSET_AIO_ROUND_UP(last))) {
+            req->bounce = NULL;
+            goto error_fd;
+        }
+    }
+    if (bitset_aio_start(aio, req) < 0) {
+        goto error_fd;
+    }
+    return 0;
+
+  error_fd:
+    close(req->fd);
+    unlink(req->tmp_path);
+  error:
+    free(req->crcs);
+    free(req->bounce);
+    free(req->path);
+    free(req->tmp_path);
+    return -1;
+}
+
+void bitset_aio_poll(bitset_aio_t* aio) {
+    bitset_aio_fill(aio);
+    bitset_aio_chunk_t* chunk;
+    while ((chunk = bitset_aio_reap(aio, 0)) != NULL) {
+        bitset_aio_complete(aio, chunk);
+        bitset_aio_fill(aio);
+    }
+}
+
+int bitset_aio_wait(bitset_aio_t* aio, bitset_aio_req_t* req) {
+    int stuck = 0;      /* Chunks may still be in flight */
+    while (!bitset_aio_finished(req)) {
+        bitset_aio_fill(aio);
+        bitset_aio_chunk_t* chunk = bitset_aio_reap(aio, 1);
+        if (!chunk) {
+            req->error = -1;
+#ifdef BITSET_HAVE_IO_URING
+            if (aio->uring) {
+                stuck = bitset_aio_uring_cancel(aio, req) != 0;
+                break;
+            }
+#endif
+            continue;
+        }
+        bitset_aio_complete(aio, chunk);
+    }
+
+    for (bitset_aio_req_t** it = &aio->active; *it; it = &(*it)->next_active) {
+        if (*it == req) {
+            *it = req->next_active;
+            break;
+        }
+    }
+    if (stuck) {
+        // The kernel may still write into the buffers of chunks the broken
+        // ring can neither cancel nor reap, so they are never freed.
+        close(req->fd);
+        if (req->write) {
+            unlink(req->tmp_path);
+            free(req->path);
+            free(req->tmp_path);
+        }
+        return -1;
+    }
+    free(req->slots);
+
+    if (!req->write) {
+        close(req->fd);
+        free(req->crcs);
+        if (req->error) {
+            free(req->bs->bits);
+        }
+        return req->error;
+    }
+
+    // This also cuts the padding a direct write of the last chunk may have
+    // left after the atoms.
+    if (!req->error
+    &&  (bitset_image_write_crcs(req->fd, req->bs->nbits, req->crcs) < 0
+         || fsync(req->fd) < 0)) {
+        req->error = -1;
+    }
+    close(req->fd);
+    if (!req->error
+    &&  (rename(req->tmp_path, req->path) < 0
+         || bitset_fsync_dir(req->path) < 0)) {
+        req->error = -1;
+    }
+    if (req->error) {
+        unlink(req->tmp_path);
+    }
+    free(req->crcs);
+    free(req->bounce);
+    free(req->path);
+    free(req->tmp_path);
+    return req->error;
+}
@@ -0,0 +1,343 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "bitset/approx.h"
+#include "bitset/arith.h"
+#include "parallel.h"
+
+int bitset_approx_compile(bitset_approx_t* ap, const char* pattern, size_t m) {
+    assert (m > 0);
+    ap->m = m;
+    ap->natoms = BITS_TO_NATOMS(m);
+    ap->peq = calloc(256 * ap->natoms, sizeof(bitset_atom_t));
+    if (!ap->peq) {
+        return -1;
+    }
+    for (size_t i = 0; i < m; i++) {
+        unsigned char c = pattern[i];
+        ap->peq[c * ap->natoms + i / BITS_PER_ATOM] |=
+            (bitset_atom_t)1 << (i % BITS_PER_ATOM);
+    }
+    return 0;
+}
+
+void bitset_approx_wipe(bitset_approx_t* ap) {
+    free(ap->peq);
+    ap->peq = NULL;
+}
+
+/* {{{ Myers */
+
+/* Patterns of a single atom. In global mode, the first row of the matrix
+ * increases by one at each column, which is a horizontal delta of +1 shifted
+ * into the low bit; in search mode, it stays 0.
+ * @return the last score in global mode, the least one otherwise.
+ */
+static size_t bitset_approx_myers_atom(const bitset_approx_t* ap,
+                                       const unsigned char* s, size_t n,
+                                       int global, size_t* end)
+{
+    const bitset_atom_t* peq = ap->peq;
+    bitset_atom_t high = (bitset_atom_t)1 << (ap->m - 1);
+    bitset_atom_t hin = global ? 1 : 0;
+    bitset_atom_t pv = BITSET_ATOM_MAX, mv = 0;
+    size_t score = ap->m, best = ap->m, best_end = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        bitset_atom_t eq = peq[s[i]];
+        bitset_atom_t xv = eq | mv;
+        bitset_atom_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        bitset_atom_t ph = mv | ~(xh | pv);
+        bitset_atom_t mh = pv & xh;
+        score += (ph & high) != 0;
+        score -= (mh & high) != 0;
+        ph = (ph << 1) | hin;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (score < best) {
+            best = score;
+            best_end = i + 1;
+        }
+    }
+    if (end) {
+        *end = best_end;
+    }
+    return global ? score : best;
+}
+
+/* Patterns of several atoms, with a scratch of 2 * ap->natoms atoms. Carries
+ * of the addition and of both shifts go from one atom to the next.
+ */
+static size_t bitset_approx_myers_atoms(const bitset_approx_t* ap,
+                                        const unsigned char* s, size_t n,
+                                        int global, size_t* end,
+                                        bitset_atom_t* scratch)
+{
+    size_t natoms = ap->natoms;
+    size_t last = natoms - 1;
+    bitset_atom_t high = (bitset_atom_t)1 << ((ap->m - 1) % BITS_PER_ATOM);
+    bitset_atom_t* pv = scratch;
+    bitset_atom_t* mv = scratch + natoms;
+    size_t score = ap->m, best = ap->m, best_end = 0;
+
+    for (size_t j = 0; j < natoms; j++) {
+        pv[j] = BITSET_ATOM_MAX;
+        mv[j] = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const bitset_atom_t* eq = ap->peq + s[i] * natoms;
+        bit_t carry = 0;
+        bitset_atom_t pin = global ? 1 : 0, min = 0;
+        for (size_t j = 0; j < natoms; j++) {
+            bitset_atom_t xv = eq[j] | mv[j];
+            bitset_atom_t sum = bitset_atom_addc(eq[j] & pv[j], pv[j],
+                                                 &carry);
+            bitset_atom_t xh = (sum ^ pv[j]) | eq[j];
+            bitset_atom_t ph = mv[j] | ~(xh | pv[j]);
+            bitset_atom_t mh = pv[j] & xh;
+            if (j == last) {
+                score += (ph & high) != 0;
+                score -= (mh & high) != 0;
+            }
+            bitset_atom_t pout = ph >> (BITS_PER_ATOM - 1);
+            bitset_atom_t mout = mh >> (BITS_PER_ATOM - 1);
+            ph = (ph << 1) | pin;
+            mh = (mh << 1) | min;
+            pin = pout;
+            min = mout;
+            pv[j] = mh | ~(xv | ph);
+            mv[j] = ph & xv;
+        }
+        if (score < best) {
+            best = score;
+            best_end = i + 1;
+        }
+    }
+    if (end) {
+        *end = best_end;
+    }
+    return global ? score : best;
+}
+
+static size_t bitset_approx_myers(const bitset_approx_t* ap, const char* text,
+                                  size_t n, int global, size_t* end)
+{
+    const unsigned char* s = (const unsigned char*)text;
+    if (ap->natoms == 1) {
+        return bitset_approx_myers_atom(ap, s, n, global, end);
+    }
+    bitset_atom_t* scratch = malloc(2 * ap->natoms * sizeof(bitset_atom_t));
+    if (!scratch) {
+        return SIZE_MAX;
+    }
+    size_t score = bitset_approx_myers_atoms(ap, s, n, global, end, scratch);
+    free(scratch);
+    return score;
+}
+
+/* }}} */
+
+size_t bitset_approx_distance(const bitset_approx_t* ap, const char* text,
+                              size_t n)
+{
+    return bitset_approx_myers(ap, text, n, 1, NULL);
+}
+
+size_t bitset_approx_search(const bitset_approx_t* ap, const char* text,
+                            size_t n, size_t* end)
+{
+    return bitset_approx_myers(ap, text, n, 0, end);
+}
+
+/* {{{ Shift-Or */
+
+/* Patterns of a single atom. Bits of the state vectors are 0 for active
+ * prefixes, and the d-th vector starts with its d low bits active, for
+ * prefixes matching the empty string with d deletions.
+ */
+static int bitset_approx_shift_or_atom(const bitset_approx_t* ap,
+                                       const unsigned char* s, size_t n,
+                                       unsigned k, size_t* end)
+{
+    bitset_atom_t r[k + 1];
+    bitset_atom_t high = (bitset_atom_t)1 << (ap->m - 1);
+    for (unsigned d = 0; d <= k; d++) {
+        r[d] = BITSET_ATOM_MAX << d;
+    }
+    for (size_t i = 0; i < n; i++) {
+        bitset_atom_t b = ~ap->peq[s[i]];
+        bitset_atom_t prev = r[0];
+        r[0] = (r[0] << 1) | b;
+        for (unsigned d = 1; d <= k; d++) {
+            bitset_atom_t old = r[d];
+            // Match, insertion, substitution and deletion.
+            r[d] = ((old << 1) | b) & prev & (prev << 1) & (r[d - 1] << 1);
+            prev = old;
+        }
+        if ((r[k] & high) == 0) {
+            *end = i + 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Patterns of several atoms, with (k + 2) * ap->natoms atoms of state.
+ *
+ * Only the band of atoms below `top` may hold active prefixes, the others
+ * being all ones in every vector: a step extends the band by one atom, or
+ * more when deletions carry over, and it shrinks back as prefixes die. In
+ * text unlike the pattern, few atoms are processed whatever its length.
+ */
+static int bitset_approx_shift_or_atoms(const bitset_approx_t* ap,
+                                        const unsigned char* s, size_t n,
+                                        unsigned k, size_t* end,
+                                        bitset_atom_t* r)
+{
+    size_t natoms = ap->natoms;
+    size_t last = natoms - 1;
+    bitset_atom_t high = (bitset_atom_t)1 << ((ap->m - 1) % BITS_PER_ATOM);
+    bitset_atom_t* prev = r + (k + 1) * natoms;
+    // The d low bits of the d-th vector stay active.
+    size_t min_top = k / BITS_PER_ATOM + 1;
+    size_t top = min_top;
+
+    for (unsigned d = 0; d <= k; d++) {
+        for (size_t j = 0; j < natoms; j++) {
+            size_t lo = j * BITS_PER_ATOM;
+            r[d * natoms + j] = d >= lo + BITS_PER_ATOM ? 0
+                              : d > lo ? BITSET_ATOM_MAX << (d - lo)
+                                       : BITSET_ATOM_MAX;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        const bitset_atom_t* peq = ap->peq + s[i] * natoms;
+        bitset_atom_t carry = 0;
+        size_t limit = top < natoms ? top + 1 : natoms;
+        for (size_t j = 0; j < limit; j++) {
+            prev[j] = r[j];
+            r[j] = (r[j] << 1) | carry | ~peq[j];
+            carry = prev[j] >> (BITS_PER_ATOM - 1);
+        }
+        for (unsigned d = 1; d <= k; d++) {
+            bitset_atom_t* row = r + d * natoms;
+            bitset_atom_t* up = row - natoms;
+            bitset_atom_t c_old = 0, c_prev = 0, c_up = 0;
+            // Past the band, only a deletion from the vector above can
+            // activate a prefix, the vectors above being all ones.
+            for (size_t j = 0; j < limit || (j < natoms && !c_up); j++) {
+                if (j == limit) {
+                    prev[limit++] = BITSET_ATOM_MAX;
+                }
+                bitset_atom_t old = row[j];
+                row[j] = ((old << 1) | c_old | ~peq[j])
+                       & prev[j] & ((prev[j] << 1) | c_prev)
+                       & ((up[j] << 1) | c_up);
+                c_old = old >> (BITS_PER_ATOM - 1);
+                c_prev = prev[j] >> (BITS_PER_ATOM - 1);
+                c_up = up[j] >> (BITS_PER_ATOM - 1);
+                prev[j] = old;
+            }
+        }
+        if ((r[k * natoms + last] & high) == 0) {
+            *end = i + 1;
+            return 1;
+        }
+
+        top = limit;
+        while (top > min_top) {
+            unsigned d = 0;
+            while (d <= k && r[d * natoms + top - 1] == BITSET_ATOM_MAX) {
+                d++;
+            }
+            if (d <= k) {
+                break;
+            }
+            top--;
+        }
+    }
+    return 0;
+}
+
+/* }}} */
+
+int bitset_approx_find(const bitset_approx_t* ap, const char* text, size_t n,
+                       unsigned k, size_t* end)
+{
+    const unsigned char* s = (const unsigned char*)text;
+    size_t dummy;
+    if (!end) {
+        end = &dummy;
+    }
+    // The empty substring is within m errors.
+    if (k >= ap->m) {
+        *end = 0;
+        return 1;
+    }
+    if (ap->natoms == 1) {
+        return bitset_approx_shift_or_atom(ap, s, n, k, end);
+    }
+    bitset_atom_t* r = malloc((k + 2) * ap->natoms * sizeof(bitset_atom_t));
+    if (!r) {
+        return -1;
+    }
+    int found = bitset_approx_shift_or_atoms(ap, s, n, k, end, r);
+    free(r);
+    return found;
+}
+
+/* {{{ Batch */
+
+typedef struct bitset_approx_job {
+    const bitset_approx_t *ap;
+    const char *const     *texts;
+    const size_t          *lens;
+    size_t                 n;
+    int                    global;
+    size_t                *out;
+    bitset_atom_t         *scratch; /* Myers scratch of each thread */
+} bitset_approx_job_t;
+
+static void bitset_approx_run(void* arg, size_t i, unsigned t) {
+    bitset_approx_job_t* job = arg;
+    const bitset_approx_t* ap = job->ap;
+    const unsigned char* s = (const unsigned char*)job->texts[i];
+    job->out[i] = ap->natoms > 1
+        ? bitset_approx_myers_atoms(ap, s, job->lens[i], job->global, NULL,
+                                    job->scratch + t * 2 * ap->natoms)
+        : bitset_approx_myers_atom(ap, s, job->lens[i], job->global, NULL);
+}
+
+/* }}} */
+
+int bitset_approx_batch(const bitset_approx_t* ap, const char* const* texts,
+                        const size_t* lens, size_t n,
+                        bitset_approx_mode_t mode, unsigned nthreads,
+                        size_t* out)
+{
+    bitset_approx_job_t job = {
+        .ap = ap,
+        .texts = texts,
+        .lens = lens,
+        .n = n,
+        .global = mode == BITSET_APPROX_GLOBAL,
+        .out = out,
+    };
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (nthreads > n) {
+        nthreads = n ? n : 1;
+    }
+    job.scratch = malloc(nthreads * 2 * ap->natoms * sizeof(bitset_atom_t));
+    if (!job.scratch) {
+        return -1;
+    }
+    bitset_parallel_for(n, nthreads, bitset_approx_run, &job);
+    free(job.scratch);
+    return 0;
+}
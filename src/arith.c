@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BITSET_ARITH_X86
+#endif
+#include "bitset/arith.h"
+#include "parallel.h"
+
+extern bitset_atom_t bitset_atom_addc(bitset_atom_t a, bitset_atom_t b,
+                                      bit_t* carry);
+extern bitset_atom_t bitset_atom_subb(bitset_atom_t a, bitset_atom_t b,
+                                      bit_t* borrow);
+
+/* {{{ Kernels */
+
+/* Store a + b + c, or a - b - c if `sub`, into the `n` atoms of `d`.
+ * @return the carry or borrow out of the last atom.
+ */
+static inline __attribute__((always_inline))
+bit_t bitset_arith_chain(bitset_atom_t* d, const bitset_atom_t* a,
+                         const bitset_atom_t* b, size_t n, bit_t c, int sub)
+{
+    size_t i = 0;
+#ifdef BITSET_ARITH_X86
+    typedef unsigned long long ull;
+    // Four atoms per iteration keep the flags chain free of loop overhead.
+    if (sub) {
+        for (; i + 4 <= n; i += 4) {
+            c = _subborrow_u64(c, a[i], b[i], (ull*)&d[i]);
+            c = _subborrow_u64(c, a[i + 1], b[i + 1], (ull*)&d[i + 1]);
+            c = _subborrow_u64(c, a[i + 2], b[i + 2], (ull*)&d[i + 2]);
+            c = _subborrow_u64(c, a[i + 3], b[i + 3], (ull*)&d[i + 3]);
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            c = _addcarry_u64(c, a[i], b[i], (ull*)&d[i]);
+            c = _addcarry_u64(c, a[i + 1], b[i + 1], (ull*)&d[i + 1]);
+            c = _addcarry_u64(c, a[i + 2], b[i + 2], (ull*)&d[i + 2]);
+            c = _addcarry_u64(c, a[i + 3], b[i + 3], (ull*)&d[i + 3]);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        d[i] = sub ? bitset_atom_subb(a[i], b[i], &c)
+                   : bitset_atom_addc(a[i], b[i], &c);
+    }
+    return c;
+}
+
+/* Add 1 to the `n` atoms of `d`, or subtract 1 if `sub`.
+ * @return the carry or borrow out.
+ */
+static bit_t bitset_arith_step(bitset_atom_t* d, size_t n, int sub) {
+    bitset_atom_t wrap = sub ? 0 : BITSET_ATOM_MAX;
+    for (size_t i = 0; i < n; i++) {
+        bitset_atom_t x = d[i];
+        d[i] = sub ? x - 1 : x + 1;
+        if (x != wrap) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Clear the bits above bs->nbits, and return the carry out of bit
+ * bs->nbits - 1, given the carry `c` out of the last atom.
+ */
+static bit_t bitset_arith_top(bitset_t* bs, bit_t c) {
+    size_t r = bs->nbits % BITS_PER_ATOM;
+    if (r == 0 || bs->natoms == 0) {
+        return c;
+    }
+    // Both operands fit in r bits: the carry or borrow is bit r, and a
+    // borrow also sets the bits above.
+    bitset_atom_t* top = &bs->bits[bs->natoms - 1];
+    c = (*top >> r) & 1;
+    *top &= ((bitset_atom_t)1 << r) - 1;
+    return c;
+}
+
+/* }}} */
+
+bit_t bitset_add_to(bitset_t* dest, const bitset_t* a, const bitset_t* b,
+                    bit_t carry)
+{
+    assert (dest->nbits == a->nbits && a->nbits == b->nbits);
+    bit_t c = bitset_arith_chain(dest->bits, a->bits, b->bits, a->natoms,
+                                 carry, 0);
+    return bitset_arith_top(dest, c);
+}
+
+bit_t bitset_sub_to(bitset_t* dest, const bitset_t* a, const bitset_t* b,
+                    bit_t borrow)
+{
+    assert (dest->nbits == a->nbits && a->nbits == b->nbits);
+    bit_t c = bitset_arith_chain(dest->bits, a->bits, b->bits, a->natoms,
+                                 borrow, 1);
+    return bitset_arith_top(dest, c);
+}
+
+bit_t bitset_neg(bitset_t* bs) {
+    // Atoms below the first non zero one stay 0, this one is negated and
+    // those above are complemented.
+    size_t i = 0;
+    while (i < bs->natoms && bs->bits[i] == 0) {
+        i++;
+    }
+    if (i == bs->natoms) {
+        return 0;
+    }
+    bs->bits[i] = -bs->bits[i];
+    for (i++; i < bs->natoms; i++) {
+        bs->bits[i] = ~bs->bits[i];
+    }
+    bitset_arith_top(bs, 0);
+    return 1;
+}
+
+bit_t bitset_inc(bitset_t* bs) {
+    bit_t c = bitset_arith_step(bs->bits, bs->natoms, 0);
+    return bitset_arith_top(bs, c);
+}
+
+bit_t bitset_dec(bitset_t* bs) {
+    bit_t c = bitset_arith_step(bs->bits, bs->natoms, 1);
+    return bitset_arith_top(bs, c);
+}
+
+/* {{{ Parallel */
+
+typedef struct bitset_arith_job {
+    bitset_atom_t       *d;
+    const bitset_atom_t *a;
+    const bitset_atom_t *b;
+    size_t               natoms;
+    size_t               nchunks;
+    int                  sub;
+    bit_t               *generates; /* Carry out of chunks, with 0 in */
+    bit_t               *propagates;/* Whether chunks pass a carry in */
+} bitset_arith_job_t;
+
+static void bitset_arith_run(void* arg, size_t ch, unsigned t) {
+    (void)t;
+    bitset_arith_job_t* job = arg;
+    // All ones propagate a carry, all zeros propagate a borrow.
+    bitset_atom_t pass = job->sub ? 0 : BITSET_ATOM_MAX;
+    size_t first = ch * BITSET_ARITH_CHUNK;
+    size_t n = job->natoms - first < BITSET_ARITH_CHUNK
+             ? job->natoms - first : BITSET_ARITH_CHUNK;
+    bitset_atom_t* d = job->d + first;
+    job->generates[ch] = job->sub
+        ? bitset_arith_chain(d, job->a + first, job->b + first, n, 0, 1)
+        : bitset_arith_chain(d, job->a + first, job->b + first, n, 0, 0);
+    bit_t propagates = 1;
+    for (size_t i = 0; i < n && propagates; i++) {
+        propagates = d[i] == pass;
+    }
+    job->propagates[ch] = propagates;
+}
+
+static int bitset_arith_parallel(bitset_t* dest, const bitset_t* a,
+                                 const bitset_t* b, bit_t c, int sub,
+                                 unsigned nthreads)
+{
+    assert (dest->nbits == a->nbits && a->nbits == b->nbits);
+    bitset_arith_job_t job = {
+        .d = dest->bits,
+        .a = a->bits,
+        .b = b->bits,
+        .natoms = a->natoms,
+        .nchunks = (a->natoms + BITSET_ARITH_CHUNK - 1) / BITSET_ARITH_CHUNK,
+        .sub = sub,
+    };
+    if (job.nchunks <= 1 || nthreads <= 1) {
+        c = bitset_arith_chain(dest->bits, a->bits, b->bits, a->natoms, c,
+                               sub);
+        return bitset_arith_top(dest, c);
+    }
+    job.generates = malloc(2 * job.nchunks);
+    if (!job.generates) {
+        return -1;
+    }
+    job.propagates = job.generates + job.nchunks;
+    bitset_parallel_for(job.nchunks, nthreads, bitset_arith_run, &job);
+
+    // Lookahead over chunks, then fix chunks receiving a carry.
+    for (size_t ch = 0; ch < job.nchunks; ch++) {
+        if (c) {
+            size_t first = ch * BITSET_ARITH_CHUNK;
+            size_t n = job.natoms - first < BITSET_ARITH_CHUNK
+                     ? job.natoms - first : BITSET_ARITH_CHUNK;
+            bitset_arith_step(job.d + first, n, sub);
+        }
+        c = job.generates[ch] | (job.propagates[ch] & c);
+    }
+    free(job.generates);
+    return bitset_arith_top(dest, c);
+}
+
+/* }}} */
+
+int bitset_add_to_parallel(bitset_t* dest, const bitset_t* a,
+                           const bitset_t* b, bit_t carry, unsigned nthreads)
+{
+    return bitset_arith_parallel(dest, a, b, carry, 0, nthreads);
+}
+
+int bitset_sub_to_parallel(bitset_t* dest, const bitset_t* a,
+                           const bitset_t* b, bit_t borrow, unsigned nthreads)
+{
+    return bitset_arith_parallel(dest, a, b, borrow, 1, nthreads);
+}
@@ -2,11 +2,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "bitset/bitset.h"
 
 #define bitset_atom_popcnt  __builtin_popcountl
 #define bitset_atom_ctz     __builtin_ctzl
 
+#if defined(__x86_64__) || defined(__i386__)
+#define BITSET_X86
+#endif
+
+static pthread_once_t bitset_once = PTHREAD_ONCE_INIT;
+static int            bitset_has_popcnt;
+
+static void bitset_init_once(void) {
+#ifdef BITSET_X86
+    bitset_has_popcnt = __builtin_cpu_supports("popcnt") != 0;
+#endif
+}
+
 int bitset_init(bitset_t* bs, size_t nbits) {
     bs->nbits = nbits;
     bs->natoms = BITS_TO_NATOMS(nbits);
@@ -34,6 +48,10 @@ int bitset_resize(bitset_t* bitset, size_t nbits) {
     if (!new_bits) {
         return -1;
     }
+    if (new_natoms > bitset->natoms) {
+        memset(new_bits + bitset->natoms, 0,
+               (new_natoms - bitset->natoms) * sizeof(bitset_atom_t));
+    }
     bitset->nbits = nbits;
     bitset->natoms = new_natoms;
     bitset->bits = new_bits;
@@ -53,7 +71,8 @@ extern void bitset_set_bit(bitset_t* bs, size_t idx, bit_t bit);
 /* }}} */
 /* {{{ Cool functions */
 
-size_t bitset_popcnt(const bitset_t* bs) {
+static inline __attribute__((always_inline))
+size_t bitset_popcnt_body(const bitset_t* bs) {
     size_t sum = 0;
     for (size_t i = 0; i < bs->natoms; i++) {
         sum += bitset_atom_popcnt(bs->bits[i]);
@@ -61,9 +80,26 @@ size_t bitset_popcnt(const bitset_t* bs) {
     return sum;
 }
 
+#ifdef BITSET_X86
+__attribute__((target("popcnt")))
+static size_t bitset_popcnt_hw(const bitset_t* bs) {
+    return bitset_popcnt_body(bs);
+}
+#endif
+
+size_t bitset_popcnt(const bitset_t* bs) {
+#ifdef BITSET_X86
+    pthread_once(&bitset_once, bitset_init_once);
+    if (bitset_has_popcnt) {
+        return bitset_popcnt_hw(bs);
+    }
+#endif
+    return bitset_popcnt_body(bs);
+}
+
 int bitset_first_set(const bitset_t* bs) {
     size_t atom = 0;
-    while (bs->bits[atom] == 0 && atom < bs->natoms) {
+    while (atom < bs->natoms && bs->bits[atom] == 0) {
         atom++;
     }
     if (atom == bs->natoms) {
@@ -74,18 +110,21 @@ int bitset_first_set(const bitset_t* bs) {
 
 int bitset_next_set(const bitset_t* bs, size_t from) {
     size_t atom = from / BITS_PER_ATOM;
+    if (atom >= bs->natoms) {
+        return -1;
+    }
 
     // We first look in the first atom, that we mask to begin from the
     // "from" index.
-    bitset_atom_t mask = (BITSET_ATOM_MAX << (from & BITS_PER_ATOM));
+    bitset_atom_t mask = (BITSET_ATOM_MAX << (from % BITS_PER_ATOM));
     if ((bs->bits[atom] & mask) != 0) {
-        return atom * BITS_PER_ATOM + bitset_atom_ctz(atom);
+        return atom * BITS_PER_ATOM + bitset_atom_ctz(bs->bits[atom] & mask);
     }
 
     // No more bits in the first atom, so we check for a set bit in rest
     // of atoms.
     atom++;
-    while (bs->bits[atom] == 0 && atom < bs->natoms) {
+    while (atom < bs->natoms && bs->bits[atom] == 0) {
         atom++;
     }
     if (atom == bs->natoms) {
@@ -94,9 +133,134 @@ int bitset_next_set(const bitset_t* bs, size_t from) {
     return atom * BITS_PER_ATOM + bitset_atom_ctz(bs->bits[atom]);
 }
 
+size_t bitset_to_array(const bitset_t* bs, size_t* out) {
+    size_t n = 0;
+    for (size_t i = 0; i < bs->natoms; i++) {
+        bitset_atom_t atom = bs->bits[i];
+        while (atom) {
+            out[n++] = i * BITS_PER_ATOM + bitset_atom_ctz(atom);
+            atom &= atom - 1;
+        }
+    }
+    return n;
+}
+
+void bitset_from_array(bitset_t* bs, const size_t* in, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        assert (in[i] < bs->nbits);
+        bs->bits[in[i] / BITS_PER_ATOM] |=
+            (bitset_atom_t)1 << (in[i] % BITS_PER_ATOM);
+    }
+}
+
+/* Number of atoms looked at together when skipping blocks */
+#define BITSET_RUNS_BLOCK   4
+
+size_t bitset_count_runs(const bitset_t* bs) {
+    size_t n = 0;
+    bitset_atom_t carry = 0;
+    for (size_t i = 0; i < bs->natoms; i++) {
+        bitset_atom_t atom = bs->bits[i];
+        n += bitset_atom_popcnt(atom & ~(atom << 1 | carry));
+        carry = atom >> (BITS_PER_ATOM - 1);
+    }
+    return n;
+}
+
+size_t bitset_to_runs(const bitset_t* bs, bitset_run_t* out) {
+    size_t n = 0;
+    size_t start = 0;
+    bitset_atom_t in = 0;   /* 1 inside a run, which is the carry */
+    size_t i = 0;
+    while (i < bs->natoms) {
+        // Outside a run, skip zeros, inside one, skip ones. The loads and
+        // compares of a block are independent, and vectorized with SIMD
+        // builds.
+        if (i + BITSET_RUNS_BLOCK <= bs->natoms) {
+            const bitset_atom_t* b = bs->bits + i;
+            bitset_atom_t skip = in ? BITSET_ATOM_MAX : 0;
+            if (((b[0] ^ skip) | (b[1] ^ skip)
+               | (b[2] ^ skip) | (b[3] ^ skip)) == 0) {
+                i += BITSET_RUNS_BLOCK;
+                continue;
+            }
+        }
+        bitset_atom_t atom = bs->bits[i];
+        bitset_atom_t transitions = atom ^ (atom << 1 | in);
+        while (transitions) {
+            size_t pos = i * BITS_PER_ATOM + bitset_atom_ctz(transitions);
+            transitions &= transitions - 1;
+            if (in) {
+                out[n].start = start;
+                out[n++].end = pos;
+            } else {
+                start = pos;
+            }
+            in ^= 1;
+        }
+        i++;
+    }
+    // Padding bits are clear, so only a run reaching a full last atom is
+    // still open.
+    if (in) {
+        out[n].start = start;
+        out[n++].end = bs->nbits;
+    }
+    return n;
+}
+
+void bitset_from_runs(bitset_t* bs, const bitset_run_t* in, size_t n) {
+    for (size_t r = 0; r < n; r++) {
+        size_t start = in[r].start, end = in[r].end;
+        assert (start <= end && end <= bs->nbits);
+        if (start == end) {
+            continue;
+        }
+        size_t first = start / BITS_PER_ATOM, last = (end - 1) / BITS_PER_ATOM;
+        bitset_atom_t head = BITSET_ATOM_MAX << (start % BITS_PER_ATOM);
+        bitset_atom_t tail = BITSET_ATOM_MAX
+                           >> (BITS_PER_ATOM - 1 - (end - 1) % BITS_PER_ATOM);
+        if (first == last) {
+            bs->bits[first] |= head & tail;
+            continue;
+        }
+        bs->bits[first] |= head;
+        memset(bs->bits + first + 1, 0xff,
+               (last - first - 1) * sizeof(bitset_atom_t));
+        bs->bits[last] |= tail;
+    }
+}
+
 /* }}} */
 /* {{{ Sets functions */
 
+static inline __attribute__((always_inline))
+size_t bitset_and_popcnt_body(const bitset_t* a, const bitset_t* b) {
+    size_t sum = 0;
+    for (size_t i = 0; i < a->natoms; i++) {
+        sum += bitset_atom_popcnt(a->bits[i] & b->bits[i]);
+    }
+    return sum;
+}
+
+#ifdef BITSET_X86
+__attribute__((target("popcnt")))
+static size_t bitset_and_popcnt_hw(const bitset_t* a, const bitset_t* b) {
+    return bitset_and_popcnt_body(a, b);
+}
+#endif
+
+size_t bitset_and_popcnt(const bitset_t* a, const bitset_t* b) {
+    assert (a->natoms == b->natoms);
+#ifdef BITSET_X86
+    pthread_once(&bitset_once, bitset_init_once);
+    if (bitset_has_popcnt) {
+        return bitset_and_popcnt_hw(a, b);
+    }
+#endif
+    return bitset_and_popcnt_body(a, b);
+}
+
 void bitset_and_to(bitset_t* dest, const bitset_t* a, const bitset_t* b) {
     assert (a->natoms == b->natoms);
     assert (dest->natoms == a->natoms);
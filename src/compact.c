@@ -0,0 +1,311 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_COMPACT_X86
+#endif
+#include "bitset/compact.h"
+
+/* Atoms with at most this many bits set are visited bit by bit */
+#define BITSET_COMPACT_SPARSE   8
+
+/* Store into `out` the values of the rows of the `natoms` atoms of `bits`
+ * that are set, and return their number.
+ */
+typedef size_t (*bitset_compact_fn)(const bitset_atom_t* bits, size_t natoms,
+                                    const void* col, void* out);
+
+/* Kernels are indexed by instruction set: generic, AVX2, AVX-512 */
+static pthread_once_t bitset_compact_once = PTHREAD_ONCE_INIT;
+static int            bitset_compact_level;
+
+/* Lanes of the set bits of a byte, first, for 32-bit lanes */
+static uint8_t bitset_compact_perm32[256][8];
+
+/* Same for the 4 bits of a nibble and 64-bit lanes, as pairs of 32-bit
+ * lanes.
+ */
+static uint8_t bitset_compact_perm64[16][8];
+
+static void bitset_compact_init_once(void) {
+    for (unsigned m = 0; m < 256; m++) {
+        unsigned n = 0;
+        for (unsigned l = 0; l < 8; l++) {
+            if (m >> l & 1) {
+                bitset_compact_perm32[m][n++] = l;
+            }
+        }
+    }
+    for (unsigned m = 0; m < 16; m++) {
+        unsigned n = 0;
+        for (unsigned l = 0; l < 4; l++) {
+            if (m >> l & 1) {
+                bitset_compact_perm64[m][n++] = 2 * l;
+                bitset_compact_perm64[m][n++] = 2 * l + 1;
+            }
+        }
+    }
+#ifdef BITSET_COMPACT_X86
+    if (__builtin_cpu_supports("popcnt")) {
+        if (__builtin_cpu_supports("avx512f")) {
+            bitset_compact_level = 2;
+        } else if (__builtin_cpu_supports("avx2")) {
+            bitset_compact_level = 1;
+        }
+    }
+#endif
+}
+
+/* Define kernel `_name`, skipping empty atoms, copying full ones, visiting
+ * the bits of those with at most `_sparse` bits set with `_one`, and
+ * compacting others with `_atom`, for values of type `_T`.
+ */
+#define BITSET_COMPACT_KERNEL(_name, _atom, _one, _sparse, _T, _target)     \
+    _target static size_t _name(const bitset_atom_t* bits, size_t natoms,   \
+                                const void* col, void* out)                 \
+    {                                                                       \
+        const _T* v = col;                                                  \
+        _T* o = out;                                                        \
+        size_t j = 0;                                                       \
+        for (size_t i = 0; i < natoms; i++, v += BITS_PER_ATOM) {           \
+            bitset_atom_t a = bits[i];                                      \
+            if (a == BITSET_ATOM_MAX) {                                     \
+                memcpy(o + j, v, BITS_PER_ATOM * sizeof(_T));               \
+                j += BITS_PER_ATOM;                                         \
+            } else if (__builtin_popcountll(a) <= (_sparse)) {              \
+                j += _one(o + j, v, a);                                     \
+            } else {                                                        \
+                j += _atom(o + j, v, a);                                    \
+            }                                                               \
+        }                                                                   \
+        return j;                                                           \
+    }
+
+/* {{{ Generic */
+
+static inline size_t bitset_compact_atom_u32(uint32_t* out,
+                                             const uint32_t* v,
+                                             bitset_atom_t a)
+{
+    size_t j = 0;
+    for (; a; a &= a - 1) {
+        out[j++] = v[__builtin_ctzll(a)];
+    }
+    return j;
+}
+
+static inline size_t bitset_compact_atom_u64(uint64_t* out,
+                                             const uint64_t* v,
+                                             bitset_atom_t a)
+{
+    size_t j = 0;
+    for (; a; a &= a - 1) {
+        out[j++] = v[__builtin_ctzll(a)];
+    }
+    return j;
+}
+
+BITSET_COMPACT_KERNEL(bitset_compact_u32_generic, bitset_compact_atom_u32,
+                      bitset_compact_atom_u32, BITS_PER_ATOM, uint32_t, )
+BITSET_COMPACT_KERNEL(bitset_compact_u64_generic, bitset_compact_atom_u64,
+                      bitset_compact_atom_u64, BITS_PER_ATOM, uint64_t, )
+
+/* }}} */
+
+#ifdef BITSET_COMPACT_X86
+
+/* {{{ AVX2 */
+
+#define BITSET_COMPACT_AVX2 \
+    __attribute__((target("avx2,popcnt"), always_inline)) static inline
+
+/* 8 rows per byte of the atom, permuted with the lanes of the byte */
+BITSET_COMPACT_AVX2
+size_t bitset_compact_atom_u32_avx2(uint32_t* out, const uint32_t* v,
+                                    bitset_atom_t a)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t j = 0;
+    for (unsigned k = 0; k < BITS_PER_ATOM; k += 8) {
+        unsigned m = a >> k & 0xff;
+        if (m == 0) {
+            continue;
+        }
+        unsigned n = __builtin_popcount(m);
+        __m256i perm = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                           (const __m128i*)bitset_compact_perm32[m]));
+        __m256i x = _mm256_permutevar8x32_epi32(
+                        _mm256_loadu_si256((const __m256i*)(v + k)), perm);
+        __m256i store = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), lanes);
+        _mm256_maskstore_epi32((int*)(out + j), store, x);
+        j += n;
+    }
+    return j;
+}
+
+/* 4 rows per nibble of the atom */
+BITSET_COMPACT_AVX2
+size_t bitset_compact_atom_u64_avx2(uint64_t* out, const uint64_t* v,
+                                    bitset_atom_t a)
+{
+    const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+    size_t j = 0;
+    for (unsigned k = 0; k < BITS_PER_ATOM; k += 4) {
+        unsigned m = a >> k & 0xf;
+        if (m == 0) {
+            continue;
+        }
+        unsigned n = __builtin_popcount(m);
+        __m256i perm = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                           (const __m128i*)bitset_compact_perm64[m]));
+        __m256i x = _mm256_permutevar8x32_epi32(
+                        _mm256_loadu_si256((const __m256i*)(v + k)), perm);
+        __m256i store = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), lanes);
+        _mm256_maskstore_epi64((long long*)(out + j), store, x);
+        j += n;
+    }
+    return j;
+}
+
+BITSET_COMPACT_KERNEL(bitset_compact_u32_avx2, bitset_compact_atom_u32_avx2,
+                      bitset_compact_atom_u32, BITSET_COMPACT_SPARSE,
+                      uint32_t, __attribute__((target("avx2,popcnt"))))
+BITSET_COMPACT_KERNEL(bitset_compact_u64_avx2, bitset_compact_atom_u64_avx2,
+                      bitset_compact_atom_u64, BITSET_COMPACT_SPARSE,
+                      uint64_t, __attribute__((target("avx2,popcnt"))))
+
+/* }}} */
+/* {{{ AVX-512 */
+
+#define BITSET_COMPACT_AVX512 \
+    __attribute__((target("avx512f,popcnt"), always_inline)) static inline
+
+/* 16 rows per 16 bits of the atom, compressed in a register and stored
+ * with a mask, which is faster than compressing to memory.
+ */
+BITSET_COMPACT_AVX512
+size_t bitset_compact_atom_u32_avx512(uint32_t* out, const uint32_t* v,
+                                      bitset_atom_t a)
+{
+    size_t j = 0;
+    for (unsigned k = 0; k < BITS_PER_ATOM; k += 16) {
+        __mmask16 m = a >> k;
+        if (m == 0) {
+            continue;
+        }
+        unsigned n = __builtin_popcount(m);
+        __m512i x = _mm512_maskz_compress_epi32(m,
+                                                _mm512_loadu_si512(v + k));
+        _mm512_mask_storeu_epi32(out + j, (__mmask16)((1u << n) - 1), x);
+        j += n;
+    }
+    return j;
+}
+
+/* 8 rows per byte of the atom */
+BITSET_COMPACT_AVX512
+size_t bitset_compact_atom_u64_avx512(uint64_t* out, const uint64_t* v,
+                                      bitset_atom_t a)
+{
+    size_t j = 0;
+    for (unsigned k = 0; k < BITS_PER_ATOM; k += 8) {
+        __mmask8 m = a >> k;
+        if (m == 0) {
+            continue;
+        }
+        unsigned n = __builtin_popcount(m);
+        __m512i x = _mm512_maskz_compress_epi64(m,
+                                                _mm512_loadu_si512(v + k));
+        _mm512_mask_storeu_epi64(out + j, (__mmask8)((1u << n) - 1), x);
+        j += n;
+    }
+    return j;
+}
+
+BITSET_COMPACT_KERNEL(bitset_compact_u32_avx512,
+                      bitset_compact_atom_u32_avx512, bitset_compact_atom_u32,
+                      BITSET_COMPACT_SPARSE, uint32_t,
+                      __attribute__((target("avx512f,popcnt"))))
+BITSET_COMPACT_KERNEL(bitset_compact_u64_avx512,
+                      bitset_compact_atom_u64_avx512, bitset_compact_atom_u64,
+                      BITSET_COMPACT_SPARSE, uint64_t,
+                      __attribute__((target("avx512f,popcnt"))))
+
+/* }}} */
+
+#define BITSET_COMPACT_KERNELS(_name) \
+    { _name##_generic, _name##_avx2, _name##_avx512 }
+
+#else
+
+#define BITSET_COMPACT_KERNELS(_name) { _name##_generic }
+
+#endif
+
+static const bitset_compact_fn bitset_compact_u32_fns[] =
+    BITSET_COMPACT_KERNELS(bitset_compact_u32);
+static const bitset_compact_fn bitset_compact_u64_fns[] =
+    BITSET_COMPACT_KERNELS(bitset_compact_u64);
+
+size_t bitset_compact_columns(const bitset_t* sel, size_t ncols,
+                              const void* const* cols, const size_t* sizes,
+                              void* const* outs)
+{
+    pthread_once(&bitset_compact_once, bitset_compact_init_once);
+    const size_t block = BITSET_COMPACT_BLOCK / BITS_PER_ATOM;
+    const size_t nfull = sel->nbits / BITS_PER_ATOM;
+    size_t j = 0, n = 0;
+
+    // Kernels read whole atoms of rows, which the last atom may not have.
+    for (size_t i = 0; i < nfull; i += block) {
+        size_t natoms = nfull - i < block ? nfull - i : block;
+        for (size_t c = 0; c < ncols; c++) {
+            assert (sizes[c] == 4 || sizes[c] == 8);
+            const bitset_compact_fn* fns = sizes[c] == 4
+                                         ? bitset_compact_u32_fns
+                                         : bitset_compact_u64_fns;
+            n = fns[bitset_compact_level](
+                    sel->bits + i, natoms,
+                    (const char*)cols[c] + i * BITS_PER_ATOM * sizes[c],
+                    (char*)outs[c] + j * sizes[c]);
+        }
+        j += n;
+    }
+
+    size_t r = sel->nbits % BITS_PER_ATOM;
+    if (r) {
+        bitset_atom_t a = sel->bits[nfull] & (((bitset_atom_t)1 << r) - 1);
+        for (size_t c = 0; c < ncols; c++) {
+            const char* v = (const char*)cols[c]
+                          + nfull * BITS_PER_ATOM * sizes[c];
+            char* o = (char*)outs[c] + j * sizes[c];
+            n = sizes[c] == 4
+              ? bitset_compact_atom_u32((uint32_t*)o, (const uint32_t*)v, a)
+              : bitset_compact_atom_u64((uint64_t*)o, (const uint64_t*)v, a);
+        }
+        j += n;
+    }
+    return j;
+}
+
+size_t bitset_compact_u32(const bitset_t* sel, const uint32_t* col,
+                          uint32_t* out)
+{
+    const void* cols[1] = { col };
+    const size_t sizes[1] = { sizeof(*col) };
+    void* outs[1] = { out };
+    return bitset_compact_columns(sel, 1, cols, sizes, outs);
+}
+
+size_t bitset_compact_u64(const bitset_t* sel, const uint64_t* col,
+                          uint64_t* out)
+{
+    const void* cols[1] = { col };
+    const size_t sizes[1] = { sizeof(*col) };
+    void* outs[1] = { out };
+    return bitset_compact_columns(sel, 1, cols, sizes, outs);
+}
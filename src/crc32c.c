@@ -0,0 +1,283 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define BITSET_CRC32C_X86
+#endif
+#include "bitset/crc32c.h"
+
+/* Reflected Castagnoli polynomial */
+#define BITSET_CRC32C_POLY      0x82f63b78
+
+/* Bytes per lane of the interleaved hardware loop */
+#define BITSET_CRC32C_LANE      8192
+
+/* Functions below work on "raw" CRCs, without the initial and final
+ * inversion: a raw CRC is linear in its input, which makes combining simple.
+ */
+
+static pthread_once_t bitset_crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t bitset_crc32c_table[8][256];    /* Slicing-by-8 tables */
+static uint32_t bitset_crc32c_x2n[32];          /* x^(2^n) mod P */
+static uint32_t bitset_crc32c_lane_shift;       /* x^(8 * LANE) mod P */
+static int      bitset_crc32c_has_hw;
+
+/* {{{ Polynomial arithmetic */
+
+/* Multiply `a` and `b` modulo P. */
+static uint32_t bitset_crc32c_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ BITSET_CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+/* Return x^(n * 2^k) mod P. */
+static uint32_t bitset_crc32c_x2nmodp(size_t n, unsigned k) {
+    uint32_t p = (uint32_t)1 << 31;     // x^0
+    while (n) {
+        if (n & 1) {
+            p = bitset_crc32c_multmodp(bitset_crc32c_x2n[k & 31], p);
+        }
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+static void bitset_crc32c_init(void) {
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = crc & 1 ? (crc >> 1) ^ BITSET_CRC32C_POLY : crc >> 1;
+        }
+        bitset_crc32c_table[0][i] = crc;
+    }
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t crc = bitset_crc32c_table[0][i];
+        for (int t = 1; t < 8; t++) {
+            crc = bitset_crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            bitset_crc32c_table[t][i] = crc;
+        }
+    }
+
+    uint32_t p = (uint32_t)1 << 30;     // x^1
+    bitset_crc32c_x2n[0] = p;
+    for (int n = 1; n < 32; n++) {
+        bitset_crc32c_x2n[n] = p = bitset_crc32c_multmodp(p, p);
+    }
+    bitset_crc32c_lane_shift = bitset_crc32c_x2nmodp(BITSET_CRC32C_LANE, 3);
+
+#ifdef BITSET_CRC32C_X86
+    bitset_crc32c_has_hw = __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+/* }}} */
+/* {{{ Software CRC */
+
+static uint32_t bitset_crc32c_sw(uint32_t crc, const unsigned char* p,
+                                 size_t len)
+{
+    while (len && ((uintptr_t)p & 7)) {
+        crc = bitset_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        w ^= crc;
+        crc = bitset_crc32c_table[7][w & 0xff]
+            ^ bitset_crc32c_table[6][(w >> 8) & 0xff]
+            ^ bitset_crc32c_table[5][(w >> 16) & 0xff]
+            ^ bitset_crc32c_table[4][(w >> 24) & 0xff]
+            ^ bitset_crc32c_table[3][(w >> 32) & 0xff]
+            ^ bitset_crc32c_table[2][(w >> 40) & 0xff]
+            ^ bitset_crc32c_table[1][(w >> 48) & 0xff]
+            ^ bitset_crc32c_table[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = bitset_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/* }}} */
+/* {{{ Hardware CRC */
+
+#ifdef BITSET_CRC32C_X86
+
+__attribute__((target("sse4.2")))
+static uint32_t bitset_crc32c_sse42(uint32_t crc, const unsigned char* p,
+                                    size_t len)
+{
+    while (len && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+    // Three independent dependency chains keep the crc32 unit busy. Lanes
+    // are then merged by shifting the first ones over the following bytes.
+    while (len >= 3 * BITSET_CRC32C_LANE) {
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        const unsigned char* p1 = p + BITSET_CRC32C_LANE;
+        const unsigned char* p2 = p + 2 * BITSET_CRC32C_LANE;
+        for (size_t i = 0; i < BITSET_CRC32C_LANE; i += 8) {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p + i, 8);
+            memcpy(&w1, p1 + i, 8);
+            memcpy(&w2, p2 + i, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        uint32_t k = bitset_crc32c_lane_shift;
+        crc = bitset_crc32c_multmodp(k, (uint32_t)c0) ^ (uint32_t)c1;
+        crc = bitset_crc32c_multmodp(k, crc) ^ (uint32_t)c2;
+        p += 3 * BITSET_CRC32C_LANE;
+        len -= 3 * BITSET_CRC32C_LANE;
+    }
+
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+#endif
+
+/* }}} */
+
+uint32_t bitset_crc32c(uint32_t crc, const void* data, size_t len) {
+    pthread_once(&bitset_crc32c_once, bitset_crc32c_init);
+    crc = ~crc;
+#ifdef BITSET_CRC32C_X86
+    if (bitset_crc32c_has_hw) {
+        return ~bitset_crc32c_sse42(crc, data, len);
+    }
+#endif
+    return ~bitset_crc32c_sw(crc, data, len);
+}
+
+uint32_t bitset_crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    pthread_once(&bitset_crc32c_once, bitset_crc32c_init);
+    return bitset_crc32c_multmodp(bitset_crc32c_x2nmodp(len2, 3), crc1) ^ crc2;
+}
+
+int bitset_crc32c_hw(void) {
+    pthread_once(&bitset_crc32c_once, bitset_crc32c_init);
+    return bitset_crc32c_has_hw;
+}
+
+/* {{{ Blocks */
+
+typedef struct bitset_crc32c_job {
+    const unsigned char *data;
+    size_t               len;
+    uint32_t            *crcs;
+    const uint32_t      *expected;  /* NULL to compute, else to verify */
+    size_t               first;     /* First block of this job */
+    size_t               nblocks;
+    int                  mismatch;
+} bitset_crc32c_job_t;
+
+static void* bitset_crc32c_run(void* arg) {
+    bitset_crc32c_job_t* job = arg;
+    for (size_t b = job->first; b < job->first + job->nblocks; b++) {
+        size_t off = b * BITSET_CRC32C_BLOCK_SIZE;
+        size_t len = job->len - off < BITSET_CRC32C_BLOCK_SIZE
+                   ? job->len - off : BITSET_CRC32C_BLOCK_SIZE;
+        uint32_t crc = bitset_crc32c(0, job->data + off, len);
+        if (job->expected) {
+            if (crc != job->expected[b]) {
+                job->mismatch = 1;
+                return NULL;
+            }
+        } else {
+            job->crcs[b] = crc;
+        }
+    }
+    return NULL;
+}
+
+/* Split blocks between threads, the calling one taking the first share. */
+static int bitset_crc32c_parallel(const bitset_atom_t* atoms, size_t natoms,
+                                  uint32_t* crcs, const uint32_t* expected,
+                                  unsigned nthreads)
+{
+    size_t nblocks = BITSET_CRC32C_NBLOCKS(natoms);
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (nthreads > nblocks) {
+        nthreads = nblocks ? nblocks : 1;
+    }
+
+    bitset_crc32c_job_t jobs[nthreads];
+    pthread_t threads[nthreads];
+    int started[nthreads];
+    size_t first = 0;
+    for (unsigned t = 0; t < nthreads; t++) {
+        size_t share = nblocks / nthreads + (t < nblocks % nthreads);
+        jobs[t] = (bitset_crc32c_job_t) {
+            .data = (const unsigned char*)atoms,
+            .len = natoms * sizeof(bitset_atom_t),
+            .crcs = crcs,
+            .expected = expected,
+            .first = first,
+            .nblocks = share,
+        };
+        first += share;
+        started[t] = t > 0 && pthread_create(&threads[t], NULL,
+                                             bitset_crc32c_run, &jobs[t]) == 0;
+    }
+
+    int mismatch = 0;
+    for (unsigned t = 0; t < nthreads; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            bitset_crc32c_run(&jobs[t]);
+        }
+        mismatch |= jobs[t].mismatch;
+    }
+    return mismatch ? -1 : 0;
+}
+
+void bitset_crc32c_blocks(const bitset_atom_t* atoms, size_t natoms,
+                          uint32_t* crcs, unsigned nthreads)
+{
+    bitset_crc32c_parallel(atoms, natoms, crcs, NULL, nthreads);
+}
+
+int bitset_crc32c_verify(const bitset_atom_t* atoms, size_t natoms,
+                         const uint32_t* crcs, unsigned nthreads)
+{
+    return bitset_crc32c_parallel(atoms, natoms, NULL, crcs, nthreads);
+}
+
+/* }}} */
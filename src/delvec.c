@@ -0,0 +1,285 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bitset/crc32c.h"
+#include "bitset/encode.h"
+#include "bitset/delvec.h"
+#include "io.h"
+
+extern void bitset_delvec_delete(bitset_delvec_t* dv, size_t row);
+
+extern int bitset_delvec_is_live(const bitset_delvec_t* dv, size_t row);
+
+int bitset_delvec_init(bitset_delvec_t* dv, size_t nrows) {
+    return bitset_init(&dv->deleted, nrows);
+}
+
+void bitset_delvec_wipe(bitset_delvec_t* dv) {
+    bitset_wipe(&dv->deleted);
+}
+
+size_t bitset_delvec_live_count(const bitset_delvec_t* dv) {
+    return dv->deleted.nbits - bitset_popcnt(&dv->deleted);
+}
+
+/* {{{ On-disk form */
+
+size_t bitset_delvec_encoded_size(const bitset_delvec_t* dv) {
+    return sizeof(bitset_delvec_header_t)
+         + bitset_encoded_size(&dv->deleted, BITSET_ENCODING_AUTO);
+}
+
+size_t bitset_delvec_encode(const bitset_delvec_t* dv, void* buf, size_t len)
+{
+    bitset_delvec_header_t header = {
+        .magic = BITSET_DELVEC_MAGIC,
+        .version = BITSET_DELVEC_VERSION,
+    };
+    if (len < sizeof(header)) {
+        return 0;
+    }
+    unsigned char* payload = (unsigned char*)buf + sizeof(header);
+    header.size = bitset_encode(&dv->deleted, BITSET_ENCODING_AUTO, payload,
+                                len - sizeof(header));
+    if (header.size == 0) {
+        return 0;
+    }
+    header.crc = bitset_crc32c(0, payload, header.size);
+    memcpy(buf, &header, sizeof(header));
+    return sizeof(header) + header.size;
+}
+
+/* Check the header and the CRC of the on-disk form of `len` bytes of `buf`,
+ * and store the size of its payload into `size`.
+ * @return the payload, or NULL if `buf` is corrupted.
+ */
+static const void* bitset_delvec_payload(const void* buf, size_t len,
+                                         size_t* size)
+{
+    bitset_delvec_header_t header;
+    if (len < sizeof(header)) {
+        return NULL;
+    }
+    memcpy(&header, buf, sizeof(header));
+    const unsigned char* payload = (const unsigned char*)buf + sizeof(header);
+    if (header.magic != BITSET_DELVEC_MAGIC
+    ||  header.version != BITSET_DELVEC_VERSION
+    ||  header.size > len - sizeof(header)
+    ||  bitset_crc32c(0, payload, header.size) != header.crc) {
+        return NULL;
+    }
+    *size = header.size;
+    return payload;
+}
+
+int bitset_delvec_decode(bitset_delvec_t* dv, const void* buf, size_t len) {
+    size_t size;
+    const void* payload = bitset_delvec_payload(buf, len, &size);
+    if (!payload) {
+        return -1;
+    }
+    return bitset_decode(&dv->deleted, payload, size);
+}
+
+int bitset_delvec_merge(bitset_delvec_t* dv, const void* buf, size_t len) {
+    size_t size;
+    const void* payload = bitset_delvec_payload(buf, len, &size);
+    if (!payload) {
+        return -1;
+    }
+    return bitset_decode_or(&dv->deleted, payload, size);
+}
+
+int bitset_delvec_save(const bitset_delvec_t* dv, const char* path) {
+    size_t size = bitset_delvec_encoded_size(dv);
+    size_t len = strlen(path);
+    char* buf = malloc(size + len + sizeof(".tmp"));
+    if (!buf) {
+        return -1;
+    }
+    char* tmp = buf + size;
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+    if (bitset_delvec_encode(dv, buf, size) != size) {
+        free(buf);
+        return -1;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(buf);
+        return -1;
+    }
+    int res = bitset_pwrite_all(fd, buf, size, 0);
+    if (res == 0) {
+        res = fsync(fd);
+    }
+    close(fd);
+    if (res == 0) {
+        res = rename(tmp, path);
+        if (res != 0) {
+            unlink(tmp);
+        } else {
+            res = bitset_fsync_dir(path);
+        }
+    } else {
+        unlink(tmp);
+    }
+    free(buf);
+    return res;
+}
+
+/* Merge the delete file `path` into `dv`, reading it into `*buf`, of
+ * `*cap` bytes, grown as needed.
+ */
+static int bitset_delvec_merge_file(bitset_delvec_t* dv, const char* path,
+                                    void** buf, size_t* cap)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    int res = fstat(fd, &st);
+    size_t len = res == 0 ? (size_t)st.st_size : 0;
+    if (res == 0 && len > *cap) {
+        void* grown = realloc(*buf, len);
+        if (grown) {
+            *buf = grown;
+            *cap = len;
+        } else {
+            res = -1;
+        }
+    }
+    if (res == 0) {
+        res = bitset_pread_all(fd, *buf, len, 0);
+    }
+    close(fd);
+    return res == 0 ? bitset_delvec_merge(dv, *buf, len) : -1;
+}
+
+int bitset_delvec_load(bitset_delvec_t* dv, size_t nrows,
+                       const char* const* paths, size_t npaths)
+{
+    if (bitset_delvec_init(dv, nrows)) {
+        return -1;
+    }
+    // One buffer is reused for all files.
+    void* buf = NULL;
+    size_t cap = 0;
+    for (size_t i = 0; i < npaths; i++) {
+        if (bitset_delvec_merge_file(dv, paths[i], &buf, &cap)) {
+            free(buf);
+            bitset_delvec_wipe(dv);
+            return -1;
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/* }}} */
+/* {{{ Runs */
+
+/* Return the first bit of `bs` from `from` that is set once xor-ed with
+ * `flip`, or bs->nbits if there is none.
+ */
+static size_t bitset_delvec_find(const bitset_t* bs, size_t from,
+                                 bitset_atom_t flip)
+{
+    if (from >= bs->nbits) {
+        return bs->nbits;
+    }
+    size_t i = from / BITS_PER_ATOM;
+    bitset_atom_t atom = (bs->bits[i] ^ flip)
+                       & (BITSET_ATOM_MAX << (from % BITS_PER_ATOM));
+    while (atom == 0 && ++i < bs->natoms) {
+        atom = bs->bits[i] ^ flip;
+    }
+    if (atom == 0) {
+        return bs->nbits;
+    }
+    // Padding bits of the last atom are clear, so set once flipped.
+    size_t bit = i * BITS_PER_ATOM + __builtin_ctzll(atom);
+    return bit < bs->nbits ? bit : bs->nbits;
+}
+
+void bitset_delvec_iter_init(bitset_delvec_iter_t* it,
+                             const bitset_delvec_t* dv)
+{
+    it->dv = dv;
+    it->row = 0;
+}
+
+int bitset_delvec_iter_next(bitset_delvec_iter_t* it, size_t* start,
+                            size_t* len)
+{
+    const bitset_t* deleted = &it->dv->deleted;
+    size_t first = bitset_delvec_find(deleted, it->row, BITSET_ATOM_MAX);
+    if (first == deleted->nbits) {
+        it->row = first;
+        return 0;
+    }
+    size_t end = bitset_delvec_find(deleted, first + 1, 0);
+    *start = first;
+    *len = end - first;
+    it->row = end;
+    return 1;
+}
+
+/* }}} */
+/* {{{ Filters */
+
+void bitset_delvec_live_and(bitset_t* dest, const bitset_delvec_t* dv,
+                            const bitset_t* pred)
+{
+    assert (dest->nbits == pred->nbits && pred->nbits == dv->deleted.nbits);
+    const bitset_atom_t* deleted = dv->deleted.bits;
+    for (size_t i = 0; i < dest->natoms; i++) {
+        dest->bits[i] = pred->bits[i] & ~deleted[i];
+    }
+}
+
+void bitset_delvec_filter(bitset_t* dest, const bitset_delvec_t* dv,
+                          bitset_delvec_pred_fn pred, void* arg)
+{
+    assert (dest->nbits == dv->deleted.nbits);
+    const size_t nrows = dest->nbits;
+    const bitset_atom_t* deleted = dv->deleted.bits;
+    for (size_t first = 0; first < nrows; first += BITSET_DELVEC_BLOCK) {
+        size_t n = nrows - first < BITSET_DELVEC_BLOCK
+                 ? nrows - first : BITSET_DELVEC_BLOCK;
+        bitset_t block = {
+            .nbits = n,
+            .natoms = BITS_TO_NATOMS(n),
+            .bits = dest->bits + first / BITS_PER_ATOM,
+        };
+        const bitset_atom_t* del = deleted + first / BITS_PER_ATOM;
+
+        // The padding of the last atom counts as deleted.
+        size_t r = n % BITS_PER_ATOM;
+        bitset_atom_t pad = r ? BITSET_ATOM_MAX << r : 0;
+        bitset_atom_t all = BITSET_ATOM_MAX;
+        for (size_t i = 0; i + 1 < block.natoms; i++) {
+            all &= del[i];
+        }
+        all &= del[block.natoms - 1] | pad;
+        if (all == BITSET_ATOM_MAX) {
+            memset(block.bits, 0, block.natoms * sizeof(bitset_atom_t));
+            continue;
+        }
+
+        pred(&block, first, arg);
+        for (size_t i = 0; i < block.natoms; i++) {
+            block.bits[i] &= ~del[i];
+        }
+    }
+}
+
+/* }}} */
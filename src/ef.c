@@ -0,0 +1,299 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BITSET_EF_X86
+#endif
+#include "bitset/ef.h"
+
+#define bitset_atom_popcnt  __builtin_popcountl
+#define bitset_atom_ctz     __builtin_ctzl
+
+static pthread_once_t bitset_ef_once = PTHREAD_ONCE_INIT;
+static int            bitset_ef_has_bmi2;
+
+static void bitset_ef_init_once(void) {
+#ifdef BITSET_EF_X86
+    bitset_ef_has_bmi2 = __builtin_cpu_supports("bmi2") != 0
+                      && __builtin_cpu_supports("popcnt") != 0;
+#endif
+}
+
+/* {{{ Helpers */
+
+/* Number of low bits per value, floor(log2(universe / n)). */
+static unsigned bitset_ef_low_bits(uint64_t universe, size_t n) {
+    if (n == 0) {
+        n = 1;
+    }
+    if (universe / n < 2) {
+        return 0;
+    }
+    return 63 - __builtin_clzl(universe / n);
+}
+
+static inline uint64_t bitset_ef_low(const bitset_ef_t* ef, size_t i) {
+    unsigned l = ef->low_bits;
+    if (l == 0) {
+        return 0;
+    }
+    size_t bit = i * l;
+    unsigned shift = bit % 64;
+    uint64_t v = ef->low[bit / 64] >> shift;
+    if (shift + l > 64) {
+        v |= ef->low[bit / 64 + 1] << (64 - shift);
+    }
+    return v & (((uint64_t)1 << l) - 1);
+}
+
+static inline void bitset_ef_set_low(bitset_ef_t* ef, size_t i, uint64_t v) {
+    unsigned l = ef->low_bits;
+    if (l == 0) {
+        return;
+    }
+    size_t bit = i * l;
+    unsigned shift = bit % 64;
+    v &= ((uint64_t)1 << l) - 1;
+    ef->low[bit / 64] |= v << shift;
+    if (shift + l > 64) {
+        ef->low[bit / 64 + 1] |= v >> (64 - shift);
+    }
+}
+
+/* Return the index of the k-th bit set in `atom`.
+ * @pre k < bitset_atom_popcnt(atom)
+ */
+static inline unsigned bitset_ef_select64(bitset_atom_t atom, unsigned k) {
+    unsigned base = 0;
+    for (;;) {
+        unsigned c = bitset_atom_popcnt(atom & 0xff);
+        if (k < c) {
+            break;
+        }
+        k -= c;
+        atom >>= 8;
+        base += 8;
+    }
+    while (k--) {
+        atom &= atom - 1;
+    }
+    return base + bitset_atom_ctz(atom);
+}
+
+/* Look for the rank-th one of `high ^ flip`, starting from the closest
+ * sample. Return the index of its atom, and store the bits of this atom into
+ * `bits`, and its rank in them into `rank`.
+ */
+static inline __attribute__((always_inline))
+size_t bitset_ef_select_atom(const bitset_t* high, const size_t* samples,
+                             size_t* rank, bitset_atom_t flip,
+                             bitset_atom_t* bits)
+{
+    size_t pos = samples[*rank / BITSET_EF_SAMPLE];
+    size_t atom = pos / BITS_PER_ATOM;
+    size_t r = *rank % BITSET_EF_SAMPLE;
+    bitset_atom_t b = (high->bits[atom] ^ flip)
+                    & (BITSET_ATOM_MAX << (pos % BITS_PER_ATOM));
+    for (;;) {
+        unsigned c = bitset_atom_popcnt(b);
+        if (r < c) {
+            break;
+        }
+        r -= c;
+        b = high->bits[++atom] ^ flip;
+    }
+    *rank = r;
+    *bits = b;
+    return atom;
+}
+
+#ifdef BITSET_EF_X86
+
+/* Same with a popcnt instruction instead of a libgcc call, and a pdep to
+ * select in an atom.
+ */
+__attribute__((target("popcnt,bmi2")))
+static size_t bitset_ef_select_bmi2(const bitset_t* high,
+                                    const size_t* samples, size_t rank,
+                                    bitset_atom_t flip)
+{
+    bitset_atom_t bits;
+    size_t atom = bitset_ef_select_atom(high, samples, &rank, flip, &bits);
+    return atom * BITS_PER_ATOM
+         + bitset_atom_ctz(_pdep_u64((uint64_t)1 << rank, bits));
+}
+
+#endif
+
+/* Return the position of the rank-th one of `high ^ flip`. */
+static size_t bitset_ef_select(const bitset_t* high, const size_t* samples,
+                               size_t rank, bitset_atom_t flip)
+{
+#ifdef BITSET_EF_X86
+    if (bitset_ef_has_bmi2) {
+        return bitset_ef_select_bmi2(high, samples, rank, flip);
+    }
+#endif
+    bitset_atom_t bits;
+    size_t atom = bitset_ef_select_atom(high, samples, &rank, flip, &bits);
+    return atom * BITS_PER_ATOM + bitset_ef_select64(bits, rank);
+}
+
+/* Record the position of every BITSET_EF_SAMPLE-th one of `high ^ flip`,
+ * within its first `nbits` bits.
+ */
+static void bitset_ef_sample(const bitset_t* high, size_t nbits,
+                             size_t* samples, bitset_atom_t flip)
+{
+    size_t rank = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < high->natoms; i++) {
+        bitset_atom_t bits = high->bits[i] ^ flip;
+        if ((i + 1) * BITS_PER_ATOM > nbits) {
+            bits &= ~(BITSET_ATOM_MAX << (nbits % BITS_PER_ATOM));
+        }
+        unsigned c = bitset_atom_popcnt(bits);
+        while (next < rank + c) {
+            samples[next / BITSET_EF_SAMPLE] =
+                i * BITS_PER_ATOM + bitset_ef_select64(bits, next - rank);
+            next += BITSET_EF_SAMPLE;
+        }
+        rank += c;
+    }
+}
+
+/* }}} */
+
+int bitset_ef_init(bitset_ef_t* ef, const uint64_t* values, size_t n,
+                   uint64_t universe)
+{
+    pthread_once(&bitset_ef_once, bitset_ef_init_once);
+    memset(ef, 0, sizeof(*ef));
+    ef->count = n;
+    ef->universe = universe;
+    ef->low_bits = bitset_ef_low_bits(universe, n);
+
+    // One padding word, so that a value can always be read from two words.
+    size_t nzeros = (universe >> ef->low_bits) + 1;
+    ef->low = calloc((n * ef->low_bits + 63) / 64 + 1, sizeof(uint64_t));
+    ef->select1 = malloc((n / BITSET_EF_SAMPLE + 1) * sizeof(size_t));
+    ef->select0 = malloc((nzeros / BITSET_EF_SAMPLE + 1) * sizeof(size_t));
+    if (!ef->low || !ef->select1 || !ef->select0
+    ||  bitset_init(&ef->high, n + nzeros) < 0) {
+        free(ef->low);
+        free(ef->select1);
+        free(ef->select0);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        assert (values[i] < universe);
+        assert (i == 0 || values[i - 1] <= values[i]);
+        bitset_set(&ef->high, (values[i] >> ef->low_bits) + i);
+        bitset_ef_set_low(ef, i, values[i]);
+    }
+    bitset_ef_sample(&ef->high, ef->high.nbits, ef->select1, 0);
+    bitset_ef_sample(&ef->high, ef->high.nbits, ef->select0, BITSET_ATOM_MAX);
+    return 0;
+}
+
+int bitset_ef_from_bitset(bitset_ef_t* ef, const bitset_t* bs) {
+    size_t n = bitset_popcnt(bs);
+    uint64_t* values = malloc((n ? n : 1) * sizeof(uint64_t));
+    if (!values) {
+        return -1;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < bs->natoms; i++) {
+        bitset_atom_t atom = bs->bits[i];
+        while (atom) {
+            values[k++] = i * BITS_PER_ATOM + bitset_atom_ctz(atom);
+            atom &= atom - 1;
+        }
+    }
+    int res = bitset_ef_init(ef, values, n, bs->nbits);
+    free(values);
+    return res;
+}
+
+void bitset_ef_wipe(bitset_ef_t* ef) {
+    free(ef->low);
+    free(ef->select1);
+    free(ef->select0);
+    bitset_wipe(&ef->high);
+}
+
+size_t bitset_ef_size(const bitset_ef_t* ef) {
+    size_t nzeros = ef->high.nbits - ef->count;
+    return sizeof(*ef)
+         + ((ef->count * ef->low_bits + 63) / 64 + 1) * sizeof(uint64_t)
+         + ef->high.natoms * sizeof(bitset_atom_t)
+         + (ef->count / BITSET_EF_SAMPLE + 1) * sizeof(size_t)
+         + (nzeros / BITSET_EF_SAMPLE + 1) * sizeof(size_t);
+}
+
+uint64_t bitset_ef_get(const bitset_ef_t* ef, size_t i) {
+    assert (i < ef->count);
+    size_t pos = bitset_ef_select(&ef->high, ef->select1, i, 0);
+    return ((uint64_t)(pos - i) << ef->low_bits) | bitset_ef_low(ef, i);
+}
+
+size_t bitset_ef_next_geq(const bitset_ef_t* ef, uint64_t x, uint64_t* value)
+{
+    if (x >= ef->universe) {
+        return ef->count;
+    }
+
+    // Values whose high bits are `h` follow the h-th zero of `high`, and
+    // are preceded by `pos - h` values.
+    uint64_t h = x >> ef->low_bits;
+    size_t pos = 0;
+    if (h > 0) {
+        pos = bitset_ef_select(&ef->high, ef->select0, h - 1,
+                               BITSET_ATOM_MAX) + 1;
+    }
+    bitset_ef_iter_t it = { .ef = ef, .index = pos - h, .pos = pos };
+    uint64_t v;
+    while (bitset_ef_iter_next(&it, &v)) {
+        if (v >= x) {
+            *value = v;
+            return it.index - 1;
+        }
+    }
+    return ef->count;
+}
+
+void bitset_ef_iter_init(bitset_ef_iter_t* it, const bitset_ef_t* ef,
+                         size_t i)
+{
+    assert (i <= ef->count);
+    it->ef = ef;
+    it->index = i;
+    it->pos = i < ef->count ? bitset_ef_select(&ef->high, ef->select1, i, 0)
+                            : ef->high.nbits;
+}
+
+int bitset_ef_iter_next(bitset_ef_iter_t* it, uint64_t* value) {
+    const bitset_ef_t* ef = it->ef;
+    if (it->index >= ef->count) {
+        return 0;
+    }
+
+    // There is a one left, no need to check bounds.
+    size_t atom = it->pos / BITS_PER_ATOM;
+    bitset_atom_t bits = ef->high.bits[atom]
+                       & (BITSET_ATOM_MAX << (it->pos % BITS_PER_ATOM));
+    while (bits == 0) {
+        bits = ef->high.bits[++atom];
+    }
+    size_t pos = atom * BITS_PER_ATOM + bitset_atom_ctz(bits);
+
+    *value = ((uint64_t)(pos - it->index) << ef->low_bits)
+           | bitset_ef_low(ef, it->index);
+    it->pos = pos + 1;
+    it->index++;
+    return 1;
+}
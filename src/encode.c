@@ -0,0 +1,505 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define BITSET_ENCODE_X86
+#endif
+#include "bitset/encode.h"
+
+#define bitset_atom_ctz     __builtin_ctzl
+
+#define BITSET_ENCODE_MAGIC     0x4e455342  /* "BSEN" */
+
+/* Largest gap stream-vbyte accepts, so that sums of four gaps fit in the
+ * 32-bit lanes of the SIMD decoder.
+ */
+#define BITSET_VBYTE_MAX_GAP    ((uint64_t)1 << 30)
+
+typedef struct bitset_encode_header {
+    uint32_t magic;
+    uint32_t encoding;
+    uint64_t nbits;
+    uint64_t count;     /* Number of positions */
+} bitset_encode_header_t;
+
+/* Iterate over set positions of `bs`, in order, as `_pos`. */
+#define BITSET_FOREACH(_bs, _pos, _body)                                    \
+    for (size_t _i = 0; _i < (_bs)->natoms; _i++) {                         \
+        bitset_atom_t _atom = (_bs)->bits[_i];                              \
+        while (_atom) {                                                     \
+            size_t _pos = _i * BITS_PER_ATOM + bitset_atom_ctz(_atom);      \
+            _atom &= _atom - 1;                                             \
+            _body                                                           \
+        }                                                                   \
+    }
+
+static inline void bitset_encode_set(bitset_t* bs, size_t pos) {
+    bs->bits[pos / BITS_PER_ATOM] |= (bitset_atom_t)1 << (pos % BITS_PER_ATOM);
+}
+
+/* {{{ Stream-vbyte */
+
+static pthread_once_t bitset_vbyte_once = PTHREAD_ONCE_INIT;
+static uint8_t bitset_vbyte_shuffle[256][16];   /* pshufb mask per control */
+static uint8_t bitset_vbyte_length[256];        /* Data bytes per control */
+static int     bitset_vbyte_has_ssse3;
+
+static void bitset_vbyte_init(void) {
+    for (int c = 0; c < 256; c++) {
+        uint8_t off = 0;
+        for (int k = 0; k < 4; k++) {
+            int len = ((c >> (2 * k)) & 3) + 1;
+            for (int j = 0; j < 4; j++) {
+                bitset_vbyte_shuffle[c][4 * k + j] = j < len ? off + j : 0xff;
+            }
+            off += len;
+        }
+        bitset_vbyte_length[c] = off;
+    }
+#ifdef BITSET_ENCODE_X86
+    bitset_vbyte_has_ssse3 = __builtin_cpu_supports("ssse3") != 0;
+#endif
+}
+
+static inline int bitset_vbyte_len(uint32_t gap) {
+    return gap < (1 << 8) ? 1 : gap < (1 << 16) ? 2 : gap < (1 << 24) ? 3 : 4;
+}
+
+/* Return the size of the vbyte payload of `bs`, or 0 if a gap is too big. */
+static size_t bitset_vbyte_size(const bitset_t* bs, size_t count) {
+    size_t size = (count + 3) / 4;
+    size_t prev = 0;
+    BITSET_FOREACH(bs, pos, {
+        if (pos - prev >= BITSET_VBYTE_MAX_GAP) {
+            return 0;
+        }
+        size += bitset_vbyte_len(pos - prev);
+        prev = pos;
+    })
+    return size;
+}
+
+static void bitset_vbyte_encode(const bitset_t* bs, size_t count,
+                                unsigned char* out)
+{
+    unsigned char* control = out;
+    unsigned char* data = out + (count + 3) / 4;
+    size_t prev = 0;
+    size_t n = 0;
+
+    memset(control, 0, (count + 3) / 4);
+    BITSET_FOREACH(bs, pos, {
+        uint32_t gap = pos - prev;
+        int len = bitset_vbyte_len(gap);
+        control[n / 4] |= (len - 1) << (2 * (n % 4));
+        for (int j = 0; j < len; j++) {
+            *data++ = gap >> (8 * j);
+        }
+        prev = pos;
+        n++;
+    })
+}
+
+/* Decode a group of `n` <= 4 gaps with plain loads.
+ * @return the number of data bytes read, or 0 if they overflow `end` or a
+ * gap or a position is out of range.
+ */
+static size_t bitset_vbyte_decode_scalar(bitset_t* bs, unsigned c, size_t n,
+                                         const unsigned char* data,
+                                         const unsigned char* end,
+                                         size_t* base)
+{
+    const unsigned char* p = data;
+    for (size_t k = 0; k < n; k++) {
+        int len = ((c >> (2 * k)) & 3) + 1;
+        if (end - p < len) {
+            return 0;
+        }
+        uint32_t gap = 0;
+        for (int j = 0; j < len; j++) {
+            gap |= (uint32_t)p[j] << (8 * j);
+        }
+        p += len;
+        if (gap >= BITSET_VBYTE_MAX_GAP) {
+            return 0;
+        }
+        *base += gap;
+        if (*base >= bs->nbits) {
+            return 0;
+        }
+        bitset_encode_set(bs, *base);
+    }
+    return p - data;
+}
+
+#ifdef BITSET_ENCODE_X86
+
+/* Decode full groups of four gaps with a byte shuffle and an in-register
+ * prefix sum, as long as 16 bytes can be loaded. Return the number of
+ * groups decoded, or -1 on a gap or a position out of range.
+ */
+__attribute__((target("ssse3")))
+static ssize_t bitset_vbyte_decode_ssse3(bitset_t* bs,
+                                         const unsigned char* control,
+                                         size_t ngroups,
+                                         const unsigned char** data,
+                                         const unsigned char* end,
+                                         size_t* base)
+{
+    const unsigned char* p = *data;
+    size_t g = 0;
+    for (; g < ngroups && end - p >= 16; g++) {
+        unsigned c = control[g];
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        __m128i mask = _mm_loadu_si128((const __m128i*)bitset_vbyte_shuffle[c]);
+        __m128i gaps = _mm_shuffle_epi8(bytes, mask);
+        // Gaps the encoder never writes could wrap the lane sums.
+        __m128i big = _mm_srli_epi32(gaps, 30);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(big, _mm_setzero_si128()))
+            != 0xffff) {
+            return -1;
+        }
+        gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 4));
+        gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 8));
+
+        uint32_t offsets[4];
+        _mm_storeu_si128((__m128i*)offsets, gaps);
+        if (*base + offsets[3] >= bs->nbits) {
+            return -1;
+        }
+        for (int k = 0; k < 4; k++) {
+            bitset_encode_set(bs, *base + offsets[k]);
+        }
+        *base += offsets[3];
+        p += bitset_vbyte_length[c];
+    }
+    *data = p;
+    return g;
+}
+
+#endif
+
+static int bitset_vbyte_decode(bitset_t* bs, size_t count,
+                               const unsigned char* in, size_t len)
+{
+    size_t ncontrol = (count + 3) / 4;
+    if (len < ncontrol) {
+        return -1;
+    }
+    const unsigned char* control = in;
+    const unsigned char* data = in + ncontrol;
+    const unsigned char* end = in + len;
+    size_t base = 0;
+    size_t g = 0;
+    size_t nfull = count / 4;
+
+#ifdef BITSET_ENCODE_X86
+    if (bitset_vbyte_has_ssse3) {
+        ssize_t done = bitset_vbyte_decode_ssse3(bs, control, nfull, &data, end,
+                                                 &base);
+        if (done < 0) {
+            return -1;
+        }
+        g = done;
+    }
+#endif
+    for (; g < ncontrol; g++) {
+        size_t n = g < nfull ? 4 : count % 4;
+        size_t used = bitset_vbyte_decode_scalar(bs, control[g], n, data, end,
+                                                 &base);
+        if (used == 0) {
+            return -1;
+        }
+        data += used;
+    }
+    return 0;
+}
+
+/* }}} */
+/* {{{ Elias-Fano */
+
+/* Number of low bits per position */
+static unsigned bitset_ef_low_bits(size_t nbits, size_t count) {
+    if (count == 0 || nbits / count < 2) {
+        return 0;
+    }
+    return 63 - __builtin_clzl(nbits / count);
+}
+
+static size_t bitset_ef_low_words(size_t count, unsigned l) {
+    return (count * l + 63) / 64;
+}
+
+static size_t bitset_ef_high_words(size_t nbits, size_t count, unsigned l) {
+    return ((nbits >> l) + count + 63) / 64;
+}
+
+static size_t bitset_ef_size(size_t nbits, size_t count) {
+    unsigned l = bitset_ef_low_bits(nbits, count);
+    return (bitset_ef_low_words(count, l) + bitset_ef_high_words(nbits, count, l))
+         * sizeof(uint64_t);
+}
+
+static int bitset_ef_encode(const bitset_t* bs, size_t count,
+                            unsigned char* out)
+{
+    unsigned l = bitset_ef_low_bits(bs->nbits, count);
+    size_t nlow = bitset_ef_low_words(count, l);
+    size_t nhigh = bitset_ef_high_words(bs->nbits, count, l);
+    uint64_t* low = calloc(nlow + nhigh + 1, sizeof(uint64_t));
+    if (!low) {
+        return -1;
+    }
+    uint64_t* high = low + nlow;
+    uint64_t mask = l ? ((uint64_t)1 << l) - 1 : 0;
+
+    // `low` is written in a scratch buffer as `out` may not be aligned.
+    size_t i = 0;
+    BITSET_FOREACH(bs, pos, {
+        if (l) {
+            size_t bit = i * l;
+            uint64_t v = pos & mask;
+            low[bit / 64] |= v << (bit % 64);
+            if (bit % 64 + l > 64) {
+                low[bit / 64 + 1] |= v >> (64 - bit % 64);
+            }
+        }
+        size_t h = (pos >> l) + i;
+        high[h / 64] |= (uint64_t)1 << (h % 64);
+        i++;
+    })
+    memcpy(out, low, (nlow + nhigh) * sizeof(uint64_t));
+    free(low);
+    return 0;
+}
+
+static int bitset_ef_decode(bitset_t* bs, size_t count,
+                            const unsigned char* in, size_t len)
+{
+    unsigned l = bitset_ef_low_bits(bs->nbits, count);
+    size_t nlow = bitset_ef_low_words(count, l);
+    size_t nhigh = bitset_ef_high_words(bs->nbits, count, l);
+    if (len < (nlow + nhigh) * sizeof(uint64_t)) {
+        return -1;
+    }
+    const unsigned char* high = in + nlow * sizeof(uint64_t);
+    uint64_t mask = l ? ((uint64_t)1 << l) - 1 : 0;
+
+    size_t i = 0;
+    for (size_t w = 0; w < nhigh; w++) {
+        uint64_t word;
+        memcpy(&word, high + w * sizeof(uint64_t), sizeof(word));
+        while (word) {
+            if (i == count) {
+                return -1;
+            }
+            size_t h = w * 64 + bitset_atom_ctz(word) - i;
+            word &= word - 1;
+
+            uint64_t v = 0;
+            if (l) {
+                size_t bit = i * l;
+                uint64_t lo[2] = { 0, 0 };
+                size_t n = bit / 64 + 1 < nlow ? 2 : 1;
+                memcpy(lo, in + bit / 64 * sizeof(uint64_t),
+                       n * sizeof(uint64_t));
+                v = lo[0] >> (bit % 64);
+                if (bit % 64 + l > 64) {
+                    v |= lo[1] << (64 - bit % 64);
+                }
+                v &= mask;
+            }
+            size_t pos = (h << l) | v;
+            if (pos >= bs->nbits) {
+                return -1;
+            }
+            bitset_encode_set(bs, pos);
+            i++;
+        }
+    }
+    return i == count ? 0 : -1;
+}
+
+/* }}} */
+
+static size_t bitset_payload_size(const bitset_t* bs, size_t count,
+                                  bitset_encoding_t encoding)
+{
+    switch (encoding) {
+      case BITSET_ENCODING_RAW:
+        return bs->natoms * sizeof(bitset_atom_t);
+      case BITSET_ENCODING_VBYTE:
+        return count ? bitset_vbyte_size(bs, count) : 0;
+      case BITSET_ENCODING_EF:
+        return bitset_ef_size(bs->nbits, count);
+      default:
+        return 0;
+    }
+}
+
+/* Pick the smallest encoding, preferring the faster ones on ties. */
+static bitset_encoding_t bitset_pick_encoding(const bitset_t* bs, size_t count,
+                                              size_t* payload)
+{
+    bitset_encoding_t best = BITSET_ENCODING_RAW;
+    *payload = bitset_payload_size(bs, count, best);
+
+    size_t vbyte = bitset_payload_size(bs, count, BITSET_ENCODING_VBYTE);
+    if ((vbyte && vbyte < *payload) || count == 0) {
+        best = BITSET_ENCODING_VBYTE;
+        *payload = vbyte;
+    }
+    size_t ef = bitset_payload_size(bs, count, BITSET_ENCODING_EF);
+    if (ef < *payload) {
+        best = BITSET_ENCODING_EF;
+        *payload = ef;
+    }
+    return best;
+}
+
+bitset_encoding_t bitset_best_encoding(const bitset_t* bs) {
+    size_t payload;
+    return bitset_pick_encoding(bs, bitset_popcnt(bs), &payload);
+}
+
+size_t bitset_encoded_size(const bitset_t* bs, bitset_encoding_t encoding) {
+    size_t count = bitset_popcnt(bs);
+    size_t payload;
+    if (encoding == BITSET_ENCODING_AUTO) {
+        bitset_pick_encoding(bs, count, &payload);
+    } else {
+        payload = bitset_payload_size(bs, count, encoding);
+        if (encoding == BITSET_ENCODING_VBYTE && payload == 0 && count) {
+            return 0;
+        }
+    }
+    return sizeof(bitset_encode_header_t) + payload;
+}
+
+size_t bitset_encode(const bitset_t* bs, bitset_encoding_t encoding,
+                     void* buf, size_t len)
+{
+    pthread_once(&bitset_vbyte_once, bitset_vbyte_init);
+
+    size_t count = bitset_popcnt(bs);
+    size_t payload;
+    if (encoding == BITSET_ENCODING_AUTO) {
+        encoding = bitset_pick_encoding(bs, count, &payload);
+    } else {
+        payload = bitset_payload_size(bs, count, encoding);
+        if (encoding == BITSET_ENCODING_VBYTE && payload == 0 && count) {
+            return 0;
+        }
+    }
+    size_t size = sizeof(bitset_encode_header_t) + payload;
+    if (size > len) {
+        return 0;
+    }
+
+    bitset_encode_header_t header = {
+        .magic = BITSET_ENCODE_MAGIC,
+        .encoding = encoding,
+        .nbits = bs->nbits,
+        .count = count,
+    };
+    unsigned char* out = buf;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+
+    switch (encoding) {
+      case BITSET_ENCODING_RAW:
+        memcpy(out, bs->bits, payload);
+        break;
+      case BITSET_ENCODING_VBYTE:
+        bitset_vbyte_encode(bs, count, out);
+        break;
+      case BITSET_ENCODING_EF:
+        if (bitset_ef_encode(bs, count, out) < 0) {
+            return 0;
+        }
+        break;
+      default:
+        return 0;
+    }
+    return size;
+}
+
+int bitset_encoding_of(const void* buf, size_t len) {
+    bitset_encode_header_t header;
+    if (len < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (header.magic != BITSET_ENCODE_MAGIC
+    ||  header.encoding < BITSET_ENCODING_RAW
+    ||  header.encoding > BITSET_ENCODING_EF
+    ||  header.count > header.nbits) {
+        return -1;
+    }
+    return header.encoding;
+}
+
+/* Set in `bs` the positions of the payload `in` of `len` bytes described
+ * by `header`, keeping those already set.
+ */
+static int bitset_decode_payload(bitset_t* bs,
+                                 const bitset_encode_header_t* header,
+                                 const unsigned char* in, size_t len)
+{
+    switch (header->encoding) {
+      case BITSET_ENCODING_RAW:
+        if (len < bs->natoms * sizeof(bitset_atom_t)) {
+            return -1;
+        }
+        for (size_t i = 0; i < bs->natoms; i++) {
+            bitset_atom_t atom;
+            memcpy(&atom, in + i * sizeof(atom), sizeof(atom));
+            bs->bits[i] |= atom;
+        }
+        return 0;
+      case BITSET_ENCODING_VBYTE:
+        return bitset_vbyte_decode(bs, header->count, in, len);
+      case BITSET_ENCODING_EF:
+        return bitset_ef_decode(bs, header->count, in, len);
+    }
+    return -1;
+}
+
+int bitset_decode(bitset_t* bs, const void* buf, size_t len) {
+    pthread_once(&bitset_vbyte_once, bitset_vbyte_init);
+
+    if (bitset_encoding_of(buf, len) < 0) {
+        return -1;
+    }
+    bitset_encode_header_t header;
+    memcpy(&header, buf, sizeof(header));
+    if (bitset_init(bs, header.nbits) < 0) {
+        return -1;
+    }
+    const unsigned char* in = (const unsigned char*)buf + sizeof(header);
+    int res = bitset_decode_payload(bs, &header, in, len - sizeof(header));
+    if (res != 0) {
+        bitset_wipe(bs);
+    }
+    return res;
+}
+
+int bitset_decode_or(bitset_t* bs, const void* buf, size_t len) {
+    pthread_once(&bitset_vbyte_once, bitset_vbyte_init);
+
+    if (bitset_encoding_of(buf, len) < 0) {
+        return -1;
+    }
+    bitset_encode_header_t header;
+    memcpy(&header, buf, sizeof(header));
+    if (header.nbits != bs->nbits) {
+        return -1;
+    }
+    const unsigned char* in = (const unsigned char*)buf + sizeof(header);
+    return bitset_decode_payload(bs, &header, in, len - sizeof(header));
+}
@@ -0,0 +1,389 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bitset/file.h"
+#include "bitset/image.h"
+#include "io.h"
+
+#define bitset_atom_popcnt  __builtin_popcountl
+
+#define BITSET_FILE_BLOCK_SIZE  (BITSET_FILE_BLOCK_ATOMS * sizeof(bitset_atom_t))
+
+#define BITSET_FILE_NO_SLOT     UINT32_MAX
+
+/* {{{ Block cache */
+
+static off_t bitset_file_block_offset(size_t block) {
+    return BITSET_IMAGE_HEADER_SIZE + (off_t)block * BITSET_FILE_BLOCK_SIZE;
+}
+
+static bitset_atom_t* bitset_file_frame(bitset_file_t* bf, size_t slot) {
+    return bf->frames + slot * BITSET_FILE_BLOCK_ATOMS;
+}
+
+static int bitset_file_writeback(bitset_file_t* bf, size_t slot) {
+    bitset_file_slot_t* s = &bf->slots[slot];
+    if (!s->dirty) {
+        return 0;
+    }
+    size_t len = bitset_file_block_natoms(bf, s->block) * sizeof(bitset_atom_t);
+    if (bitset_pwrite_all(bf->fd, bitset_file_frame(bf, slot), len,
+                          bitset_file_block_offset(s->block)) < 0) {
+        return -1;
+    }
+    s->dirty = 0;
+    bf->writebacks++;
+    return 0;
+}
+
+/* Find a slot to load a new block into, using the CLOCK algorithm: the hand
+ * goes around slots, clearing reference bits, until it finds a slot that
+ * hasn't been referenced since its last visit.
+ */
+static ssize_t bitset_file_evict(bitset_file_t* bf) {
+    for (;;) {
+        size_t slot = bf->hand;
+        bitset_file_slot_t* s = &bf->slots[slot];
+        bf->hand = (bf->hand + 1) % bf->nslots;
+
+        if (s->block == SIZE_MAX) {
+            return slot;
+        }
+        if (s->ref) {
+            s->ref = 0;
+            continue;
+        }
+        if (bitset_file_writeback(bf, slot) < 0) {
+            return -1;
+        }
+        bf->block_slot[s->block] = BITSET_FILE_NO_SLOT;
+        s->block = SIZE_MAX;
+        return slot;
+    }
+}
+
+/* Load `block` into the cache. When `load` is 0 the block is about to be
+ * entirely overwritten, so its content isn't read.
+ */
+static bitset_atom_t* bitset_file_fetch(bitset_file_t* bf, size_t block,
+                                        int write, int load)
+{
+    assert (block < bf->nblocks);
+    assert (!write || !bf->rdonly);
+
+    uint32_t slot = bf->block_slot[block];
+    if (slot != BITSET_FILE_NO_SLOT) {
+        bf->hits++;
+        bf->slots[slot].ref = 1;
+        bf->slots[slot].dirty |= write;
+        return bitset_file_frame(bf, slot);
+    }
+
+    bf->misses++;
+    ssize_t victim = bitset_file_evict(bf);
+    if (victim < 0) {
+        return NULL;
+    }
+    bitset_atom_t* frame = bitset_file_frame(bf, victim);
+    if (load) {
+        size_t len = bitset_file_block_natoms(bf, block)
+                   * sizeof(bitset_atom_t);
+        if (bitset_pread_all(bf->fd, frame, len,
+                             bitset_file_block_offset(block)) < 0) {
+            return NULL;
+        }
+        // Let the kernel read following blocks while we work on this one.
+        if (bf->readahead && block + 1 < bf->nblocks) {
+            posix_fadvise(bf->fd, bitset_file_block_offset(block + 1),
+                          bf->readahead * BITSET_FILE_BLOCK_SIZE,
+                          POSIX_FADV_WILLNEED);
+        }
+    }
+
+    bf->slots[victim].block = block;
+    bf->slots[victim].ref = 1;
+    bf->slots[victim].dirty = write;
+    bf->block_slot[block] = victim;
+    return frame;
+}
+
+static int bitset_file_init_cache(bitset_file_t* bf, size_t cache_size) {
+    bf->nblocks = (bf->natoms + BITSET_FILE_BLOCK_ATOMS - 1)
+                / BITSET_FILE_BLOCK_ATOMS;
+    bf->nslots = cache_size / BITSET_FILE_BLOCK_SIZE;
+    if (bf->nslots < 1) {
+        bf->nslots = 1;
+    }
+    if (bf->nslots > bf->nblocks && bf->nblocks > 0) {
+        bf->nslots = bf->nblocks;
+    }
+    bf->hand = 0;
+    bf->readahead = BITSET_FILE_READAHEAD;
+    bf->hits = bf->misses = bf->writebacks = 0;
+
+    bf->slots = malloc(bf->nslots * sizeof(*bf->slots));
+    bf->block_slot = malloc((bf->nblocks + 1) * sizeof(*bf->block_slot));
+    if (posix_memalign((void**)&bf->frames, 4096,
+                       bf->nslots * BITSET_FILE_BLOCK_SIZE) != 0) {
+        bf->frames = NULL;
+    }
+    if (!bf->slots || !bf->block_slot || !bf->frames) {
+        free(bf->slots);
+        free(bf->block_slot);
+        free(bf->frames);
+        return -1;
+    }
+    for (size_t i = 0; i < bf->nslots; i++) {
+        bf->slots[i].block = SIZE_MAX;
+        bf->slots[i].ref = 0;
+        bf->slots[i].dirty = 0;
+    }
+    for (size_t i = 0; i < bf->nblocks; i++) {
+        bf->block_slot[i] = BITSET_FILE_NO_SLOT;
+    }
+    return 0;
+}
+
+/* }}} */
+
+int bitset_file_create(bitset_file_t* bf, const char* path, size_t nbits,
+                       size_t cache_size)
+{
+    bf->nbits = nbits;
+    bf->natoms = BITS_TO_NATOMS(nbits);
+    bf->rdonly = 0;
+    bf->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (bf->fd < 0) {
+        return -1;
+    }
+
+    // The atoms are a hole in the file, which reads as zeros.
+    char header[BITSET_IMAGE_HEADER_SIZE] = { 0 };
+    bitset_image_header_init((bitset_image_header_t*)header, nbits);
+    if (bitset_pwrite_all(bf->fd, header, sizeof(header), 0) < 0
+    ||  ftruncate(bf->fd, BITSET_IMAGE_SIZE(nbits)) < 0
+    ||  bitset_file_init_cache(bf, cache_size) < 0) {
+        close(bf->fd);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+int bitset_file_open(bitset_file_t* bf, const char* path, int rdonly,
+                     size_t cache_size)
+{
+    bf->rdonly = rdonly;
+    bf->fd = open(path, rdonly ? O_RDONLY : O_RDWR);
+    if (bf->fd < 0) {
+        return -1;
+    }
+
+    bitset_image_header_t header;
+    if (bitset_image_read_header(bf->fd, &header) < 0) {
+        close(bf->fd);
+        return -1;
+    }
+    // Blocks are going to be modified without updating the CRC table, so
+    // the image stops claiming to have one.
+    if (!rdonly && (header.flags & BITSET_IMAGE_CRC32C)) {
+        header.flags &= ~BITSET_IMAGE_CRC32C;
+        if (bitset_pwrite_all(bf->fd, &header, sizeof(header), 0) < 0) {
+            close(bf->fd);
+            return -1;
+        }
+    }
+    bf->nbits = header.nbits;
+    bf->natoms = BITS_TO_NATOMS(header.nbits);
+    if (bitset_file_init_cache(bf, cache_size) < 0) {
+        close(bf->fd);
+        return -1;
+    }
+    posix_fadvise(bf->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+int bitset_file_flush(bitset_file_t* bf) {
+    if (bf->rdonly) {
+        return 0;
+    }
+    for (size_t i = 0; i < bf->nslots; i++) {
+        if (bitset_file_writeback(bf, i) < 0) {
+            return -1;
+        }
+    }
+    return fdatasync(bf->fd);
+}
+
+int bitset_file_close(bitset_file_t* bf) {
+    int res = bitset_file_flush(bf);
+    close(bf->fd);
+    free(bf->slots);
+    free(bf->block_slot);
+    free(bf->frames);
+    return res;
+}
+
+bitset_atom_t* bitset_file_block(bitset_file_t* bf, size_t block, int write) {
+    return bitset_file_fetch(bf, block, write, 1);
+}
+
+extern size_t bitset_file_block_natoms(const bitset_file_t* bf, size_t block);
+
+/* {{{ Single bit manipulation */
+
+int bitset_file_get(bitset_file_t* bf, size_t bit) {
+    assert (bit < bf->nbits);
+    size_t atom = bit / BITS_PER_ATOM;
+    bitset_atom_t* atoms = bitset_file_block(bf, atom / BITSET_FILE_BLOCK_ATOMS,
+                                             0);
+    if (!atoms) {
+        return -1;
+    }
+    return (atoms[atom % BITSET_FILE_BLOCK_ATOMS] >> (bit % BITS_PER_ATOM)) & 1;
+}
+
+int bitset_file_set(bitset_file_t* bf, size_t bit) {
+    assert (bit < bf->nbits);
+    size_t atom = bit / BITS_PER_ATOM;
+    bitset_atom_t* atoms = bitset_file_block(bf, atom / BITSET_FILE_BLOCK_ATOMS,
+                                             1);
+    if (!atoms) {
+        return -1;
+    }
+    atoms[atom % BITSET_FILE_BLOCK_ATOMS] |=
+        (bitset_atom_t)1 << (bit % BITS_PER_ATOM);
+    return 0;
+}
+
+int bitset_file_unset(bitset_file_t* bf, size_t bit) {
+    assert (bit < bf->nbits);
+    size_t atom = bit / BITS_PER_ATOM;
+    bitset_atom_t* atoms = bitset_file_block(bf, atom / BITSET_FILE_BLOCK_ATOMS,
+                                             1);
+    if (!atoms) {
+        return -1;
+    }
+    atoms[atom % BITSET_FILE_BLOCK_ATOMS] &=
+        ~((bitset_atom_t)1 << (bit % BITS_PER_ATOM));
+    return 0;
+}
+
+/* }}} */
+/* {{{ Streaming functions */
+
+long long bitset_file_popcnt(bitset_file_t* bf) {
+    long long sum = 0;
+    for (size_t block = 0; block < bf->nblocks; block++) {
+        const bitset_atom_t* atoms = bitset_file_block(bf, block, 0);
+        if (!atoms) {
+            return -1;
+        }
+        size_t n = bitset_file_block_natoms(bf, block);
+        for (size_t i = 0; i < n; i++) {
+            sum += bitset_atom_popcnt(atoms[i]);
+        }
+    }
+    return sum;
+}
+
+long long bitset_file_and_popcnt(bitset_file_t* a, bitset_file_t* b) {
+    assert (a->natoms == b->natoms);
+
+    long long sum = 0;
+    for (size_t block = 0; block < a->nblocks; block++) {
+        const bitset_atom_t* x = bitset_file_block(a, block, 0);
+        const bitset_atom_t* y = bitset_file_block(b, block, 0);
+        if (!x || !y) {
+            return -1;
+        }
+        size_t n = bitset_file_block_natoms(a, block);
+        for (size_t i = 0; i < n; i++) {
+            sum += bitset_atom_popcnt(x[i] & y[i]);
+        }
+    }
+    return sum;
+}
+
+int bitset_file_and_to(bitset_file_t* dest, bitset_file_t* a,
+                       bitset_file_t* b)
+{
+    assert (a->natoms == b->natoms);
+    assert (dest->natoms == a->natoms);
+
+    for (size_t block = 0; block < a->nblocks; block++) {
+        const bitset_atom_t* x = bitset_file_block(a, block, 0);
+        const bitset_atom_t* y = bitset_file_block(b, block, 0);
+        bitset_atom_t* d = bitset_file_fetch(dest, block, 1, 0);
+        if (!x || !y || !d) {
+            return -1;
+        }
+        size_t n = bitset_file_block_natoms(a, block);
+        for (size_t i = 0; i < n; i++) {
+            d[i] = x[i] & y[i];
+        }
+    }
+    return 0;
+}
+
+int bitset_file_or_to(bitset_file_t* dest, bitset_file_t* a,
+                      bitset_file_t* b)
+{
+    assert (a->natoms == b->natoms);
+    assert (dest->natoms == a->natoms);
+
+    for (size_t block = 0; block < a->nblocks; block++) {
+        const bitset_atom_t* x = bitset_file_block(a, block, 0);
+        const bitset_atom_t* y = bitset_file_block(b, block, 0);
+        bitset_atom_t* d = bitset_file_fetch(dest, block, 1, 0);
+        if (!x || !y || !d) {
+            return -1;
+        }
+        size_t n = bitset_file_block_natoms(a, block);
+        for (size_t i = 0; i < n; i++) {
+            d[i] = x[i] | y[i];
+        }
+    }
+    return 0;
+}
+
+int bitset_file_and(bitset_file_t* a, bitset_file_t* b) {
+    assert (a->natoms == b->natoms);
+
+    for (size_t block = 0; block < a->nblocks; block++) {
+        const bitset_atom_t* y = bitset_file_block(b, block, 0);
+        bitset_atom_t* x = bitset_file_block(a, block, 1);
+        if (!x || !y) {
+            return -1;
+        }
+        size_t n = bitset_file_block_natoms(a, block);
+        for (size_t i = 0; i < n; i++) {
+            x[i] &= y[i];
+        }
+    }
+    return 0;
+}
+
+int bitset_file_or(bitset_file_t* a, bitset_file_t* b) {
+    assert (a->natoms == b->natoms);
+
+    for (size_t block = 0; block < a->nblocks; block++) {
+        const bitset_atom_t* y = bitset_file_block(b, block, 0);
+        bitset_atom_t* x = bitset_file_block(a, block, 1);
+        if (!x || !y) {
+            return -1;
+        }
+        size_t n = bitset_file_block_natoms(a, block);
+        for (size_t i = 0; i < n; i++) {
+            x[i] |= y[i];
+        }
+    }
+    return 0;
+}
+
+/* }}} */
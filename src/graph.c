@@ -0,0 +1,541 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "bitset/graph.h"
+
+#define bitset_atom_ctz     __builtin_ctzl
+
+int bitset_graph_init(bitset_graph_t* g, size_t n) {
+    g->n = n;
+    g->rows = malloc((n ? n : 1) * sizeof(bitset_t));
+    if (!g->rows) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (bitset_init(&g->rows[i], n) < 0) {
+            g->n = i;
+            bitset_graph_wipe(g);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void bitset_graph_wipe(bitset_graph_t* g) {
+    for (size_t i = 0; i < g->n; i++) {
+        bitset_wipe(&g->rows[i]);
+    }
+    free(g->rows);
+}
+
+extern void bitset_graph_add_edge(bitset_graph_t* g, size_t u, size_t v);
+
+/* Return a view of the atoms of `bs` from the first one holding vertices
+ * ranked after `v`, those before being empty in sets of later vertices.
+ */
+static inline bitset_t bitset_graph_after(const bitset_t* bs, size_t v) {
+    size_t from = (v + 1) / BITS_PER_ATOM;
+    bitset_t tail = {
+        .nbits = bs->nbits - from * BITS_PER_ATOM,
+        .natoms = bs->natoms - from,
+        .bits = bs->bits + from,
+    };
+    return tail;
+}
+
+/* {{{ Ranking */
+
+/* Graph relabeled so that vertex ids are ranks by increasing degree */
+typedef struct bitset_graph_ranked {
+    size_t    n;
+    bitset_t *adj;      /* All neighbors, NULL if not needed */
+    bitset_t *up;       /* Neighbors of higher rank */
+    size_t   *vertex;   /* Vertex of each rank */
+    size_t    max_up;   /* Largest number of neighbors of higher rank */
+} bitset_graph_ranked_t;
+
+typedef struct bitset_graph_degree {
+    size_t degree;
+    size_t vertex;
+} bitset_graph_degree_t;
+
+static int bitset_graph_degree_cmp(const void* a, const void* b) {
+    const bitset_graph_degree_t* da = a;
+    const bitset_graph_degree_t* db = b;
+    if (da->degree != db->degree) {
+        return da->degree < db->degree ? -1 : 1;
+    }
+    return da->vertex < db->vertex ? -1 : da->vertex > db->vertex;
+}
+
+static void bitset_graph_rows_wipe(bitset_t* rows, size_t n) {
+    if (rows) {
+        for (size_t i = 0; i < n; i++) {
+            bitset_wipe(&rows[i]);
+        }
+        free(rows);
+    }
+}
+
+static bitset_t* bitset_graph_rows_init(size_t n) {
+    bitset_t* rows = malloc((n ? n : 1) * sizeof(bitset_t));
+    if (!rows) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (bitset_init(&rows[i], n) < 0) {
+            bitset_graph_rows_wipe(rows, i);
+            return NULL;
+        }
+    }
+    return rows;
+}
+
+static void bitset_graph_ranked_wipe(bitset_graph_ranked_t* r) {
+    bitset_graph_rows_wipe(r->adj, r->n);
+    bitset_graph_rows_wipe(r->up, r->n);
+    free(r->vertex);
+}
+
+static int bitset_graph_rank(bitset_graph_ranked_t* r, const bitset_graph_t* g,
+                             int with_adj)
+{
+    size_t n = g->n;
+    memset(r, 0, sizeof(*r));
+    r->n = n;
+    r->vertex = malloc((n ? n : 1) * sizeof(size_t));
+    size_t* rank = malloc((n ? n : 1) * sizeof(size_t));
+    size_t* neighbors = malloc((n ? n : 1) * sizeof(size_t));
+    bitset_graph_degree_t* degrees = malloc((n ? n : 1) * sizeof(*degrees));
+    r->up = bitset_graph_rows_init(n);
+    if (with_adj) {
+        r->adj = bitset_graph_rows_init(n);
+    }
+    if (!r->vertex || !rank || !neighbors || !degrees || !r->up
+    ||  (with_adj && !r->adj)) {
+        free(rank);
+        free(neighbors);
+        free(degrees);
+        bitset_graph_ranked_wipe(r);
+        return -1;
+    }
+
+    for (size_t v = 0; v < n; v++) {
+        degrees[v].degree = bitset_popcnt(&g->rows[v]);
+        degrees[v].vertex = v;
+    }
+    qsort(degrees, n, sizeof(*degrees), bitset_graph_degree_cmp);
+    for (size_t i = 0; i < n; i++) {
+        r->vertex[i] = degrees[i].vertex;
+        rank[degrees[i].vertex] = i;
+    }
+
+    for (size_t v = 0; v < n; v++) {
+        size_t rv = rank[v];
+        size_t m = bitset_to_array(&g->rows[v], neighbors);
+        size_t nup = 0;
+        for (size_t i = 0; i < m; i++) {
+            size_t rw = rank[neighbors[i]];
+            if (rw > rv) {
+                bitset_set(&r->up[rv], rw);
+                nup++;
+            }
+            if (with_adj) {
+                bitset_set(&r->adj[rv], rw);
+            }
+        }
+        if (nup > r->max_up) {
+            r->max_up = nup;
+        }
+    }
+
+    free(rank);
+    free(neighbors);
+    free(degrees);
+    return 0;
+}
+
+/* }}} */
+/* {{{ Scheduling */
+
+typedef struct bitset_graph_run bitset_graph_run_t;
+
+struct bitset_graph_run {
+    const bitset_graph_ranked_t *r;
+    unsigned                     k;
+    bitset_graph_clique_cb       cb;
+    void                        *arg;
+    pthread_mutex_t              lock;      /* Serializes `cb` */
+    size_t                       next;      /* Next vertex to process */
+    uint64_t                     count;
+    int                          error;
+    void*                      (*worker)(void*);
+};
+
+/* Run `run->worker` on `nthreads` threads, the calling one included. */
+static int bitset_graph_parallel(bitset_graph_run_t* run, unsigned nthreads) {
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    pthread_t threads[nthreads];
+    int started[nthreads];
+    for (unsigned t = 1; t < nthreads; t++) {
+        started[t] = pthread_create(&threads[t], NULL, run->worker, run) == 0;
+    }
+    run->worker(run);
+    for (unsigned t = 1; t < nthreads; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    return run->error ? -1 : 0;
+}
+
+/* }}} */
+/* {{{ k-cliques */
+
+/* Scratch of a thread: a candidate set and its decoded ids per level */
+typedef struct bitset_graph_scratch {
+    unsigned  nlevels;
+    bitset_t *cands;
+    size_t  **ids;
+} bitset_graph_scratch_t;
+
+static void bitset_graph_scratch_wipe(bitset_graph_scratch_t* s) {
+    for (unsigned l = 0; l < s->nlevels; l++) {
+        if (s->cands) {
+            free(s->cands[l].bits);
+        }
+        if (s->ids) {
+            free(s->ids[l]);
+        }
+    }
+    free(s->cands);
+    free(s->ids);
+}
+
+static int bitset_graph_scratch_init(bitset_graph_scratch_t* s,
+                                     unsigned nlevels, size_t n,
+                                     size_t max_ids)
+{
+    s->nlevels = nlevels;
+    s->cands = calloc(nlevels, sizeof(bitset_t));
+    s->ids = calloc(nlevels, sizeof(size_t*));
+    if (!s->cands || !s->ids) {
+        bitset_graph_scratch_wipe(s);
+        return -1;
+    }
+    for (unsigned l = 0; l < nlevels; l++) {
+        s->ids[l] = malloc((max_ids + 1) * sizeof(size_t));
+        if (!s->ids[l] || bitset_init(&s->cands[l], n) < 0) {
+            bitset_graph_scratch_wipe(s);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Count the cliques of `k` vertices within `cand`, a set of vertices ranked
+ * after `u`. Atoms of `cand` before those of `u`'s later vertices may be
+ * stale.
+ */
+static uint64_t bitset_graph_count(const bitset_graph_ranked_t* r,
+                                   bitset_graph_scratch_t* s, unsigned level,
+                                   const bitset_t* cand, size_t u, unsigned k)
+{
+    size_t* ids = s->ids[level];
+    bitset_t tail = bitset_graph_after(cand, u);
+    size_t m = bitset_to_array(&tail, ids);
+    for (size_t i = 0; i < m; i++) {
+        ids[i] += (cand->natoms - tail.natoms) * BITS_PER_ATOM;
+    }
+    uint64_t sum = 0;
+
+    if (k == 2) {
+        // Last level: count without materializing intersections.
+        for (size_t i = 0; i < m; i++) {
+            size_t v = ids[i];
+            bitset_t a = bitset_graph_after(cand, v);
+            bitset_t b = bitset_graph_after(&r->up[v], v);
+            sum += bitset_and_popcnt(&a, &b);
+        }
+        return sum;
+    }
+
+    bitset_t* next = &s->cands[level];
+    for (size_t i = 0; i + k <= m; i++) {
+        // Cliques through ids[i] only use candidates ranked after it, of
+        // which there are m - i - 1.
+        size_t v = ids[i];
+        bitset_t dest = bitset_graph_after(next, v);
+        bitset_t a = bitset_graph_after(cand, v);
+        bitset_t b = bitset_graph_after(&r->up[v], v);
+        bitset_and_to(&dest, &a, &b);
+        if (bitset_popcnt(&dest) >= k - 1) {
+            sum += bitset_graph_count(r, s, level + 1, next, v, k - 1);
+        }
+    }
+    return sum;
+}
+
+static void* bitset_graph_cliques_worker(void* arg) {
+    bitset_graph_run_t* run = arg;
+    const bitset_graph_ranked_t* r = run->r;
+    bitset_graph_scratch_t s;
+    unsigned nlevels = run->k > 2 ? run->k - 2 : 1;
+    if (bitset_graph_scratch_init(&s, nlevels, r->n, r->max_up) < 0) {
+        __atomic_store_n(&run->error, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    uint64_t sum = 0;
+    for (;;) {
+        size_t u = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (u >= r->n) {
+            break;
+        }
+        if (run->k == 1) {
+            sum++;
+        } else if (run->k == 2) {
+            sum += bitset_popcnt(&r->up[u]);
+        } else {
+            sum += bitset_graph_count(r, &s, 0, &r->up[u], u, run->k - 1);
+        }
+    }
+    __atomic_fetch_add(&run->count, sum, __ATOMIC_RELAXED);
+    bitset_graph_scratch_wipe(&s);
+    return NULL;
+}
+
+int bitset_graph_cliques(const bitset_graph_t* g, unsigned k,
+                         unsigned nthreads, uint64_t* count)
+{
+    assert (k > 0);
+    bitset_graph_ranked_t r;
+    if (bitset_graph_rank(&r, g, 0) < 0) {
+        return -1;
+    }
+    bitset_graph_run_t run = {
+        .r = &r,
+        .k = k,
+        .worker = bitset_graph_cliques_worker,
+    };
+    int res = bitset_graph_parallel(&run, nthreads);
+    *count = run.count;
+    bitset_graph_ranked_wipe(&r);
+    return res;
+}
+
+int bitset_graph_triangles(const bitset_graph_t* g, unsigned nthreads,
+                           uint64_t* count)
+{
+    return bitset_graph_cliques(g, 3, nthreads, count);
+}
+
+/* }}} */
+/* {{{ Maximal cliques */
+
+/* Sets of a level of the Bron–Kerbosch recursion */
+typedef struct bitset_graph_level {
+    bitset_t  p;        /* Candidates to extend the clique */
+    bitset_t  x;        /* Vertices already explored */
+    size_t   *ids;      /* Decoded branching vertices */
+} bitset_graph_level_t;
+
+typedef struct bitset_graph_bk {
+    bitset_graph_run_t    *run;
+    size_t                 n;
+    size_t                *clique;      /* Current clique, by rank */
+    size_t                *vertices;    /* Reported clique */
+    bitset_graph_level_t **levels;      /* Allocated on demand */
+    size_t                 nlevels;
+} bitset_graph_bk_t;
+
+static void bitset_graph_bk_wipe(bitset_graph_bk_t* bk) {
+    for (size_t d = 0; d < bk->nlevels; d++) {
+        if (bk->levels[d]) {
+            free(bk->levels[d]->p.bits);
+            free(bk->levels[d]->x.bits);
+            free(bk->levels[d]->ids);
+            free(bk->levels[d]);
+        }
+    }
+    free(bk->levels);
+    free(bk->clique);
+    free(bk->vertices);
+}
+
+static bitset_graph_level_t* bitset_graph_bk_level(bitset_graph_bk_t* bk,
+                                                   size_t depth)
+{
+    if (depth >= bk->nlevels) {
+        size_t nlevels = 2 * depth + 2;
+        bitset_graph_level_t** levels =
+            realloc(bk->levels, nlevels * sizeof(*levels));
+        if (!levels) {
+            return NULL;
+        }
+        memset(levels + bk->nlevels, 0,
+               (nlevels - bk->nlevels) * sizeof(*levels));
+        bk->levels = levels;
+        bk->nlevels = nlevels;
+    }
+    if (!bk->levels[depth]) {
+        bitset_graph_level_t* l = calloc(1, sizeof(*l));
+        if (!l) {
+            return NULL;
+        }
+        bk->levels[depth] = l;
+        l->ids = malloc((bk->n ? bk->n : 1) * sizeof(size_t));
+        if (!l->ids || bitset_init(&l->p, bk->n) < 0
+        ||  bitset_init(&l->x, bk->n) < 0) {
+            return NULL;
+        }
+    }
+    return bk->levels[depth];
+}
+
+static void bitset_graph_bk_report(bitset_graph_bk_t* bk, size_t size) {
+    bitset_graph_run_t* run = bk->run;
+    __atomic_fetch_add(&run->count, 1, __ATOMIC_RELAXED);
+    if (!run->cb) {
+        return;
+    }
+    for (size_t i = 0; i < size; i++) {
+        bk->vertices[i] = run->r->vertex[bk->clique[i]];
+    }
+    pthread_mutex_lock(&run->lock);
+    run->cb(bk->vertices, size, run->arg);
+    pthread_mutex_unlock(&run->lock);
+}
+
+/* Extend the clique of `size` vertices with the sets of level `depth`. */
+static int bitset_graph_bk_expand(bitset_graph_bk_t* bk, size_t depth,
+                                  size_t size)
+{
+    const bitset_graph_ranked_t* r = bk->run->r;
+    bitset_graph_level_t* l = bk->levels[depth];
+    size_t natoms = l->p.natoms;
+
+    // Choose the pivot among P ∪ X with most neighbors in P: only its
+    // non-neighbors need to be branched on.
+    size_t pivot = SIZE_MAX;
+    size_t best = 0;
+    int empty = 1;
+    for (size_t i = 0; i < natoms; i++) {
+        bitset_atom_t atom = l->p.bits[i] | l->x.bits[i];
+        if (atom) {
+            empty = 0;
+        }
+        while (atom) {
+            size_t u = i * BITS_PER_ATOM + bitset_atom_ctz(atom);
+            atom &= atom - 1;
+            size_t c = bitset_and_popcnt(&l->p, &r->adj[u]);
+            if (pivot == SIZE_MAX || c > best) {
+                pivot = u;
+                best = c;
+            }
+        }
+    }
+    if (empty) {
+        bitset_graph_bk_report(bk, size);
+        return 0;
+    }
+
+    size_t m = 0;
+    for (size_t i = 0; i < natoms; i++) {
+        bitset_atom_t atom = l->p.bits[i] & ~r->adj[pivot].bits[i];
+        while (atom) {
+            l->ids[m++] = i * BITS_PER_ATOM + bitset_atom_ctz(atom);
+            atom &= atom - 1;
+        }
+    }
+
+    for (size_t i = 0; i < m; i++) {
+        size_t v = l->ids[i];
+        bitset_graph_level_t* next = bitset_graph_bk_level(bk, depth + 1);
+        if (!next) {
+            return -1;
+        }
+        l = bk->levels[depth];
+        bitset_and_to(&next->p, &l->p, &r->adj[v]);
+        bitset_and_to(&next->x, &l->x, &r->adj[v]);
+        bk->clique[size] = v;
+        if (bitset_graph_bk_expand(bk, depth + 1, size + 1) < 0) {
+            return -1;
+        }
+        bitset_unset(&l->p, v);
+        bitset_set(&l->x, v);
+    }
+    return 0;
+}
+
+static void* bitset_graph_bk_worker(void* arg) {
+    bitset_graph_run_t* run = arg;
+    const bitset_graph_ranked_t* r = run->r;
+    bitset_graph_bk_t bk = {
+        .run = run,
+        .n = r->n,
+        .clique = malloc((r->n ? r->n : 1) * sizeof(size_t)),
+        .vertices = malloc((r->n ? r->n : 1) * sizeof(size_t)),
+    };
+    if (!bk.clique || !bk.vertices) {
+        goto error;
+    }
+
+    // Every maximal clique is found from its lowest ranked vertex v, with
+    // neighbors of higher rank as candidates and the others as excluded.
+    for (;;) {
+        size_t v = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (v >= r->n) {
+            break;
+        }
+        bitset_graph_level_t* l = bitset_graph_bk_level(&bk, 0);
+        if (!l) {
+            goto error;
+        }
+        bitset_copy(&l->p, &r->up[v]);
+        for (size_t i = 0; i < l->x.natoms; i++) {
+            l->x.bits[i] = r->adj[v].bits[i] & ~r->up[v].bits[i];
+        }
+        bk.clique[0] = v;
+        if (bitset_graph_bk_expand(&bk, 0, 1) < 0) {
+            goto error;
+        }
+    }
+    bitset_graph_bk_wipe(&bk);
+    return NULL;
+
+  error:
+    __atomic_store_n(&run->error, 1, __ATOMIC_RELAXED);
+    bitset_graph_bk_wipe(&bk);
+    return NULL;
+}
+
+int bitset_graph_maximal_cliques(const bitset_graph_t* g, unsigned nthreads,
+                                 bitset_graph_clique_cb cb, void* arg,
+                                 uint64_t* count)
+{
+    bitset_graph_ranked_t r;
+    if (bitset_graph_rank(&r, g, 1) < 0) {
+        return -1;
+    }
+    bitset_graph_run_t run = {
+        .r = &r,
+        .cb = cb,
+        .arg = arg,
+        .worker = bitset_graph_bk_worker,
+    };
+    pthread_mutex_init(&run.lock, NULL);
+    int res = bitset_graph_parallel(&run, nthreads);
+    pthread_mutex_destroy(&run.lock);
+    *count = run.count;
+    bitset_graph_ranked_wipe(&r);
+    return res;
+}
+
+/* }}} */
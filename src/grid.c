@@ -0,0 +1,363 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "bitset/grid.h"
+
+#define bitset_atom_popcnt  __builtin_popcountl
+#define bitset_atom_ctz     __builtin_ctzl
+
+int bitset_grid_init(bitset_grid_t* g, size_t width, size_t height) {
+    g->width = width;
+    g->height = height;
+    g->stride = BITS_TO_NATOMS(width);
+    return bitset_init(&g->bits, height * g->stride * BITS_PER_ATOM);
+}
+
+void bitset_grid_wipe(bitset_grid_t* g) {
+    bitset_wipe(&g->bits);
+}
+
+extern bitset_atom_t* bitset_grid_row(const bitset_grid_t* g, size_t y);
+
+extern bit_t bitset_grid_get(const bitset_grid_t* g, size_t x, size_t y);
+
+extern void bitset_grid_set(bitset_grid_t* g, size_t x, size_t y);
+
+extern void bitset_grid_unset(bitset_grid_t* g, size_t x, size_t y);
+
+/* Mask of the bits of a row's last atom that are cells */
+static bitset_atom_t bitset_grid_last_mask(const bitset_grid_t* g) {
+    size_t r = g->width % BITS_PER_ATOM;
+    return r ? ((bitset_atom_t)1 << r) - 1 : BITSET_ATOM_MAX;
+}
+
+/* {{{ Rectangles */
+
+typedef enum bitset_grid_op {
+    BITSET_GRID_FILL,
+    BITSET_GRID_CLEAR,
+    BITSET_GRID_COUNT,
+} bitset_grid_op_t;
+
+/* Apply `op` to the clipped rectangle, and return the count of cells set
+ * for BITSET_GRID_COUNT.
+ */
+static size_t bitset_grid_rect(const bitset_grid_t* g, size_t x, size_t y,
+                               size_t w, size_t h, bitset_grid_op_t op)
+{
+    if (x >= g->width || y >= g->height || w == 0 || h == 0) {
+        return 0;
+    }
+    size_t x1 = w > g->width - x ? g->width : x + w;
+    size_t y1 = h > g->height - y ? g->height : y + h;
+    size_t first = x / BITS_PER_ATOM;
+    size_t last = (x1 - 1) / BITS_PER_ATOM;
+    bitset_atom_t lmask = BITSET_ATOM_MAX << (x % BITS_PER_ATOM);
+    bitset_atom_t rmask = BITSET_ATOM_MAX >> (BITS_PER_ATOM - 1
+                                              - (x1 - 1) % BITS_PER_ATOM);
+    size_t count = 0;
+
+    for (; y < y1; y++) {
+        bitset_atom_t* row = bitset_grid_row(g, y);
+        for (size_t j = first; j <= last; j++) {
+            bitset_atom_t mask = BITSET_ATOM_MAX;
+            if (j == first) {
+                mask &= lmask;
+            }
+            if (j == last) {
+                mask &= rmask;
+            }
+            switch (op) {
+            case BITSET_GRID_FILL:
+                row[j] |= mask;
+                break;
+            case BITSET_GRID_CLEAR:
+                row[j] &= ~mask;
+                break;
+            case BITSET_GRID_COUNT:
+                count += bitset_atom_popcnt(row[j] & mask);
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/* }}} */
+
+void bitset_grid_fill_rect(bitset_grid_t* g, size_t x, size_t y,
+                           size_t w, size_t h)
+{
+    bitset_grid_rect(g, x, y, w, h, BITSET_GRID_FILL);
+}
+
+void bitset_grid_clear_rect(bitset_grid_t* g, size_t x, size_t y,
+                            size_t w, size_t h)
+{
+    bitset_grid_rect(g, x, y, w, h, BITSET_GRID_CLEAR);
+}
+
+size_t bitset_grid_count_rect(const bitset_grid_t* g, size_t x, size_t y,
+                              size_t w, size_t h)
+{
+    return bitset_grid_rect(g, x, y, w, h, BITSET_GRID_COUNT);
+}
+
+/* {{{ Morphology */
+
+/* Store into `dest` the `n` atoms of `src` moved by `s` cells, toward
+ * higher columns if `left`, lower ones otherwise. Cells shifted in are 0.
+ */
+static void bitset_grid_shift(bitset_atom_t* dest, const bitset_atom_t* src,
+                              size_t n, size_t s, int left)
+{
+    size_t q = s / BITS_PER_ATOM;
+    unsigned r = s % BITS_PER_ATOM;
+    for (size_t j = 0; j < n; j++) {
+        bitset_atom_t lo = 0, hi = 0;
+        if (left) {
+            // Bit x of dest is bit x - s of src.
+            if (j >= q) {
+                lo = src[j - q] << r;
+                if (r && j > q) {
+                    hi = src[j - q - 1] >> (BITS_PER_ATOM - r);
+                }
+            }
+        } else {
+            // Bit x of dest is bit x + s of src.
+            if (j + q < n) {
+                lo = src[j + q] >> r;
+                if (r && j + q + 1 < n) {
+                    hi = src[j + q + 1] << (BITS_PER_ATOM - r);
+                }
+            }
+        }
+        dest[j] = lo | hi;
+    }
+}
+
+/* Or (and if `erode`) the `n` atoms of `row` with their copies shifted by 1
+ * to `r` cells in one direction, doubling the span at each step.
+ */
+static void bitset_grid_spread(bitset_atom_t* row, bitset_atom_t* tmp,
+                               size_t n, size_t r, int left, int erode)
+{
+    size_t span = 1;
+    while (span <= r) {
+        size_t s = 2 * span <= r + 1 ? span : r + 1 - span;
+        bitset_grid_shift(tmp, row, n, s, left);
+        for (size_t j = 0; j < n; j++) {
+            row[j] = erode ? row[j] & tmp[j] : row[j] | tmp[j];
+        }
+        span += s;
+    }
+}
+
+static int bitset_grid_morph(bitset_grid_t* dest, const bitset_grid_t* src,
+                             size_t rx, size_t ry, int erode)
+{
+    assert (dest->width == src->width && dest->height == src->height);
+    assert (dest != src);
+    size_t n = src->stride;
+    size_t height = src->height;
+    bitset_atom_t last = bitset_grid_last_mask(src);
+    bitset_atom_t* tmp = malloc((n ? n : 1) * sizeof(bitset_atom_t));
+    if (!tmp) {
+        return -1;
+    }
+
+    // Rows, both ways; cells shifted in from outside the grid are 0.
+    bitset_copy(&dest->bits, &src->bits);
+    for (size_t y = 0; y < height && n > 0; y++) {
+        bitset_atom_t* row = bitset_grid_row(dest, y);
+        bitset_grid_spread(row, tmp, n, rx, 0, erode);
+        bitset_grid_spread(row, tmp, n, rx, 1, erode);
+        row[n - 1] &= last;
+    }
+    free(tmp);
+
+    // Columns, both ways, in place: with increasing y, row y + s has not
+    // been updated yet when row y reads it, and conversely.
+    size_t span = 1;
+    while (span <= ry) {
+        size_t s = 2 * span <= ry + 1 ? span : ry + 1 - span;
+        for (size_t y = 0; y < height; y++) {
+            bitset_atom_t* row = bitset_grid_row(dest, y);
+            if (y + s < height) {
+                const bitset_atom_t* below = bitset_grid_row(dest, y + s);
+                for (size_t j = 0; j < n; j++) {
+                    row[j] = erode ? row[j] & below[j] : row[j] | below[j];
+                }
+            } else if (erode) {
+                memset(row, 0, n * sizeof(bitset_atom_t));
+            }
+        }
+        for (size_t y = height; y-- > 0; ) {
+            bitset_atom_t* row = bitset_grid_row(dest, y);
+            if (y >= s) {
+                const bitset_atom_t* above = bitset_grid_row(dest, y - s);
+                for (size_t j = 0; j < n; j++) {
+                    row[j] = erode ? row[j] & above[j] : row[j] | above[j];
+                }
+            } else if (erode) {
+                memset(row, 0, n * sizeof(bitset_atom_t));
+            }
+        }
+        span += s;
+    }
+    return 0;
+}
+
+/* }}} */
+
+int bitset_grid_dilate_to(bitset_grid_t* dest, const bitset_grid_t* src,
+                          size_t rx, size_t ry)
+{
+    return bitset_grid_morph(dest, src, rx, ry, 0);
+}
+
+int bitset_grid_erode_to(bitset_grid_t* dest, const bitset_grid_t* src,
+                         size_t rx, size_t ry)
+{
+    return bitset_grid_morph(dest, src, rx, ry, 1);
+}
+
+/* {{{ Regions */
+
+typedef struct bitset_grid_runs {
+    size_t *start;      /* First cell of each run */
+    size_t *end;        /* Cell after the last one of each run */
+    size_t *parent;     /* Union-find forest over runs */
+    size_t  n, cap;
+} bitset_grid_runs_t;
+
+static int bitset_grid_runs_push(bitset_grid_runs_t* runs, size_t start,
+                                 size_t end)
+{
+    if (runs->n == runs->cap) {
+        size_t cap = runs->cap ? 2 * runs->cap : 256;
+        size_t* p = realloc(runs->start, 3 * cap * sizeof(size_t));
+        if (!p) {
+            return -1;
+        }
+        // Move the ends and parents up to their new place.
+        memmove(p + 2 * cap, p + 2 * runs->cap, runs->n * sizeof(size_t));
+        memmove(p + cap, p + runs->cap, runs->n * sizeof(size_t));
+        runs->start = p;
+        runs->end = p + cap;
+        runs->parent = p + 2 * cap;
+        runs->cap = cap;
+    }
+    runs->start[runs->n] = start;
+    runs->end[runs->n] = end;
+    runs->parent[runs->n] = runs->n;
+    runs->n++;
+    return 0;
+}
+
+static size_t bitset_grid_find(size_t* parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Append the runs of `row` to `runs`. Runs start where a cell is set and
+ * the previous one is not, and end where it is the converse: both are bits
+ * of x ^ (x << 1), with the carry of the previous atom.
+ */
+static int bitset_grid_row_runs(bitset_grid_runs_t* runs,
+                                const bitset_atom_t* row, size_t n)
+{
+    bitset_atom_t carry = 0;
+    size_t start = 0;
+    for (size_t j = 0; j < n; j++) {
+        bitset_atom_t x = row[j];
+        for (bitset_atom_t t = x ^ ((x << 1) | carry); t; t &= t - 1) {
+            size_t cell = j * BITS_PER_ATOM + bitset_atom_ctz(t);
+            if ((x >> (cell % BITS_PER_ATOM)) & 1) {
+                start = cell;
+            } else if (bitset_grid_runs_push(runs, start, cell) < 0) {
+                return -1;
+            }
+        }
+        carry = x >> (BITS_PER_ATOM - 1);
+    }
+    if (carry) {
+        return bitset_grid_runs_push(runs, start, n * BITS_PER_ATOM);
+    }
+    return 0;
+}
+
+/* }}} */
+
+int bitset_grid_regions(const bitset_grid_t* g, bitset_grid_conn_t conn,
+                        uint32_t* labels, size_t* count)
+{
+    bitset_grid_runs_t runs = { NULL, NULL, NULL, 0, 0 };
+    size_t* firsts = malloc((g->height + 1) * sizeof(size_t));
+    if (!firsts) {
+        return -1;
+    }
+    // With 8-connectivity, runs touching by a corner are connected too.
+    size_t reach = conn == BITSET_GRID_CONN8 ? 1 : 0;
+
+    firsts[0] = 0;
+    for (size_t y = 0; y < g->height; y++) {
+        if (bitset_grid_row_runs(&runs, bitset_grid_row(g, y), g->stride) < 0) {
+            free(runs.start);
+            free(firsts);
+            return -1;
+        }
+        firsts[y + 1] = runs.n;
+        if (y == 0) {
+            continue;
+        }
+        // Merge with the touching runs of the previous row, both lists being
+        // sorted.
+        size_t i = firsts[y - 1], j = firsts[y];
+        while (i < firsts[y] && j < runs.n) {
+            if (runs.start[i] < runs.end[j] + reach
+                    && runs.start[j] < runs.end[i] + reach) {
+                size_t a = bitset_grid_find(runs.parent, i);
+                size_t b = bitset_grid_find(runs.parent, j);
+                // Keep the earliest run as root, for numbering.
+                if (a < b) {
+                    runs.parent[b] = a;
+                } else {
+                    runs.parent[a] = b;
+                }
+            }
+            if (runs.end[i] < runs.end[j]) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+    }
+
+    // Roots are the first runs of their regions: number them in order, then
+    // label the cells of every run. Region numbers overwrite the start of
+    // runs, which are not needed once read.
+    memset(labels, 0, g->width * g->height * sizeof(uint32_t));
+    size_t nregions = 0;
+    for (size_t y = 0; y < g->height; y++) {
+        for (size_t r = firsts[y]; r < firsts[y + 1]; r++) {
+            size_t root = bitset_grid_find(runs.parent, r);
+            size_t start = runs.start[r];
+            if (root == r) {
+                runs.start[r] = ++nregions;
+            }
+            uint32_t label = runs.start[root];
+            for (size_t x = start; x < runs.end[r]; x++) {
+                labels[y * g->width + x] = label;
+            }
+        }
+    }
+    free(runs.start);
+    free(firsts);
+    *count = nregions;
+    return 0;
+}
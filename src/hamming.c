@@ -0,0 +1,345 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_HAMMING_X86
+#endif
+#include "bitset/hamming.h"
+#include "parallel.h"
+
+/* Bytes of database compared to all queries at once, sized for L2 */
+#define BITSET_HAMMING_TILE_SIZE    (256 * 1024)
+
+#define BITSET_HAMMING_ALIGN        64
+
+static pthread_once_t bitset_hamming_once = PTHREAD_ONCE_INIT;
+static int            bitset_hamming_has_vpopcnt;
+static int            bitset_hamming_has_popcnt;
+
+static void bitset_hamming_init_once(void) {
+#ifdef BITSET_HAMMING_X86
+    bitset_hamming_has_vpopcnt = __builtin_cpu_supports("avx512f") != 0
+                              && __builtin_cpu_supports("avx512vpopcntdq") != 0;
+    bitset_hamming_has_popcnt = __builtin_cpu_supports("popcnt") != 0;
+#endif
+}
+
+int bitset_codes_init(bitset_codes_t* c, size_t ncodes, size_t nbits) {
+    pthread_once(&bitset_hamming_once, bitset_hamming_init_once);
+    c->ncodes = ncodes;
+    c->nbits = nbits;
+    c->stride = BITS_TO_NATOMS(nbits);
+    size_t size = ncodes * c->stride * sizeof(bitset_atom_t);
+    if (posix_memalign((void**)&c->atoms, BITSET_HAMMING_ALIGN,
+                       size ? size : BITSET_HAMMING_ALIGN)) {
+        return -1;
+    }
+    memset(c->atoms, 0, size);
+    return 0;
+}
+
+void bitset_codes_wipe(bitset_codes_t* c) {
+    free(c->atoms);
+}
+
+extern bitset_atom_t* bitset_codes_row(const bitset_codes_t* c, size_t i);
+
+void bitset_codes_set(bitset_codes_t* c, size_t i, const bitset_t* code) {
+    assert (code->nbits == c->nbits);
+    memcpy(bitset_codes_row(c, i), code->bits,
+           c->stride * sizeof(bitset_atom_t));
+}
+
+/* {{{ Distance kernels */
+
+/* Compute the distances between `query` and `nrows` codes of `natoms` atoms
+ * stored back to back from `rows`.
+ */
+static inline __attribute__((always_inline))
+void bitset_hamming_rows_scalar(const bitset_atom_t* rows, size_t nrows,
+                                size_t natoms, const bitset_atom_t* query,
+                                uint32_t* out)
+{
+    for (size_t r = 0; r < nrows; r++) {
+        const bitset_atom_t* row = rows + r * natoms;
+        uint32_t d = 0;
+        for (size_t j = 0; j < natoms; j++) {
+            d += __builtin_popcountl(row[j] ^ query[j]);
+        }
+        out[r] = d;
+    }
+}
+
+static void bitset_hamming_rows_generic(const bitset_atom_t* rows,
+                                        size_t nrows, size_t natoms,
+                                        const bitset_atom_t* query,
+                                        uint32_t* out)
+{
+    bitset_hamming_rows_scalar(rows, nrows, natoms, query, out);
+}
+
+#ifdef BITSET_HAMMING_X86
+
+__attribute__((target("popcnt")))
+static void bitset_hamming_rows_popcnt(const bitset_atom_t* rows,
+                                       size_t nrows, size_t natoms,
+                                       const bitset_atom_t* query,
+                                       uint32_t* out)
+{
+    bitset_hamming_rows_scalar(rows, nrows, natoms, query, out);
+}
+
+/* Xor and popcount 8 atoms at a time, the last chunk of a code being read
+ * with a masked load.
+ */
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void bitset_hamming_rows_vpopcnt(const bitset_atom_t* rows,
+                                        size_t nrows, size_t natoms,
+                                        const bitset_atom_t* query,
+                                        uint32_t* out)
+{
+    const size_t nfull = natoms / 8;
+    const __mmask8 tail = (1 << (natoms % 8)) - 1;
+    const __m512i qtail = _mm512_maskz_loadu_epi64(tail, query + 8 * nfull);
+
+    for (size_t r = 0; r < nrows; r++) {
+        const bitset_atom_t* row = rows + r * natoms;
+        __m512i sum = _mm512_popcnt_epi64(_mm512_xor_si512(
+                        _mm512_maskz_loadu_epi64(tail, row + 8 * nfull),
+                        qtail));
+        for (size_t j = 0; j < nfull; j++) {
+            __m512i x = _mm512_xor_si512(
+                            _mm512_loadu_si512(row + 8 * j),
+                            _mm512_loadu_si512(query + 8 * j));
+            sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+        }
+        out[r] = _mm512_reduce_add_epi64(sum);
+    }
+}
+
+#endif
+
+static void bitset_hamming_rows(const bitset_atom_t* rows, size_t nrows,
+                                size_t natoms, const bitset_atom_t* query,
+                                uint32_t* out)
+{
+#ifdef BITSET_HAMMING_X86
+    if (bitset_hamming_has_vpopcnt) {
+        bitset_hamming_rows_vpopcnt(rows, nrows, natoms, query, out);
+        return;
+    }
+    if (bitset_hamming_has_popcnt) {
+        bitset_hamming_rows_popcnt(rows, nrows, natoms, query, out);
+        return;
+    }
+#endif
+    bitset_hamming_rows_generic(rows, nrows, natoms, query, out);
+}
+
+/* }}} */
+
+uint32_t bitset_hamming_distance(const bitset_atom_t* a,
+                                 const bitset_atom_t* b, size_t nbits)
+{
+    pthread_once(&bitset_hamming_once, bitset_hamming_init_once);
+    uint32_t d;
+    bitset_hamming_rows(a, 1, BITS_TO_NATOMS(nbits), b, &d);
+    return d;
+}
+
+void bitset_hamming_distances(const bitset_codes_t* db,
+                              const bitset_atom_t* query, uint32_t* out)
+{
+    bitset_hamming_rows(db->atoms, db->ncodes, db->stride, query, out);
+}
+
+/* {{{ Top-k heaps */
+
+/* Max-heaps of matches, the worst one (farthest, then highest index) at
+ * the root.
+ */
+
+static inline int bitset_hamming_worse(const bitset_hamming_match_t* a,
+                                       const bitset_hamming_match_t* b)
+{
+    return a->distance > b->distance
+       || (a->distance == b->distance && a->index > b->index);
+}
+
+static void bitset_hamming_sift_down(bitset_hamming_match_t* heap,
+                                     size_t size, size_t i)
+{
+    bitset_hamming_match_t m = heap[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size
+        &&  bitset_hamming_worse(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!bitset_hamming_worse(&heap[child], &m)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = m;
+}
+
+/* Offer `m` to a heap of at most `k` matches. */
+static inline void bitset_hamming_offer(bitset_hamming_match_t* heap,
+                                        size_t* size, size_t k,
+                                        bitset_hamming_match_t m)
+{
+    if (*size < k) {
+        size_t i = (*size)++;
+        while (i > 0 && bitset_hamming_worse(&m, &heap[(i - 1) / 2])) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = m;
+    } else if (bitset_hamming_worse(&heap[0], &m)) {
+        heap[0] = m;
+        bitset_hamming_sift_down(heap, k, 0);
+    }
+}
+
+/* Sort a full heap by increasing distance, in place. */
+static void bitset_hamming_sort(bitset_hamming_match_t* heap, size_t size) {
+    while (size > 1) {
+        bitset_hamming_match_t m = heap[0];
+        heap[0] = heap[--size];
+        heap[size] = m;
+        bitset_hamming_sift_down(heap, size, 0);
+    }
+}
+
+/* }}} */
+/* {{{ k-NN */
+
+typedef struct bitset_hamming_job {
+    const bitset_codes_t   *db;
+    const bitset_codes_t   *queries;
+    size_t                  k;
+    size_t                  first;  /* First database code of this job */
+    size_t                  last;
+    bitset_hamming_match_t *heaps;  /* k matches per query */
+    size_t                 *sizes;  /* Number of matches per query */
+    uint32_t               *dist;   /* Distances to a tile */
+    size_t                  tile;   /* Number of codes per tile */
+} bitset_hamming_job_t;
+
+/* Search the share `i` of the database, in jobs `arg`. */
+static void bitset_hamming_run(void* arg, size_t i, unsigned t) {
+    (void)t;
+    bitset_hamming_job_t* job = (bitset_hamming_job_t*)arg + i;
+    const bitset_codes_t* db = job->db;
+    const bitset_codes_t* queries = job->queries;
+
+    for (size_t t = job->first; t < job->last; t += job->tile) {
+        size_t n = job->last - t < job->tile ? job->last - t : job->tile;
+        const bitset_atom_t* rows = db->atoms + t * db->stride;
+        for (size_t q = 0; q < queries->ncodes; q++) {
+            bitset_hamming_rows(rows, n, db->stride,
+                                bitset_codes_row(queries, q), job->dist);
+            bitset_hamming_match_t* heap = job->heaps + q * job->k;
+            size_t size = job->sizes[q];
+            // Most codes are farther than the current k-th neighbor.
+            uint32_t bound = size == job->k ? heap[0].distance : UINT32_MAX;
+            for (size_t r = 0; r < n; r++) {
+                if (job->dist[r] >= bound) {
+                    continue;
+                }
+                bitset_hamming_match_t m = {
+                    .index = t + r,
+                    .distance = job->dist[r],
+                };
+                bitset_hamming_offer(heap, &size, job->k, m);
+                if (size == job->k) {
+                    bound = heap[0].distance;
+                }
+            }
+            job->sizes[q] = size;
+        }
+    }
+}
+
+int bitset_hamming_knn(const bitset_codes_t* db,
+                       const bitset_codes_t* queries, size_t k,
+                       unsigned nthreads, bitset_hamming_match_t* out)
+{
+    assert (queries->nbits == db->nbits);
+    assert (k > 0 && k <= db->ncodes);
+
+    size_t row_size = db->stride * sizeof(bitset_atom_t);
+    size_t tile = row_size ? BITSET_HAMMING_TILE_SIZE / row_size : db->ncodes;
+    if (tile == 0) {
+        tile = 1;
+    }
+    size_t ntiles = (db->ncodes + tile - 1) / tile;
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (nthreads > ntiles) {
+        nthreads = ntiles;
+    }
+
+    // The database is cut in one share per thread, each keeping its own
+    // heaps, the first share's being `out`.
+    size_t nq = queries->ncodes;
+    bitset_hamming_match_t* heaps =
+        malloc((nthreads - 1) * nq * k * sizeof(bitset_hamming_match_t) + 1);
+    size_t* sizes = calloc(nthreads * nq + 1, sizeof(size_t));
+    uint32_t* dist = malloc(nthreads * tile * sizeof(uint32_t));
+    if (!heaps || !sizes || !dist) {
+        free(heaps);
+        free(sizes);
+        free(dist);
+        return -1;
+    }
+
+    bitset_hamming_job_t jobs[nthreads];
+    size_t first_tile = 0;
+    for (unsigned t = 0; t < nthreads; t++) {
+        size_t share = ntiles / nthreads + (t < ntiles % nthreads);
+        size_t last = (first_tile + share) * tile;
+        jobs[t] = (bitset_hamming_job_t) {
+            .db = db,
+            .queries = queries,
+            .k = k,
+            .first = first_tile * tile,
+            .last = last < db->ncodes ? last : db->ncodes,
+            .heaps = t ? heaps + (t - 1) * nq * k : out,
+            .sizes = sizes + t * nq,
+            .dist = dist + t * tile,
+            .tile = tile,
+        };
+        first_tile += share;
+    }
+    bitset_parallel_for(nthreads, nthreads, bitset_hamming_run, jobs);
+
+    // Merge the heaps of other shares into the first one, and sort it.
+    for (size_t q = 0; q < nq; q++) {
+        for (unsigned t = 1; t < nthreads; t++) {
+            for (size_t i = 0; i < jobs[t].sizes[q]; i++) {
+                bitset_hamming_offer(out + q * k, &sizes[q], k,
+                                     jobs[t].heaps[q * k + i]);
+            }
+        }
+        bitset_hamming_sort(out + q * k, sizes[q]);
+    }
+
+    free(heaps);
+    free(sizes);
+    free(dist);
+    return 0;
+}
+
+/* }}} */
@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bitset/crc32c.h"
+#include "bitset/image.h"
+#include "io.h"
+
+void bitset_image_header_init(bitset_image_header_t* header, size_t nbits) {
+    memset(header, 0, sizeof(*header));
+    header->magic = BITSET_IMAGE_MAGIC;
+    header->version = BITSET_IMAGE_VERSION;
+    header->nbits = nbits;
+}
+
+int bitset_image_read_header(int fd, bitset_image_header_t* header) {
+    if (bitset_pread_all(fd, header, sizeof(*header), 0) < 0) {
+        return -1;
+    }
+    if (header->magic != BITSET_IMAGE_MAGIC
+    ||  header->version != BITSET_IMAGE_VERSION) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Number of threads used to compute and verify CRCs */
+static unsigned bitset_image_nthreads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+/* Size of the CRC table rounded up to a page */
+static size_t bitset_image_crcs_size(size_t nbits) {
+    size_t len = BITSET_CRC32C_NBLOCKS(BITS_TO_NATOMS(nbits)) * sizeof(uint32_t);
+    return (len + BITSET_IMAGE_HEADER_SIZE - 1)
+         / BITSET_IMAGE_HEADER_SIZE * BITSET_IMAGE_HEADER_SIZE;
+}
+
+int bitset_image_read_crcs(int fd, const bitset_image_header_t* header,
+                           uint32_t** crcs)
+{
+    size_t len = BITSET_CRC32C_NBLOCKS(BITS_TO_NATOMS(header->nbits))
+               * sizeof(uint32_t);
+    size_t size = bitset_image_crcs_size(header->nbits);
+    if (posix_memalign((void**)crcs, BITSET_IMAGE_HEADER_SIZE,
+                       size ? size : BITSET_IMAGE_HEADER_SIZE)) {
+        return -1;
+    }
+    // Read whole pages for O_DIRECT, the last one being cut by the end of
+    // file.
+    ssize_t n = 0;
+    for (size_t got = 0; got < len; got += n) {
+        n = pread(fd, (char*)*crcs + got, size - got,
+                  BITSET_IMAGE_CRC_OFFSET(header->nbits) + got);
+        if (n <= 0) {
+            free(*crcs);
+            return -1;
+        }
+    }
+    if (bitset_crc32c(0, *crcs, len) != header->table_crc) {
+        free(*crcs);
+        return -1;
+    }
+    return 0;
+}
+
+int bitset_image_write_crcs(int fd, size_t nbits, const uint32_t* crcs) {
+    size_t len = BITSET_CRC32C_NBLOCKS(BITS_TO_NATOMS(nbits)) * sizeof(uint32_t);
+    size_t size = bitset_image_crcs_size(nbits);
+    char* buf;
+    if (posix_memalign((void**)&buf, BITSET_IMAGE_HEADER_SIZE,
+                       BITSET_IMAGE_HEADER_SIZE + size)) {
+        return -1;
+    }
+    char* table = buf + BITSET_IMAGE_HEADER_SIZE;
+    memset(buf, 0, BITSET_IMAGE_HEADER_SIZE + size);
+    memcpy(table, crcs, len);
+
+    bitset_image_header_t* header = (bitset_image_header_t*)buf;
+    bitset_image_header_init(header, nbits);
+    header->flags |= BITSET_IMAGE_CRC32C;
+    header->table_crc = bitset_crc32c(0, table, len);
+
+    // The table goes first: the header must never refer to a table that
+    // isn't there.
+    int res = -1;
+    if (bitset_pwrite_all(fd, table, size, BITSET_IMAGE_CRC_OFFSET(nbits)) == 0
+    &&  bitset_pwrite_all(fd, buf, BITSET_IMAGE_HEADER_SIZE, 0) == 0
+    &&  ftruncate(fd, BITSET_IMAGE_CRC_OFFSET(nbits) + len) == 0) {
+        res = 0;
+    }
+    free(buf);
+    return res;
+}
+
+int bitset_image_write(int fd, const bitset_t* bs) {
+    size_t nblocks = BITSET_CRC32C_NBLOCKS(bs->natoms);
+    uint32_t* crcs = malloc((nblocks ? nblocks : 1) * sizeof(uint32_t));
+    if (!crcs) {
+        return -1;
+    }
+    bitset_crc32c_blocks(bs->bits, bs->natoms, crcs, bitset_image_nthreads());
+
+    int res = -1;
+    if (bitset_pwrite_all(fd, bs->bits, bs->natoms * sizeof(bitset_atom_t),
+                          BITSET_IMAGE_HEADER_SIZE) == 0
+    &&  bitset_image_write_crcs(fd, bs->nbits, crcs) == 0) {
+        res = 0;
+    }
+    free(crcs);
+    return res;
+}
+
+int bitset_image_read(int fd, bitset_t* bs, int flags) {
+    bitset_image_header_t header;
+    if (bitset_image_read_header(fd, &header) < 0) {
+        return -1;
+    }
+    uint32_t* crcs = NULL;
+    int verify = (header.flags & BITSET_IMAGE_CRC32C)
+              && !(flags & BITSET_IMAGE_NO_VERIFY);
+    if (verify && bitset_image_read_crcs(fd, &header, &crcs) < 0) {
+        return -1;
+    }
+    if (bitset_init(bs, header.nbits) < 0) {
+        free(crcs);
+        return -1;
+    }
+    if (bitset_pread_all(fd, bs->bits, bs->natoms * sizeof(bitset_atom_t),
+                         BITSET_IMAGE_HEADER_SIZE) < 0
+    ||  (verify && bitset_crc32c_verify(bs->bits, bs->natoms, crcs,
+                                        bitset_image_nthreads()) < 0)) {
+        free(crcs);
+        bitset_wipe(bs);
+        return -1;
+    }
+    free(crcs);
+    return 0;
+}
+
+int bitset_save(const bitset_t* bs, const char* path) {
+    size_t len = strlen(path);
+    char* tmp = malloc(len + sizeof(".tmp"));
+    if (!tmp) {
+        return -1;
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+    int res = bitset_image_write(fd, bs);
+    if (res == 0) {
+        res = fsync(fd);
+    }
+    close(fd);
+    if (res == 0) {
+        res = rename(tmp, path);
+        if (res != 0) {
+            unlink(tmp);
+        } else {
+            res = bitset_fsync_dir(path);
+        }
+    } else {
+        unlink(tmp);
+    }
+    free(tmp);
+    return res;
+}
+
+int bitset_load(bitset_t* bs, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int res = bitset_image_read(fd, bs, 0);
+    close(fd);
+    return res;
+}
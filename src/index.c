@@ -0,0 +1,1118 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "bitset/index.h"
+#include "io.h"
+
+/* Atoms of a bitmap container */
+#define BITSET_INDEX_CONTAINER_ATOMS \
+    (BITSET_INDEX_CONTAINER_DOCS / BITS_PER_ATOM)
+
+/* Words of the buffer of records written to runs */
+#define BITSET_INDEX_SPILL_WORDS    4096
+
+/* Fewest words of the buffer of a run read back */
+#define BITSET_INDEX_RUN_WORDS      1024
+
+/* Posting of terms no document contains */
+static const bitset_posting_t bitset_index_empty = {
+    .kind = BITSET_POSTING_ARRAY,
+};
+
+static const bitset_posting_t* bitset_index_posting(const bitset_index_t* idx,
+                                                    uint32_t term)
+{
+    return term < idx->nterms ? &idx->postings[term] : &bitset_index_empty;
+}
+
+/* Define `_name`, returning the index of the first of the `n` sorted values
+ * of type `_T` of `v` not lower than `x`.
+ */
+#define BITSET_INDEX_LOWER_BOUND(_name, _T)                                 \
+    static size_t _name(const _T* v, size_t n, _T x) {                      \
+        size_t lo = 0, hi = n;                                              \
+        while (lo < hi) {                                                   \
+            size_t mid = lo + (hi - lo) / 2;                                \
+            if (v[mid] < x) {                                               \
+                lo = mid + 1;                                               \
+            } else {                                                        \
+                hi = mid;                                                   \
+            }                                                               \
+        }                                                                   \
+        return lo;                                                          \
+    }
+
+BITSET_INDEX_LOWER_BOUND(bitset_index_lower_u32, uint32_t)
+BITSET_INDEX_LOWER_BOUND(bitset_index_lower_u16, uint16_t)
+
+/* {{{ Postings */
+
+/* Return the size in bytes of the roaring form of the `n` sorted documents
+ * of `docs`, and store its number of containers into `ncontainers`.
+ */
+static size_t bitset_index_roaring_size(const uint32_t* docs, size_t n,
+                                        size_t* ncontainers)
+{
+    size_t size = 0, nc = 0;
+    for (size_t i = 0; i < n; nc++) {
+        size_t j = i + 1;
+        while (j < n && docs[j] >> 16 == docs[i] >> 16) {
+            j++;
+        }
+        size += sizeof(bitset_index_container_t);
+        size += j - i <= BITSET_INDEX_CONTAINER_ARRAY_MAX
+              ? (j - i) * sizeof(uint16_t)
+              : BITSET_INDEX_CONTAINER_ATOMS * sizeof(bitset_atom_t);
+        i = j;
+    }
+    *ncontainers = nc;
+    return size;
+}
+
+/* Initialize `p` with the `n` sorted distinct documents of `docs`, among
+ * `ndocs`, in its smallest representation.
+ * @return not 0 if memory allocation failed.
+ */
+static int bitset_index_posting_init(bitset_posting_t* p, const uint32_t* docs,
+                                     size_t n, uint32_t ndocs)
+{
+    memset(p, 0, sizeof(*p));
+    p->kind = BITSET_POSTING_ARRAY;
+    p->df = n;
+    if (n == 0) {
+        return 0;
+    }
+
+    size_t ncontainers;
+    size_t array = n * sizeof(uint32_t);
+    size_t roaring = bitset_index_roaring_size(docs, n, &ncontainers);
+    size_t dense = BITS_TO_NATOMS(ndocs) * sizeof(bitset_atom_t);
+
+    // Dense postings are the fastest to combine, so they win ties.
+    if (dense <= array && dense <= roaring) {
+        p->kind = BITSET_POSTING_DENSE;
+        if (bitset_init(&p->dense, ndocs)) {
+            return -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+            bitset_set(&p->dense, docs[i]);
+        }
+        return 0;
+    }
+    if (array <= roaring) {
+        p->docs = malloc(array);
+        if (!p->docs) {
+            return -1;
+        }
+        memcpy(p->docs, docs, array);
+        return 0;
+    }
+
+    p->kind = BITSET_POSTING_ROARING;
+    p->containers = calloc(ncontainers, sizeof(*p->containers));
+    if (!p->containers) {
+        return -1;
+    }
+    p->ncontainers = ncontainers;
+    bitset_index_container_t* c = p->containers;
+    for (size_t i = 0; i < n; c++) {
+        size_t j = i + 1;
+        while (j < n && docs[j] >> 16 == docs[i] >> 16) {
+            j++;
+        }
+        c->key = docs[i] >> 16;
+        c->card = j - i;
+        if (c->card <= BITSET_INDEX_CONTAINER_ARRAY_MAX) {
+            uint16_t* lows = malloc(c->card * sizeof(uint16_t));
+            if (!lows) {
+                return -1;
+            }
+            for (size_t k = i; k < j; k++) {
+                lows[k - i] = (uint16_t)docs[k];
+            }
+            c->data = lows;
+        } else {
+            bitset_atom_t* atoms = calloc(BITSET_INDEX_CONTAINER_ATOMS,
+                                          sizeof(bitset_atom_t));
+            if (!atoms) {
+                return -1;
+            }
+            for (size_t k = i; k < j; k++) {
+                uint16_t low = docs[k];
+                atoms[low / BITS_PER_ATOM] |=
+                    (bitset_atom_t)1 << (low % BITS_PER_ATOM);
+            }
+            c->data = atoms;
+        }
+        i = j;
+    }
+    return 0;
+}
+
+static void bitset_index_posting_wipe(bitset_posting_t* p) {
+    free(p->docs);
+    for (size_t c = 0; c < p->ncontainers; c++) {
+        free(p->containers[c].data);
+    }
+    free(p->containers);
+    if (p->kind == BITSET_POSTING_DENSE) {
+        bitset_wipe(&p->dense);
+    }
+}
+
+static size_t bitset_index_posting_size(const bitset_posting_t* p) {
+    switch (p->kind) {
+    case BITSET_POSTING_ARRAY:
+        return p->df * sizeof(uint32_t);
+    case BITSET_POSTING_ROARING: {
+        size_t size = p->ncontainers * sizeof(bitset_index_container_t);
+        for (size_t c = 0; c < p->ncontainers; c++) {
+            size += p->containers[c].card <= BITSET_INDEX_CONTAINER_ARRAY_MAX
+                  ? p->containers[c].card * sizeof(uint16_t)
+                  : BITSET_INDEX_CONTAINER_ATOMS * sizeof(bitset_atom_t);
+        }
+        return size;
+    }
+    default:
+        return p->dense.natoms * sizeof(bitset_atom_t);
+    }
+}
+
+static int bitset_index_posting_contains(const bitset_posting_t* p,
+                                         uint32_t doc)
+{
+    switch (p->kind) {
+    case BITSET_POSTING_ARRAY: {
+        size_t i = bitset_index_lower_u32(p->docs, p->df, doc);
+        return i < p->df && p->docs[i] == doc;
+    }
+    case BITSET_POSTING_ROARING: {
+        size_t lo = 0, hi = p->ncontainers;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (p->containers[mid].key < doc >> 16) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == p->ncontainers || p->containers[lo].key != doc >> 16) {
+            return 0;
+        }
+        const bitset_index_container_t* c = &p->containers[lo];
+        uint16_t low = doc;
+        if (c->card > BITSET_INDEX_CONTAINER_ARRAY_MAX) {
+            const bitset_atom_t* atoms = c->data;
+            return atoms[low / BITS_PER_ATOM] >> (low % BITS_PER_ATOM) & 1;
+        }
+        const uint16_t* lows = c->data;
+        size_t i = bitset_index_lower_u16(lows, c->card, low);
+        return i < c->card && lows[i] == low;
+    }
+    default:
+        return doc < p->dense.nbits && bitset_get(&p->dense, doc);
+    }
+}
+
+/* }}} */
+/* {{{ Combining postings into bitsets */
+
+/* Define `_name`, clearing the bits of the `natoms` atoms of `bits` that
+ * are not among the `n` sorted values of type `_T` of `v`. Atoms are
+ * and-ed with the mask of their values built in a register.
+ */
+#define BITSET_INDEX_AND_SORTED(_name, _T)                                  \
+    static void _name(bitset_atom_t* bits, size_t natoms,                   \
+                      const _T* v, size_t n)                                \
+    {                                                                       \
+        size_t a = 0;                                                       \
+        for (size_t i = 0; i < n; ) {                                       \
+            size_t atom = v[i] / BITS_PER_ATOM;                             \
+            bitset_atom_t mask = 0;                                         \
+            for (; i < n && v[i] / BITS_PER_ATOM == atom; i++) {            \
+                mask |= (bitset_atom_t)1 << (v[i] % BITS_PER_ATOM);         \
+            }                                                               \
+            memset(bits + a, 0, (atom - a) * sizeof(bitset_atom_t));        \
+            bits[atom] &= mask;                                             \
+            a = atom + 1;                                                   \
+        }                                                                   \
+        memset(bits + a, 0, (natoms - a) * sizeof(bitset_atom_t));          \
+    }
+
+BITSET_INDEX_AND_SORTED(bitset_index_and_u32, uint32_t)
+BITSET_INDEX_AND_SORTED(bitset_index_and_u16, uint16_t)
+
+/* Return the atoms of `out` covered by container `c`, from `*base`. */
+static size_t bitset_index_container_atoms(const bitset_t* out,
+                                           const bitset_index_container_t* c,
+                                           size_t* base)
+{
+    *base = (size_t)c->key * BITSET_INDEX_CONTAINER_ATOMS;
+    size_t left = out->natoms - *base;
+    return left < BITSET_INDEX_CONTAINER_ATOMS
+         ? left : BITSET_INDEX_CONTAINER_ATOMS;
+}
+
+/* out &= p */
+static void bitset_index_and_into(bitset_t* out, const bitset_posting_t* p) {
+    switch (p->kind) {
+    case BITSET_POSTING_ARRAY:
+        bitset_index_and_u32(out->bits, out->natoms, p->docs, p->df);
+        break;
+    case BITSET_POSTING_ROARING: {
+        size_t a = 0;
+        for (size_t i = 0; i < p->ncontainers; i++) {
+            const bitset_index_container_t* c = &p->containers[i];
+            size_t base;
+            size_t n = bitset_index_container_atoms(out, c, &base);
+            memset(out->bits + a, 0, (base - a) * sizeof(bitset_atom_t));
+            if (c->card <= BITSET_INDEX_CONTAINER_ARRAY_MAX) {
+                bitset_index_and_u16(out->bits + base, n, c->data, c->card);
+            } else {
+                const bitset_atom_t* atoms = c->data;
+                for (size_t k = 0; k < n; k++) {
+                    out->bits[base + k] &= atoms[k];
+                }
+            }
+            a = base + n;
+        }
+        memset(out->bits + a, 0, (out->natoms - a) * sizeof(bitset_atom_t));
+        break;
+    }
+    default:
+        bitset_and(out, &p->dense);
+    }
+}
+
+/* out |= p */
+static void bitset_index_or_into(bitset_t* out, const bitset_posting_t* p) {
+    switch (p->kind) {
+    case BITSET_POSTING_ARRAY:
+        for (size_t i = 0; i < p->df; i++) {
+            bitset_set(out, p->docs[i]);
+        }
+        break;
+    case BITSET_POSTING_ROARING:
+        for (size_t i = 0; i < p->ncontainers; i++) {
+            const bitset_index_container_t* c = &p->containers[i];
+            size_t base;
+            size_t n = bitset_index_container_atoms(out, c, &base);
+            if (c->card <= BITSET_INDEX_CONTAINER_ARRAY_MAX) {
+                const uint16_t* lows = c->data;
+                for (size_t k = 0; k < c->card; k++) {
+                    out->bits[base + lows[k] / BITS_PER_ATOM] |=
+                        (bitset_atom_t)1 << (lows[k] % BITS_PER_ATOM);
+                }
+            } else {
+                const bitset_atom_t* atoms = c->data;
+                for (size_t k = 0; k < n; k++) {
+                    out->bits[base + k] |= atoms[k];
+                }
+            }
+        }
+        break;
+    default:
+        bitset_or(out, &p->dense);
+    }
+}
+
+/* out &= ~p */
+static void bitset_index_andnot_into(bitset_t* out,
+                                     const bitset_posting_t* p)
+{
+    switch (p->kind) {
+    case BITSET_POSTING_ARRAY:
+        for (size_t i = 0; i < p->df; i++) {
+            bitset_unset(out, p->docs[i]);
+        }
+        break;
+    case BITSET_POSTING_ROARING:
+        for (size_t i = 0; i < p->ncontainers; i++) {
+            const bitset_index_container_t* c = &p->containers[i];
+            size_t base;
+            size_t n = bitset_index_container_atoms(out, c, &base);
+            if (c->card <= BITSET_INDEX_CONTAINER_ARRAY_MAX) {
+                const uint16_t* lows = c->data;
+                for (size_t k = 0; k < c->card; k++) {
+                    out->bits[base + lows[k] / BITS_PER_ATOM] &=
+                        ~((bitset_atom_t)1 << (lows[k] % BITS_PER_ATOM));
+                }
+            } else {
+                const bitset_atom_t* atoms = c->data;
+                for (size_t k = 0; k < n; k++) {
+                    out->bits[base + k] &= ~atoms[k];
+                }
+            }
+        }
+        break;
+    default:
+        for (size_t k = 0; k < out->natoms; k++) {
+            out->bits[k] &= ~p->dense.bits[k];
+        }
+    }
+}
+
+/* }}} */
+/* {{{ Index */
+
+void bitset_index_wipe(bitset_index_t* idx) {
+    if (idx->postings) {
+        for (uint32_t t = 0; t < idx->nterms; t++) {
+            bitset_index_posting_wipe(&idx->postings[t]);
+        }
+    }
+    free(idx->postings);
+}
+
+size_t bitset_index_size(const bitset_index_t* idx) {
+    size_t size = sizeof(*idx) + idx->nterms * sizeof(bitset_posting_t);
+    for (uint32_t t = 0; t < idx->nterms; t++) {
+        size += bitset_index_posting_size(&idx->postings[t]);
+    }
+    return size;
+}
+
+uint32_t bitset_index_df(const bitset_index_t* idx, uint32_t term) {
+    return bitset_index_posting(idx, term)->df;
+}
+
+bitset_posting_kind_t bitset_index_kind(const bitset_index_t* idx,
+                                        uint32_t term)
+{
+    return bitset_index_posting(idx, term)->kind;
+}
+
+int bitset_index_contains(const bitset_index_t* idx, uint32_t term,
+                          uint32_t doc)
+{
+    return bitset_index_posting_contains(bitset_index_posting(idx, term), doc);
+}
+
+/* }}} */
+/* {{{ Queries */
+
+/* Return 1 if document `doc` matches a boolean query. */
+static int bitset_index_matches(const bitset_index_t* idx, uint32_t doc,
+                                const uint32_t* must, size_t nmust,
+                                const uint32_t* should, size_t nshould,
+                                const uint32_t* must_not, size_t nnot)
+{
+    for (size_t i = 0; i < nmust; i++) {
+        if (!bitset_index_contains(idx, must[i], doc)) {
+            return 0;
+        }
+    }
+    int any = nshould == 0;
+    for (size_t i = 0; i < nshould && !any; i++) {
+        any = bitset_index_contains(idx, should[i], doc);
+    }
+    for (size_t i = 0; i < nnot && any; i++) {
+        any = !bitset_index_contains(idx, must_not[i], doc);
+    }
+    return any;
+}
+
+int bitset_index_query(const bitset_index_t* idx,
+                       const uint32_t* must, size_t nmust,
+                       const uint32_t* should, size_t nshould,
+                       const uint32_t* must_not, size_t nnot,
+                       bitset_t* out)
+{
+    assert (out->nbits == idx->ndocs);
+    const size_t size = out->natoms * sizeof(bitset_atom_t);
+
+    if (nmust > 0) {
+        size_t rarest = 0;
+        for (size_t i = 1; i < nmust; i++) {
+            if (bitset_index_df(idx, must[i])
+              < bitset_index_df(idx, must[rarest])) {
+                rarest = i;
+            }
+        }
+        const bitset_posting_t* p = bitset_index_posting(idx, must[rarest]);
+        memset(out->bits, 0, size);
+
+        // Few candidates are checked one by one against other terms.
+        if (p->kind == BITSET_POSTING_ARRAY) {
+            for (size_t i = 0; i < p->df; i++) {
+                if (bitset_index_matches(idx, p->docs[i], must, nmust,
+                                         should, nshould, must_not, nnot)) {
+                    bitset_set(out, p->docs[i]);
+                }
+            }
+            return 0;
+        }
+        bitset_index_or_into(out, p);
+        for (size_t i = 0; i < nmust; i++) {
+            if (i != rarest) {
+                bitset_index_and_into(out, bitset_index_posting(idx, must[i]));
+            }
+        }
+    } else if (nshould == 0) {
+        memset(out->bits, 0xff, size);
+        if (out->nbits % BITS_PER_ATOM) {
+            out->bits[out->natoms - 1] &=
+                ((bitset_atom_t)1 << (out->nbits % BITS_PER_ATOM)) - 1;
+        }
+    }
+
+    if (nshould > 0) {
+        bitset_t any;
+        bitset_t* u = out;
+        if (nmust > 0) {
+            if (bitset_init(&any, idx->ndocs)) {
+                return -1;
+            }
+            u = &any;
+        } else {
+            memset(out->bits, 0, size);
+        }
+        for (size_t i = 0; i < nshould; i++) {
+            bitset_index_or_into(u, bitset_index_posting(idx, should[i]));
+        }
+        if (nmust > 0) {
+            bitset_and(out, &any);
+            bitset_wipe(&any);
+        }
+    }
+
+    for (size_t i = 0; i < nnot; i++) {
+        bitset_index_andnot_into(out, bitset_index_posting(idx, must_not[i]));
+    }
+    return 0;
+}
+
+/* Position in a posting, for documents looked for in increasing order */
+typedef struct bitset_index_cursor {
+    const bitset_posting_t *p;
+    size_t                  i;      /* Document or container */
+    size_t                  j;      /* Low bits in the container */
+    float                   idf;
+} bitset_index_cursor_t;
+
+/* Return 1 if the posting of `c` contains `doc`, moving `c` up to it.
+ * @pre `doc` is greater than the documents looked for before
+ */
+static int bitset_index_cursor_has(bitset_index_cursor_t* c, uint32_t doc) {
+    const bitset_posting_t* p = c->p;
+    switch (p->kind) {
+    case BITSET_POSTING_ARRAY:
+        while (c->i < p->df && p->docs[c->i] < doc) {
+            c->i++;
+        }
+        return c->i < p->df && p->docs[c->i] == doc;
+    case BITSET_POSTING_ROARING: {
+        while (c->i < p->ncontainers && p->containers[c->i].key < doc >> 16) {
+            c->i++;
+            c->j = 0;
+        }
+        if (c->i == p->ncontainers || p->containers[c->i].key != doc >> 16) {
+            return 0;
+        }
+        const bitset_index_container_t* ct = &p->containers[c->i];
+        uint16_t low = doc;
+        if (ct->card > BITSET_INDEX_CONTAINER_ARRAY_MAX) {
+            const bitset_atom_t* atoms = ct->data;
+            return atoms[low / BITS_PER_ATOM] >> (low % BITS_PER_ATOM) & 1;
+        }
+        const uint16_t* lows = ct->data;
+        while (c->j < ct->card && lows[c->j] < low) {
+            c->j++;
+        }
+        return c->j < ct->card && lows[c->j] == low;
+    }
+    default:
+        return bitset_get(&p->dense, doc);
+    }
+}
+
+/* Return 1 if hit `a` ranks after hit `b`. */
+static int bitset_index_hit_worse(const bitset_index_hit_t* a,
+                                  const bitset_index_hit_t* b)
+{
+    return a->score < b->score || (a->score == b->score && a->doc > b->doc);
+}
+
+static int bitset_index_hit_cmp(const void* a, const void* b) {
+    const bitset_index_hit_t* x = a;
+    const bitset_index_hit_t* y = b;
+    return bitset_index_hit_worse(x, y) - bitset_index_hit_worse(y, x);
+}
+
+/* Restore the heap of the `n` hits of `heap`, worst first, from `i` down. */
+static void bitset_index_heap_down(bitset_index_hit_t* heap, size_t n,
+                                   size_t i)
+{
+    for (;;) {
+        size_t w = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && bitset_index_hit_worse(&heap[l], &heap[w])) {
+            w = l;
+        }
+        if (r < n && bitset_index_hit_worse(&heap[r], &heap[w])) {
+            w = r;
+        }
+        if (w == i) {
+            return;
+        }
+        bitset_index_hit_t tmp = heap[i];
+        heap[i] = heap[w];
+        heap[w] = tmp;
+        i = w;
+    }
+}
+
+static void bitset_index_heap_up(bitset_index_hit_t* heap, size_t i) {
+    while (i > 0 && bitset_index_hit_worse(&heap[i], &heap[(i - 1) / 2])) {
+        bitset_index_hit_t tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+int bitset_index_ranked(const bitset_index_t* idx, const uint32_t* terms,
+                        size_t n, const bitset_t* filter, size_t k,
+                        bitset_index_hit_t* hits, size_t* nhits)
+{
+    assert (!filter || filter->nbits == idx->ndocs);
+    *nhits = 0;
+    if (k == 0 || n == 0) {
+        return 0;
+    }
+    bitset_t cand;
+    if (bitset_init(&cand, idx->ndocs)) {
+        return -1;
+    }
+    bitset_index_cursor_t* cursors = malloc(n * sizeof(*cursors));
+    if (!cursors) {
+        bitset_wipe(&cand);
+        return -1;
+    }
+    for (size_t t = 0; t < n; t++) {
+        const bitset_posting_t* p = bitset_index_posting(idx, terms[t]);
+        double df = p->df;
+        cursors[t] = (bitset_index_cursor_t){
+            .p = p,
+            .idf = log(1.0 + (idx->ndocs - df + 0.5) / (df + 0.5)),
+        };
+        bitset_index_or_into(&cand, p);
+    }
+    if (filter) {
+        bitset_and(&cand, filter);
+    }
+
+    // Candidates are scored in increasing order, each posting being walked
+    // once by its cursor, and the best k kept in a heap of the worst.
+    size_t m = 0;
+    for (size_t a = 0; a < cand.natoms; a++) {
+        for (bitset_atom_t atom = cand.bits[a]; atom; atom &= atom - 1) {
+            bitset_index_hit_t hit = {
+                .doc = a * BITS_PER_ATOM + __builtin_ctzll(atom),
+            };
+            for (size_t t = 0; t < n; t++) {
+                if (bitset_index_cursor_has(&cursors[t], hit.doc)) {
+                    hit.score += cursors[t].idf;
+                }
+            }
+            if (m < k) {
+                hits[m] = hit;
+                bitset_index_heap_up(hits, m++);
+            } else if (hit.score > hits[0].score) {
+                hits[0] = hit;
+                bitset_index_heap_down(hits, m, 0);
+            }
+        }
+    }
+    qsort(hits, m, sizeof(*hits), bitset_index_hit_cmp);
+    *nhits = m;
+    free(cursors);
+    bitset_wipe(&cand);
+    return 0;
+}
+
+/* }}} */
+/* {{{ Building */
+
+int bitset_index_builder_init(bitset_index_builder_t* b, size_t budget,
+                              const char* dir)
+{
+    memset(b, 0, sizeof(*b));
+    b->fd = -1;
+    // The buffer and the room for sorting it share the budget.
+    b->cap = budget / (2 * sizeof(uint64_t));
+    if (b->cap == 0) {
+        b->cap = 1;
+    }
+    b->pairs = malloc(b->cap * sizeof(uint64_t));
+    b->sorted = malloc(b->cap * sizeof(uint64_t));
+    b->dir = strdup(dir ? dir : "/tmp");
+    b->runs = calloc(1, sizeof(uint64_t));
+    if (!b->pairs || !b->sorted || !b->dir || !b->runs) {
+        bitset_index_builder_wipe(b);
+        return -1;
+    }
+    return 0;
+}
+
+void bitset_index_builder_wipe(bitset_index_builder_t* b) {
+    free(b->pairs);
+    free(b->sorted);
+    free(b->dir);
+    free(b->runs);
+    if (b->fd >= 0) {
+        close(b->fd);
+    }
+    b->pairs = b->sorted = NULL;
+    b->dir = NULL;
+    b->runs = NULL;
+    b->fd = -1;
+}
+
+/* Sort the pairs of `b` by term, with a radix sort on the bytes of terms
+ * skipping those all pairs share. Pairs are added by increasing document,
+ * and the sort is stable, so documents of a term stay sorted.
+ */
+static void bitset_index_builder_sort(bitset_index_builder_t* b) {
+    uint64_t* src = b->pairs;
+    uint64_t* dst = b->sorted;
+    const size_t n = b->npairs;
+    if (n == 0) {
+        return;
+    }
+    for (unsigned shift = 32; shift < 64; shift += 8) {
+        size_t count[256] = { 0 };
+        for (size_t i = 0; i < n; i++) {
+            count[src[i] >> shift & 0xff]++;
+        }
+        if (count[src[0] >> shift & 0xff] == n) {
+            continue;
+        }
+        size_t sum = 0;
+        for (unsigned d = 0; d < 256; d++) {
+            size_t c = count[d];
+            count[d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            dst[count[src[i] >> shift & 0xff]++] = src[i];
+        }
+        uint64_t* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    b->pairs = src;
+    b->sorted = dst;
+}
+
+/* Write the `*len` words of `buf` at `*off` of `fd`, and empty `buf`. */
+static int bitset_index_flush(int fd, const uint32_t* buf, size_t* len,
+                              uint64_t* off)
+{
+    if (bitset_pwrite_all(fd, buf, *len * sizeof(uint32_t), *off)) {
+        return -1;
+    }
+    *off += *len * sizeof(uint32_t);
+    *len = 0;
+    return 0;
+}
+
+/* Sort the buffer of `b` and write it at the end of the temporary file as
+ * a run of records: a term, its number of documents, and its documents.
+ */
+static int bitset_index_builder_spill(bitset_index_builder_t* b) {
+    if (b->fd < 0) {
+        size_t len = strlen(b->dir);
+        char* path = malloc(len + sizeof("/bitset-index-XXXXXX"));
+        if (!path) {
+            return -1;
+        }
+        memcpy(path, b->dir, len);
+        memcpy(path + len, "/bitset-index-XXXXXX",
+               sizeof("/bitset-index-XXXXXX"));
+        // The file is removed right away, and freed once closed.
+        b->fd = mkstemp(path);
+        if (b->fd >= 0) {
+            unlink(path);
+        }
+        free(path);
+        if (b->fd < 0) {
+            return -1;
+        }
+    }
+    uint64_t* runs = realloc(b->runs, (b->nruns + 2) * sizeof(*runs));
+    if (!runs) {
+        return -1;
+    }
+    b->runs = runs;
+    bitset_index_builder_sort(b);
+
+    uint32_t buf[BITSET_INDEX_SPILL_WORDS];
+    size_t len = 0;
+    uint64_t off = runs[b->nruns];
+    const uint64_t* pairs = b->pairs;
+    for (size_t i = 0; i < b->npairs; ) {
+        uint32_t term = pairs[i] >> 32;
+        size_t j = i + 1, count = 1;
+        for (; j < b->npairs && pairs[j] >> 32 == term; j++) {
+            count += (uint32_t)pairs[j] != (uint32_t)pairs[j - 1];
+        }
+        if (len + 2 > BITSET_INDEX_SPILL_WORDS
+        &&  bitset_index_flush(b->fd, buf, &len, &off)) {
+            return -1;
+        }
+        buf[len++] = term;
+        buf[len++] = count;
+        for (size_t k = i; k < j; k++) {
+            if (k > i && (uint32_t)pairs[k] == (uint32_t)pairs[k - 1]) {
+                continue;
+            }
+            if (len == BITSET_INDEX_SPILL_WORDS
+            &&  bitset_index_flush(b->fd, buf, &len, &off)) {
+                return -1;
+            }
+            buf[len++] = (uint32_t)pairs[k];
+        }
+        i = j;
+    }
+    if (bitset_index_flush(b->fd, buf, &len, &off)) {
+        return -1;
+    }
+    runs[++b->nruns] = off;
+    b->npairs = 0;
+    return 0;
+}
+
+int bitset_index_builder_add(bitset_index_builder_t* b,
+                             const uint32_t* terms, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        assert (terms[i] < UINT32_MAX);
+        if (b->npairs == b->cap && bitset_index_builder_spill(b)) {
+            return -1;
+        }
+        b->pairs[b->npairs++] = (uint64_t)terms[i] << 32 | b->ndocs;
+        if (terms[i] >= b->nterms) {
+            b->nterms = terms[i] + 1;
+        }
+    }
+    b->ndocs++;
+    return 0;
+}
+
+/* Build the postings of `idx` from the buffer of `b`, nothing spilled. */
+static int bitset_index_builder_build(bitset_index_builder_t* b,
+                                      bitset_index_t* idx)
+{
+    bitset_index_builder_sort(b);
+    // Documents of a term fit in the room for sorting.
+    uint32_t* docs = (uint32_t*)b->sorted;
+    for (size_t i = 0; i < b->npairs; ) {
+        uint32_t term = b->pairs[i] >> 32;
+        size_t n = 0;
+        for (; i < b->npairs && b->pairs[i] >> 32 == term; i++) {
+            if (n == 0 || docs[n - 1] != (uint32_t)b->pairs[i]) {
+                docs[n++] = b->pairs[i];
+            }
+        }
+        if (bitset_index_posting_init(&idx->postings[term], docs, n,
+                                      idx->ndocs)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Run of the temporary file read back */
+typedef struct bitset_index_run {
+    uint64_t  off;      /* Next byte of the file to read */
+    uint64_t  end;      /* End of the run in the file */
+    uint32_t *buf;
+    size_t    cap;      /* Words of `buf` */
+    size_t    pos;      /* Next word of `buf` */
+    size_t    len;      /* Words in `buf` */
+    uint64_t  term;     /* Term of the next record, UINT64_MAX at the end */
+    uint32_t  count;    /* Documents of the next record */
+} bitset_index_run_t;
+
+/* Read the next `n` words of run `r` of `fd` into `out`. */
+static int bitset_index_run_read(int fd, bitset_index_run_t* r, uint32_t* out,
+                                 size_t n)
+{
+    while (n > 0) {
+        if (r->pos == r->len) {
+            uint64_t left = (r->end - r->off) / sizeof(uint32_t);
+            if (left == 0) {
+                return -1;
+            }
+            r->len = left < r->cap ? left : r->cap;
+            r->pos = 0;
+            if (bitset_pread_all(fd, r->buf, r->len * sizeof(uint32_t),
+                                 r->off)) {
+                return -1;
+            }
+            r->off += r->len * sizeof(uint32_t);
+        }
+        size_t m = r->len - r->pos < n ? r->len - r->pos : n;
+        memcpy(out, r->buf + r->pos, m * sizeof(uint32_t));
+        out += m;
+        r->pos += m;
+        n -= m;
+    }
+    return 0;
+}
+
+/* Read the header of the next record of run `r` of `fd`. */
+static int bitset_index_run_next(int fd, bitset_index_run_t* r) {
+    if (r->pos == r->len && r->off == r->end) {
+        r->term = UINT64_MAX;
+        return 0;
+    }
+    uint32_t head[2];
+    if (bitset_index_run_read(fd, r, head, 2)) {
+        return -1;
+    }
+    r->term = head[0];
+    r->count = head[1];
+    return 0;
+}
+
+/* Return 1 if run `a` of `runs` comes out of merges before run `b`: by
+ * term, then by run, so that documents of a term stay sorted.
+ */
+static int bitset_index_run_before(const bitset_index_run_t* runs, size_t a,
+                                   size_t b)
+{
+    return runs[a].term < runs[b].term
+        || (runs[a].term == runs[b].term && a < b);
+}
+
+/* Restore the heap of the `n` runs of `heap`, first first, from `i` down. */
+static void bitset_index_run_down(const bitset_index_run_t* runs,
+                                  size_t* heap, size_t n, size_t i)
+{
+    for (;;) {
+        size_t f = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && bitset_index_run_before(runs, heap[l], heap[f])) {
+            f = l;
+        }
+        if (r < n && bitset_index_run_before(runs, heap[r], heap[f])) {
+            f = r;
+        }
+        if (f == i) {
+            return;
+        }
+        size_t tmp = heap[i];
+        heap[i] = heap[f];
+        heap[f] = tmp;
+        i = f;
+    }
+}
+
+/* Merge runs `first` to first + n - 1 of `b`, with the `n` buffers of
+ * `words` words of `bufs`, and `heap` of `n` entries. Append the merged run
+ * to the file if `idx` is NULL, or build the postings of `idx` otherwise.
+ */
+static int bitset_index_builder_merge_runs(bitset_index_builder_t* b,
+                                           size_t first, size_t n,
+                                           bitset_index_run_t* runs,
+                                           uint32_t* bufs, size_t words,
+                                           size_t* heap, bitset_index_t* idx)
+{
+    size_t nheap = 0;
+    for (size_t r = 0; r < n; r++) {
+        runs[r] = (bitset_index_run_t){
+            .off = b->runs[first + r],
+            .end = b->runs[first + r + 1],
+            .buf = bufs + r * words,
+            .cap = words,
+        };
+        if (bitset_index_run_next(b->fd, &runs[r])) {
+            return -1;
+        }
+        if (runs[r].term != UINT64_MAX) {
+            heap[nheap++] = r;
+        }
+    }
+    for (size_t i = nheap / 2; i-- > 0; ) {
+        bitset_index_run_down(runs, heap, nheap, i);
+    }
+    if (!idx) {
+        uint64_t* grown = realloc(b->runs, (b->nruns + 2) * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        b->runs = grown;
+    }
+
+    uint32_t out[BITSET_INDEX_SPILL_WORDS];
+    size_t len = 0;
+    uint64_t off = b->runs[b->nruns];
+    uint32_t* docs = NULL;
+    size_t cap = 0;
+    int res = 0;
+    while (nheap > 0 && res == 0) {
+        uint64_t term = runs[heap[0]].term;
+        uint64_t head = off + len * sizeof(uint32_t);   /* Merged record */
+        size_t ndocs = 0;
+        if (!idx) {
+            if (len + 2 > BITSET_INDEX_SPILL_WORDS) {
+                res = bitset_index_flush(b->fd, out, &len, &off);
+                head = off;
+            }
+            out[len++] = term;
+            out[len++] = 0;
+        }
+
+        // Records of the term, in document order, are concatenated.
+        while (res == 0 && nheap > 0 && runs[heap[0]].term == term) {
+            bitset_index_run_t* r = &runs[heap[0]];
+            size_t count = r->count;
+            if (idx && ndocs + count > cap) {
+                size_t size = 2 * cap > ndocs + count
+                            ? 2 * cap : ndocs + count;
+                uint32_t* tmp = realloc(docs, size * sizeof(uint32_t));
+                if (!tmp) {
+                    res = -1;
+                    break;
+                }
+                docs = tmp;
+                cap = size;
+            }
+            if (idx) {
+                res = bitset_index_run_read(b->fd, r, docs + ndocs, count);
+            }
+            for (size_t left = count; !idx && res == 0 && left > 0; ) {
+                if (len == BITSET_INDEX_SPILL_WORDS) {
+                    res = bitset_index_flush(b->fd, out, &len, &off);
+                }
+                size_t m = BITSET_INDEX_SPILL_WORDS - len < left
+                         ? BITSET_INDEX_SPILL_WORDS - len : left;
+                if (res == 0) {
+                    res = bitset_index_run_read(b->fd, r, out + len, m);
+                }
+                len += m;
+                left -= m;
+            }
+            ndocs += count;
+            if (res == 0) {
+                res = bitset_index_run_next(b->fd, r);
+            }
+            if (r->term == UINT64_MAX) {
+                heap[0] = heap[--nheap];
+            }
+            bitset_index_run_down(runs, heap, nheap, 0);
+        }
+        if (res != 0) {
+            break;
+        }
+
+        if (idx) {
+            // The document spanning two spills may be repeated.
+            size_t m = 0;
+            for (size_t i = 0; i < ndocs; i++) {
+                if (m == 0 || docs[i] != docs[m - 1]) {
+                    docs[m++] = docs[i];
+                }
+            }
+            res = bitset_index_posting_init(&idx->postings[term], docs, m,
+                                            idx->ndocs);
+        } else if (head >= off) {
+            out[(head - off) / sizeof(uint32_t) + 1] = ndocs;
+        } else {
+            uint32_t count = ndocs;
+            res = bitset_pwrite_all(b->fd, &count, sizeof(count),
+                                    head + sizeof(uint32_t));
+        }
+    }
+    free(docs);
+    if (res == 0 && !idx) {
+        res = bitset_index_flush(b->fd, out, &len, &off);
+        if (res == 0) {
+            b->runs[++b->nruns] = off;
+        }
+    }
+    return res;
+}
+
+/* Build the postings of `idx` by merging the runs of `b`, several passes
+ * merging groups of consecutive runs into new ones until few enough are
+ * left for the budget.
+ */
+static int bitset_index_builder_merge(bitset_index_builder_t* b,
+                                      bitset_index_t* idx)
+{
+    // The buffer is not needed anymore: its budget goes to reading runs.
+    size_t budget = b->cap * 2 * sizeof(uint64_t);
+    free(b->pairs);
+    free(b->sorted);
+    b->pairs = b->sorted = NULL;
+
+    size_t fanin = budget / (BITSET_INDEX_RUN_WORDS * sizeof(uint32_t));
+    if (fanin < 2) {
+        fanin = 2;
+    }
+    if (fanin > b->nruns) {
+        fanin = b->nruns;
+    }
+    size_t words = budget / sizeof(uint32_t) / fanin;
+    if (words < BITSET_INDEX_RUN_WORDS) {
+        words = BITSET_INDEX_RUN_WORDS;
+    }
+
+    bitset_index_run_t* runs = malloc(fanin * sizeof(*runs));
+    uint32_t* bufs = malloc(fanin * words * sizeof(uint32_t));
+    size_t* heap = malloc(fanin * sizeof(*heap));
+    int res = runs && bufs && heap ? 0 : -1;
+
+    // Merged runs are appended to the file, after those of the pass.
+    size_t first = 0;
+    while (res == 0 && b->nruns - first > fanin) {
+        size_t end = b->nruns;
+        for (size_t g = first; g < end && res == 0; g += fanin) {
+            size_t n = end - g < fanin ? end - g : fanin;
+            res = bitset_index_builder_merge_runs(b, g, n, runs, bufs, words,
+                                                  heap, NULL);
+        }
+        first = end;
+    }
+    if (res == 0) {
+        res = bitset_index_builder_merge_runs(b, first, b->nruns - first,
+                                              runs, bufs, words, heap, idx);
+    }
+
+    free(heap);
+    free(bufs);
+    free(runs);
+    return res;
+}
+
+int bitset_index_builder_finish(bitset_index_builder_t* b,
+                                bitset_index_t* idx)
+{
+    idx->ndocs = b->ndocs;
+    idx->nterms = b->nterms;
+    idx->postings = calloc(b->nterms ? b->nterms : 1,
+                           sizeof(*idx->postings));
+    int res = idx->postings ? 0 : -1;
+    if (res == 0 && b->nruns == 0) {
+        res = bitset_index_builder_build(b, idx);
+    } else if (res == 0) {
+        if (b->npairs > 0) {
+            res = bitset_index_builder_spill(b);
+        }
+        if (res == 0) {
+            res = bitset_index_builder_merge(b, idx);
+        }
+    }
+    bitset_index_builder_wipe(b);
+    if (res != 0) {
+        bitset_index_wipe(idx);
+    }
+    return res;
+}
+
+/* }}} */
@@ -0,0 +1,70 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "io.h"
+
+int bitset_pwrite_all(int fd, const void* buf, size_t len, off_t off) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+int bitset_pread_all(int fd, void* buf, size_t len, off_t off) {
+    char* p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+int bitset_fsync_dir(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t len = slash ? (size_t)(slash - path) : 0;
+    char* dir = malloc(len + sizeof("."));
+    if (!dir) {
+        return -1;
+    }
+    if (slash == path) {
+        strcpy(dir, "/");
+    } else if (slash) {
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    int fd = open(dir, O_RDONLY);
+    free(dir);
+    if (fd < 0) {
+        return -1;
+    }
+    int res = fsync(fd);
+    close(fd);
+    return res;
+}
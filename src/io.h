@@ -0,0 +1,24 @@
+/* Internal I/O helpers shared by modules storing bitsets in files. */
+
+#ifndef _bitset_io_h_
+#define _bitset_io_h_
+
+#include <sys/types.h>
+
+/* Write exactly `len` bytes of `buf` at offset `off` of `fd`.
+ * @return not 0 on error.
+ */
+int bitset_pwrite_all(int fd, const void* buf, size_t len, off_t off);
+
+/* Read exactly `len` bytes at offset `off` of `fd` into `buf`.
+ * @return not 0 on error or if the file is too short.
+ */
+int bitset_pread_all(int fd, void* buf, size_t len, off_t off);
+
+/* Sync the directory containing `path`, so that files created or renamed
+ * in it survive a crash.
+ * @return not 0 on error.
+ */
+int bitset_fsync_dir(const char* path);
+
+#endif
@@ -0,0 +1,297 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define BITSET_LIFE_X86
+#endif
+#include "bitset/life.h"
+#include "parallel.h"
+
+static pthread_once_t bitset_life_once = PTHREAD_ONCE_INIT;
+static int            bitset_life_has_avx512;
+static int            bitset_life_has_avx2;
+
+static void bitset_life_init_once(void) {
+#ifdef BITSET_LIFE_X86
+    bitset_life_has_avx512 = __builtin_cpu_supports("avx512f") != 0;
+    bitset_life_has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+int bitset_life_rule_parse(bitset_life_rule_t* rule, const char* s) {
+    bitset_life_rule_t r = { 0, 0 };
+    int seen_b = 0, seen_s = 0;
+    for (;;) {
+        uint16_t* mask;
+        if ((*s == 'B' || *s == 'b') && !seen_b) {
+            mask = &r.birth;
+            seen_b = 1;
+        } else if ((*s == 'S' || *s == 's') && !seen_s) {
+            mask = &r.survive;
+            seen_s = 1;
+        } else {
+            return -1;
+        }
+        for (s++; *s >= '0' && *s <= '8'; s++) {
+            *mask |= 1 << (*s - '0');
+        }
+        if (*s == '\0') {
+            break;
+        }
+        if (*s++ != '/') {
+            return -1;
+        }
+    }
+    *rule = r;
+    return 0;
+}
+
+/* {{{ Kernels */
+
+/* Full adder: bitwise sum `_s` and carry `_c` of `_a`, `_b` and `_d` */
+#define BITSET_LIFE_ADD3(_s, _c, _a, _b, _d)                                \
+    do {                                                                    \
+        __typeof__(_a) _t = (_a) ^ (_b);                                    \
+        (_s) = _t ^ (_d);                                                   \
+        (_c) = ((_a) & (_b)) | (_t & (_d));                                 \
+    } while (0)
+
+/* Half adder: bitwise sum `_s` and carry `_c` of `_a` and `_b` */
+#define BITSET_LIFE_ADD2(_s, _c, _a, _b)                                    \
+    do {                                                                    \
+        __typeof__(_a) _t = (_a);                                           \
+        (_s) = _t ^ (_b);                                                   \
+        (_c) = _t & (_b);                                                   \
+    } while (0)
+
+/* Define `_name`, computing the next state of the cells of `mc` from the
+ * atoms above (`u`), of (`m`) and below (`d`) them, each with the atom
+ * before (`p`) and after (`n`) it. Works on atoms or vectors of atoms, of
+ * type `_T`.
+ */
+#define BITSET_LIFE_EVAL(_T, _name, _target)                                \
+    _target static inline __attribute__((always_inline))                    \
+    _T _name(_T up, _T uc, _T un, _T mp, _T mc, _T mn, _T dp, _T dc, _T dn, \
+             unsigned birth, unsigned survive)                              \
+    {                                                                       \
+        const int last = BITS_PER_ATOM - 1;                                 \
+        /* Cell x - 1 (x + 1) of a row is at bit x of its west (east). */   \
+        _T uw = uc << 1 | up >> last, ue = uc >> 1 | un << last;            \
+        _T mw = mc << 1 | mp >> last, me = mc >> 1 | mn << last;            \
+        _T dw = dc << 1 | dp >> last, de = dc >> 1 | dn << last;            \
+                                                                            \
+        /* Sum the 8 neighbors into the 4 bits s0 to s3 of a count. */      \
+        _T su, cu, sm, cm, sd, cd, s0, c0, t1, c2, s1, c1, s2, s3;          \
+        BITSET_LIFE_ADD3(su, cu, uw, uc, ue);                               \
+        BITSET_LIFE_ADD2(sm, cm, mw, me);                                   \
+        BITSET_LIFE_ADD3(sd, cd, dw, dc, de);                               \
+        BITSET_LIFE_ADD3(s0, c0, su, sm, sd);                               \
+        BITSET_LIFE_ADD3(t1, c2, cu, cm, cd);                               \
+        BITSET_LIFE_ADD2(s1, c1, t1, c0);                                   \
+        BITSET_LIFE_ADD2(s2, s3, c2, c1);                                   \
+                                                                            \
+        _T next = mc ^ mc;                                                  \
+        for (unsigned k = 0; k <= 8; k++) {                                 \
+            int b = birth >> k & 1, s = survive >> k & 1;                   \
+            if (!b && !s) {                                                 \
+                continue;                                                   \
+            }                                                               \
+            _T eq = (k & 1 ? s0 : ~s0) & (k & 2 ? s1 : ~s1)                 \
+                  & (k & 4 ? s2 : ~s2) & (k & 8 ? s3 : ~s3);                \
+            next |= b && s ? eq : b ? eq & ~mc : eq & mc;                   \
+        }                                                                   \
+        return next;                                                        \
+    }
+
+BITSET_LIFE_EVAL(bitset_atom_t, bitset_life_eval, )
+
+/* Next state of atom `j` of a row of `stride` atoms */
+static inline bitset_atom_t bitset_life_atom(const bitset_atom_t* u,
+                                             const bitset_atom_t* m,
+                                             const bitset_atom_t* d,
+                                             size_t j, size_t stride,
+                                             unsigned birth, unsigned survive)
+{
+    size_t p = j > 0 ? j - 1 : j, n = j + 1 < stride ? j + 1 : j;
+    bitset_atom_t hasp = j > 0 ? BITSET_ATOM_MAX : 0;
+    bitset_atom_t hasn = j + 1 < stride ? BITSET_ATOM_MAX : 0;
+    return bitset_life_eval(u[p] & hasp, u[j], u[n] & hasn,
+                            m[p] & hasp, m[j], m[n] & hasn,
+                            d[p] & hasp, d[j], d[n] & hasn, birth, survive);
+}
+
+/* Define `_name`, storing into out[j] to out[end - 1] the next state of
+ * their atoms, a vector of type `_T` at a time, with `_eval`. Return the
+ * first atom not computed.
+ * @pre j > 0, end < stride
+ */
+#define BITSET_LIFE_ROW(_T, _name, _eval, _target)                          \
+    _target static size_t _name(bitset_atom_t* out, const bitset_atom_t* u, \
+                                const bitset_atom_t* m,                     \
+                                const bitset_atom_t* d, size_t j,           \
+                                size_t end, unsigned birth,                 \
+                                unsigned survive)                           \
+    {                                                                       \
+        const size_t w = sizeof(_T) / sizeof(bitset_atom_t);                \
+        _T v[9];                                                            \
+        for (; j + w <= end; j += w) {                                      \
+            const bitset_atom_t* rows[3] = { u, m, d };                     \
+            for (int r = 0; r < 3; r++) {                                   \
+                memcpy(&v[3 * r], rows[r] + j - 1, sizeof(_T));             \
+                memcpy(&v[3 * r + 1], rows[r] + j, sizeof(_T));             \
+                memcpy(&v[3 * r + 2], rows[r] + j + 1, sizeof(_T));         \
+            }                                                               \
+            _T next = _eval(v[0], v[1], v[2], v[3], v[4], v[5],             \
+                            v[6], v[7], v[8], birth, survive);              \
+            memcpy(out + j, &next, sizeof(_T));                             \
+        }                                                                   \
+        return j;                                                           \
+    }
+
+#ifdef BITSET_LIFE_X86
+
+typedef bitset_atom_t bitset_life_v4_t
+    __attribute__((vector_size(4 * sizeof(bitset_atom_t))));
+typedef bitset_atom_t bitset_life_v8_t
+    __attribute__((vector_size(8 * sizeof(bitset_atom_t))));
+
+BITSET_LIFE_EVAL(bitset_life_v4_t, bitset_life_eval_avx2,
+                 __attribute__((target("avx2"))))
+BITSET_LIFE_ROW(bitset_life_v4_t, bitset_life_row_avx2,
+                bitset_life_eval_avx2, __attribute__((target("avx2"))))
+
+BITSET_LIFE_EVAL(bitset_life_v8_t, bitset_life_eval_avx512,
+                 __attribute__((target("avx512f"))))
+BITSET_LIFE_ROW(bitset_life_v8_t, bitset_life_row_avx512,
+                bitset_life_eval_avx512, __attribute__((target("avx512f"))))
+
+#endif
+
+/* Store into out[j0] to out[j1 - 1] the next state of their atoms, given
+ * the rows above and below.
+ */
+static void bitset_life_row(bitset_atom_t* out, const bitset_atom_t* u,
+                            const bitset_atom_t* m, const bitset_atom_t* d,
+                            size_t j0, size_t j1, size_t stride,
+                            unsigned birth, unsigned survive)
+{
+    size_t j = j0;
+    if (j == 0 && j < j1) {
+        out[0] = bitset_life_atom(u, m, d, 0, stride, birth, survive);
+        j++;
+    }
+    // Vectors read one atom past their end, which the last atom has not.
+    size_t end = j1 < stride ? j1 : stride - 1;
+#ifdef BITSET_LIFE_X86
+    if (bitset_life_has_avx512) {
+        j = bitset_life_row_avx512(out, u, m, d, j, end, birth, survive);
+    }
+    if (bitset_life_has_avx2) {
+        j = bitset_life_row_avx2(out, u, m, d, j, end, birth, survive);
+    }
+#endif
+    for (; j < j1; j++) {
+        out[j] = bitset_life_atom(u, m, d, j, stride, birth, survive);
+    }
+}
+
+/* }}} */
+/* {{{ Tiles */
+
+typedef struct bitset_life_job {
+    bitset_grid_t       *dest;
+    const bitset_grid_t *src;
+    const bitset_atom_t *zeros;     /* A row of dead cells */
+    bitset_atom_t        last_mask; /* Cells of the last atom of a row */
+    unsigned             birth;
+    unsigned             survive;
+    size_t               tiles_x;   /* Tiles per row of tiles */
+    size_t               ntiles;
+} bitset_life_job_t;
+
+static void bitset_life_run_tile(void* arg, size_t tile, unsigned t) {
+    (void)t;
+    bitset_life_job_t* job = arg;
+    const bitset_grid_t* src = job->src;
+    size_t y0 = tile / job->tiles_x * BITSET_LIFE_TILE_ROWS;
+    size_t y1 = y0 + BITSET_LIFE_TILE_ROWS < src->height
+              ? y0 + BITSET_LIFE_TILE_ROWS : src->height;
+    size_t j0 = tile % job->tiles_x * BITSET_LIFE_TILE_ATOMS;
+    size_t j1 = j0 + BITSET_LIFE_TILE_ATOMS < src->stride
+              ? j0 + BITSET_LIFE_TILE_ATOMS : src->stride;
+    for (size_t y = y0; y < y1; y++) {
+        bitset_atom_t* out = bitset_grid_row(job->dest, y);
+        const bitset_atom_t* u = y > 0
+                               ? bitset_grid_row(src, y - 1) : job->zeros;
+        const bitset_atom_t* d = y + 1 < src->height
+                               ? bitset_grid_row(src, y + 1) : job->zeros;
+        bitset_life_row(out, u, bitset_grid_row(src, y), d, j0, j1,
+                        src->stride, job->birth, job->survive);
+        // Cells are born in the padding next to the last column.
+        if (j1 == src->stride) {
+            out[j1 - 1] &= job->last_mask;
+        }
+    }
+}
+
+/* }}} */
+
+int bitset_life_step(bitset_grid_t* dest, const bitset_grid_t* src,
+                     bitset_life_rule_t rule, unsigned nthreads)
+{
+    assert (dest != src);
+    assert (dest->width == src->width && dest->height == src->height);
+    pthread_once(&bitset_life_once, bitset_life_init_once);
+    if (src->width == 0 || src->height == 0) {
+        return 0;
+    }
+    bitset_atom_t* zeros = calloc(src->stride, sizeof(bitset_atom_t));
+    if (!zeros) {
+        return -1;
+    }
+    size_t r = src->width % BITS_PER_ATOM;
+    size_t tiles_x = (src->stride + BITSET_LIFE_TILE_ATOMS - 1)
+                   / BITSET_LIFE_TILE_ATOMS;
+    size_t tiles_y = (src->height + BITSET_LIFE_TILE_ROWS - 1)
+                   / BITSET_LIFE_TILE_ROWS;
+    bitset_life_job_t job = {
+        .dest = dest,
+        .src = src,
+        .zeros = zeros,
+        .last_mask = r ? ((bitset_atom_t)1 << r) - 1 : BITSET_ATOM_MAX,
+        .birth = rule.birth,
+        .survive = rule.survive,
+        .tiles_x = tiles_x,
+        .ntiles = tiles_x * tiles_y,
+    };
+    bitset_parallel_for(job.ntiles, nthreads, bitset_life_run_tile, &job);
+    free(zeros);
+    return 0;
+}
+
+int bitset_life_run(bitset_grid_t* g, bitset_life_rule_t rule,
+                    size_t generations, unsigned nthreads)
+{
+    if (generations == 0) {
+        return 0;
+    }
+    bitset_grid_t tmp;
+    if (bitset_grid_init(&tmp, g->width, g->height)) {
+        return -1;
+    }
+    for (size_t i = 0; i < generations; i++) {
+        if (bitset_life_step(&tmp, g, rule, nthreads)) {
+            bitset_grid_wipe(&tmp);
+            return -1;
+        }
+        bitset_grid_t t = *g;
+        *g = tmp;
+        tmp = t;
+    }
+    bitset_grid_wipe(&tmp);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "bitset/mih.h"
+
+#define BITSET_MIH_EMPTY    UINT32_MAX
+
+/* {{{ Helpers */
+
+/* Return bits [first, first + nbits) of `code`. */
+static inline uint32_t bitset_mih_substring(const bitset_atom_t* code,
+                                            unsigned first, unsigned nbits)
+{
+    const bitset_atom_t* atom = code + first / BITS_PER_ATOM;
+    unsigned shift = first % BITS_PER_ATOM;
+    bitset_atom_t v = atom[0] >> shift;
+    if (shift + nbits > BITS_PER_ATOM) {
+        v |= atom[1] << (BITS_PER_ATOM - shift);
+    }
+    return v & (((bitset_atom_t)1 << nbits) - 1);
+}
+
+static inline size_t bitset_mih_hash(uint32_t key, unsigned log_capacity) {
+    return (key * 0x9e3779b97f4a7c15ULL) >> (64 - log_capacity);
+}
+
+/* Return the group of codes whose substring is `key`, or BITSET_MIH_EMPTY.
+ */
+static inline uint32_t bitset_mih_find(const bitset_mih_table_t* t,
+                                       uint32_t key)
+{
+    size_t mask = ((size_t)1 << t->log_capacity) - 1;
+    for (size_t s = bitset_mih_hash(key, t->log_capacity); ;
+         s = (s + 1) & mask) {
+        if (t->groups[s] == BITSET_MIH_EMPTY || t->keys[s] == key) {
+            return t->groups[s];
+        }
+    }
+}
+
+/* Sort (substring << 32 | index) pairs, with two passes of 16 bits. */
+static void bitset_mih_sort(uint64_t* pairs, uint64_t* tmp, size_t n,
+                            size_t* counts)
+{
+    for (unsigned shift = 32; shift < 64; shift += 16) {
+        memset(counts, 0, (1 << 16) * sizeof(size_t));
+        for (size_t i = 0; i < n; i++) {
+            counts[(pairs[i] >> shift) & 0xffff]++;
+        }
+        size_t sum = 0;
+        for (size_t d = 0; d < (1 << 16); d++) {
+            size_t c = counts[d];
+            counts[d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            tmp[counts[(pairs[i] >> shift) & 0xffff]++] = pairs[i];
+        }
+        memcpy(pairs, tmp, n * sizeof(uint64_t));
+    }
+}
+
+/* Index the substrings of table `t` of all codes of `db`. */
+static int bitset_mih_build(bitset_mih_table_t* t, const bitset_codes_t* db,
+                            uint64_t* pairs, uint64_t* tmp, size_t* counts)
+{
+    size_t n = db->ncodes;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t key = bitset_mih_substring(bitset_codes_row(db, i),
+                                            t->first, t->nbits);
+        pairs[i] = key << 32 | i;
+    }
+    bitset_mih_sort(pairs, tmp, n, counts);
+
+    size_t ngroups = 0;
+    for (size_t i = 0; i < n; i++) {
+        ngroups += i == 0 || pairs[i] >> 32 != pairs[i - 1] >> 32;
+    }
+    // Keep the load factor of the table below 1/2.
+    t->log_capacity = 1;
+    while (((size_t)1 << t->log_capacity) < 2 * ngroups) {
+        t->log_capacity++;
+    }
+    size_t capacity = (size_t)1 << t->log_capacity;
+    t->keys = malloc(capacity * sizeof(uint32_t));
+    t->groups = malloc(capacity * sizeof(uint32_t));
+    t->starts = malloc((ngroups + 1) * sizeof(uint32_t));
+    t->ids = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (!t->keys || !t->groups || !t->starts || !t->ids) {
+        return -1;
+    }
+    memset(t->groups, 0xff, capacity * sizeof(uint32_t));
+
+    size_t g = 0;
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t key = pairs[i] >> 32;
+        if (i == 0 || key != pairs[i - 1] >> 32) {
+            size_t s = bitset_mih_hash(key, t->log_capacity);
+            while (t->groups[s] != BITSET_MIH_EMPTY) {
+                s = (s + 1) & mask;
+            }
+            t->keys[s] = key;
+            t->groups[s] = g;
+            t->starts[g++] = i;
+        }
+        t->ids[i] = (uint32_t)pairs[i];
+    }
+    t->starts[g] = n;
+    return 0;
+}
+
+/* Search radius of the j-th substring, so that a code within `radius` of
+ * the query matches at least one substring: with radius = a * m + b, the
+ * first b + 1 substrings are searched within a, and the others within
+ * a - 1. Return -1 if the j-th table doesn't need to be searched.
+ */
+static inline int bitset_mih_radius(unsigned m, unsigned radius, unsigned j) {
+    unsigned a = radius / m;
+    unsigned b = radius % m;
+    return j <= b ? (int)a : (int)a - 1;
+}
+
+/* }}} */
+
+int bitset_mih_init(bitset_mih_t* mih, const bitset_codes_t* db, unsigned m) {
+    assert (db->ncodes < ((uint64_t)1 << 32));
+    assert (m <= db->nbits);
+
+    if (m == 0) {
+        unsigned log_n = 1;
+        while (((size_t)1 << (log_n + 1)) <= db->ncodes) {
+            log_n++;
+        }
+        m = (db->nbits + log_n / 2) / log_n;
+        if (m < 1) {
+            m = 1;
+        }
+    }
+    unsigned min_m = (db->nbits + BITSET_MIH_MAX_SUBSTRING - 1)
+                   / BITSET_MIH_MAX_SUBSTRING;
+    if (m < min_m) {
+        m = min_m;
+    }
+
+    mih->db = db;
+    mih->m = m;
+    mih->tables = calloc(m, sizeof(bitset_mih_table_t));
+    uint64_t* pairs = malloc((db->ncodes + 1) * sizeof(uint64_t));
+    uint64_t* tmp = malloc((db->ncodes + 1) * sizeof(uint64_t));
+    size_t* counts = malloc((1 << 16) * sizeof(size_t));
+    if (!mih->tables || !pairs || !tmp || !counts) {
+        goto error;
+    }
+
+    // The first nbits % m substrings are one bit longer.
+    unsigned first = 0;
+    for (unsigned j = 0; j < m; j++) {
+        bitset_mih_table_t* t = &mih->tables[j];
+        t->first = first;
+        t->nbits = db->nbits / m + (j < db->nbits % m);
+        first += t->nbits;
+        if (bitset_mih_build(t, db, pairs, tmp, counts) < 0) {
+            goto error;
+        }
+    }
+    free(pairs);
+    free(tmp);
+    free(counts);
+    return 0;
+
+  error:
+    free(pairs);
+    free(tmp);
+    free(counts);
+    if (mih->tables) {
+        bitset_mih_wipe(mih);
+    }
+    return -1;
+}
+
+void bitset_mih_wipe(bitset_mih_t* mih) {
+    for (unsigned j = 0; j < mih->m; j++) {
+        free(mih->tables[j].keys);
+        free(mih->tables[j].groups);
+        free(mih->tables[j].starts);
+        free(mih->tables[j].ids);
+    }
+    free(mih->tables);
+}
+
+/* Verify the codes of group `g` of the j-th table, and store those within
+ * `radius` of `query` into `out`.
+ */
+static void bitset_mih_verify(const bitset_mih_t* mih,
+                              const bitset_atom_t* query,
+                              const uint32_t* subs, unsigned radius,
+                              unsigned j, uint32_t g,
+                              bitset_hamming_match_t* out, size_t max,
+                              size_t* found)
+{
+    const bitset_mih_table_t* t = &mih->tables[j];
+    for (uint32_t k = t->starts[g]; k < t->starts[g + 1]; k++) {
+        size_t id = t->ids[k];
+        const bitset_atom_t* code = bitset_codes_row(mih->db, id);
+
+        // Skip codes already found through a previous table.
+        unsigned i = 0;
+        for (; i < j; i++) {
+            const bitset_mih_table_t* ti = &mih->tables[i];
+            uint32_t s = bitset_mih_substring(code, ti->first, ti->nbits);
+            if ((int)__builtin_popcount(s ^ subs[i])
+                <= bitset_mih_radius(mih->m, radius, i)) {
+                break;
+            }
+        }
+        if (i < j) {
+            continue;
+        }
+
+        uint32_t dist = bitset_hamming_distance(code, query, mih->db->nbits);
+        if (dist <= radius) {
+            if (*found < max) {
+                out[*found].index = id;
+                out[*found].distance = dist;
+            }
+            (*found)++;
+        }
+    }
+}
+
+size_t bitset_mih_search(const bitset_mih_t* mih, const bitset_atom_t* query,
+                         unsigned radius, bitset_hamming_match_t* out,
+                         size_t max)
+{
+    const unsigned m = mih->m;
+    uint32_t subs[m];
+    for (unsigned j = 0; j < m; j++) {
+        subs[j] = bitset_mih_substring(query, mih->tables[j].first,
+                                       mih->tables[j].nbits);
+    }
+
+    size_t found = 0;
+    for (unsigned j = 0; j < m; j++) {
+        const bitset_mih_table_t* t = &mih->tables[j];
+        int r = bitset_mih_radius(m, radius, j);
+        if (r > (int)t->nbits) {
+            r = t->nbits;
+        }
+
+        // Enumerate substrings within distance r of the query's one, as
+        // masks of d bits among nbits in increasing order (Gosper's hack).
+        for (int d = 0; d <= r; d++) {
+            uint64_t mask = ((uint64_t)1 << d) - 1;
+            uint64_t end = (uint64_t)1 << t->nbits;
+            while (mask < end) {
+                uint32_t g = bitset_mih_find(t, subs[j] ^ (uint32_t)mask);
+                if (g != BITSET_MIH_EMPTY) {
+                    bitset_mih_verify(mih, query, subs, radius, j, g,
+                                      out, max, &found);
+                }
+                if (d == 0) {
+                    break;
+                }
+                uint64_t low = mask & -mask;
+                uint64_t next = mask + low;
+                mask = (((next ^ mask) >> 2) / low) | next;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_PACKED_X86
+#endif
+#include "bitset/packed.h"
+
+/* Number of values in a group, which fills exactly `width` atoms */
+#define BITSET_PACKED_GROUP     BITS_PER_ATOM
+
+/* Largest width unpacked with 32-bit gathers: a value starting at any bit
+ * of a byte still fits in the 32 bits loaded from this byte.
+ */
+#define BITSET_PACKED_GATHER_MAX_WIDTH  25
+
+static pthread_once_t bitset_packed_once = PTHREAD_ONCE_INIT;
+static int            bitset_packed_has_avx2;
+
+static void bitset_packed_init_once(void) {
+#ifdef BITSET_PACKED_X86
+    bitset_packed_has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+int bitset_packed_init(bitset_packed_t* p, size_t n, unsigned width) {
+    assert (width > 0 && width <= BITSET_PACKED_MAX_WIDTH);
+    pthread_once(&bitset_packed_once, bitset_packed_init_once);
+    p->n = n;
+    p->width = width;
+    // A padding atom lets any value be read from two atoms, and any gather
+    // read 32 bits past the last value.
+    p->natoms = BITS_TO_NATOMS(n * width) + 1;
+    p->atoms = calloc(p->natoms, sizeof(bitset_atom_t));
+    if (!p->atoms) {
+        return -1;
+    }
+    return 0;
+}
+
+void bitset_packed_wipe(bitset_packed_t* p) {
+    free(p->atoms);
+}
+
+extern uint32_t bitset_packed_get(const bitset_packed_t* p, size_t i);
+
+extern void bitset_packed_set(bitset_packed_t* p, size_t i, uint32_t v);
+
+/* {{{ Groups */
+
+/* Unpack the 64 values of `width` bits held by the `width` atoms of `in`.
+ * Inlined with a constant `width`, the loop is unrolled into constant
+ * shifts and masks.
+ */
+static inline __attribute__((always_inline))
+void bitset_packed_unpack_group(const bitset_atom_t* in, uint32_t* out,
+                                unsigned width)
+{
+    const bitset_atom_t mask = ((bitset_atom_t)1 << width) - 1;
+#pragma GCC unroll 64
+    for (unsigned j = 0; j < BITSET_PACKED_GROUP; j++) {
+        unsigned bit = j * width;
+        unsigned shift = bit % BITS_PER_ATOM;
+        bitset_atom_t v = in[bit / BITS_PER_ATOM] >> shift;
+        if (shift + width > BITS_PER_ATOM) {
+            v |= in[bit / BITS_PER_ATOM + 1] << (BITS_PER_ATOM - shift);
+        }
+        out[j] = v & mask;
+    }
+}
+
+/* Pack 64 values of `width` bits into the `width` atoms of `out`. */
+static inline __attribute__((always_inline))
+void bitset_packed_pack_group(const uint32_t* in, bitset_atom_t* out,
+                              unsigned width)
+{
+    bitset_atom_t atom = 0;
+#pragma GCC unroll 64
+    for (unsigned j = 0; j < BITSET_PACKED_GROUP; j++) {
+        unsigned bit = j * width;
+        unsigned shift = bit % BITS_PER_ATOM;
+        atom |= (bitset_atom_t)in[j] << shift;
+        if (shift + width >= BITS_PER_ATOM) {
+            out[bit / BITS_PER_ATOM] = atom;
+            atom = shift ? (bitset_atom_t)in[j] >> (BITS_PER_ATOM - shift) : 0;
+        }
+    }
+}
+
+typedef void (*bitset_packed_unpack_fn)(const bitset_atom_t*, size_t,
+                                        uint32_t*);
+typedef void (*bitset_packed_pack_fn)(const uint32_t*, size_t,
+                                      bitset_atom_t*);
+
+#define BITSET_PACKED_WIDTH(_w)                                             \
+    static void bitset_packed_unpack_##_w(const bitset_atom_t* in,          \
+                                          size_t ngroups, uint32_t* out)    \
+    {                                                                       \
+        for (size_t g = 0; g < ngroups; g++) {                              \
+            bitset_packed_unpack_group(in + g * (_w),                       \
+                                       out + g * BITSET_PACKED_GROUP, _w);  \
+        }                                                                   \
+    }                                                                       \
+    static void bitset_packed_pack_##_w(const uint32_t* in, size_t ngroups, \
+                                        bitset_atom_t* out)                 \
+    {                                                                       \
+        for (size_t g = 0; g < ngroups; g++) {                              \
+            bitset_packed_pack_group(in + g * BITSET_PACKED_GROUP,          \
+                                     out + g * (_w), _w);                   \
+        }                                                                   \
+    }
+
+#define BITSET_PACKED_WIDTHS(_)                                             \
+    _(1)  _(2)  _(3)  _(4)  _(5)  _(6)  _(7)  _(8)                          \
+    _(9)  _(10) _(11) _(12) _(13) _(14) _(15) _(16)                         \
+    _(17) _(18) _(19) _(20) _(21) _(22) _(23) _(24)                         \
+    _(25) _(26) _(27) _(28) _(29) _(30) _(31) _(32)
+
+BITSET_PACKED_WIDTHS(BITSET_PACKED_WIDTH)
+
+#define BITSET_PACKED_UNPACK_ENTRY(_w)  bitset_packed_unpack_##_w,
+#define BITSET_PACKED_PACK_ENTRY(_w)    bitset_packed_pack_##_w,
+
+/* Specialized functions, indexed by width - 1 */
+static const bitset_packed_unpack_fn bitset_packed_unpackers[] = {
+    BITSET_PACKED_WIDTHS(BITSET_PACKED_UNPACK_ENTRY)
+};
+static const bitset_packed_pack_fn bitset_packed_packers[] = {
+    BITSET_PACKED_WIDTHS(BITSET_PACKED_PACK_ENTRY)
+};
+
+/* }}} */
+/* {{{ AVX2 */
+
+#ifdef BITSET_PACKED_X86
+
+/* Unpack `n` values from index `first`, 8 at a time, each one with a 32-bit
+ * load at the byte holding its first bit. Return the number of values
+ * unpacked.
+ */
+__attribute__((target("avx2")))
+static size_t bitset_packed_unpack_avx2(const bitset_packed_t* p,
+                                        size_t first, size_t n, uint32_t* out)
+{
+    const unsigned char* bytes = (const unsigned char*)p->atoms;
+    const unsigned width = p->width;
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i offsets = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(width));
+    const __m256i mask = _mm256_set1_epi32(((uint32_t)1 << width) - 1);
+    const __m256i seven = _mm256_set1_epi32(7);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        size_t bit = (first + i) * width;
+        __m256i bits = _mm256_add_epi32(offsets, _mm256_set1_epi32(bit % 8));
+        __m256i v = _mm256_i32gather_epi32((const int*)(bytes + bit / 8),
+                                           _mm256_srli_epi32(bits, 3), 1);
+        v = _mm256_srlv_epi32(v, _mm256_and_si256(bits, seven));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_and_si256(v, mask));
+    }
+    return i;
+}
+
+#endif
+
+/* }}} */
+
+void bitset_packed_unpack(const bitset_packed_t* p, size_t first, size_t n,
+                          uint32_t* out)
+{
+    assert (first + n <= p->n);
+    size_t i = 0;
+
+#ifdef BITSET_PACKED_X86
+    if (bitset_packed_has_avx2
+    &&  p->width <= BITSET_PACKED_GATHER_MAX_WIDTH) {
+        i = bitset_packed_unpack_avx2(p, first, n, out);
+    }
+#endif
+
+    // Reach a group boundary, then unpack whole groups at once.
+    for (; i < n && (first + i) % BITSET_PACKED_GROUP; i++) {
+        out[i] = bitset_packed_get(p, first + i);
+    }
+    size_t ngroups = (n - i) / BITSET_PACKED_GROUP;
+    if (ngroups) {
+        bitset_packed_unpackers[p->width - 1](
+            p->atoms + (first + i) / BITSET_PACKED_GROUP * p->width,
+            ngroups, out + i);
+        i += ngroups * BITSET_PACKED_GROUP;
+    }
+    for (; i < n; i++) {
+        out[i] = bitset_packed_get(p, first + i);
+    }
+}
+
+void bitset_packed_pack(bitset_packed_t* p, size_t first, size_t n,
+                        const uint32_t* in)
+{
+    assert (first + n <= p->n);
+    size_t i = 0;
+    for (; i < n && (first + i) % BITSET_PACKED_GROUP; i++) {
+        bitset_packed_set(p, first + i, in[i]);
+    }
+    size_t ngroups = (n - i) / BITSET_PACKED_GROUP;
+    if (ngroups) {
+        bitset_packed_packers[p->width - 1](
+            in + i, ngroups,
+            p->atoms + (first + i) / BITSET_PACKED_GROUP * p->width);
+        i += ngroups * BITSET_PACKED_GROUP;
+    }
+    for (; i < n; i++) {
+        bitset_packed_set(p, first + i, in[i]);
+    }
+}
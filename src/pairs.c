@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_PAIRS_X86
+#endif
+#include "bitset/pairs.h"
+#include "parallel.h"
+
+static pthread_once_t bitset_pairs_once = PTHREAD_ONCE_INIT;
+static int            bitset_pairs_has_vpopcnt;
+static int            bitset_pairs_has_popcnt;
+
+static void bitset_pairs_init_once(void) {
+#ifdef BITSET_PAIRS_X86
+    bitset_pairs_has_vpopcnt = __builtin_cpu_supports("avx512f") != 0
+                            && __builtin_cpu_supports("avx512vpopcntdq") != 0;
+    bitset_pairs_has_popcnt = __builtin_cpu_supports("popcnt") != 0;
+#endif
+}
+
+/* {{{ Kernels */
+
+/* Return the popcount of the and of `n` atoms of `a` and `b`. */
+static inline __attribute__((always_inline))
+uint64_t bitset_pairs_and_popcnt_scalar(const bitset_atom_t* a,
+                                        const bitset_atom_t* b, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += __builtin_popcountl(a[i] & b[i]);
+    }
+    return sum;
+}
+
+static uint64_t bitset_pairs_and_popcnt_generic(const bitset_atom_t* a,
+                                                const bitset_atom_t* b,
+                                                size_t n)
+{
+    return bitset_pairs_and_popcnt_scalar(a, b, n);
+}
+
+#ifdef BITSET_PAIRS_X86
+
+__attribute__((target("popcnt")))
+static uint64_t bitset_pairs_and_popcnt_popcnt(const bitset_atom_t* a,
+                                               const bitset_atom_t* b,
+                                               size_t n)
+{
+    return bitset_pairs_and_popcnt_scalar(a, b, n);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t bitset_pairs_and_popcnt_vpopcnt(const bitset_atom_t* a,
+                                                const bitset_atom_t* b,
+                                                size_t n)
+{
+    __m512i sum = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i x = _mm512_and_si512(_mm512_loadu_si512(a + i),
+                                     _mm512_loadu_si512(b + i));
+        sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+    }
+    __mmask8 tail = (1 << (n - i)) - 1;
+    __m512i x = _mm512_and_si512(_mm512_maskz_loadu_epi64(tail, a + i),
+                                 _mm512_maskz_loadu_epi64(tail, b + i));
+    sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+    return _mm512_reduce_add_epi64(sum);
+}
+
+#endif
+
+static uint64_t bitset_pairs_and_popcnt(const bitset_atom_t* a,
+                                        const bitset_atom_t* b, size_t n)
+{
+#ifdef BITSET_PAIRS_X86
+    if (bitset_pairs_has_vpopcnt) {
+        return bitset_pairs_and_popcnt_vpopcnt(a, b, n);
+    }
+    if (bitset_pairs_has_popcnt) {
+        return bitset_pairs_and_popcnt_popcnt(a, b, n);
+    }
+#endif
+    return bitset_pairs_and_popcnt_generic(a, b, n);
+}
+
+/* }}} */
+/* {{{ Tiles */
+
+typedef struct bitset_pairs_job {
+    const bitset_t *const *sets;
+    size_t                 n;
+    size_t                 ntiles;
+    size_t                 npairs;  /* Number of pairs of tiles */
+    uint64_t              *counts;
+} bitset_pairs_job_t;
+
+/* Compute counts between sets of tiles `ti` and `tj`, with ti <= tj. */
+static void bitset_pairs_tile(bitset_pairs_job_t* job, size_t ti, size_t tj) {
+    const bitset_t* const* sets = job->sets;
+    size_t n = job->n;
+    size_t natoms = sets[0]->natoms;
+    size_t i0 = ti * BITSET_PAIRS_TILE;
+    size_t j0 = tj * BITSET_PAIRS_TILE;
+    size_t ni = n - i0 < BITSET_PAIRS_TILE ? n - i0 : BITSET_PAIRS_TILE;
+    size_t nj = n - j0 < BITSET_PAIRS_TILE ? n - j0 : BITSET_PAIRS_TILE;
+    uint64_t acc[BITSET_PAIRS_TILE][BITSET_PAIRS_TILE];
+    memset(acc, 0, sizeof(acc));
+
+    for (size_t b = 0; b < natoms; b += BITSET_PAIRS_BLOCK) {
+        size_t len = natoms - b < BITSET_PAIRS_BLOCK
+                   ? natoms - b : BITSET_PAIRS_BLOCK;
+        for (size_t i = 0; i < ni; i++) {
+            const bitset_atom_t* a = sets[i0 + i]->bits + b;
+            // On the diagonal, only compute the upper triangle.
+            for (size_t j = ti == tj ? i : 0; j < nj; j++) {
+                acc[i][j] += bitset_pairs_and_popcnt(a, sets[j0 + j]->bits + b,
+                                                     len);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < ni; i++) {
+        for (size_t j = ti == tj ? i : 0; j < nj; j++) {
+            job->counts[(i0 + i) * n + j0 + j] = acc[i][j];
+            job->counts[(j0 + j) * n + i0 + i] = acc[i][j];
+        }
+    }
+}
+
+static void bitset_pairs_run(void* arg, size_t p, unsigned t) {
+    (void)t;
+    bitset_pairs_job_t* job = arg;
+    // Pairs are numbered row by row in the upper triangle of tiles.
+    size_t ti = 0;
+    while (p >= job->ntiles - ti) {
+        p -= job->ntiles - ti;
+        ti++;
+    }
+    bitset_pairs_tile(job, ti, ti + p);
+}
+
+/* }}} */
+
+void bitset_pairs_count(const bitset_t* const* sets, size_t n,
+                        unsigned nthreads, uint64_t* counts)
+{
+    pthread_once(&bitset_pairs_once, bitset_pairs_init_once);
+    if (n == 0) {
+        return;
+    }
+    for (size_t i = 1; i < n; i++) {
+        assert (sets[i]->natoms == sets[0]->natoms);
+    }
+
+    bitset_pairs_job_t job = {
+        .sets = sets,
+        .n = n,
+        .ntiles = (n + BITSET_PAIRS_TILE - 1) / BITSET_PAIRS_TILE,
+        .counts = counts,
+    };
+    job.npairs = job.ntiles * (job.ntiles + 1) / 2;
+    bitset_parallel_for(job.npairs, nthreads, bitset_pairs_run, &job);
+}
+
+void bitset_pairs_scores(const uint64_t* counts, size_t n,
+                         bitset_pairs_score_t score, double* scores)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            double inter = counts[i * n + j];
+            double a = counts[i * n + i];
+            double b = counts[j * n + j];
+            double denom = score == BITSET_PAIRS_JACCARD ? a + b - inter
+                                                         : sqrt(a * b);
+            scores[i * n + j] = denom > 0 ? inter / denom : 0;
+        }
+    }
+}
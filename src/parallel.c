@@ -0,0 +1,63 @@
+#include <pthread.h>
+#include "parallel.h"
+
+typedef struct bitset_parallel_job {
+    bitset_parallel_fn_t  fn;
+    void                 *arg;
+    size_t                n;
+    size_t                next;     /* Next iteration to run */
+} bitset_parallel_job_t;
+
+typedef struct bitset_parallel_worker {
+    bitset_parallel_job_t *job;
+    unsigned               t;
+} bitset_parallel_worker_t;
+
+static void* bitset_parallel_run(void* arg) {
+    bitset_parallel_worker_t* worker = arg;
+    bitset_parallel_job_t* job = worker->job;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->n) {
+            break;
+        }
+        job->fn(job->arg, i, worker->t);
+    }
+    return NULL;
+}
+
+void bitset_parallel_for(size_t n, unsigned nthreads, bitset_parallel_fn_t fn,
+                         void* arg)
+{
+    bitset_parallel_job_t job = {
+        .fn = fn,
+        .arg = arg,
+        .n = n,
+    };
+    if (nthreads > n) {
+        nthreads = n;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    // The calling thread works too, and threads that fail to start are
+    // simply not waited for: the others run their iterations.
+    pthread_t threads[nthreads];
+    int started[nthreads];
+    bitset_parallel_worker_t workers[nthreads];
+    for (unsigned t = 0; t < nthreads; t++) {
+        workers[t].job = &job;
+        workers[t].t = t;
+    }
+    for (unsigned t = 1; t < nthreads; t++) {
+        started[t] = pthread_create(&threads[t], NULL, bitset_parallel_run,
+                                    &workers[t]) == 0;
+    }
+    bitset_parallel_run(&workers[0]);
+    for (unsigned t = 1; t < nthreads; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+}
@@ -0,0 +1,20 @@
+/* Internal helper running loops over several threads. */
+
+#ifndef _bitset_parallel_h_
+#define _bitset_parallel_h_
+
+#include <stddef.h>
+
+/* Body of a parallel loop: run iteration `i` on the thread numbered `t`,
+ * for per-thread scratch.
+ */
+typedef void (*bitset_parallel_fn_t)(void* arg, size_t i, unsigned t);
+
+/* Run `fn` for each i in [0, n) on up to `nthreads` threads, the calling
+ * one numbered 0. Iterations are handed out one at a time, in increasing
+ * order, so each thread sees its iterations in increasing order.
+ */
+void bitset_parallel_for(size_t n, unsigned nthreads, bitset_parallel_fn_t fn,
+                         void* arg);
+
+#endif
@@ -0,0 +1,647 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "bitset/regex.h"
+
+/* {{{ Parsing */
+
+typedef enum bitset_regex_kind {
+    BITSET_REGEX_EMPTY,
+    BITSET_REGEX_CLASS,     /* `a` is the state of the class */
+    BITSET_REGEX_CAT,       /* `a` then `b` */
+    BITSET_REGEX_ALT,       /* `a` or `b` */
+    BITSET_REGEX_STAR,      /* `a`* */
+    BITSET_REGEX_PLUS,      /* `a`+ */
+    BITSET_REGEX_OPT,       /* `a`? */
+} bitset_regex_kind_t;
+
+typedef struct bitset_regex_node {
+    bitset_regex_kind_t kind;
+    size_t              a, b;
+} bitset_regex_node_t;
+
+/* Character classes are sets of 256 bytes */
+typedef struct bitset_regex_class {
+    uint64_t bytes[4];
+} bitset_regex_class_t;
+
+/* Nodes are appended after their children, so that they can be walked
+ * bottom-up in order.
+ */
+typedef struct bitset_regex_parser {
+    const char           *p;
+    const char           *end;
+    bitset_regex_node_t  *nodes;
+    size_t                nnodes, cnodes;
+    bitset_regex_class_t *classes;  /* Class of state i + 1 */
+    size_t                nclasses, cclasses;
+    int                   error;
+} bitset_regex_parser_t;
+
+static size_t bitset_regex_node(bitset_regex_parser_t* ps,
+                                bitset_regex_kind_t kind, size_t a, size_t b)
+{
+    if (ps->nnodes == ps->cnodes) {
+        size_t cnodes = ps->cnodes ? 2 * ps->cnodes : 16;
+        void* nodes = realloc(ps->nodes, cnodes * sizeof(*ps->nodes));
+        if (nodes == NULL) {
+            ps->error = 1;
+            return 0;
+        }
+        ps->nodes = nodes;
+        ps->cnodes = cnodes;
+    }
+    ps->nodes[ps->nnodes] = (bitset_regex_node_t){ kind, a, b };
+    return ps->nnodes++;
+}
+
+static void bitset_regex_class_add(bitset_regex_class_t* cls, unsigned char c) {
+    cls->bytes[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static void bitset_regex_class_range(bitset_regex_class_t* cls,
+                                     unsigned lo, unsigned hi)
+{
+    for (unsigned c = lo; c <= hi; c++) {
+        bitset_regex_class_add(cls, c);
+    }
+}
+
+/* Add the class of escape `\c` to `cls`.
+ * @return not 0 if `c` is an unknown escape.
+ */
+static int bitset_regex_class_escape(bitset_regex_class_t* cls, char c) {
+    switch (c) {
+    case 'd':
+        bitset_regex_class_range(cls, '0', '9');
+        return 0;
+    case 'w':
+        bitset_regex_class_range(cls, '0', '9');
+        bitset_regex_class_range(cls, 'a', 'z');
+        bitset_regex_class_range(cls, 'A', 'Z');
+        bitset_regex_class_add(cls, '_');
+        return 0;
+    case 's':
+        bitset_regex_class_add(cls, ' ');
+        bitset_regex_class_range(cls, '\t', '\r');
+        return 0;
+    case 'n':
+        bitset_regex_class_add(cls, '\n');
+        return 0;
+    case 't':
+        bitset_regex_class_add(cls, '\t');
+        return 0;
+    default:
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+                || (c >= 'A' && c <= 'Z')) {
+            return 1;
+        }
+        bitset_regex_class_add(cls, c);
+        return 0;
+    }
+}
+
+/* Parse a bracketed class, after the opening bracket. */
+static int bitset_regex_parse_bracket(bitset_regex_parser_t* ps,
+                                      bitset_regex_class_t* cls)
+{
+    int negate = 0;
+    if (ps->p < ps->end && *ps->p == '^') {
+        negate = 1;
+        ps->p++;
+    }
+    // A closing bracket first is a literal.
+    int first = 1;
+    while (ps->p < ps->end && (*ps->p != ']' || first)) {
+        first = 0;
+        unsigned char lo = *ps->p++;
+        if (lo == '\\') {
+            if (ps->p == ps->end) {
+                return 1;
+            }
+            char c = *ps->p++;
+            if (c == 'd' || c == 'w' || c == 's' || c == 'n' || c == 't') {
+                bitset_regex_class_escape(cls, c);
+                continue;
+            }
+            lo = c;
+        }
+        if (ps->end - ps->p >= 2 && ps->p[0] == '-' && ps->p[1] != ']') {
+            unsigned char hi = ps->p[1];
+            ps->p += 2;
+            if (hi == '\\') {
+                if (ps->p == ps->end) {
+                    return 1;
+                }
+                hi = *ps->p++;
+            }
+            if (hi < lo) {
+                return 1;
+            }
+            bitset_regex_class_range(cls, lo, hi);
+        } else {
+            bitset_regex_class_add(cls, lo);
+        }
+    }
+    if (ps->p == ps->end) {
+        return 1;
+    }
+    ps->p++;
+    if (negate) {
+        for (size_t i = 0; i < 4; i++) {
+            cls->bytes[i] = ~cls->bytes[i];
+        }
+    }
+    return 0;
+}
+
+static size_t bitset_regex_parse_alt(bitset_regex_parser_t* ps);
+
+/* Parse a class or a group. */
+static size_t bitset_regex_parse_atom(bitset_regex_parser_t* ps) {
+    char c = *ps->p++;
+    if (c == '(') {
+        size_t node = bitset_regex_parse_alt(ps);
+        if (ps->p == ps->end || *ps->p != ')') {
+            ps->error = 1;
+            return 0;
+        }
+        ps->p++;
+        return node;
+    }
+
+    bitset_regex_class_t cls = { { 0 } };
+    if (c == '.') {
+        bitset_regex_class_range(&cls, 0, 255);
+        cls.bytes['\n' / 64] &= ~((uint64_t)1 << ('\n' % 64));
+    } else if (c == '[') {
+        ps->error |= bitset_regex_parse_bracket(ps, &cls);
+    } else if (c == '\\') {
+        if (ps->p == ps->end) {
+            ps->error = 1;
+            return 0;
+        }
+        ps->error |= bitset_regex_class_escape(&cls, *ps->p++);
+    } else if (c == '*' || c == '+' || c == '?') {
+        ps->error = 1;
+    } else {
+        bitset_regex_class_add(&cls, c);
+    }
+    if (ps->error) {
+        return 0;
+    }
+
+    if (ps->nclasses == ps->cclasses) {
+        size_t cclasses = ps->cclasses ? 2 * ps->cclasses : 16;
+        void* classes = realloc(ps->classes, cclasses * sizeof(*ps->classes));
+        if (classes == NULL) {
+            ps->error = 1;
+            return 0;
+        }
+        ps->classes = classes;
+        ps->cclasses = cclasses;
+    }
+    ps->classes[ps->nclasses++] = cls;
+    return bitset_regex_node(ps, BITSET_REGEX_CLASS, ps->nclasses, 0);
+}
+
+/* Parse a concatenation of repeated atoms. */
+static size_t bitset_regex_parse_cat(bitset_regex_parser_t* ps) {
+    size_t node = bitset_regex_node(ps, BITSET_REGEX_EMPTY, 0, 0);
+    int empty = 1;
+    while (!ps->error && ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+        size_t atom = bitset_regex_parse_atom(ps);
+        while (!ps->error && ps->p < ps->end
+                && (*ps->p == '*' || *ps->p == '+' || *ps->p == '?')) {
+            bitset_regex_kind_t kind = *ps->p == '*' ? BITSET_REGEX_STAR
+                                     : *ps->p == '+' ? BITSET_REGEX_PLUS
+                                                     : BITSET_REGEX_OPT;
+            atom = bitset_regex_node(ps, kind, atom, 0);
+            ps->p++;
+        }
+        node = empty ? atom
+                     : bitset_regex_node(ps, BITSET_REGEX_CAT, node, atom);
+        empty = 0;
+    }
+    return node;
+}
+
+static size_t bitset_regex_parse_alt(bitset_regex_parser_t* ps) {
+    size_t node = bitset_regex_parse_cat(ps);
+    while (!ps->error && ps->p < ps->end && *ps->p == '|') {
+        ps->p++;
+        size_t right = bitset_regex_parse_cat(ps);
+        node = bitset_regex_node(ps, BITSET_REGEX_ALT, node, right);
+    }
+    return node;
+}
+
+/* }}} */
+/* {{{ Construction */
+
+static void bitset_regex_or(bitset_atom_t* dest, const bitset_atom_t* src,
+                            size_t natoms)
+{
+    for (size_t i = 0; i < natoms; i++) {
+        dest[i] |= src[i];
+    }
+}
+
+/* Add `set` to the follow sets of the states of `from`. */
+static void bitset_regex_link(bitset_atom_t* follow, const bitset_atom_t* from,
+                              const bitset_atom_t* set, size_t natoms)
+{
+    for (size_t i = 0; i < natoms; i++) {
+        for (bitset_atom_t x = from[i]; x != 0; x &= x - 1) {
+            size_t state = i * BITS_PER_ATOM + __builtin_ctzl(x);
+            bitset_regex_or(follow + state * natoms, set, natoms);
+        }
+    }
+}
+
+/* Compute the Glushkov automaton of the parsed pattern rooted at `root`,
+ * that is first and last states and nullability of every node, and follow
+ * sets of every state. Split follow sets into shifts and other transitions.
+ */
+static int bitset_regex_build(bitset_regex_t* re,
+                              const bitset_regex_parser_t* ps, size_t root)
+{
+    size_t natoms = re->natoms;
+    size_t nnodes = ps->nnodes;
+    bitset_atom_t* first = calloc(2 * nnodes * natoms, sizeof(bitset_atom_t));
+    char* nullable = malloc(nnodes);
+    bitset_atom_t* follow = calloc(re->nstates * natoms, sizeof(bitset_atom_t));
+    if (first == NULL || nullable == NULL || follow == NULL) {
+        free(first);
+        free(nullable);
+        free(follow);
+        return -1;
+    }
+    bitset_atom_t* last = first + nnodes * natoms;
+
+    for (size_t n = 0; n < nnodes; n++) {
+        const bitset_regex_node_t* node = &ps->nodes[n];
+        bitset_atom_t* f = first + n * natoms;
+        bitset_atom_t* l = last + n * natoms;
+        bitset_atom_t* fa = first + node->a * natoms;
+        bitset_atom_t* la = last + node->a * natoms;
+        bitset_atom_t* fb = first + node->b * natoms;
+        bitset_atom_t* lb = last + node->b * natoms;
+        switch (node->kind) {
+        case BITSET_REGEX_EMPTY:
+            nullable[n] = 1;
+            break;
+        case BITSET_REGEX_CLASS:
+            nullable[n] = 0;
+            f[node->a / BITS_PER_ATOM] |=
+                (bitset_atom_t)1 << (node->a % BITS_PER_ATOM);
+            l[node->a / BITS_PER_ATOM] |=
+                (bitset_atom_t)1 << (node->a % BITS_PER_ATOM);
+            break;
+        case BITSET_REGEX_CAT:
+            nullable[n] = nullable[node->a] && nullable[node->b];
+            bitset_regex_or(f, fa, natoms);
+            if (nullable[node->a]) {
+                bitset_regex_or(f, fb, natoms);
+            }
+            bitset_regex_or(l, lb, natoms);
+            if (nullable[node->b]) {
+                bitset_regex_or(l, la, natoms);
+            }
+            bitset_regex_link(follow, la, fb, natoms);
+            break;
+        case BITSET_REGEX_ALT:
+            nullable[n] = nullable[node->a] || nullable[node->b];
+            bitset_regex_or(f, fa, natoms);
+            bitset_regex_or(f, fb, natoms);
+            bitset_regex_or(l, la, natoms);
+            bitset_regex_or(l, lb, natoms);
+            break;
+        case BITSET_REGEX_STAR:
+        case BITSET_REGEX_PLUS:
+        case BITSET_REGEX_OPT:
+            nullable[n] = node->kind == BITSET_REGEX_PLUS ? nullable[node->a]
+                                                          : 1;
+            bitset_regex_or(f, fa, natoms);
+            bitset_regex_or(l, la, natoms);
+            if (node->kind != BITSET_REGEX_OPT) {
+                bitset_regex_link(follow, la, fa, natoms);
+            }
+            break;
+        }
+    }
+
+    // The initial state is followed by the first states, and is final if the
+    // pattern matches the empty string. It is only active before the first
+    // byte, or before every byte when the pattern is not anchored, so that
+    // its transitions are kept apart.
+    bitset_regex_or(re->first, first + root * natoms, natoms);
+    bitset_regex_or(re->final, last + root * natoms, natoms);
+    re->final[0] |= nullable[root];
+    for (size_t c = 0; c < 256; c++) {
+        const bitset_atom_t* b = re->classes + c * natoms;
+        for (size_t j = 0; j < natoms; j++) {
+            if ((b[j] & re->first[j]) != 0) {
+                re->starts[c / 64] |= (bitset_atom_t)1 << (c % 64);
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 1; i < re->nstates; i++) {
+        bitset_atom_t* fi = follow + i * natoms;
+        size_t next = i + 1;
+        bitset_atom_t bit = (bitset_atom_t)1 << (next % BITS_PER_ATOM);
+        if (next < re->nstates && (fi[next / BITS_PER_ATOM] & bit) != 0) {
+            re->shift[next / BITS_PER_ATOM] |= bit;
+            fi[next / BITS_PER_ATOM] &= ~bit;
+        }
+        for (size_t j = 0; j < natoms; j++) {
+            if (fi[j] != 0) {
+                re->irregular[i / BITS_PER_ATOM] |=
+                    (bitset_atom_t)1 << (i % BITS_PER_ATOM);
+                break;
+            }
+        }
+    }
+    re->follow = follow;
+
+    free(first);
+    free(nullable);
+    return 0;
+}
+
+/* Build the follow sets of every byte of a single atom set of states. */
+static int bitset_regex_build_table(bitset_regex_t* re) {
+    size_t nbytes = (re->nstates + 7) / 8;
+    re->table = calloc(nbytes * 256, sizeof(bitset_atom_t));
+    if (re->table == NULL) {
+        return -1;
+    }
+    for (size_t j = 0; j < nbytes; j++) {
+        bitset_atom_t* t = re->table + j * 256;
+        for (size_t b = 1; b < 256; b++) {
+            // Reuse the entry of b without its lowest bit.
+            size_t k = __builtin_ctzl(b);
+            size_t state = 8 * j + k;
+            t[b] = t[b & (b - 1)];
+            if (state < re->nstates) {
+                t[b] |= re->follow[state];
+            }
+        }
+    }
+    return 0;
+}
+
+/* }}} */
+
+int bitset_regex_compile(bitset_regex_t* re, const char* pattern) {
+    memset(re, 0, sizeof(*re));
+    size_t len = strlen(pattern);
+    if (len > 0 && pattern[0] == '^') {
+        re->anchor_start = 1;
+        pattern++;
+        len--;
+    }
+    // A trailing dollar is an anchor unless it is escaped.
+    if (len > 0 && pattern[len - 1] == '$') {
+        size_t escapes = 0;
+        while (escapes + 1 < len && pattern[len - 2 - escapes] == '\\') {
+            escapes++;
+        }
+        if (escapes % 2 == 0) {
+            re->anchor_end = 1;
+            len--;
+        }
+    }
+
+    bitset_regex_parser_t ps = { .p = pattern, .end = pattern + len };
+    size_t root = bitset_regex_parse_alt(&ps);
+    if (!ps.error && ps.p != ps.end) {
+        ps.error = 1;
+    }
+    if (ps.error) {
+        free(ps.nodes);
+        free(ps.classes);
+        return -1;
+    }
+
+    re->nstates = ps.nclasses + 1;
+    re->natoms = BITS_TO_NATOMS(re->nstates);
+    size_t natoms = re->natoms;
+    re->classes = calloc((256 + 4) * natoms, sizeof(bitset_atom_t));
+    if (re->classes == NULL) {
+        free(ps.nodes);
+        free(ps.classes);
+        return -1;
+    }
+    re->shift = re->classes + 256 * natoms;
+    re->irregular = re->shift + natoms;
+    re->final = re->irregular + natoms;
+    re->first = re->final + natoms;
+
+    for (size_t i = 0; i < ps.nclasses; i++) {
+        size_t state = i + 1;
+        for (size_t c = 0; c < 256; c++) {
+            if ((ps.classes[i].bytes[c / 64] >> (c % 64)) & 1) {
+                re->classes[c * natoms + state / BITS_PER_ATOM] |=
+                    (bitset_atom_t)1 << (state % BITS_PER_ATOM);
+            }
+        }
+    }
+
+    int err = bitset_regex_build(re, &ps, root);
+    free(ps.nodes);
+    free(ps.classes);
+    if (err == 0 && natoms == 1) {
+        err = bitset_regex_build_table(re);
+    }
+    if (err != 0) {
+        bitset_regex_wipe(re);
+        return -1;
+    }
+    return 0;
+}
+
+void bitset_regex_wipe(bitset_regex_t* re) {
+    free(re->classes);
+    free(re->follow);
+    free(re->table);
+    memset(re, 0, sizeof(*re));
+}
+
+/* {{{ Simulation */
+
+/* Return 1 if byte `c` may start a match. */
+static inline int bitset_regex_starts(const bitset_atom_t* starts,
+                                      unsigned char c)
+{
+    return (starts[c / 64] >> (c % 64)) & 1;
+}
+
+/* Single atom sets of states. The initial state is never in `d`: when no
+ * other state is active, bytes that can not start a match are skipped.
+ */
+static int bitset_regex_match_atom(const bitset_regex_t* re,
+                                   const unsigned char* s, size_t len)
+{
+    const bitset_atom_t* classes = re->classes;
+    const bitset_atom_t* table = re->table;
+    bitset_atom_t shift = re->shift[0];
+    bitset_atom_t irregular = re->irregular[0];
+    bitset_atom_t final = re->final[0];
+    bitset_atom_t first = re->first[0];
+    bitset_atom_t again = re->anchor_start ? 0 : first;
+    bitset_atom_t starts[4];
+    int anchor_end = re->anchor_end;
+
+    memcpy(starts, re->starts, sizeof(starts));
+    if (!anchor_end && (final & 1) != 0) {
+        return 1;
+    }
+    bitset_atom_t d = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (d == 0) {
+            if (re->anchor_start && i > 0) {
+                return 0;
+            }
+            while (again != 0 && i < len
+                    && !bitset_regex_starts(starts, s[i])) {
+                i++;
+            }
+            if (i == len) {
+                break;
+            }
+            d = first & classes[s[i]];
+        } else {
+            bitset_atom_t f = ((d << 1) & shift) | again;
+            bitset_atom_t x = d & irregular;
+            for (size_t j = 0; x != 0; j += 256, x >>= 8) {
+                f |= table[j + (x & 0xff)];
+            }
+            d = f & classes[s[i]];
+        }
+        if (!anchor_end && (d & final) != 0) {
+            return 1;
+        }
+    }
+    return (d & final) != 0
+        || ((final & 1) != 0 && (!re->anchor_start || len == 0));
+}
+
+/* Multiple atoms sets of states, with `d` and `f` scratch sets. */
+static int bitset_regex_match_atoms(const bitset_regex_t* re,
+                                    const unsigned char* s, size_t len,
+                                    bitset_atom_t* d, bitset_atom_t* f)
+{
+    size_t natoms = re->natoms;
+    const bitset_atom_t* final = re->final;
+    const bitset_atom_t* first = re->first;
+    int anchor_end = re->anchor_end;
+
+    if (!anchor_end && (final[0] & 1) != 0) {
+        return 1;
+    }
+    memset(d, 0, natoms * sizeof(bitset_atom_t));
+    bitset_atom_t live = 0, hit = 0;
+    for (size_t i = 0; i < len; i++) {
+        const bitset_atom_t* b;
+        if (live == 0) {
+            if (re->anchor_start && i > 0) {
+                return 0;
+            }
+            while (!re->anchor_start && i < len
+                    && !bitset_regex_starts(re->starts, s[i])) {
+                i++;
+            }
+            if (i == len) {
+                break;
+            }
+            memcpy(f, first, natoms * sizeof(bitset_atom_t));
+        } else {
+            bitset_atom_t carry = 0;
+            for (size_t j = 0; j < natoms; j++) {
+                f[j] = ((d[j] << 1) | carry) & re->shift[j];
+                carry = d[j] >> (BITS_PER_ATOM - 1);
+            }
+            for (size_t j = 0; j < natoms; j++) {
+                bitset_atom_t x = d[j] & re->irregular[j];
+                for (; x != 0; x &= x - 1) {
+                    size_t state = j * BITS_PER_ATOM + __builtin_ctzl(x);
+                    bitset_regex_or(f, re->follow + state * natoms, natoms);
+                }
+            }
+            if (!re->anchor_start) {
+                bitset_regex_or(f, first, natoms);
+            }
+        }
+        b = re->classes + s[i] * natoms;
+        live = 0;
+        hit = 0;
+        for (size_t j = 0; j < natoms; j++) {
+            d[j] = f[j] & b[j];
+            live |= d[j];
+            hit |= d[j] & final[j];
+        }
+        if (!anchor_end && hit != 0) {
+            return 1;
+        }
+    }
+    return hit != 0
+        || ((final[0] & 1) != 0 && (!re->anchor_start || len == 0));
+}
+
+/* }}} */
+
+int bitset_regex_match(const bitset_regex_t* re, const char* text,
+                       size_t len)
+{
+    if (re->natoms == 1) {
+        return bitset_regex_match_atom(re, (const unsigned char*)text, len);
+    }
+    bitset_atom_t* scratch = malloc(2 * re->natoms * sizeof(bitset_atom_t));
+    if (scratch == NULL) {
+        return 0;
+    }
+    int match = bitset_regex_match_atoms(re, (const unsigned char*)text, len,
+                                         scratch, scratch + re->natoms);
+    free(scratch);
+    return match;
+}
+
+size_t bitset_regex_match_lines(const bitset_regex_t* re, const char* text,
+                                size_t len, bitset_t* matches)
+{
+    bitset_atom_t* scratch = NULL;
+    if (re->natoms > 1) {
+        scratch = malloc(2 * re->natoms * sizeof(bitset_atom_t));
+        if (scratch == NULL) {
+            return 0;
+        }
+    }
+
+    size_t count = 0;
+    const char* end = text + len;
+    for (size_t line = 0; text < end || (line == 0 && len == 0); line++) {
+        const char* eol = memchr(text, '\n', end - text);
+        if (eol == NULL) {
+            eol = end;
+        }
+        const unsigned char* s = (const unsigned char*)text;
+        int match = scratch == NULL
+                  ? bitset_regex_match_atom(re, s, eol - text)
+                  : bitset_regex_match_atoms(re, s, eol - text,
+                                             scratch, scratch + re->natoms);
+        if (match) {
+            bitset_set(matches, line);
+            count++;
+        }
+        text = eol + 1;
+        if (eol == end) {
+            break;
+        }
+    }
+    free(scratch);
+    return count;
+}
@@ -0,0 +1,542 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_SCAN_X86
+#endif
+#include "bitset/scan.h"
+
+/* Predicate of a scan */
+typedef struct bitset_scan_pred {
+    uint64_t      lo;       /* Integers: v - lo <= span, unsigned */
+    uint64_t      span;
+    float         flo;      /* Floats: flo <= v <= fhi */
+    float         fhi;
+    const void   *set;      /* Members of a set */
+    size_t        nset;
+    bitset_atom_t flip;     /* Xor-ed into atoms, to negate ranges */
+} bitset_scan_pred_t;
+
+/* Store into out[0] to out[n / BITS_PER_ATOM - 1] the atoms of the first
+ * rows of `col` under `p`, and return the number of rows done.
+ */
+typedef size_t (*bitset_scan_fn)(bitset_atom_t* out, const void* col,
+                                 size_t n, const bitset_scan_pred_t* p);
+
+/* Kernels are indexed by instruction set: generic, AVX2, AVX-512 */
+static pthread_once_t bitset_scan_once = PTHREAD_ONCE_INIT;
+static int            bitset_scan_level;
+
+static void bitset_scan_init_once(void) {
+#ifdef BITSET_SCAN_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        bitset_scan_level = 2;
+    } else if (__builtin_cpu_supports("avx2")) {
+        bitset_scan_level = 1;
+    }
+#endif
+}
+
+/* Define kernel `_name`, assembling the masks of `_lanes` values of type
+ * `_T` returned by `_mask` into atoms.
+ */
+#define BITSET_SCAN_KERNEL(_name, _mask, _T, _lanes, _target)               \
+    _target static size_t _name(bitset_atom_t* out, const void* col,        \
+                                size_t n, const bitset_scan_pred_t* p)      \
+    {                                                                       \
+        const _T* v = col;                                                  \
+        size_t i = 0;                                                       \
+        for (; i + BITS_PER_ATOM <= n; i += BITS_PER_ATOM) {                \
+            bitset_atom_t a = 0;                                            \
+            for (size_t k = 0; k < BITS_PER_ATOM; k += (_lanes)) {          \
+                a |= (bitset_atom_t)_mask(v + i + k, p) << k;               \
+            }                                                               \
+            out[i / BITS_PER_ATOM] = a ^ p->flip;                           \
+        }                                                                   \
+        return i;                                                           \
+    }
+
+/* {{{ Generic */
+
+static inline int bitset_scan_range_u32_one(const uint32_t* v,
+                                            const bitset_scan_pred_t* p)
+{
+    return (uint32_t)(*v - (uint32_t)p->lo) <= (uint32_t)p->span;
+}
+
+static inline int bitset_scan_range_u64_one(const uint64_t* v,
+                                            const bitset_scan_pred_t* p)
+{
+    return *v - p->lo <= p->span;
+}
+
+static inline int bitset_scan_range_f32_one(const float* v,
+                                            const bitset_scan_pred_t* p)
+{
+    return (*v >= p->flo) & (*v <= p->fhi);
+}
+
+static inline int bitset_scan_in_u32_one(const uint32_t* v,
+                                         const bitset_scan_pred_t* p)
+{
+    const uint32_t* set = p->set;
+    int in = 0;
+    for (size_t j = 0; j < p->nset; j++) {
+        in |= *v == set[j];
+    }
+    return in;
+}
+
+static inline int bitset_scan_in_u64_one(const uint64_t* v,
+                                         const bitset_scan_pred_t* p)
+{
+    const uint64_t* set = p->set;
+    int in = 0;
+    for (size_t j = 0; j < p->nset; j++) {
+        in |= *v == set[j];
+    }
+    return in;
+}
+
+static inline int bitset_scan_in_f32_one(const float* v,
+                                         const bitset_scan_pred_t* p)
+{
+    const float* set = p->set;
+    int in = 0;
+    for (size_t j = 0; j < p->nset; j++) {
+        in |= *v == set[j];
+    }
+    return in;
+}
+
+BITSET_SCAN_KERNEL(bitset_scan_range_u32_generic, bitset_scan_range_u32_one,
+                   uint32_t, 1, )
+BITSET_SCAN_KERNEL(bitset_scan_range_u64_generic, bitset_scan_range_u64_one,
+                   uint64_t, 1, )
+BITSET_SCAN_KERNEL(bitset_scan_range_f32_generic, bitset_scan_range_f32_one,
+                   float, 1, )
+BITSET_SCAN_KERNEL(bitset_scan_in_u32_generic, bitset_scan_in_u32_one,
+                   uint32_t, 1, )
+BITSET_SCAN_KERNEL(bitset_scan_in_u64_generic, bitset_scan_in_u64_one,
+                   uint64_t, 1, )
+BITSET_SCAN_KERNEL(bitset_scan_in_f32_generic, bitset_scan_in_f32_one,
+                   float, 1, )
+
+/* }}} */
+
+#ifdef BITSET_SCAN_X86
+
+/* {{{ AVX2 */
+
+#define BITSET_SCAN_AVX2 \
+    __attribute__((target("avx2"), always_inline)) static inline
+
+/* AVX2 compares signed integers only: flipping the sign bit of both sides
+ * makes them compare as unsigned.
+ */
+BITSET_SCAN_AVX2
+unsigned bitset_scan_range_u32_avx2(const uint32_t* v,
+                                    const bitset_scan_pred_t* p)
+{
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    __m256i d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)v),
+                                 _mm256_set1_epi32(p->lo));
+    __m256i gt = _mm256_cmpgt_epi32(_mm256_xor_si256(d, sign),
+                                    _mm256_set1_epi32(p->span ^ INT32_MIN));
+    return ~_mm256_movemask_ps(_mm256_castsi256_ps(gt)) & 0xff;
+}
+
+BITSET_SCAN_AVX2
+unsigned bitset_scan_range_u64_avx2(const uint64_t* v,
+                                    const bitset_scan_pred_t* p)
+{
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    __m256i d = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)v),
+                                 _mm256_set1_epi64x(p->lo));
+    __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(d, sign),
+                                    _mm256_set1_epi64x(p->span ^ INT64_MIN));
+    return ~_mm256_movemask_pd(_mm256_castsi256_pd(gt)) & 0xf;
+}
+
+BITSET_SCAN_AVX2
+unsigned bitset_scan_range_f32_avx2(const float* v,
+                                    const bitset_scan_pred_t* p)
+{
+    __m256 x = _mm256_loadu_ps(v);
+    __m256 in = _mm256_and_ps(
+                    _mm256_cmp_ps(x, _mm256_set1_ps(p->flo), _CMP_GE_OQ),
+                    _mm256_cmp_ps(x, _mm256_set1_ps(p->fhi), _CMP_LE_OQ));
+    return _mm256_movemask_ps(in);
+}
+
+BITSET_SCAN_AVX2
+unsigned bitset_scan_in_u32_avx2(const uint32_t* v,
+                                 const bitset_scan_pred_t* p)
+{
+    const uint32_t* set = p->set;
+    __m256i x = _mm256_loadu_si256((const __m256i*)v);
+    __m256i in = _mm256_setzero_si256();
+    for (size_t j = 0; j < p->nset; j++) {
+        in = _mm256_or_si256(in, _mm256_cmpeq_epi32(x,
+                                     _mm256_set1_epi32(set[j])));
+    }
+    return _mm256_movemask_ps(_mm256_castsi256_ps(in));
+}
+
+BITSET_SCAN_AVX2
+unsigned bitset_scan_in_u64_avx2(const uint64_t* v,
+                                 const bitset_scan_pred_t* p)
+{
+    const uint64_t* set = p->set;
+    __m256i x = _mm256_loadu_si256((const __m256i*)v);
+    __m256i in = _mm256_setzero_si256();
+    for (size_t j = 0; j < p->nset; j++) {
+        in = _mm256_or_si256(in, _mm256_cmpeq_epi64(x,
+                                     _mm256_set1_epi64x(set[j])));
+    }
+    return _mm256_movemask_pd(_mm256_castsi256_pd(in));
+}
+
+BITSET_SCAN_AVX2
+unsigned bitset_scan_in_f32_avx2(const float* v, const bitset_scan_pred_t* p)
+{
+    const float* set = p->set;
+    __m256 x = _mm256_loadu_ps(v);
+    __m256 in = _mm256_setzero_ps();
+    for (size_t j = 0; j < p->nset; j++) {
+        in = _mm256_or_ps(in, _mm256_cmp_ps(x, _mm256_set1_ps(set[j]),
+                                            _CMP_EQ_OQ));
+    }
+    return _mm256_movemask_ps(in);
+}
+
+BITSET_SCAN_KERNEL(bitset_scan_range_u32_avx2_kernel,
+                   bitset_scan_range_u32_avx2, uint32_t, 8,
+                   __attribute__((target("avx2"))))
+BITSET_SCAN_KERNEL(bitset_scan_range_u64_avx2_kernel,
+                   bitset_scan_range_u64_avx2, uint64_t, 4,
+                   __attribute__((target("avx2"))))
+BITSET_SCAN_KERNEL(bitset_scan_range_f32_avx2_kernel,
+                   bitset_scan_range_f32_avx2, float, 8,
+                   __attribute__((target("avx2"))))
+BITSET_SCAN_KERNEL(bitset_scan_in_u32_avx2_kernel,
+                   bitset_scan_in_u32_avx2, uint32_t, 8,
+                   __attribute__((target("avx2"))))
+BITSET_SCAN_KERNEL(bitset_scan_in_u64_avx2_kernel,
+                   bitset_scan_in_u64_avx2, uint64_t, 4,
+                   __attribute__((target("avx2"))))
+BITSET_SCAN_KERNEL(bitset_scan_in_f32_avx2_kernel,
+                   bitset_scan_in_f32_avx2, float, 8,
+                   __attribute__((target("avx2"))))
+
+/* }}} */
+/* {{{ AVX-512 */
+
+#define BITSET_SCAN_AVX512 \
+    __attribute__((target("avx512f"), always_inline)) static inline
+
+BITSET_SCAN_AVX512
+__mmask16 bitset_scan_range_u32_avx512(const uint32_t* v,
+                                       const bitset_scan_pred_t* p)
+{
+    __m512i d = _mm512_sub_epi32(_mm512_loadu_si512(v),
+                                 _mm512_set1_epi32(p->lo));
+    return _mm512_cmp_epu32_mask(d, _mm512_set1_epi32(p->span),
+                                 _MM_CMPINT_LE);
+}
+
+BITSET_SCAN_AVX512
+__mmask8 bitset_scan_range_u64_avx512(const uint64_t* v,
+                                      const bitset_scan_pred_t* p)
+{
+    __m512i d = _mm512_sub_epi64(_mm512_loadu_si512(v),
+                                 _mm512_set1_epi64(p->lo));
+    return _mm512_cmp_epu64_mask(d, _mm512_set1_epi64(p->span),
+                                 _MM_CMPINT_LE);
+}
+
+BITSET_SCAN_AVX512
+__mmask16 bitset_scan_range_f32_avx512(const float* v,
+                                       const bitset_scan_pred_t* p)
+{
+    __m512 x = _mm512_loadu_ps(v);
+    __mmask16 ge = _mm512_cmp_ps_mask(x, _mm512_set1_ps(p->flo), _CMP_GE_OQ);
+    return _mm512_mask_cmp_ps_mask(ge, x, _mm512_set1_ps(p->fhi),
+                                   _CMP_LE_OQ);
+}
+
+BITSET_SCAN_AVX512
+__mmask16 bitset_scan_in_u32_avx512(const uint32_t* v,
+                                    const bitset_scan_pred_t* p)
+{
+    const uint32_t* set = p->set;
+    __m512i x = _mm512_loadu_si512(v);
+    __mmask16 in = 0;
+    for (size_t j = 0; j < p->nset; j++) {
+        in |= _mm512_cmpeq_epi32_mask(x, _mm512_set1_epi32(set[j]));
+    }
+    return in;
+}
+
+BITSET_SCAN_AVX512
+__mmask8 bitset_scan_in_u64_avx512(const uint64_t* v,
+                                   const bitset_scan_pred_t* p)
+{
+    const uint64_t* set = p->set;
+    __m512i x = _mm512_loadu_si512(v);
+    __mmask8 in = 0;
+    for (size_t j = 0; j < p->nset; j++) {
+        in |= _mm512_cmpeq_epi64_mask(x, _mm512_set1_epi64(set[j]));
+    }
+    return in;
+}
+
+BITSET_SCAN_AVX512
+__mmask16 bitset_scan_in_f32_avx512(const float* v,
+                                    const bitset_scan_pred_t* p)
+{
+    const float* set = p->set;
+    __m512 x = _mm512_loadu_ps(v);
+    __mmask16 in = 0;
+    for (size_t j = 0; j < p->nset; j++) {
+        in |= _mm512_cmp_ps_mask(x, _mm512_set1_ps(set[j]), _CMP_EQ_OQ);
+    }
+    return in;
+}
+
+BITSET_SCAN_KERNEL(bitset_scan_range_u32_avx512_kernel,
+                   bitset_scan_range_u32_avx512, uint32_t, 16,
+                   __attribute__((target("avx512f"))))
+BITSET_SCAN_KERNEL(bitset_scan_range_u64_avx512_kernel,
+                   bitset_scan_range_u64_avx512, uint64_t, 8,
+                   __attribute__((target("avx512f"))))
+BITSET_SCAN_KERNEL(bitset_scan_range_f32_avx512_kernel,
+                   bitset_scan_range_f32_avx512, float, 16,
+                   __attribute__((target("avx512f"))))
+BITSET_SCAN_KERNEL(bitset_scan_in_u32_avx512_kernel,
+                   bitset_scan_in_u32_avx512, uint32_t, 16,
+                   __attribute__((target("avx512f"))))
+BITSET_SCAN_KERNEL(bitset_scan_in_u64_avx512_kernel,
+                   bitset_scan_in_u64_avx512, uint64_t, 8,
+                   __attribute__((target("avx512f"))))
+BITSET_SCAN_KERNEL(bitset_scan_in_f32_avx512_kernel,
+                   bitset_scan_in_f32_avx512, float, 16,
+                   __attribute__((target("avx512f"))))
+
+/* }}} */
+
+#define BITSET_SCAN_KERNELS(_name) \
+    { _name##_generic, _name##_avx2_kernel, _name##_avx512_kernel }
+
+#else
+
+#define BITSET_SCAN_KERNELS(_name) { _name##_generic }
+
+#endif
+
+static const bitset_scan_fn bitset_scan_range_u32_fns[] =
+    BITSET_SCAN_KERNELS(bitset_scan_range_u32);
+static const bitset_scan_fn bitset_scan_range_u64_fns[] =
+    BITSET_SCAN_KERNELS(bitset_scan_range_u64);
+static const bitset_scan_fn bitset_scan_range_f32_fns[] =
+    BITSET_SCAN_KERNELS(bitset_scan_range_f32);
+static const bitset_scan_fn bitset_scan_in_u32_fns[] =
+    BITSET_SCAN_KERNELS(bitset_scan_in_u32);
+static const bitset_scan_fn bitset_scan_in_u64_fns[] =
+    BITSET_SCAN_KERNELS(bitset_scan_in_u64);
+static const bitset_scan_fn bitset_scan_in_f32_fns[] =
+    BITSET_SCAN_KERNELS(bitset_scan_in_f32);
+
+/* Scan the rows of `col`, of `size` bytes each, into `dest` with the kernel
+ * of the best instruction set among `fns`.
+ */
+static void bitset_scan(bitset_t* dest, const void* col, size_t size,
+                        const bitset_scan_fn* fns,
+                        const bitset_scan_pred_t* p)
+{
+    pthread_once(&bitset_scan_once, bitset_scan_init_once);
+    bitset_scan_fn fn = fns[bitset_scan_level];
+    size_t n = dest->nbits;
+    size_t i = fn(dest->bits, col, n, p);
+    if (i < n) {
+        // The last rows are copied to a whole atom of rows, whose extra
+        // bits are dropped.
+        bitset_atom_t rows[BITS_PER_ATOM] = { 0 };
+        memcpy(rows, (const char*)col + i * size, (n - i) * size);
+        bitset_atom_t* last = &dest->bits[i / BITS_PER_ATOM];
+        fn(last, rows, BITS_PER_ATOM, p);
+        *last &= ((bitset_atom_t)1 << (n - i)) - 1;
+    }
+}
+
+/* Clear all bits of `dest` */
+static void bitset_scan_none(bitset_t* dest) {
+    memset(dest->bits, 0, dest->natoms * sizeof(bitset_atom_t));
+}
+
+/* Turn `op` x into the range [lo, hi] of integers in [min, max], negated
+ * if `flip`.
+ * @return 0 if the range is empty.
+ */
+static int bitset_scan_op_range(bitset_scan_op_t op, int64_t x, int64_t min,
+                                int64_t max, int64_t* lo, int64_t* hi,
+                                bitset_atom_t* flip)
+{
+    *lo = min;
+    *hi = max;
+    *flip = 0;
+    switch (op) {
+    case BITSET_SCAN_LT:
+        if (x == min) {
+            return 0;
+        }
+        *hi = x - 1;
+        return 1;
+    case BITSET_SCAN_LE:
+        *hi = x;
+        return 1;
+    case BITSET_SCAN_GT:
+        if (x == max) {
+            return 0;
+        }
+        *lo = x + 1;
+        return 1;
+    case BITSET_SCAN_GE:
+        *lo = x;
+        return 1;
+    case BITSET_SCAN_NE:
+        *flip = BITSET_ATOM_MAX;
+        // Fall through
+    case BITSET_SCAN_EQ:
+    default:
+        *lo = *hi = x;
+        return 1;
+    }
+}
+
+void bitset_scan_i32(bitset_t* dest, const int32_t* col, bitset_scan_op_t op,
+                     int32_t x)
+{
+    int64_t lo, hi;
+    bitset_scan_pred_t p = { 0 };
+    if (!bitset_scan_op_range(op, x, INT32_MIN, INT32_MAX, &lo, &hi,
+                              &p.flip)) {
+        bitset_scan_none(dest);
+        return;
+    }
+    p.lo = (uint32_t)lo;
+    p.span = (uint32_t)((uint32_t)hi - (uint32_t)lo);
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_range_u32_fns, &p);
+}
+
+void bitset_scan_i64(bitset_t* dest, const int64_t* col, bitset_scan_op_t op,
+                     int64_t x)
+{
+    int64_t lo, hi;
+    bitset_scan_pred_t p = { 0 };
+    if (!bitset_scan_op_range(op, x, INT64_MIN, INT64_MAX, &lo, &hi,
+                              &p.flip)) {
+        bitset_scan_none(dest);
+        return;
+    }
+    p.lo = (uint64_t)lo;
+    p.span = (uint64_t)hi - (uint64_t)lo;
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_range_u64_fns, &p);
+}
+
+void bitset_scan_f32(bitset_t* dest, const float* col, bitset_scan_op_t op,
+                     float x)
+{
+    bitset_scan_pred_t p = { .flo = -INFINITY, .fhi = INFINITY };
+    switch (op) {
+    case BITSET_SCAN_LT:
+        if (x == -INFINITY) {
+            bitset_scan_none(dest);
+            return;
+        }
+        p.fhi = nextafterf(x, -INFINITY);
+        break;
+    case BITSET_SCAN_LE:
+        p.fhi = x;
+        break;
+    case BITSET_SCAN_GT:
+        if (x == INFINITY) {
+            bitset_scan_none(dest);
+            return;
+        }
+        p.flo = nextafterf(x, INFINITY);
+        break;
+    case BITSET_SCAN_GE:
+        p.flo = x;
+        break;
+    case BITSET_SCAN_NE:
+        p.flip = BITSET_ATOM_MAX;
+        // Fall through
+    case BITSET_SCAN_EQ:
+    default:
+        p.flo = p.fhi = x;
+        break;
+    }
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_range_f32_fns, &p);
+}
+
+void bitset_scan_between_i32(bitset_t* dest, const int32_t* col,
+                             int32_t lo, int32_t hi)
+{
+    if (lo > hi) {
+        bitset_scan_none(dest);
+        return;
+    }
+    bitset_scan_pred_t p = {
+        .lo = (uint32_t)lo,
+        .span = (uint32_t)((uint32_t)hi - (uint32_t)lo),
+    };
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_range_u32_fns, &p);
+}
+
+void bitset_scan_between_i64(bitset_t* dest, const int64_t* col,
+                             int64_t lo, int64_t hi)
+{
+    if (lo > hi) {
+        bitset_scan_none(dest);
+        return;
+    }
+    bitset_scan_pred_t p = {
+        .lo = (uint64_t)lo,
+        .span = (uint64_t)hi - (uint64_t)lo,
+    };
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_range_u64_fns, &p);
+}
+
+void bitset_scan_between_f32(bitset_t* dest, const float* col,
+                             float lo, float hi)
+{
+    bitset_scan_pred_t p = { .flo = lo, .fhi = hi };
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_range_f32_fns, &p);
+}
+
+void bitset_scan_in_i32(bitset_t* dest, const int32_t* col,
+                        const int32_t* set, size_t nset)
+{
+    bitset_scan_pred_t p = { .set = set, .nset = nset };
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_in_u32_fns, &p);
+}
+
+void bitset_scan_in_i64(bitset_t* dest, const int64_t* col,
+                        const int64_t* set, size_t nset)
+{
+    bitset_scan_pred_t p = { .set = set, .nset = nset };
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_in_u64_fns, &p);
+}
+
+void bitset_scan_in_f32(bitset_t* dest, const float* col,
+                        const float* set, size_t nset)
+{
+    bitset_scan_pred_t p = { .set = set, .nset = nset };
+    bitset_scan(dest, col, sizeof(*col), bitset_scan_in_f32_fns, &p);
+}
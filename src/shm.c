@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bitset/shm.h"
+
+#define BITSET_SHM_MAGIC    0x4253544d53484d31ULL   /* "BSTMSHM1" */
+
+/* Header at the beginning of the shared object. It is padded to a cache line
+ * so atoms that follow don't share their line with the header.
+ */
+typedef struct bitset_shm_header {
+    uint64_t magic;
+    uint64_t nbits;
+    uint64_t pad[6];
+} bitset_shm_header_t;
+
+static size_t bitset_shm_size(size_t nbits) {
+    return sizeof(bitset_shm_header_t)
+         + BITS_TO_NATOMS(nbits) * sizeof(bitset_atom_t);
+}
+
+static bitset_shm_header_t* bitset_shm_header(const bitset_t* bs) {
+    return (bitset_shm_header_t*)bs->bits - 1;
+}
+
+int bitset_shm_create(bitset_t* bs, const char* name, size_t nbits) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t size = bitset_shm_size(nbits);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name);
+        return -1;
+    }
+
+    // ftruncate already zeroed the atoms. The magic is published last so
+    // attachers never see a half-initialized header.
+    bitset_shm_header_t* header = map;
+    header->nbits = nbits;
+    __atomic_store_n(&header->magic, BITSET_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    bs->nbits = nbits;
+    bs->natoms = BITS_TO_NATOMS(nbits);
+    bs->bits = (bitset_atom_t*)(header + 1);
+    return 0;
+}
+
+int bitset_shm_attach(bitset_t* bs, const char* name, int flags) {
+    int rdonly = (flags & BITSET_SHM_RDONLY) != 0;
+    int fd = shm_open(name, rdonly ? O_RDONLY : O_RDWR, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(bitset_shm_header_t)) {
+        close(fd);
+        return -1;
+    }
+    int prot = rdonly ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* map = mmap(NULL, st.st_size, prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    bitset_shm_header_t* header = map;
+    size_t size = bitset_shm_size(header->nbits);
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != BITSET_SHM_MAGIC
+    ||  size > (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    // Detaching unmaps the pages of the header and atoms only: drop those
+    // of a larger object past them, so that none of them leak.
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t used = (size + page - 1) / page * page;
+    if (used < (size_t)st.st_size) {
+        munmap((char*)map + used, st.st_size - used);
+    }
+
+    bs->nbits = header->nbits;
+    bs->natoms = BITS_TO_NATOMS(header->nbits);
+    bs->bits = (bitset_atom_t*)(header + 1);
+    return 0;
+}
+
+void bitset_shm_detach(bitset_t* bs) {
+    munmap(bitset_shm_header(bs), bitset_shm_size(bs->nbits));
+    bs->bits = NULL;
+}
+
+int bitset_shm_unlink(const char* name) {
+    return shm_unlink(name);
+}
+
+/* {{{ Atomic operations */
+
+extern void bitset_atomic_set(bitset_t* bs, size_t bit);
+
+extern void bitset_atomic_unset(bitset_t* bs, size_t bit);
+
+extern bit_t bitset_atomic_get(const bitset_t* bs, size_t bit);
+
+extern bit_t bitset_atomic_test_and_set(bitset_t* bs, size_t bit);
+
+void bitset_atomic_and(bitset_t* a, const bitset_t* b) {
+    assert (a->natoms == b->natoms);
+
+    for (size_t i = 0; i < a->natoms; i++) {
+        if (~b->bits[i] & __atomic_load_n(&a->bits[i], __ATOMIC_RELAXED)) {
+            __atomic_fetch_and(&a->bits[i], b->bits[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void bitset_atomic_or(bitset_t* a, const bitset_t* b) {
+    assert (a->natoms == b->natoms);
+
+    for (size_t i = 0; i < a->natoms; i++) {
+        if (b->bits[i] & ~__atomic_load_n(&a->bits[i], __ATOMIC_RELAXED)) {
+            __atomic_fetch_or(&a->bits[i], b->bits[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* }}} */
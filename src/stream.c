@@ -0,0 +1,488 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "bitset/crc32c.h"
+#include "bitset/image.h"
+#include "bitset/stream.h"
+#include "io.h"
+
+#define bitset_atom_popcnt  __builtin_popcountl
+
+#define BITSET_STREAM_ALIGN 4096
+
+/* Running CRC32C of the atoms of an image, fed in order */
+typedef struct bitset_stream_crc {
+    uint32_t               *crcs;       /* CRC table, NULL if none */
+    uint32_t                crc;        /* Of the current CRC block so far */
+    size_t                  len;        /* Bytes of the current CRC block */
+    size_t                  block;      /* Current CRC block */
+    size_t                  left;       /* Bytes of atoms not fed yet */
+} bitset_stream_crc_t;
+
+/* State shared by the I/O thread and the kernel thread. Block `i` lives in
+ * slot `i % depth`.
+ */
+typedef struct bitset_stream_run {
+    bitset_stream_t        *s;
+    int                     in_fds[BITSET_STREAM_MAX_INPUTS];
+    bitset_stream_crc_t     in_crcs[BITSET_STREAM_MAX_INPUTS];
+    size_t                  nin;
+    int                     out_fd;     /* -1 if no output */
+    char                   *out_tmp;    /* Written, then renamed to output */
+    bitset_stream_crc_t     out_crc;
+    size_t                  natoms;
+    size_t                  block_atoms;
+    size_t                  nblocks;
+    bitset_atom_t          *buffers;    /* depth * nin blocks */
+
+    pthread_mutex_t         lock;
+    pthread_cond_t          cond;
+    size_t                  nread;      /* Blocks loaded in their slot */
+    size_t                  ndone;      /* Blocks processed by the kernel */
+    int                     error;
+    double                  io_time;
+} bitset_stream_run_t;
+
+static double bitset_stream_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bitset_atom_t* bitset_stream_block(bitset_stream_run_t* run,
+                                          size_t block, size_t input)
+{
+    size_t slot = block % run->s->depth;
+    return run->buffers + (slot * run->nin + input) * run->block_atoms;
+}
+
+static size_t bitset_stream_block_natoms(const bitset_stream_run_t* run,
+                                         size_t block)
+{
+    size_t left = run->natoms - block * run->block_atoms;
+    return left < run->block_atoms ? left : run->block_atoms;
+}
+
+static off_t bitset_stream_block_offset(const bitset_stream_run_t* run,
+                                        size_t block)
+{
+    return BITSET_IMAGE_HEADER_SIZE
+         + (off_t)block * run->block_atoms * sizeof(bitset_atom_t);
+}
+
+/* Feed the `len` next bytes of atoms `data` to `c`. The CRC of each CRC
+ * block completed is stored into the table if `store`, and checked against
+ * it otherwise.
+ * @return not 0 if a block doesn't match its CRC.
+ */
+static int bitset_stream_crc(bitset_stream_crc_t* c, const void* data,
+                             size_t len, int store)
+{
+    const unsigned char* p = data;
+    while (len > 0) {
+        size_t n = BITSET_CRC32C_BLOCK_SIZE - c->len;
+        n = n < len ? n : len;
+        c->crc = bitset_crc32c(c->crc, p, n);
+        c->len += n;
+        c->left -= n;
+        p += n;
+        len -= n;
+        if (c->len == BITSET_CRC32C_BLOCK_SIZE || c->left == 0) {
+            if (store) {
+                c->crcs[c->block] = c->crc;
+            } else if (c->crc != c->crcs[c->block]) {
+                return -1;
+            }
+            c->crc = 0;
+            c->len = 0;
+            c->block++;
+        }
+    }
+    return 0;
+}
+
+/* Wait until the kernel is done with `block`, or an error occurred. */
+static int bitset_stream_wait_done(bitset_stream_run_t* run, size_t block) {
+    pthread_mutex_lock(&run->lock);
+    while (run->ndone <= block && !run->error) {
+        pthread_cond_wait(&run->cond, &run->lock);
+    }
+    int error = run->error;
+    pthread_mutex_unlock(&run->lock);
+    return error;
+}
+
+/* Write back the result of `block`, which is written in order. */
+static int bitset_stream_write_block(bitset_stream_run_t* run, size_t block) {
+    size_t len = bitset_stream_block_natoms(run, block) * sizeof(bitset_atom_t);
+    bitset_atom_t* atoms = bitset_stream_block(run, block, 0);
+    bitset_stream_crc(&run->out_crc, atoms, len, 1);
+    return bitset_pwrite_all(run->out_fd, atoms, len,
+                             bitset_stream_block_offset(run, block));
+}
+
+static void bitset_stream_fail(bitset_stream_run_t* run) {
+    pthread_mutex_lock(&run->lock);
+    run->error = -1;
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+}
+
+/* I/O thread: fill slots ahead of the kernel, and write results back before
+ * reusing a slot.
+ */
+static void* bitset_stream_io(void* arg) {
+    bitset_stream_run_t* run = arg;
+    unsigned depth = run->s->depth;
+
+    for (size_t block = 0; block < run->nblocks; block++) {
+        if (block >= depth) {
+            size_t prev = block - depth;
+            if (bitset_stream_wait_done(run, prev)) {
+                return NULL;
+            }
+            double start = bitset_stream_now();
+            if (run->out_fd >= 0 && bitset_stream_write_block(run, prev) < 0) {
+                bitset_stream_fail(run);
+                return NULL;
+            }
+            run->io_time += bitset_stream_now() - start;
+        }
+
+        double start = bitset_stream_now();
+        size_t len = bitset_stream_block_natoms(run, block)
+                   * sizeof(bitset_atom_t);
+        for (size_t i = 0; i < run->nin; i++) {
+            bitset_atom_t* atoms = bitset_stream_block(run, block, i);
+            if (bitset_pread_all(run->in_fds[i], atoms, len,
+                                 bitset_stream_block_offset(run, block)) < 0
+            ||  (run->in_crcs[i].crcs
+                 && bitset_stream_crc(&run->in_crcs[i], atoms, len, 0) < 0)) {
+                bitset_stream_fail(run);
+                return NULL;
+            }
+        }
+        run->io_time += bitset_stream_now() - start;
+
+        pthread_mutex_lock(&run->lock);
+        run->nread++;
+        pthread_cond_broadcast(&run->cond);
+        pthread_mutex_unlock(&run->lock);
+    }
+
+    // Write back the results still in the ring.
+    if (run->out_fd >= 0) {
+        size_t first = run->nblocks > depth ? run->nblocks - depth : 0;
+        for (size_t block = first; block < run->nblocks; block++) {
+            if (bitset_stream_wait_done(run, block)) {
+                return NULL;
+            }
+            double start = bitset_stream_now();
+            if (bitset_stream_write_block(run, block) < 0) {
+                bitset_stream_fail(run);
+                return NULL;
+            }
+            run->io_time += bitset_stream_now() - start;
+        }
+    }
+    return NULL;
+}
+
+/* Open inputs, check they all have the same size, and read their CRC
+ * tables to verify blocks as they are read.
+ */
+static int bitset_stream_open(bitset_stream_run_t* run, const char** inputs,
+                              size_t nin, size_t* nbits)
+{
+    run->nin = 0;
+    for (size_t i = 0; i < nin; i++) {
+        bitset_image_header_t header;
+        int fd = open(inputs[i], O_RDONLY);
+        if (fd < 0) {
+            return -1;
+        }
+        run->in_fds[run->nin++] = fd;
+        if (bitset_image_read_header(fd, &header) < 0
+        ||  (i > 0 && header.nbits != *nbits)) {
+            return -1;
+        }
+        if (header.flags & BITSET_IMAGE_CRC32C) {
+            if (bitset_image_read_crcs(fd, &header,
+                                       &run->in_crcs[i].crcs) < 0) {
+                run->in_crcs[i].crcs = NULL;
+                return -1;
+            }
+            run->in_crcs[i].left = BITS_TO_NATOMS(header.nbits)
+                                 * sizeof(bitset_atom_t);
+        }
+        *nbits = header.nbits;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return 0;
+}
+
+void bitset_stream_init(bitset_stream_t* s, size_t block_size, unsigned depth) {
+    if (block_size == 0) {
+        block_size = BITSET_STREAM_BLOCK_SIZE;
+    }
+    s->block_size = (block_size + BITSET_STREAM_ALIGN - 1)
+                  / BITSET_STREAM_ALIGN * BITSET_STREAM_ALIGN;
+    if (depth == 0) {
+        depth = BITSET_STREAM_DEPTH;
+    }
+    s->depth = depth < 2 ? 2 : depth;
+    s->io_time = s->cpu_time = s->wall_time = 0;
+    s->nblocks = 0;
+}
+
+double bitset_stream_overlap(const bitset_stream_t* s) {
+    double shortest = s->io_time < s->cpu_time ? s->io_time : s->cpu_time;
+    if (shortest <= 0) {
+        return 0;
+    }
+    double hidden = (s->io_time + s->cpu_time - s->wall_time) / shortest;
+    return hidden < 0 ? 0 : hidden > 1 ? 1 : hidden;
+}
+
+int bitset_stream_run(bitset_stream_t* s, const char* output,
+                      const char** inputs, size_t nin,
+                      bitset_stream_kernel_t kernel, void* arg)
+{
+    assert (nin >= 1 && nin <= BITSET_STREAM_MAX_INPUTS);
+
+    double start = bitset_stream_now();
+    bitset_stream_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.s = s;
+    run.out_fd = -1;
+    run.block_atoms = s->block_size / sizeof(bitset_atom_t);
+
+    int res = -1;
+    size_t nbits = 0;
+    if (bitset_stream_open(&run, inputs, nin, &nbits) < 0) {
+        goto close;
+    }
+    run.natoms = BITS_TO_NATOMS(nbits);
+    run.nblocks = (run.natoms + run.block_atoms - 1) / run.block_atoms;
+
+    // The output is written aside like `bitset_save` does, and its header
+    // is written last, with its CRC table.
+    if (output) {
+        size_t len = strlen(output);
+        size_t nblocks = BITSET_CRC32C_NBLOCKS(run.natoms);
+        run.out_tmp = malloc(len + sizeof(".tmp"));
+        run.out_crc.crcs = malloc((nblocks ? nblocks : 1) * sizeof(uint32_t));
+        run.out_crc.left = run.natoms * sizeof(bitset_atom_t);
+        if (!run.out_tmp || !run.out_crc.crcs) {
+            goto close;
+        }
+        memcpy(run.out_tmp, output, len);
+        memcpy(run.out_tmp + len, ".tmp", sizeof(".tmp"));
+        run.out_fd = open(run.out_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (run.out_fd < 0
+        ||  ftruncate(run.out_fd, BITSET_IMAGE_SIZE(nbits)) < 0) {
+            goto close;
+        }
+    }
+
+    if (posix_memalign((void**)&run.buffers, BITSET_STREAM_ALIGN,
+                       (size_t)s->depth * nin * s->block_size)) {
+        run.buffers = NULL;
+        goto close;
+    }
+
+    pthread_t io;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
+    if (pthread_create(&io, NULL, bitset_stream_io, &run)) {
+        goto destroy;
+    }
+
+    double cpu_time = 0;
+    bitset_atom_t* blocks[BITSET_STREAM_MAX_INPUTS];
+    for (size_t block = 0; block < run.nblocks; block++) {
+        pthread_mutex_lock(&run.lock);
+        while (run.nread <= block && !run.error) {
+            pthread_cond_wait(&run.cond, &run.lock);
+        }
+        int error = run.error;
+        pthread_mutex_unlock(&run.lock);
+        if (error) {
+            break;
+        }
+
+        for (size_t i = 0; i < nin; i++) {
+            blocks[i] = bitset_stream_block(&run, block, i);
+        }
+        double kstart = bitset_stream_now();
+        error = kernel(blocks, bitset_stream_block_natoms(&run, block),
+                       block * run.block_atoms, arg);
+        cpu_time += bitset_stream_now() - kstart;
+        if (error) {
+            bitset_stream_fail(&run);
+            break;
+        }
+
+        pthread_mutex_lock(&run.lock);
+        run.ndone++;
+        pthread_cond_broadcast(&run.cond);
+        pthread_mutex_unlock(&run.lock);
+    }
+    pthread_join(io, NULL);
+
+    res = run.error;
+    if (res == 0 && run.out_fd >= 0) {
+        double start = bitset_stream_now();
+        if (bitset_image_write_crcs(run.out_fd, nbits, run.out_crc.crcs) < 0
+        ||  fsync(run.out_fd) < 0
+        ||  rename(run.out_tmp, output) < 0
+        ||  bitset_fsync_dir(output) < 0) {
+            res = -1;
+        }
+        run.io_time += bitset_stream_now() - start;
+    }
+    s->io_time = run.io_time;
+    s->cpu_time = cpu_time;
+    s->nblocks = run.nblocks;
+
+  destroy:
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.lock);
+  close:
+    free(run.buffers);
+    for (size_t i = 0; i < run.nin; i++) {
+        close(run.in_fds[i]);
+        free(run.in_crcs[i].crcs);
+    }
+    if (run.out_fd >= 0) {
+        close(run.out_fd);
+        if (res != 0) {
+            unlink(run.out_tmp);
+        }
+    }
+    free(run.out_tmp);
+    free(run.out_crc.crcs);
+    s->wall_time = bitset_stream_now() - start;
+    return res;
+}
+
+/* {{{ Kernels */
+
+static int bitset_stream_popcnt_kernel(bitset_atom_t** blocks, size_t natoms,
+                                       size_t atom, void* arg)
+{
+    (void)atom;
+    long long sum = 0;
+    for (size_t i = 0; i < natoms; i++) {
+        sum += bitset_atom_popcnt(blocks[0][i]);
+    }
+    *(long long*)arg += sum;
+    return 0;
+}
+
+static int bitset_stream_and_popcnt_kernel(bitset_atom_t** blocks,
+                                           size_t natoms, size_t atom,
+                                           void* arg)
+{
+    (void)atom;
+    long long sum = 0;
+    for (size_t i = 0; i < natoms; i++) {
+        sum += bitset_atom_popcnt(blocks[0][i] & blocks[1][i]);
+    }
+    *(long long*)arg += sum;
+    return 0;
+}
+
+static int bitset_stream_or_popcnt_kernel(bitset_atom_t** blocks,
+                                          size_t natoms, size_t atom,
+                                          void* arg)
+{
+    (void)atom;
+    long long sum = 0;
+    for (size_t i = 0; i < natoms; i++) {
+        sum += bitset_atom_popcnt(blocks[0][i] | blocks[1][i]);
+    }
+    *(long long*)arg += sum;
+    return 0;
+}
+
+static int bitset_stream_and_kernel(bitset_atom_t** blocks, size_t natoms,
+                                    size_t atom, void* arg)
+{
+    (void)atom;
+    (void)arg;
+    for (size_t i = 0; i < natoms; i++) {
+        blocks[0][i] &= blocks[1][i];
+    }
+    return 0;
+}
+
+static int bitset_stream_or_kernel(bitset_atom_t** blocks, size_t natoms,
+                                   size_t atom, void* arg)
+{
+    (void)atom;
+    (void)arg;
+    for (size_t i = 0; i < natoms; i++) {
+        blocks[0][i] |= blocks[1][i];
+    }
+    return 0;
+}
+
+/* }}} */
+
+long long bitset_stream_popcnt(bitset_stream_t* s, const char* path) {
+    long long sum = 0;
+    if (bitset_stream_run(s, NULL, &path, 1, bitset_stream_popcnt_kernel,
+                          &sum) != 0) {
+        return -1;
+    }
+    return sum;
+}
+
+long long bitset_stream_and_popcnt(bitset_stream_t* s, const char* a,
+                                   const char* b)
+{
+    const char* inputs[2] = { a, b };
+    long long sum = 0;
+    if (bitset_stream_run(s, NULL, inputs, 2, bitset_stream_and_popcnt_kernel,
+                          &sum) != 0) {
+        return -1;
+    }
+    return sum;
+}
+
+long long bitset_stream_or_popcnt(bitset_stream_t* s, const char* a,
+                                  const char* b)
+{
+    const char* inputs[2] = { a, b };
+    long long sum = 0;
+    if (bitset_stream_run(s, NULL, inputs, 2, bitset_stream_or_popcnt_kernel,
+                          &sum) != 0) {
+        return -1;
+    }
+    return sum;
+}
+
+int bitset_stream_and_to(bitset_stream_t* s, const char* dest, const char* a,
+                         const char* b)
+{
+    const char* inputs[2] = { a, b };
+    return bitset_stream_run(s, dest, inputs, 2, bitset_stream_and_kernel,
+                             NULL);
+}
+
+int bitset_stream_or_to(bitset_stream_t* s, const char* dest, const char* a,
+                        const char* b)
+{
+    const char* inputs[2] = { a, b };
+    return bitset_stream_run(s, dest, inputs, 2, bitset_stream_or_kernel,
+                             NULL);
+}
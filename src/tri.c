@@ -0,0 +1,266 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITSET_TRI_X86
+#endif
+#include "bitset/tri.h"
+
+#define bitset_atom_popcnt  __builtin_popcountl
+
+#define BITSET_TRI_FALSE_MASK   (BITSET_TRI_TRUE_MASK << 1)
+
+static pthread_once_t bitset_tri_once = PTHREAD_ONCE_INIT;
+static int            bitset_tri_has_avx2;
+
+static void bitset_tri_init_once(void) {
+#ifdef BITSET_TRI_X86
+    bitset_tri_has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+int bitset_tri_init(bitset_tri_t* t, size_t n) {
+    pthread_once(&bitset_tri_once, bitset_tri_init_once);
+    t->n = n;
+    t->natoms = n / BITSET_TRI_PER_ATOM + (n % BITSET_TRI_PER_ATOM != 0);
+    t->atoms = calloc(t->natoms ? t->natoms : 1, sizeof(bitset_atom_t));
+    if (!t->atoms) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Spread the 32 bits of `x` over the even bits of an atom. */
+static bitset_atom_t bitset_tri_spread(uint32_t x) {
+    bitset_atom_t v = x;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8))  & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2))  & 0x3333333333333333ULL;
+    v = (v | (v << 1))  & 0x5555555555555555ULL;
+    return v;
+}
+
+int bitset_tri_from_bitsets(bitset_tri_t* t, const bitset_t* trues,
+                            const bitset_t* falses)
+{
+    assert (trues->nbits == falses->nbits);
+    if (bitset_tri_init(t, trues->nbits) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < t->natoms; i++) {
+        unsigned shift = BITSET_TRI_PER_ATOM * (i % 2);
+        uint32_t tb = trues->bits[i / 2] >> shift;
+        uint32_t fb = falses->bits[i / 2] >> shift;
+        assert ((tb & fb) == 0);
+        t->atoms[i] = bitset_tri_spread(tb) | (bitset_tri_spread(fb) << 1);
+    }
+    return 0;
+}
+
+void bitset_tri_wipe(bitset_tri_t* t) {
+    free(t->atoms);
+}
+
+extern bitset_tri_state_t bitset_tri_get(const bitset_tri_t* t, size_t i);
+
+extern void bitset_tri_set(bitset_tri_t* t, size_t i,
+                           bitset_tri_state_t state);
+
+/* {{{ Kernels */
+
+/* Bits beyond the last element are 00 (unknown) and stay so through all
+ * operations, so kernels don't need to mask the last atom.
+ */
+
+static inline bitset_atom_t bitset_tri_and_atom(bitset_atom_t a,
+                                                bitset_atom_t b)
+{
+    return ((a & b) & BITSET_TRI_TRUE_MASK) | ((a | b) & BITSET_TRI_FALSE_MASK);
+}
+
+static inline bitset_atom_t bitset_tri_or_atom(bitset_atom_t a,
+                                               bitset_atom_t b)
+{
+    return ((a | b) & BITSET_TRI_TRUE_MASK) | ((a & b) & BITSET_TRI_FALSE_MASK);
+}
+
+static inline bitset_atom_t bitset_tri_not_atom(bitset_atom_t a) {
+    return ((a & BITSET_TRI_TRUE_MASK) << 1) | ((a >> 1) & BITSET_TRI_TRUE_MASK);
+}
+
+#ifdef BITSET_TRI_X86
+
+/* Select the "true" bits of `x` from `t`, and its "false" bits from `f`. */
+__attribute__((target("avx2")))
+static inline __m256i bitset_tri_blend256(__m256i t, __m256i f) {
+    const __m256i mask = _mm256_set1_epi64x(BITSET_TRI_TRUE_MASK);
+    return _mm256_or_si256(_mm256_and_si256(t, mask),
+                           _mm256_andnot_si256(mask, f));
+}
+
+__attribute__((target("avx2")))
+static size_t bitset_tri_and_avx2(bitset_atom_t* dest, const bitset_atom_t* a,
+                                  const bitset_atom_t* b, size_t natoms)
+{
+    size_t i = 0;
+    for (; i + 4 <= natoms; i += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i r = bitset_tri_blend256(_mm256_and_si256(va, vb),
+                                        _mm256_or_si256(va, vb));
+        _mm256_storeu_si256((__m256i*)(dest + i), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t bitset_tri_or_avx2(bitset_atom_t* dest, const bitset_atom_t* a,
+                                 const bitset_atom_t* b, size_t natoms)
+{
+    size_t i = 0;
+    for (; i + 4 <= natoms; i += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i r = bitset_tri_blend256(_mm256_or_si256(va, vb),
+                                        _mm256_and_si256(va, vb));
+        _mm256_storeu_si256((__m256i*)(dest + i), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t bitset_tri_not_avx2(bitset_atom_t* dest, const bitset_atom_t* a,
+                                  size_t natoms)
+{
+    size_t i = 0;
+    for (; i + 4 <= natoms; i += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i r = bitset_tri_blend256(_mm256_srli_epi64(va, 1),
+                                        _mm256_slli_epi64(va, 1));
+        _mm256_storeu_si256((__m256i*)(dest + i), r);
+    }
+    return i;
+}
+
+/* Per-byte popcount with a nibble lookup, summed in 64-bit lanes. */
+__attribute__((target("avx2")))
+static inline __m256i bitset_tri_popcnt256(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(lookup,
+                        _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static size_t bitset_tri_counts_avx2(const bitset_atom_t* a, size_t natoms,
+                                     size_t* trues, size_t* falses)
+{
+    const __m256i mask = _mm256_set1_epi64x(BITSET_TRI_TRUE_MASK);
+    __m256i t = _mm256_setzero_si256();
+    __m256i f = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= natoms; i += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        t = _mm256_add_epi64(t,
+                bitset_tri_popcnt256(_mm256_and_si256(va, mask)));
+        f = _mm256_add_epi64(f,
+                bitset_tri_popcnt256(_mm256_andnot_si256(mask, va)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, t);
+    *trues = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i*)lanes, f);
+    *falses = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return i;
+}
+
+#endif
+
+/* }}} */
+
+void bitset_tri_counts(const bitset_tri_t* t, size_t counts[3]) {
+    size_t trues = 0;
+    size_t falses = 0;
+    size_t i = 0;
+#ifdef BITSET_TRI_X86
+    if (bitset_tri_has_avx2) {
+        i = bitset_tri_counts_avx2(t->atoms, t->natoms, &trues, &falses);
+    }
+#endif
+    for (; i < t->natoms; i++) {
+        trues += bitset_atom_popcnt(t->atoms[i] & BITSET_TRI_TRUE_MASK);
+        falses += bitset_atom_popcnt(t->atoms[i] & BITSET_TRI_FALSE_MASK);
+    }
+    counts[BITSET_TRI_UNKNOWN] = t->n - trues - falses;
+    counts[BITSET_TRI_TRUE] = trues;
+    counts[BITSET_TRI_FALSE] = falses;
+}
+
+size_t bitset_tri_count(const bitset_tri_t* t, bitset_tri_state_t state) {
+    size_t counts[3];
+    bitset_tri_counts(t, counts);
+    return counts[state];
+}
+
+void bitset_tri_and_to(bitset_tri_t* dest, const bitset_tri_t* a,
+                       const bitset_tri_t* b)
+{
+    assert (dest->n == a->n && a->n == b->n);
+    size_t i = 0;
+#ifdef BITSET_TRI_X86
+    if (bitset_tri_has_avx2) {
+        i = bitset_tri_and_avx2(dest->atoms, a->atoms, b->atoms, a->natoms);
+    }
+#endif
+    for (; i < a->natoms; i++) {
+        dest->atoms[i] = bitset_tri_and_atom(a->atoms[i], b->atoms[i]);
+    }
+}
+
+void bitset_tri_or_to(bitset_tri_t* dest, const bitset_tri_t* a,
+                      const bitset_tri_t* b)
+{
+    assert (dest->n == a->n && a->n == b->n);
+    size_t i = 0;
+#ifdef BITSET_TRI_X86
+    if (bitset_tri_has_avx2) {
+        i = bitset_tri_or_avx2(dest->atoms, a->atoms, b->atoms, a->natoms);
+    }
+#endif
+    for (; i < a->natoms; i++) {
+        dest->atoms[i] = bitset_tri_or_atom(a->atoms[i], b->atoms[i]);
+    }
+}
+
+void bitset_tri_not_to(bitset_tri_t* dest, const bitset_tri_t* a) {
+    assert (dest->n == a->n);
+    size_t i = 0;
+#ifdef BITSET_TRI_X86
+    if (bitset_tri_has_avx2) {
+        i = bitset_tri_not_avx2(dest->atoms, a->atoms, a->natoms);
+    }
+#endif
+    for (; i < a->natoms; i++) {
+        dest->atoms[i] = bitset_tri_not_atom(a->atoms[i]);
+    }
+}
+
+void bitset_tri_and(bitset_tri_t* a, const bitset_tri_t* b) {
+    bitset_tri_and_to(a, a, b);
+}
+
+void bitset_tri_or(bitset_tri_t* a, const bitset_tri_t* b) {
+    bitset_tri_or_to(a, a, b);
+}
+
+void bitset_tri_not(bitset_tri_t* a) {
+    bitset_tri_not_to(a, a);
+}
@@ -0,0 +1,355 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "bitset/voxels.h"
+
+#define bitset_atom_popcnt  __builtin_popcountl
+
+/* Bricks per block side */
+#define BITSET_VOXELS_BRICKS    (BITSET_VOXELS_BLOCK / BITSET_VOXELS_BRICK)
+
+int bitset_voxels_init(bitset_voxels_t* v, size_t nx, size_t ny, size_t nz) {
+    size_t n[3] = { nx, ny, nz };
+    unsigned nbits[3], maxbits = 0;
+    size_t ntable = 0, nblocks = 1;
+    for (int a = 0; a < 3; a++) {
+        v->n[a] = n[a];
+        v->nbricks[a] = (n[a] + BITSET_VOXELS_BRICK - 1) / BITSET_VOXELS_BRICK;
+        v->nblocks[a] = (n[a] + BITSET_VOXELS_BLOCK - 1) / BITSET_VOXELS_BLOCK;
+        nbits[a] = 0;
+        while (((size_t)1 << nbits[a]) < v->nbricks[a]) {
+            nbits[a]++;
+        }
+        maxbits = nbits[a] > maxbits ? nbits[a] : maxbits;
+        ntable += v->nbricks[a];
+        nblocks *= v->nblocks[a];
+    }
+
+    v->morton[0] = calloc(ntable ? ntable : 1, sizeof(size_t));
+    if (!v->morton[0]) {
+        return -1;
+    }
+    v->morton[1] = v->morton[0] + v->nbricks[0];
+    v->morton[2] = v->morton[1] + v->nbricks[1];
+
+    // Bit b of axis a goes to the next free position, axes taking turns
+    // while they have bits left.
+    unsigned pos = 0;
+    for (unsigned b = 0; b < maxbits; b++) {
+        for (int a = 0; a < 3; a++) {
+            if (b >= nbits[a]) {
+                continue;
+            }
+            for (size_t c = 0; c < v->nbricks[a]; c++) {
+                v->morton[a][c] |= ((c >> b) & (size_t)1) << pos;
+            }
+            pos++;
+        }
+    }
+
+    if (bitset_init(&v->bricks, ((size_t)1 << pos) * BITS_PER_ATOM) < 0) {
+        free(v->morton[0]);
+        return -1;
+    }
+    if (bitset_init(&v->summary, nblocks) < 0) {
+        bitset_wipe(&v->bricks);
+        free(v->morton[0]);
+        return -1;
+    }
+    return 0;
+}
+
+void bitset_voxels_wipe(bitset_voxels_t* v) {
+    bitset_wipe(&v->bricks);
+    bitset_wipe(&v->summary);
+    free(v->morton[0]);
+}
+
+extern bitset_atom_t* bitset_voxels_brick(const bitset_voxels_t* v,
+                                          size_t x, size_t y, size_t z);
+
+extern unsigned bitset_voxels_bit(size_t x, size_t y, size_t z);
+
+extern bit_t bitset_voxels_get(const bitset_voxels_t* v,
+                               size_t x, size_t y, size_t z);
+
+/* Return the summary bit of the block of voxel (x, y, z). */
+static size_t bitset_voxels_block(const bitset_voxels_t* v,
+                                  size_t x, size_t y, size_t z)
+{
+    return x / BITSET_VOXELS_BLOCK
+         + v->nblocks[0] * (y / BITSET_VOXELS_BLOCK
+                            + v->nblocks[1] * (z / BITSET_VOXELS_BLOCK));
+}
+
+void bitset_voxels_set(bitset_voxels_t* v, size_t x, size_t y, size_t z) {
+    *bitset_voxels_brick(v, x, y, z) |=
+        (bitset_atom_t)1 << bitset_voxels_bit(x, y, z);
+    bitset_set(&v->summary, bitset_voxels_block(v, x, y, z));
+}
+
+void bitset_voxels_unset(bitset_voxels_t* v, size_t x, size_t y, size_t z) {
+    bitset_atom_t* brick = bitset_voxels_brick(v, x, y, z);
+    *brick &= ~((bitset_atom_t)1 << bitset_voxels_bit(x, y, z));
+    if (*brick != 0) {
+        return;
+    }
+    // The brick became empty: so may have its block.
+    size_t lo[3] = { x, y, z }, hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] -= lo[a] % BITSET_VOXELS_BLOCK;
+        hi[a] = lo[a] + BITSET_VOXELS_BLOCK;
+    }
+    if (!bitset_voxels_any_box(v, lo, hi)) {
+        bitset_unset(&v->summary, bitset_voxels_block(v, x, y, z));
+    }
+}
+
+/* {{{ Boxes */
+
+/* Return the mask of the voxels of a brick within [lo, hi), coordinates
+ * being relative to the brick.
+ */
+static bitset_atom_t bitset_voxels_mask(const size_t lo[3],
+                                        const size_t hi[3])
+{
+    // Columns of a row, rows of a slice and slices of a brick multiply
+    // together without carries.
+    bitset_atom_t x = (((bitset_atom_t)1 << hi[0]) - 1)
+                    & ~(((bitset_atom_t)1 << lo[0]) - 1);
+    bitset_atom_t y = (((bitset_atom_t)1 << (4 * hi[1])) - 1)
+                    & ~(((bitset_atom_t)1 << (4 * lo[1])) - 1)
+                    & 0x1111;
+    bitset_atom_t z = (hi[2] == 4 ? BITSET_ATOM_MAX
+                                  : ((bitset_atom_t)1 << (16 * hi[2])) - 1)
+                    & ~(((bitset_atom_t)1 << (16 * lo[2])) - 1)
+                    & 0x0001000100010001ULL;
+    return x * y * z;
+}
+
+typedef enum bitset_voxels_op {
+    BITSET_VOXELS_FILL,
+    BITSET_VOXELS_COUNT,
+    BITSET_VOXELS_ANY,
+} bitset_voxels_op_t;
+
+/* Apply `op` to the box [lo, hi) clipped to the volume, block by block and
+ * brick by brick. Return the count of voxels set for BITSET_VOXELS_COUNT,
+ * and whether there is any for BITSET_VOXELS_ANY.
+ */
+static size_t bitset_voxels_box(bitset_voxels_t* v, const size_t lo[3],
+                                const size_t hi[3], bitset_voxels_op_t op)
+{
+    size_t l[3], h[3];
+    for (int a = 0; a < 3; a++) {
+        l[a] = lo[a] < v->n[a] ? lo[a] : v->n[a];
+        h[a] = hi[a] < v->n[a] ? hi[a] : v->n[a];
+        if (l[a] >= h[a]) {
+            return 0;
+        }
+    }
+
+    size_t count = 0;
+    size_t b0[3], b1[3];
+    for (int a = 0; a < 3; a++) {
+        b0[a] = l[a] / BITSET_VOXELS_BLOCK;
+        b1[a] = (h[a] - 1) / BITSET_VOXELS_BLOCK;
+    }
+    size_t k[3];    // Current block
+    for (k[2] = b0[2]; k[2] <= b1[2]; k[2]++)
+    for (k[1] = b0[1]; k[1] <= b1[1]; k[1]++)
+    for (k[0] = b0[0]; k[0] <= b1[0]; k[0]++) {
+        size_t block = k[0] + v->nblocks[0] * (k[1] + v->nblocks[1] * k[2]);
+        if (op == BITSET_VOXELS_FILL) {
+            bitset_set(&v->summary, block);
+        } else if (!bitset_get(&v->summary, block)) {
+            continue;
+        }
+
+        // Bricks of the block within the box
+        size_t r0[3], r1[3];
+        for (int a = 0; a < 3; a++) {
+            size_t first = k[a] * BITSET_VOXELS_BRICKS;
+            size_t last = first + BITSET_VOXELS_BRICKS - 1;
+            r0[a] = l[a] / BITSET_VOXELS_BRICK;
+            r1[a] = (h[a] - 1) / BITSET_VOXELS_BRICK;
+            r0[a] = r0[a] > first ? r0[a] : first;
+            r1[a] = r1[a] < last ? r1[a] : last;
+        }
+        size_t c[3];    // Current brick
+        for (c[2] = r0[2]; c[2] <= r1[2]; c[2]++)
+        for (c[1] = r0[1]; c[1] <= r1[1]; c[1]++)
+        for (c[0] = r0[0]; c[0] <= r1[0]; c[0]++) {
+            bitset_atom_t* brick = &v->bricks.bits[v->morton[0][c[0]]
+                                                   | v->morton[1][c[1]]
+                                                   | v->morton[2][c[2]]];
+            size_t ml[3], mh[3];
+            for (int a = 0; a < 3; a++) {
+                size_t origin = c[a] * BITSET_VOXELS_BRICK;
+                ml[a] = l[a] > origin ? l[a] - origin : 0;
+                mh[a] = h[a] - origin < BITSET_VOXELS_BRICK
+                      ? h[a] - origin : BITSET_VOXELS_BRICK;
+            }
+            bitset_atom_t mask = bitset_voxels_mask(ml, mh);
+            switch (op) {
+            case BITSET_VOXELS_FILL:
+                *brick |= mask;
+                break;
+            case BITSET_VOXELS_COUNT:
+                count += bitset_atom_popcnt(*brick & mask);
+                break;
+            case BITSET_VOXELS_ANY:
+                if ((*brick & mask) != 0) {
+                    return 1;
+                }
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/* }}} */
+
+void bitset_voxels_fill_box(bitset_voxels_t* v, const size_t lo[3],
+                            const size_t hi[3])
+{
+    bitset_voxels_box(v, lo, hi, BITSET_VOXELS_FILL);
+}
+
+size_t bitset_voxels_count_box(const bitset_voxels_t* v, const size_t lo[3],
+                               const size_t hi[3])
+{
+    return bitset_voxels_box((bitset_voxels_t*)v, lo, hi,
+                             BITSET_VOXELS_COUNT);
+}
+
+int bitset_voxels_any_box(const bitset_voxels_t* v, const size_t lo[3],
+                          const size_t hi[3])
+{
+    return bitset_voxels_box((bitset_voxels_t*)v, lo, hi,
+                             BITSET_VOXELS_ANY) != 0;
+}
+
+/* {{{ Rays */
+
+typedef struct bitset_voxels_dda {
+    size_t i[3];        /* Current voxel */
+    int    step[3];     /* Direction of the ray along each axis */
+    double next[3];     /* Value of t at the next voxel boundary per axis */
+    double delta[3];    /* Increment of t between voxel boundaries */
+} bitset_voxels_dda_t;
+
+/* Move to the first voxel after the aligned cube of side `s` holding the
+ * current one, and return the value of t where the ray enters it. With
+ * s = 1, this is one step of the DDA.
+ */
+static double bitset_voxels_jump(bitset_voxels_dda_t* dda, size_t s) {
+    size_t left[3];     // Boundaries left before leaving the cube
+    double exit = INFINITY;
+    int out = -1;
+    for (int a = 0; a < 3; a++) {
+        if (dda->step[a] == 0) {
+            continue;
+        }
+        left[a] = dda->step[a] > 0 ? s - 1 - dda->i[a] % s : dda->i[a] % s;
+        double t = dda->next[a] + left[a] * dda->delta[a];
+        if (t < exit) {
+            exit = t;
+            out = a;
+        }
+    }
+    if (out < 0) {
+        return INFINITY;
+    }
+    // The ray leaves the cube along `out`, and crosses along other axes the
+    // boundaries it meets before.
+    for (int a = 0; a < 3; a++) {
+        if (dda->step[a] == 0) {
+            continue;
+        }
+        size_t c;
+        if (a == out) {
+            c = left[a] + 1;
+        } else if (exit > dda->next[a]) {
+            c = ceil((exit - dda->next[a]) / dda->delta[a]);
+            c = c < left[a] ? c : left[a];
+        } else {
+            c = 0;
+        }
+        // Leaving the volume downward wraps around, out of it too.
+        dda->i[a] += dda->step[a] > 0 ? c : -c;
+        dda->next[a] += c * dda->delta[a];
+    }
+    return exit;
+}
+
+/* }}} */
+
+int bitset_voxels_raycast(const bitset_voxels_t* v, const double origin[3],
+                          const double dir[3], double tmax, size_t hit[3],
+                          double* t)
+{
+    // Clip the ray to the volume.
+    double enter = 0, leave = tmax;
+    for (int a = 0; a < 3; a++) {
+        if (dir[a] == 0) {
+            if (origin[a] < 0 || origin[a] >= v->n[a]) {
+                return 0;
+            }
+            continue;
+        }
+        double t0 = -origin[a] / dir[a];
+        double t1 = (v->n[a] - origin[a]) / dir[a];
+        enter = fmax(enter, fmin(t0, t1));
+        leave = fmin(leave, fmax(t0, t1));
+    }
+    if (enter > leave) {
+        return 0;
+    }
+
+    bitset_voxels_dda_t dda;
+    for (int a = 0; a < 3; a++) {
+        double p = origin[a] + enter * dir[a];
+        double cell = floor(p);
+        cell = cell < 0 ? 0 : cell;
+        dda.i[a] = cell < v->n[a] ? (size_t)cell : v->n[a] - 1;
+        dda.step[a] = dir[a] > 0 ? 1 : dir[a] < 0 ? -1 : 0;
+        if (dda.step[a] == 0) {
+            dda.next[a] = INFINITY;
+            dda.delta[a] = INFINITY;
+            continue;
+        }
+        double boundary = dda.i[a] + (dda.step[a] > 0);
+        dda.next[a] = (boundary - origin[a]) / dir[a];
+        dda.delta[a] = fabs(1 / dir[a]);
+    }
+
+    double at = enter;
+    while (at <= leave) {
+        size_t x = dda.i[0], y = dda.i[1], z = dda.i[2];
+        if (x >= v->n[0] || y >= v->n[1] || z >= v->n[2]) {
+            break;
+        }
+        if (!bitset_get(&v->summary, bitset_voxels_block(v, x, y, z))) {
+            at = bitset_voxels_jump(&dda, BITSET_VOXELS_BLOCK);
+            continue;
+        }
+        bitset_atom_t brick = *bitset_voxels_brick(v, x, y, z);
+        if (brick == 0) {
+            at = bitset_voxels_jump(&dda, BITSET_VOXELS_BRICK);
+            continue;
+        }
+        if ((brick >> bitset_voxels_bit(x, y, z)) & 1) {
+            hit[0] = x;
+            hit[1] = y;
+            hit[2] = z;
+            *t = at;
+            return 1;
+        }
+        at = bitset_voxels_jump(&dda, 1);
+    }
+    return 0;
+}
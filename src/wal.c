@@ -0,0 +1,346 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bitset/crc32c.h"
+#include "bitset/image.h"
+#include "bitset/wal.h"
+#include "io.h"
+
+/* Log records operations */
+enum {
+    BITSET_WAL_SET = 1,
+    BITSET_WAL_UNSET,
+    BITSET_WAL_AND,
+    BITSET_WAL_OR,
+};
+
+/* Header of a log record, followed by `len` bytes of payload: the bit index
+ * for single bit operations, the atoms of the operand for set operations.
+ */
+typedef struct bitset_wal_record {
+    uint32_t sum;       /* Checksum of the rest of the record */
+    uint32_t op;
+    uint64_t len;
+} bitset_wal_record_t;
+
+/* {{{ Helpers */
+
+/* CRC32C of a record, enough to detect a torn record at the end of the log.
+ */
+static uint32_t bitset_wal_sum(uint32_t op, uint64_t len, const void* payload)
+{
+    uint32_t crc = bitset_crc32c(0, &op, sizeof(op));
+    crc = bitset_crc32c(crc, &len, sizeof(len));
+    return bitset_crc32c(crc, payload, len);
+}
+
+static int bitset_wal_write_all(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Read exactly `len` bytes. Return 1 on a short read (end of log). */
+static int bitset_wal_read_all(int fd, void* buf, size_t len) {
+    char* p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return 1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void bitset_wal_apply(bitset_t* bs, uint32_t op, const void* payload) {
+    uint64_t bit;
+    const bitset_atom_t* atoms = payload;
+
+    switch (op) {
+      case BITSET_WAL_SET:
+        memcpy(&bit, payload, sizeof(bit));
+        bitset_set(bs, bit);
+        break;
+      case BITSET_WAL_UNSET:
+        memcpy(&bit, payload, sizeof(bit));
+        bitset_unset(bs, bit);
+        break;
+      case BITSET_WAL_AND:
+        for (size_t i = 0; i < bs->natoms; i++) {
+            bs->bits[i] &= atoms[i];
+        }
+        break;
+      case BITSET_WAL_OR:
+        for (size_t i = 0; i < bs->natoms; i++) {
+            bs->bits[i] |= atoms[i];
+        }
+        break;
+    }
+}
+
+/* Check that a record read from the log is consistent with `bs`. */
+static int bitset_wal_record_valid(const bitset_t* bs,
+                                   const bitset_wal_record_t* rec)
+{
+    switch (rec->op) {
+      case BITSET_WAL_SET:
+      case BITSET_WAL_UNSET:
+        return rec->len == sizeof(uint64_t);
+      case BITSET_WAL_AND:
+      case BITSET_WAL_OR:
+        return rec->len == bs->natoms * sizeof(bitset_atom_t);
+    }
+    return 0;
+}
+
+/* Replay the log over `d->bs`, and cut it after the last valid record. */
+static int bitset_wal_replay(bitset_durable_t* d) {
+    size_t cap = d->bs.natoms * sizeof(bitset_atom_t);
+    if (cap < sizeof(uint64_t)) {
+        cap = sizeof(uint64_t);
+    }
+    uint64_t* payload = malloc(cap);
+    if (!payload) {
+        return -1;
+    }
+
+    uint64_t offset = 0;
+    for (;;) {
+        bitset_wal_record_t rec;
+        int res = bitset_wal_read_all(d->wal_fd, &rec, sizeof(rec));
+        if (res < 0) {
+            free(payload);
+            return -1;
+        }
+        if (res > 0 || !bitset_wal_record_valid(&d->bs, &rec)) {
+            break;
+        }
+        res = bitset_wal_read_all(d->wal_fd, payload, rec.len);
+        if (res < 0) {
+            free(payload);
+            return -1;
+        }
+        if (res > 0 || bitset_wal_sum(rec.op, rec.len, payload) != rec.sum) {
+            break;
+        }
+        bitset_wal_apply(&d->bs, rec.op, payload);
+        offset += sizeof(rec) + rec.len;
+    }
+    free(payload);
+
+    // Drop the torn tail, so new records are appended right after the last
+    // valid one.
+    if (ftruncate(d->wal_fd, offset) < 0
+    ||  lseek(d->wal_fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    d->wal_size = offset;
+    return 0;
+}
+
+/* Append a record to the pending batch, committing it if it's full. */
+static int bitset_wal_log(bitset_durable_t* d, uint32_t op,
+                          const void* payload, size_t len)
+{
+    size_t needed = d->batch_len + sizeof(bitset_wal_record_t) + len;
+    if (needed > d->batch_cap) {
+        size_t cap = d->batch_cap ? d->batch_cap : 4096;
+        while (cap < needed) {
+            cap *= 2;
+        }
+        unsigned char* batch = realloc(d->batch, cap);
+        if (!batch) {
+            return -1;
+        }
+        d->batch = batch;
+        d->batch_cap = cap;
+    }
+
+    bitset_wal_record_t rec = {
+        .sum = bitset_wal_sum(op, len, payload),
+        .op  = op,
+        .len = len,
+    };
+    memcpy(d->batch + d->batch_len, &rec, sizeof(rec));
+    memcpy(d->batch + d->batch_len + sizeof(rec), payload, len);
+    d->batch_len = needed;
+
+    if (d->batch_len >= d->batch_max) {
+        return bitset_durable_commit(d);
+    }
+    return 0;
+}
+
+/* Write pending updates to the log and sync it, without checkpointing. */
+static int bitset_wal_commit(bitset_durable_t* d) {
+    if (d->batch_len == 0) {
+        return 0;
+    }
+    if (bitset_wal_write_all(d->wal_fd, d->batch, d->batch_len) < 0
+    ||  fdatasync(d->wal_fd) < 0) {
+        // Forget about a partially written batch, so that later commits
+        // aren't appended after a torn record. The batch is kept pending.
+        if (ftruncate(d->wal_fd, d->wal_size) == 0) {
+            lseek(d->wal_fd, d->wal_size, SEEK_SET);
+        }
+        return -1;
+    }
+    d->wal_size += d->batch_len;
+    d->batch_len = 0;
+    return 0;
+}
+
+/* }}} */
+
+int bitset_durable_open(bitset_durable_t* d, const char* path, size_t nbits) {
+    memset(d, 0, sizeof(*d));
+    d->batch_max = BITSET_WAL_BATCH_MAX;
+    d->wal_max = BITSET_WAL_CHECKPOINT_MAX;
+    d->wal_fd = -1;
+
+    // Images are created whole by bitset_save, so a file too short to have
+    // a header is the leftover of a creation interrupted by older versions.
+    struct stat st;
+    d->image_fd = open(path, O_RDWR);
+    if (d->image_fd < 0 && errno != ENOENT) {
+        return -1;
+    }
+    if (d->image_fd >= 0 && fstat(d->image_fd, &st) < 0) {
+        close(d->image_fd);
+        return -1;
+    }
+    if (d->image_fd < 0 || st.st_size < BITSET_IMAGE_HEADER_SIZE) {
+        if (d->image_fd >= 0) {
+            close(d->image_fd);
+        }
+        if (bitset_init(&d->bs, nbits) < 0) {
+            return -1;
+        }
+        d->image_fd = bitset_save(&d->bs, path) == 0
+                    ? open(path, O_RDWR) : -1;
+        if (d->image_fd < 0) {
+            bitset_wipe(&d->bs);
+            return -1;
+        }
+    } else {
+        // A checkpoint interrupted by a crash leaves an image that doesn't
+        // match its CRCs, but replaying the log fixes it (see header).
+        if (bitset_image_read(d->image_fd, &d->bs,
+                              BITSET_IMAGE_NO_VERIFY) < 0) {
+            goto error;
+        }
+        if (d->bs.nbits != nbits) {
+            bitset_wipe(&d->bs);
+            goto error;
+        }
+    }
+
+    size_t len = strlen(path);
+    char* wal_path = malloc(len + sizeof(".wal"));
+    if (!wal_path) {
+        bitset_wipe(&d->bs);
+        goto error;
+    }
+    memcpy(wal_path, path, len);
+    memcpy(wal_path + len, ".wal", sizeof(".wal"));
+    d->wal_fd = open(wal_path, O_RDWR | O_CREAT, 0644);
+    free(wal_path);
+    // The entry of a log just created must be durable too.
+    if (d->wal_fd < 0 || bitset_wal_replay(d) < 0
+    ||  bitset_fsync_dir(path) < 0) {
+        bitset_wipe(&d->bs);
+        goto error;
+    }
+    return 0;
+
+  error:
+    if (d->wal_fd >= 0) {
+        close(d->wal_fd);
+    }
+    close(d->image_fd);
+    return -1;
+}
+
+int bitset_durable_close(bitset_durable_t* d) {
+    int res = bitset_durable_commit(d);
+    close(d->wal_fd);
+    close(d->image_fd);
+    bitset_wipe(&d->bs);
+    free(d->batch);
+    return res;
+}
+
+int bitset_durable_set(bitset_durable_t* d, size_t bit) {
+    uint64_t payload = bit;
+    bitset_set(&d->bs, bit);
+    return bitset_wal_log(d, BITSET_WAL_SET, &payload, sizeof(payload));
+}
+
+int bitset_durable_unset(bitset_durable_t* d, size_t bit) {
+    uint64_t payload = bit;
+    bitset_unset(&d->bs, bit);
+    return bitset_wal_log(d, BITSET_WAL_UNSET, &payload, sizeof(payload));
+}
+
+int bitset_durable_and(bitset_durable_t* d, const bitset_t* b) {
+    bitset_and(&d->bs, b);
+    return bitset_wal_log(d, BITSET_WAL_AND, b->bits,
+                          b->natoms * sizeof(bitset_atom_t));
+}
+
+int bitset_durable_or(bitset_durable_t* d, const bitset_t* b) {
+    bitset_or(&d->bs, b);
+    return bitset_wal_log(d, BITSET_WAL_OR, b->bits,
+                          b->natoms * sizeof(bitset_atom_t));
+}
+
+int bitset_durable_commit(bitset_durable_t* d) {
+    if (bitset_wal_commit(d) < 0) {
+        return -1;
+    }
+    if (d->wal_max && d->wal_size >= d->wal_max) {
+        return bitset_durable_checkpoint(d);
+    }
+    return 0;
+}
+
+int bitset_durable_checkpoint(bitset_durable_t* d) {
+    if (bitset_wal_commit(d) < 0) {
+        return -1;
+    }
+    if (bitset_image_write(d->image_fd, &d->bs) < 0
+    ||  fdatasync(d->image_fd) < 0) {
+        return -1;
+    }
+    if (ftruncate(d->wal_fd, 0) < 0
+    ||  lseek(d->wal_fd, 0, SEEK_SET) < 0
+    ||  fdatasync(d->wal_fd) < 0) {
+        return -1;
+    }
+    d->wal_size = 0;
+    return 0;
+}